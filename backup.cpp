@@ -1,12 +1,38 @@
 // Copyright 2025 Alex Batista Resende
 #include "backup.hpp"  // NOLINT
+#include "caminho.hpp"  // NOLINT
+#include "copia.hpp"  // NOLINT
+#include "copia_uring.hpp"  // NOLINT
+#include "delta.hpp"  // NOLINT
+#include "digests.hpp"  // NOLINT
+#include "durabilidade.hpp"  // NOLINT
+#include "fila.hpp"  // NOLINT
+#include "fragmentos.hpp"  // NOLINT
+#include "log_assincrono.hpp"  // NOLINT
+#include "manifesto.hpp"  // NOLINT
+#include "metadados.hpp"  // NOLINT
+#include "pacotes.hpp"  // NOLINT
+#include "pool.hpp"  // NOLINT
+#include "snapshots.hpp"  // NOLINT
+#include "varredura.hpp"  // NOLINT
 
+#include <algorithm>
+#include <condition_variable>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 #include <fstream>
 #include <cassert>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <ctime>
 #include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 
@@ -15,110 +41,1148 @@
  ***************************************************************************/
 time_t getFileModTime(const std::string& path) {
   assert(!path.empty());
-  struct stat result;
-  if (stat(path.c_str(), &result) == 0) return result.st_mtime;
-  return 0;
+  MetadadosArquivo meta = obterMetadados(path, CAMPO_MTIME);
+  return meta.existe() ? static_cast<time_t>(meta.mtime_seg) : 0;
 }
 
 /***************************************************************************
  * Função auxiliar: Verifica se há permissão de escrita em um diretório
  ***************************************************************************/
 bool temPermissaoEscrita(const std::string& dir_path) {
-  struct stat st;
-  return (stat(dir_path.c_str(), &st) == 0) && (st.st_mode & S_IWUSR);
+  MetadadosArquivo meta = obterMetadados(dir_path, CAMPO_MODO);
+  return meta.existe() && (meta.modo & S_IWUSR);
 }
 
 /***************************************************************************
- * Função auxiliar: Copia o conteúdo de um arquivo de origem para destino
+ * Funções auxiliares para log
+ ***************************************************************************/
+namespace {
+
+// A linha é montada num texto da thread, reaproveitado de uma linha para
+// a outra: as entradas do laço chegam ao log sem alocar. Dentro de
+// realizaBackup/realizaRestauracao a linha vai para o log assíncrono;
+// fora de uma sessão, o arquivo é aberto a cada linha.
+void registrarLogPartes(std::initializer_list<VisaoTexto> partes) {
+  static thread_local std::string linha;
+  linha.clear();
+  std::initializer_list<VisaoTexto>::const_iterator it;
+  for (it = partes.begin(); it != partes.end(); ++it) {
+    linha.append(it->data(), it->size());
+  }
+  linha += '\n';
+  if (enviarLog(linha)) return;
+  std::ofstream log("Backup.log", std::ios::app);
+  if (log.is_open()) log << linha << std::flush;
+}
+
+}  // namespace
+
+void registrarLog(const std::string& mensagem) {
+  registrarLogPartes({ mensagem });
+}
+
+void registrarResumo(int copiados, int ignorados, int erros,
+                     const std::string& complemento = "") {
+  registrarLog("[RESUMO] Copiados: " + std::to_string(copiados) +
+               " | Ignorados: " + std::to_string(ignorados) +
+               " | Erros: " + std::to_string(erros) + complemento);
+}
+
+namespace {
+
+// Decisão tomada para uma entrada do Backup.parm
+enum Decisao {
+  DECISAO_COPIAR,
+  DECISAO_IGNORAR,
+  DECISAO_ORIGEM_INEXISTENTE,
+  DECISAO_ERRO_METADADOS,
+  DECISAO_DIRETORIO_ILEGIVEL,  // a varredura não abriu o diretório
+  DECISAO_NOME_TEMPORARIO,     // colidiria com o temporário de outra cópia
+  DECISAO_SEM_PERMISSAO,
+  DECISAO_DESTINO_MAIS_NOVO,
+  DECISAO_ORIGEM_MAIS_ANTIGA,
+  DECISAO_IDENTICO  // tomada na cópia: conteúdo igual, só os tempos mudam
+};
+
+// Uma entrada do Backup.parm e o que foi feito com ela
+struct ItemBackup {
+  std::string nome;
+  std::string origem;
+  std::string destino;
+  MetadadosArquivo meta_origem;
+  MetadadosArquivo meta_destino;
+  MetadadosArquivo meta_falha;  // consulta que levou a DECISAO_ERRO_METADADOS
+  int erro_diretorio = 0;  // errno do diretório que a varredura não abriu
+  bool destino_do_manifesto = false;  // meta_destino veio do manifesto
+  Decisao decisao = DECISAO_IGNORAR;
+  MetodoCopia metodo = COPIA_FALHOU;
+  uint32_t crc = 0;  // CRC32C calculado na cópia (com tabela de digests)
+  ResultadoDelta delta;  // bytes da cópia delta (COPIA_DELTA)
+};
+
+// Contagens do [RESUMO]
+struct ResumoBackup {
+  int copiados = 0;
+  int ignorados = 0;
+  int erros = 0;
+  uint64_t delta_reaproveitados = 0;  // bytes que o destino já tinha
+  uint64_t delta_escritos = 0;
+};
+
+// Backup ou restauração; 'base' é o diretório do pendrive. 'manifesto'
+// só existe no backup com OpcoesBackup::usar_manifesto; 'pool' recebe os
+// blocos de arquivos grandes (OpcoesCopia::limite_paralelo); 'lote' adia
+// os renames das cópias até o próximo syncfs (DURABILIDADE_LOTE);
+// 'digests' recebe o CRC32C de cada cópia (OpcoesBackup::calcular_digests);
+// 'comparar_conteudo' liga OpcoesBackup::pular_identicos; 'fragmentos'
+// só existe com DESTINO_FRAGMENTOS, e então o destino (ou, na
+// restauração, a origem) de cada entrada é uma receita; 'pacotes' só
+// existe com DESTINO_PACOTES, e então o índice dos pacotes faz as vezes
+// dos metadados do pendrive; 'compressao' só existe com um codec em
+// OpcoesBackup::compressao e acumula as estatísticas de cada codec;
+// 'snapshots' só existe com DESTINO_SNAPSHOTS (junto de 'fragmentos', que
+// guarda os objetos) e faz as vezes dos metadados do pendrive.
+// 'granularidade_mtime' é a do pendrive, a que vale na comparação dos
+// mtimes nos dois sentidos (1 ns com pacotes e snapshots, cujos índices
+// guardam o mtime exato).
+struct Operacao {
+  const std::string& base;
+  bool restauracao;
+  Manifesto* manifesto;
+  PoolThreads* pool;
+  LoteDurabilidade* lote;
+  TabelaDigests* digests;
+  bool comparar_conteudo;
+  RepositorioFragmentos* fragmentos;
+  Pacotes* pacotes;
+  EstatisticasCompressao* compressao;
+  Snapshots* snapshots;
+  int64_t granularidade_mtime;
+};
+
+/***************************************************************************
+ * Classe: LeitorEntradas
+ * Entrega os nomes do Backup.parm. Um nome que é diretório (no HD, para o
+ * backup; no pendrive, para a restauração) é expandido recursivamente por
+ * uma VarreduraParalela, e os arquivos chegam ao laço à medida que são
+ * encontrados. Na restauração de pacotes ou de um snapshot, o diretório
+ * é expandido pelo índice. Um subdiretório que a varredura não abriu é
+ * entregue como entrada, com o errno em 'erro_diretorio' (0 nas demais).
+ * Na restauração, temporários de cópias interrompidas achados no pendrive
+ * são removidos; no backup, um arquivo com esse nome é entregue e recusado
+ * na decisão.
+ ***************************************************************************/
+class LeitorEntradas {
+ public:
+  LeitorEntradas(std::istream& param, const Operacao& op,
+                 const OpcoesBackup& opcoes)
+      : param_(param), op_(op), opcoes_(opcoes) {}
+
+  bool proxima(std::string* nome, int* erro_diretorio) {
+    *erro_diretorio = 0;
+    for (;;) {
+      if (indice_lista_ < lista_.size()) {
+        *nome = lista_[indice_lista_++];
+        return true;
+      }
+      if (varredura_) {
+        if (varredura_->proximo(nome, erro_diretorio)) {
+          if (op_.restauracao && *erro_diretorio == 0 &&
+              ehCaminhoTemporario(*nome)) {
+            descartarTemporario(*nome);  // cópia interrompida
+            continue;
+          }
+          return true;
+        }
+        varredura_.reset();
+      }
+      if (!(param_ >> *nome)) return false;
+
+      if (op_.restauracao && (op_.pacotes || op_.snapshots)) {
+        if (op_.pacotes ? !op_.pacotes->listar(*nome, &lista_)
+                        : !op_.snapshots->listar(*nome, &lista_)) {
+          return true;
+        }
+        indice_lista_ = 0;
+        continue;
+      }
+      // raiz_ reaproveita a capacidade: um nome comum não aloca
+      raiz_.assign(op_.restauracao ? op_.base : *nome);
+      if (op_.restauracao) raiz_.append(1, '/').append(*nome);
+      MetadadosArquivo meta = obterMetadados(raiz_, CAMPO_MODO);
+      if (!meta.existe() || !S_ISDIR(meta.modo)) return true;
+
+      std::string prefixo = *nome;
+      while (prefixo.size() > 1 && prefixo[prefixo.size() - 1] == '/') {
+        prefixo.erase(prefixo.size() - 1);
+      }
+      varredura_.reset(new VarreduraParalela(raiz_, prefixo,
+                                             opcoes_.threads_varredura,
+                                             opcoes_.capacidade_pipeline));
+    }
+  }
+
+ private:
+  std::istream& param_;
+  const Operacao& op_;
+  const OpcoesBackup& opcoes_;
+  std::unique_ptr<VarreduraParalela> varredura_;
+  std::vector<std::string> lista_;  // diretório expandido pelo índice
+  size_t indice_lista_ = 0;
+  std::string raiz_;  // nome lido, no HD ou no pendrive
+
+  // Sobra de uma execução interrompida, achada na varredura do pendrive
+  void descartarTemporario(const std::string& nome) {
+    raiz_.assign(op_.base).append(1, '/').append(nome);
+    unlink(raiz_.c_str());
+  }
+};
+
+/***************************************************************************
+ * Funções auxiliares: montagem, decisão e registro de cada entrada
  ***************************************************************************/
-void copiarArquivo(const std::string& origem, const std::string& destino) {
-  assert(!origem.empty());
-  assert(!destino.empty());
+void montarItem(const std::string& nome, int erro_diretorio,
+                const Operacao& op, ItemBackup* item) {
+  // assign/append reaproveitam a capacidade das strings do item: no laço
+  // serial, a mesma entrada não aloca de novo depois das primeiras
+  item->nome.assign(nome);
+  std::string* no_pendrive = op.restauracao ? &item->origem : &item->destino;
+  std::string* no_hd = op.restauracao ? &item->destino : &item->origem;
+  no_pendrive->assign(op.base).append(1, '/').append(nome);
+  no_hd->assign(nome);
+  item->metodo = COPIA_FALHOU;
+  item->destino_do_manifesto = false;
+  item->erro_diretorio = erro_diretorio;
+  item->delta = ResultadoDelta();
+}
+
+// Origem mais nova com o mesmo tamanho: se o conteúdo for igual ao do
+// destino, só o mtime do destino é atualizado e nada é reescrito. Os dois
+// arquivos são comparados byte a byte; se a linha da tabela de digests
+// ainda corresponde ao destino (tamanho e mtime), um CRC32C diferente do
+// da origem já decide a cópia sem ler o destino. CRCs iguais não bastam:
+// numa colisão, o arquivo alterado nunca mais seria copiado. Retorna true
+// se a entrada terminou.
+// Com fragmentos o destino é uma receita: a origem é fragmentada de novo,
+// e os fragmentos que não mudaram já não são gravados.
+bool aproveitarIdentico(ItemBackup* item, const Operacao& op) {
+  const MetadadosArquivo& origem = item->meta_origem;
+  const MetadadosArquivo& destino = item->meta_destino;
+  if (!op.comparar_conteudo || op.fragmentos || op.pacotes ||
+      op.compressao || op.snapshots || !destino.existe() ||
+      destino.tamanho != origem.tamanho) {
+    return false;
+  }
+
+  DigestArquivo digest;
+  bool igual;
+  if (op.digests && op.digests->buscar(item->nome, &digest) &&
+      digest.tamanho == destino.tamanho &&
+      digest.mtime_seg == destino.mtime_seg &&
+      digest.mtime_nseg == destino.mtime_nseg) {
+    igual = calcularCrcArquivo(item->origem, &item->crc) &&
+            item->crc == digest.crc32c &&
+            conteudoIgual(item->origem, item->destino, &item->crc);
+  } else {
+    igual = conteudoIgual(item->origem, item->destino, &item->crc);
+  }
+  if (!igual) return false;
+
+  struct timespec tempos[2];
+  tempos[0].tv_sec = 0;
+  tempos[0].tv_nsec = UTIME_OMIT;
+  tempos[1].tv_sec = static_cast<time_t>(origem.mtime_seg);
+  tempos[1].tv_nsec = static_cast<long>(origem.mtime_nseg);  // NOLINT
+  if (utimensat(AT_FDCWD, item->destino.c_str(), tempos, 0) != 0) {
+    return false;  // segue para a cópia
+  }
+  item->decisao = DECISAO_IDENTICO;
+  return true;
+}
+
+// Arquivo grande com destino já existente: só os blocos que mudaram. O
+// destino comprimido não tem os blocos da origem para comparar.
+bool usarDelta(const ItemBackup& item, const OpcoesBackup& opcoes) {
+  return opcoes.copia.limite_delta > 0 &&
+         opcoes.compressao.codec == CODEC_NENHUM &&
+         item.meta_destino.existe() &&
+         item.meta_origem.tamanho >= opcoes.copia.limite_delta;
+}
+
+// Pool que divide os blocos de um arquivo grande comprimido (ou, na
+// restauração, a descomprimir)
+PoolThreads* poolCompressao(const ItemBackup& item, const Operacao& op,
+                            const OpcoesBackup& opcoes) {
+  const uint64_t limite = opcoes.compressao.limite_paralelo;
+  return limite > 0 && item.meta_origem.tamanho >= limite ? op.pool : NULL;
+}
+
+// Compressão da entrada pela amostragem: o que não comprime bem é copiado
+// como está, mas um arquivo que já começa com o cabeçalho de compressão
+// vai enquadrado (sem comprimir) para não ser confundido na restauração
+MetodoCopia comprimirItem(ItemBackup* item, const Operacao& op,
+                          const OpcoesBackup& opcoes,
+                          const OpcoesCopia& copia, uint32_t* crc) {
+  const OpcoesCompressao& compressao = opcoes.compressao;
+  AmostraCompressao amostra = amostrarCompressao(item->origem, compressao);
+  if (!amostra.comprimir) op.compressao->registrarPulado();
+  if (!amostra.comprimir && !amostra.cabecalho) {
+    return copiarArquivo(item->origem, item->destino, copia, op.pool, crc);
+  }
+  return copiarComprimindo(item->origem, item->destino,
+                           amostra.comprimir ? compressao.codec
+                                             : CODEC_NENHUM,
+                           compressao.bloco, copia.renomear, crc,
+                           op.compressao, poolCompressao(*item, op, opcoes));
+}
+
+// Copia uma entrada; arquivos grandes dividem o pool da operação ou, com
+// destino existente, vão por delta; com fragmentos, a entrada vira (ou
+// vem de) uma receita; num snapshot, a receita vira um objeto e a
+// entrada, uma folha do próximo snapshot; com compressão, a entrada é
+// amostrada e comprimida (ou descomprimida, se tiver o cabeçalho); com
+// lote de durabilidade o rename fica para a conclusão do lote e, com
+// tabela de digests, o CRC é calculado durante a cópia
+void copiarItem(ItemBackup* item, const Operacao& op,
+                const OpcoesBackup& opcoes) {
+  if (aproveitarIdentico(item, op)) return;
+  OpcoesCopia copia = opcoes.copia;
+  copia.renomear = op.lote == NULL;
+  uint32_t* crc = op.digests ? &item->crc : NULL;
+  LocalPacote local;
+  ArquivoSnapshot arquivo;
+  if (op.snapshots && op.restauracao) {
+    item->metodo = op.snapshots->buscar(item->nome, &arquivo)
+        ? op.fragmentos->restaurarObjeto(arquivo.receita, arquivo.mtime_seg,
+                                         arquivo.mtime_nseg, item->destino,
+                                         copia.renomear)
+        : COPIA_FALHOU;
+  } else if (op.snapshots) {
+    item->metodo = op.fragmentos->guardarObjeto(item->origem,
+                                                &arquivo.receita, crc);
+    if (item->metodo == COPIA_FALHOU) return;
+    arquivo.tamanho = item->meta_origem.tamanho;
+    arquivo.mtime_seg = item->meta_origem.mtime_seg;
+    arquivo.mtime_nseg = item->meta_origem.mtime_nseg;
+    op.snapshots->registrar(item->nome, arquivo);
+    return;  // só objetos, sem temporário para o lote
+  } else if (op.pacotes && op.restauracao &&
+      op.pacotes->buscar(item->nome, &local) && local.pacote != 0) {
+    item->metodo = op.pacotes->extrair(item->nome, item->destino,
+                                       copia.renomear);
+  } else if (op.pacotes && !op.restauracao &&
+             item->meta_origem.tamanho < op.pacotes->opcoes().limite_arquivo) {
+    item->metodo = op.pacotes->adicionar(item->origem, item->nome, crc);
+    return;  // sem temporário para o lote
+  } else if (op.fragmentos && op.restauracao) {
+    item->metodo = op.fragmentos->restaurar(item->origem, item->destino,
+                                            copia.renomear);
+  } else if (op.fragmentos) {
+    item->metodo = op.fragmentos->guardar(item->origem, item->destino,
+                                          copia.renomear, crc);
+  } else if (op.compressao && !op.restauracao) {
+    item->metodo = comprimirItem(item, op, opcoes, copia, crc);
+  } else if (op.restauracao && ehArquivoComprimido(item->origem)) {
+    // O cabeçalho basta: a restauração não depende do codec pedido
+    item->metodo = copiarDescomprimindo(item->origem, item->destino,
+                                        copia.renomear,
+                                        poolCompressao(*item, op, opcoes));
+  } else if (usarDelta(*item, opcoes)) {
+    item->metodo = copiarDelta(item->origem, item->destino, copia,
+                               &item->delta, crc);
+  } else {
+    item->metodo = copiarArquivo(item->origem, item->destino, copia,
+                                 op.pool, crc);
+  }
+  if (op.lote && item->metodo != COPIA_FALHOU && !item->delta.no_lugar) {
+    BufferCaminho temporario;
+    caminhoTemporario(item->destino, &temporario);
+    op.lote->adicionar(temporario.visao(), item->destino);
+  }
+  if (op.pacotes && !op.restauracao && item->metodo != COPIA_FALHOU) {
+    // Arquivo grande, copiado no caminho espelhado: o índice aponta para ele
+    op.pacotes->registrarEspelho(item->nome, item->meta_origem.tamanho,
+                                 item->meta_origem.mtime_seg,
+                                 item->meta_origem.mtime_nseg);
+  }
+}
+
+// Mesmo destino de uma cópia de io_uring (escrita no nome temporário)
+void concluirCopiaUring(ItemBackup* item, const Operacao& op) {
+  BufferCaminho temporario;
+  caminhoTemporario(item->destino, &temporario);
+  if (item->metodo == COPIA_FALHOU) {
+    unlink(temporario.c_str());
+  } else if (op.lote) {
+    op.lote->adicionar(temporario.visao(), item->destino);
+  } else if (rename(temporario.c_str(), item->destino.c_str()) != 0) {
+    unlink(temporario.c_str());
+    item->metodo = COPIA_FALHOU;
+  }
+}
+
+// Metadados de um arquivo do pendrive segundo o índice dos pacotes
+MetadadosArquivo metadadosDoIndice(const std::string& nome,
+                                   const Pacotes& pacotes) {
+  MetadadosArquivo meta;
+  LocalPacote local;
+  if (!pacotes.buscar(nome, &local)) return meta;  // METADADOS_INEXISTENTE
+  meta.erro = METADADOS_OK;
+  meta.mtime_seg = local.mtime_seg;
+  meta.mtime_nseg = local.mtime_nseg;
+  meta.tamanho = local.tamanho;
+  meta.blocos = (local.tamanho + 511) / 512;
+  return meta;
+}
+
+// Metadados de um arquivo do pendrive segundo o snapshot aberto
+MetadadosArquivo metadadosDoSnapshot(const std::string& nome,
+                                     const Snapshots& snapshots) {
+  MetadadosArquivo meta;
+  ArquivoSnapshot arquivo;
+  if (!snapshots.buscar(nome, &arquivo)) return meta;  // INEXISTENTE
+  meta.erro = METADADOS_OK;
+  meta.mtime_seg = arquivo.mtime_seg;
+  meta.mtime_nseg = arquivo.mtime_nseg;
+  meta.tamanho = arquivo.tamanho;
+  meta.blocos = (arquivo.tamanho + 511) / 512;
+  return meta;
+}
+
+// Primeira metade da decisão: só olha a origem
+void consultarOrigem(ItemBackup* item, const Operacao& op) {
+  if (op.pacotes && op.restauracao) {
+    item->meta_origem = metadadosDoIndice(item->nome, *op.pacotes);
+    return;
+  }
+  if (op.snapshots && op.restauracao) {
+    item->meta_origem = metadadosDoSnapshot(item->nome, *op.snapshots);
+    return;
+  }
+  item->meta_origem = obterMetadados(item->origem,
+                                     CAMPO_MTIME | CAMPO_TAMANHO |
+                                     CAMPO_BLOCOS);
+}
+
+// Destino segundo o manifesto da execução anterior, sem tocar no destino
+bool consultarManifesto(ItemBackup* item, const Operacao& op) {
+  RegistroManifesto registro;
+  if (op.manifesto == NULL || !op.manifesto->buscar(item->nome, &registro)) {
+    return false;
+  }
+  MetadadosArquivo& meta = item->meta_destino;
+  meta.erro = METADADOS_OK;
+  meta.codigo_errno = 0;
+  meta.mtime_seg = registro.mtime_seg;
+  meta.mtime_nseg = registro.mtime_nseg;
+  meta.tamanho = registro.tamanho;
+  meta.inode = registro.inode;
+  item->destino_do_manifesto = true;
+  return true;
+}
+
+// Segunda metade: permissão e destino, com a origem já consultada.
+// A comparação usa o mtime com nanossegundos; só ENOENT conta como
+// arquivo inexistente, os demais erros de stat são reportados como tal.
+Decisao decidirComOrigem(ItemBackup* item, const Operacao& op) {
+  if (item->erro_diretorio != 0) return DECISAO_DIRETORIO_ILEGIVEL;
+  // No pendrive, o nome é o de uma cópia em andamento: não há como guardar
+  if (!op.restauracao && ehCaminhoTemporario(item->nome)) {
+    return DECISAO_NOME_TEMPORARIO;
+  }
+  const MetadadosArquivo& origem = item->meta_origem;
+  if (origem.erro == METADADOS_INEXISTENTE) return DECISAO_ORIGEM_INEXISTENTE;
+  if (!origem.existe()) {
+    item->meta_falha = origem;
+    return DECISAO_ERRO_METADADOS;
+  }
+
+  if (!op.restauracao && !temPermissaoEscrita(op.base)) {
+    return DECISAO_SEM_PERMISSAO;
+  }
+
+  if (op.pacotes && !op.restauracao) {
+    item->meta_destino = metadadosDoIndice(item->nome, *op.pacotes);
+  } else if (op.snapshots && !op.restauracao) {
+    item->meta_destino = metadadosDoSnapshot(item->nome, *op.snapshots);
+  } else if (!consultarManifesto(item, op)) {
+    // Uma cópia do mesmo destino ainda no lote precisa valer antes do stat
+    if (op.lote) op.lote->concluirSePendente(item->destino);
+    // Com manifesto, tamanho e inode também são guardados para a próxima
+    unsigned campos = CAMPO_MTIME;
+    if (op.manifesto) campos |= CAMPO_TAMANHO | CAMPO_INODE;
+    if (op.comparar_conteudo) campos |= CAMPO_TAMANHO;
+    item->meta_destino = obterMetadados(item->destino, campos);
+  }
+  const MetadadosArquivo& destino = item->meta_destino;
+  if (!destino.existe()) {
+    if (destino.erro == METADADOS_INEXISTENTE) return DECISAO_COPIAR;
+    item->meta_falha = destino;
+    return DECISAO_ERRO_METADADOS;
+  }
+
+  int comparacao = compararMtime(origem, destino, op.granularidade_mtime);
+  // Um snapshot pedido pelo número volta mesmo sobre arquivos mais novos
+  if (comparacao < 0 && op.snapshots && op.restauracao &&
+      op.snapshots->fixo()) {
+    return DECISAO_COPIAR;
+  }
+  if (comparacao < 0 && !op.restauracao &&
+      access(caminhoTemporario(item->destino).c_str(), F_OK) == 0) {
+    return DECISAO_COPIAR;  // delta no lugar interrompido (delta.hpp)
+  }
+  if (comparacao < 0) {
+    return op.restauracao ? DECISAO_ORIGEM_MAIS_ANTIGA
+                          : DECISAO_DESTINO_MAIS_NOVO;
+  }
+  return comparacao > 0 ? DECISAO_COPIAR : DECISAO_IGNORAR;
+}
+
+Decisao decidir(ItemBackup* item, const Operacao& op) {
+  consultarOrigem(item, op);
+  return decidirComOrigem(item, op);
+}
+
+// Granularidade dos mtimes do pendrive; os índices de pacotes e snapshots
+// guardam o mtime exato da origem
+int64_t granularidadePendrive(const std::string& pendrive,
+                             const OpcoesBackup& opcoes) {
+  if (opcoes.formato == DESTINO_PACOTES ||
+      opcoes.formato == DESTINO_SNAPSHOTS) {
+    return 1;
+  }
+  return granularidadeMtime(pendrive);
+}
+
+// Decisões que encerram a operação (as entradas seguintes não são vistas)
+bool decisaoFatal(Decisao decisao, const Operacao& op) {
+  switch (decisao) {
+    case DECISAO_SEM_PERMISSAO:
+    case DECISAO_DESTINO_MAIS_NOVO:
+    case DECISAO_ORIGEM_MAIS_ANTIGA:
+      return true;
+    case DECISAO_ORIGEM_INEXISTENTE:
+    case DECISAO_ERRO_METADADOS:
+    case DECISAO_DIRETORIO_ILEGIVEL:
+      return op.restauracao;
+    default:
+      return false;
+  }
+}
+
+// Leva ao manifesto o estado em que a entrada deixou o destino
+void atualizarManifesto(const ItemBackup& item, const Operacao& op) {
+  if (op.manifesto == NULL) return;
+  MetadadosArquivo destino = item.meta_destino;
+  if (item.decisao == DECISAO_IDENTICO) {
+    destino = obterMetadados(item.destino, CAMPO_MTIME | CAMPO_TAMANHO |
+                                           CAMPO_INODE);
+  } else if (item.decisao == DECISAO_COPIAR) {
+    if (item.metodo != COPIA_FALHOU) {
+      // Com lote, a cópia pode estar no temporário; o rename mantém o inode
+      const unsigned campos = CAMPO_MTIME | CAMPO_TAMANHO | CAMPO_INODE;
+      if (op.lote) {
+        destino = obterMetadados(caminhoTemporario(item.destino), campos);
+      }
+      if (!destino.existe()) destino = obterMetadados(item.destino, campos);
+    } else {
+      destino.erro = METADADOS_ERRO;  // conteúdo do destino é incerto
+    }
+  } else if (item.decisao != DECISAO_IGNORAR || item.destino_do_manifesto) {
+    return;  // destino intocado e o manifesto já está certo
+  }
 
-  size_t pos = destino.find_last_of('/');
-  if (pos != std::string::npos) {
-    std::string dir = destino.substr(0, pos);
-    mkdir(dir.c_str(), 0777);
+  if (!destino.existe()) {
+    op.manifesto->descartar(item.nome);
+    return;
   }
+  RegistroManifesto registro;
+  registro.tamanho = destino.tamanho;
+  registro.mtime_seg = destino.mtime_seg;
+  registro.mtime_nseg = destino.mtime_nseg;
+  registro.inode = destino.inode;
+  op.manifesto->atualizar(item.nome, registro);
+}
 
-  std::ifstream src(origem, std::ios::binary);
-  if (!src.is_open()) {
-    std::cerr << "[ERRO] Não foi possível abrir origem: "
-              << origem << " (errno=" << errno << ")\n";
+// Leva à tabela de digests o CRC calculado na cópia
+void atualizarDigest(const ItemBackup& item, const Operacao& op) {
+  if (op.digests == NULL) return;
+  if (item.decisao != DECISAO_COPIAR && item.decisao != DECISAO_IDENTICO) {
+    return;
+  }
+  if (item.decisao == DECISAO_COPIAR && item.metodo == COPIA_FALHOU) {
+    op.digests->descartar(item.nome);  // conteúdo do destino é incerto
     return;
   }
+  DigestArquivo digest;
+  digest.crc32c = item.crc;
+  digest.tamanho = item.meta_origem.tamanho;
+  digest.mtime_seg = item.meta_origem.mtime_seg;  // o destino fica com ele
+  digest.mtime_nseg = item.meta_origem.mtime_nseg;
+  op.digests->atualizar(item.nome, digest);
+}
 
-  std::ofstream dst(destino, std::ios::binary);
-  if (!dst.is_open()) {
-    std::cerr << "[ERRO] Não foi possível criar destino: "
-              << destino << " (errno=" << errno << ")\n";
+// Leva ao próximo snapshot, como estava, a entrada que não foi copiada
+// agora (ignorada ou com falha); só a origem que sumiu sai do snapshot,
+// e um diretório que não abriu não é entrada dele
+void atualizarSnapshot(const ItemBackup& item, const Operacao& op) {
+  if (op.snapshots == NULL || op.restauracao) return;
+  if (item.decisao == DECISAO_ORIGEM_INEXISTENTE ||
+      item.decisao == DECISAO_DIRETORIO_ILEGIVEL ||
+      item.decisao == DECISAO_NOME_TEMPORARIO) {
     return;
   }
+  if (item.decisao == DECISAO_COPIAR && item.metodo != COPIA_FALHOU) return;
+  op.snapshots->manter(item.nome);
+}
 
-  dst << src.rdbuf();
+// Registra o resultado no log e nas contagens; retorna o status da operação
+int registrarItem(const ItemBackup& item, const Operacao& op,
+                  ResumoBackup* resumo) {
+  atualizarManifesto(item, op);
+  atualizarDigest(item, op);
+  atualizarSnapshot(item, op);
+  switch (item.decisao) {
+    case DECISAO_ORIGEM_INEXISTENTE:
+      if (op.restauracao) return ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
+      // Sem origem, nenhuma cópia vai reaproveitar o temporário de uma
+      // execução interrompida
+      unlink(caminhoTemporario(item.destino).c_str());
+      registrarLogPartes({ "[ERRO] Arquivo inexistente: ", item.origem });
+      resumo->erros++;
+      return OPERACAO_SUCESSO;
+    case DECISAO_ERRO_METADADOS:
+      if (op.restauracao) {
+        return item.meta_falha.erro == METADADOS_SEM_PERMISSAO
+                   ? ERRO_SEM_PERMISSAO : ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
+      }
+      registrarLogPartes({ "[ERRO] Falha ao consultar metadados: ",
+                           item.origem, " (errno=",
+                           std::to_string(item.meta_falha.codigo_errno),
+                           ")" });
+      resumo->erros++;
+      return OPERACAO_SUCESSO;
+    case DECISAO_DIRETORIO_ILEGIVEL:
+      registrarLogPartes({ "[ERRO] Não foi possível abrir diretório: ",
+                           item.origem, " (errno=",
+                           std::to_string(item.erro_diretorio), ")" });
+      if (op.restauracao) {
+        return item.erro_diretorio == EACCES || item.erro_diretorio == EPERM
+                   ? ERRO_SEM_PERMISSAO : ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
+      }
+      resumo->erros++;
+      return OPERACAO_SUCESSO;
+    case DECISAO_NOME_TEMPORARIO:
+      registrarLogPartes({ "[ERRO] Nome reservado às cópias temporárias: ",
+                           item.origem });
+      resumo->erros++;
+      return OPERACAO_SUCESSO;
+    case DECISAO_SEM_PERMISSAO:
+      registrarLogPartes({ "[ERRO] Sem permissão para escrever em: ",
+                           op.base });
+      return ERRO_SEM_PERMISSAO;
+    case DECISAO_DESTINO_MAIS_NOVO:
+      registrarLogPartes({ "[ERRO] Destino mais novo: ", item.destino });
+      return ERRO_DESTINO_MAIS_NOVO;
+    case DECISAO_ORIGEM_MAIS_ANTIGA:
+      return ERRO_ORIGEM_MAIS_ANTIGA;
+    case DECISAO_COPIAR:
+      if (item.metodo == COPIA_FALHOU) {
+        registrarLogPartes({ "[ERRO] Falha ao copiar: ", item.origem });
+        resumo->erros++;
+      } else {
+        registrarLogPartes({ op.restauracao ? "[OK] RESTAURADO: "
+                                            : "[OK] COPIADO: ",
+                             item.nome, " (", nomeMetodoCopia(item.metodo),
+                             ")" });
+        resumo->copiados++;
+        resumo->delta_reaproveitados += item.delta.reaproveitados;
+        resumo->delta_escritos += item.delta.escritos;
+      }
+      return OPERACAO_SUCESSO;
+    case DECISAO_IDENTICO:
+      registrarLogPartes({ "[IDENTICO] ", item.nome,
+                           " (só o mtime atualizado)" });
+      resumo->ignorados++;
+      return OPERACAO_SUCESSO;
+    default:
+      if (!op.restauracao) registrarLogPartes({ "[IGNORADO] ", item.nome });
+      resumo->ignorados++;
+      return OPERACAO_SUCESSO;
+  }
 }
 
 /***************************************************************************
- * Funções auxiliares para log
+ * Laço serial: decide, copia e registra uma entrada por vez
  ***************************************************************************/
-void registrarLog(const std::string& mensagem) {
-  std::ofstream log("Backup.log", std::ios::app);
-  if (log.is_open()) log << mensagem << std::endl;
+int processarSerial(std::istream& param, const Operacao& op,
+                    const OpcoesBackup& opcoes, ResumoBackup* resumo) {
+  LeitorEntradas leitor(param, op, opcoes);
+  ItemBackup item;
+  std::string nome_arquivo;
+  int erro_diretorio;
+  while (leitor.proxima(&nome_arquivo, &erro_diretorio)) {
+    montarItem(nome_arquivo, erro_diretorio, op, &item);
+    item.decisao = decidir(&item, op);
+    if (item.decisao == DECISAO_COPIAR) {
+      copiarItem(&item, op, opcoes);
+    }
+    int status = registrarItem(item, op, resumo);
+    if (status != OPERACAO_SUCESSO) return status;
+  }
+  return OPERACAO_SUCESSO;
 }
 
-void registrarResumo(int copiados, int ignorados, int erros) {
-  std::ofstream log("Backup.log", std::ios::app);
-  if (log.is_open()) {
-    log << "[RESUMO] Copiados: " << copiados
-        << " | Ignorados: " << ignorados
-        << " | Erros: " << erros << std::endl;
+/***************************************************************************
+ * Laço io_uring: as decisões continuam em ordem, mas as cópias de um lote
+ * de entradas seguem juntas para o anel; o log é emitido na ordem do
+ * Backup.parm depois que o lote termina.
+ ***************************************************************************/
+int copiarLoteERegistrar(std::vector<ItemBackup>* lote, const Operacao& op,
+                         const OpcoesBackup& opcoes, ResumoBackup* resumo) {
+  std::vector<TarefaCopia> tarefas;
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < lote->size(); i++) {
+    ItemBackup& item = (*lote)[i];
+    if (item.decisao != DECISAO_COPIAR) continue;
+    if (aproveitarIdentico(&item, op)) continue;
+    const MetadadosArquivo& meta = item.meta_origem;
+    if (pareceEsparso(meta.tamanho, meta.blocos) ||
+        (opcoes.copia.limite_direto > 0 &&
+         meta.tamanho >= opcoes.copia.limite_direto) ||
+        (op.pool && opcoes.copia.limite_paralelo > 0 &&
+         meta.tamanho >= opcoes.copia.limite_paralelo) ||
+        usarDelta(item, opcoes) || op.fragmentos || op.pacotes ||
+        op.compressao ||
+        (op.restauracao && ehArquivoComprimido(item.origem))) {
+      // O anel leria os buracos como zeros e passaria pelo cache; as
+      // cópias esparsa, direta, em blocos, delta, por fragmentos, em
+      // pacotes e comprimidas ficam com o motor síncrono
+      copiarItem(&item, op, opcoes);
+      continue;
+    }
+    TarefaCopia tarefa;
+    tarefa.origem = item.origem;
+    tarefa.destino = caminhoTemporario(item.destino);
+    tarefa.calcular_crc = op.digests != NULL;
+    tarefas.push_back(tarefa);
+    indices.push_back(i);
+  }
+
+  if (copiarComIoUring(&tarefas, opcoes.profundidade_uring)) {
+    for (size_t t = 0; t < tarefas.size(); t++) {
+      (*lote)[indices[t]].metodo = tarefas[t].metodo;
+      (*lote)[indices[t]].crc = tarefas[t].crc;
+      concluirCopiaUring(&(*lote)[indices[t]], op);
+    }
+  } else {
+    // Kernel sem io_uring: mesmo lote pelo motor síncrono
+    for (size_t t = 0; t < tarefas.size(); t++) {
+      copiarItem(&(*lote)[indices[t]], op, opcoes);
+    }
+  }
+
+  for (size_t i = 0; i < lote->size(); i++) {
+    int status = registrarItem((*lote)[i], op, resumo);
+    if (status != OPERACAO_SUCESSO) return status;
+  }
+  lote->clear();
+  return OPERACAO_SUCESSO;
+}
+
+int processarComIoUring(std::istream& param, const Operacao& op,
+                        const OpcoesBackup& opcoes, ResumoBackup* resumo) {
+  const size_t limite_lote = 4 * (opcoes.profundidade_uring + 1);
+  LeitorEntradas leitor(param, op, opcoes);
+  std::vector<ItemBackup> lote;
+  std::set<std::string> destinos;
+  size_t copias = 0;
+  std::string nome_arquivo;
+  int erro_diretorio;
+
+  while (leitor.proxima(&nome_arquivo, &erro_diretorio)) {
+    ItemBackup item;
+    montarItem(nome_arquivo, erro_diretorio, op, &item);
+    // Um destino repetido fecha o lote antes de ser decidido: a repetição
+    // vê a primeira cópia, como no laço serial, e duas tarefas do anel
+    // nunca escrevem o mesmo temporário.
+    if (!destinos.insert(item.destino).second) {
+      int status = copiarLoteERegistrar(&lote, op, opcoes, resumo);
+      if (status != OPERACAO_SUCESSO) return status;
+      copias = 0;
+      destinos.clear();
+      destinos.insert(item.destino);
+    }
+    item.decisao = decidir(&item, op);
+    if (item.decisao == DECISAO_COPIAR) copias++;
+    const bool fatal = decisaoFatal(item.decisao, op);
+    lote.push_back(std::move(item));
+
+    // Uma decisão fatal fecha o lote: as cópias anteriores a ela ainda
+    // acontecem, como no laço serial, e nada depois dela é lido.
+    if (fatal || copias >= limite_lote) {
+      int status = copiarLoteERegistrar(&lote, op, opcoes, resumo);
+      if (status != OPERACAO_SUCESSO) return status;
+      copias = 0;
+      destinos.clear();
+    }
+  }
+  return copiarLoteERegistrar(&lote, op, opcoes, resumo);
+}
+
+/***************************************************************************
+ * Laço paralelo: cada janela do Backup.parm passa por três fases
+ *  1. decisões em paralelo (apenas stats);
+ *  2. cópias em paralelo das entradas anteriores à primeira decisão fatal;
+ *  3. registro no log, na ordem do Backup.parm ou na ordem de conclusão.
+ * Nada depois da primeira decisão fatal é copiado, então status, contagens
+ * e linhas do log são os mesmos do laço serial, com qualquer número de
+ * threads.
+ ***************************************************************************/
+int processarJanela(std::vector<ItemBackup>* janela, const Operacao& op,
+                    const OpcoesBackup& opcoes, PoolThreads* pool,
+                    ResumoBackup* resumo) {
+  const size_t n = janela->size();
+  const size_t passo = std::max<size_t>(1, n / (4 * pool->tamanho()));
+  {
+    GrupoTarefas grupo(pool);
+    for (size_t ini = 0; ini < n; ini += passo) {
+      size_t fim = std::min(n, ini + passo);
+      grupo.enviar([janela, &op, ini, fim] {
+        for (size_t i = ini; i < fim; i++) {
+          (*janela)[i].decisao = decidir(&(*janela)[i], op);
+        }
+      });
+    }
+    grupo.esperar();
+  }
+
+  size_t limite = n;
+  bool fatal = false;
+  for (size_t i = 0; i < n && !fatal; i++) {
+    fatal = decisaoFatal((*janela)[i].decisao, op);
+    if (fatal) limite = i;
+  }
+
+  std::mutex trava_log;
+  {
+    GrupoTarefas grupo(pool);
+    for (size_t i = 0; i < limite; i++) {
+      ItemBackup* item = &(*janela)[i];
+      if (item->decisao != DECISAO_COPIAR) {
+        if (!opcoes.log_em_ordem) {
+          std::lock_guard<std::mutex> trava(trava_log);
+          registrarItem(*item, op, resumo);
+        }
+        continue;
+      }
+      grupo.enviar([item, &op, &opcoes, &trava_log, resumo] {
+        copiarItem(item, op, opcoes);
+        if (!opcoes.log_em_ordem) {
+          std::lock_guard<std::mutex> trava(trava_log);
+          registrarItem(*item, op, resumo);
+        }
+      });
+    }
+    grupo.esperar();
+  }
+
+  if (opcoes.log_em_ordem) {
+    for (size_t i = 0; i < limite; i++) registrarItem((*janela)[i], op, resumo);
+  }
+  if (fatal) return registrarItem((*janela)[limite], op, resumo);
+  return OPERACAO_SUCESSO;
+}
+
+int processarEmParalelo(std::istream& param, const Operacao& op_original,
+                        const OpcoesBackup& opcoes, ResumoBackup* resumo) {
+  // Entradas e blocos de arquivos grandes dividem o mesmo pool
+  PoolThreads pool(opcoes.threads);
+  Operacao op = op_original;
+  op.pool = &pool;
+  LeitorEntradas leitor(param, op, opcoes);
+  const size_t limite_janela = 256 * pool.tamanho();
+  std::vector<ItemBackup> janela;
+  std::set<std::string> destinos;
+  std::string nome_arquivo;
+  int erro_diretorio;
+  bool adiado = false;
+
+  for (;;) {
+    janela.clear();
+    destinos.clear();
+    while (janela.size() < limite_janela) {
+      if (!adiado && !leitor.proxima(&nome_arquivo, &erro_diretorio)) break;
+      adiado = false;
+      ItemBackup item;
+      montarItem(nome_arquivo, erro_diretorio, op, &item);
+      // Um destino repetido fecha a janela: duas threads nunca escrevem o
+      // mesmo arquivo e a repetição é decidida depois da primeira cópia.
+      if (!destinos.insert(item.destino).second) {
+        adiado = true;
+        break;
+      }
+      janela.push_back(item);
+    }
+    if (janela.empty()) return OPERACAO_SUCESSO;
+
+    int status = processarJanela(&janela, op, opcoes, &pool, resumo);
+    if (status != OPERACAO_SUCESSO) return status;
+  }
+}
+
+/***************************************************************************
+ * Pipeline: leitura+stat da origem → permissão+stat do destino+decisão →
+ * cópia → log, cada estágio em sua thread, ligados por filas limitadas.
+ * Os metadados das próximas entradas são consultados enquanto a cópia da
+ * entrada atual está em andamento; a capacidade das filas limita quantas
+ * entradas ficam em memória. A ordem é preservada em todos os estágios, e
+ * o estágio de decisão para na primeira decisão fatal, como no laço serial.
+ * Um destino repetido só é decidido depois que a cópia anterior dele
+ * termina, então a repetição vê o destino já copiado.
+ ***************************************************************************/
+int processarEmPipeline(std::istream& param, const Operacao& op,
+                        const OpcoesBackup& opcoes, ResumoBackup* resumo) {
+  FilaLimitada<ItemBackup> consultados(opcoes.capacidade_pipeline);
+  FilaLimitada<ItemBackup> decididos(opcoes.capacidade_pipeline);
+  FilaLimitada<ItemBackup> copiados(opcoes.capacidade_pipeline);
+
+  // Destinos com cópia decidida e ainda não concluída
+  std::set<std::string> em_copia;
+  std::mutex trava_copias;
+  std::condition_variable copia_concluida;
+
+  std::thread leitura([&] {
+    LeitorEntradas leitor(param, op, opcoes);
+    std::string nome_arquivo;
+    int erro_diretorio;
+    while (leitor.proxima(&nome_arquivo, &erro_diretorio)) {
+      ItemBackup item;
+      montarItem(nome_arquivo, erro_diretorio, op, &item);
+      consultarOrigem(&item, op);
+      if (!consultados.inserir(std::move(item))) break;
+    }
+    consultados.fechar();
+  });
+
+  std::thread decisao([&] {
+    ItemBackup item;
+    while (consultados.retirar(&item)) {
+      {
+        // A cópia não depende deste estágio: a espera sempre termina
+        std::unique_lock<std::mutex> trava(trava_copias);
+        copia_concluida.wait(trava, [&] {
+          return em_copia.count(item.destino) == 0;
+        });
+      }
+      item.decisao = decidirComOrigem(&item, op);
+      if (item.decisao == DECISAO_COPIAR) {
+        std::lock_guard<std::mutex> trava(trava_copias);
+        em_copia.insert(item.destino);
+      }
+      bool fatal = decisaoFatal(item.decisao, op);
+      decididos.inserir(std::move(item));
+      if (fatal) break;
+    }
+    consultados.fechar();  // libera a leitura se ela estiver bloqueada
+    decididos.fechar();
+  });
+
+  std::thread copia([&] {
+    ItemBackup item;
+    while (decididos.retirar(&item)) {
+      if (item.decisao == DECISAO_COPIAR) {
+        copiarItem(&item, op, opcoes);
+        {
+          std::lock_guard<std::mutex> trava(trava_copias);
+          em_copia.erase(item.destino);
+        }
+        copia_concluida.notify_all();
+      }
+      copiados.inserir(std::move(item));
+    }
+    copiados.fechar();
+  });
+
+  // Estágio de log na thread chamadora
+  int status = OPERACAO_SUCESSO;
+  ItemBackup item;
+  while (copiados.retirar(&item)) {
+    if (status == OPERACAO_SUCESSO) status = registrarItem(item, op, resumo);
+  }
+
+  leitura.join();
+  decisao.join();
+  copia.join();
+  return status;
+}
+
+int processar(std::istream& param, const Operacao& op_original,
+              const OpcoesBackup& opcoes, ResumoBackup* resumo) {
+  if (opcoes.execucao == EXECUCAO_PARALELA) {
+    return processarEmParalelo(param, op_original, opcoes, resumo);
+  }
+
+  // Nos demais modos, um pool só para os blocos dos arquivos grandes
+  // (copiados ou comprimidos em paralelo)
+  std::unique_ptr<PoolThreads> pool;
+  Operacao op = op_original;
+  if (opcoes.copia.limite_paralelo > 0 ||
+      (op.compressao && opcoes.compressao.limite_paralelo > 0)) {
+    pool.reset(new PoolThreads(opcoes.threads));
+    op.pool = pool.get();
+  }
+  if (opcoes.execucao == EXECUCAO_PIPELINE) {
+    return processarEmPipeline(param, op, opcoes, resumo);
+  }
+  if (opcoes.execucao == EXECUCAO_IO_URING) {
+    return processarComIoUring(param, op, opcoes, resumo);
   }
+  return processarSerial(param, op, opcoes, resumo);
 }
 
+// Complemento do [RESUMO] com fragmentos: quantos eram novos, a taxa de
+// deduplicação (bytes lidos / bytes gravados) e a vazão da fragmentação
+std::string resumoFragmentos(const RepositorioFragmentos& repositorio) {
+  ResultadoFragmentos totais = repositorio.totais();
+  double segundos = repositorio.segundosFragmentacao();
+  char texto[192];
+  snprintf(texto, sizeof(texto),
+           " | Fragmentos: %llu novos de %llu | Dedup: %.2fx"
+           " | Fragmentação: %.1f MB/s",
+           static_cast<unsigned long long>(totais.fragmentos_novos),  // NOLINT
+           static_cast<unsigned long long>(totais.fragmentos),  // NOLINT
+           totais.bytes_novos ? static_cast<double>(totais.bytes) /
+                                    totais.bytes_novos
+                              : 0.0,
+           segundos > 0 ? totais.bytes / segundos / 1e6 : 0.0);
+  return texto;
+}
+
+}  // namespace
+
 /***************************************************************************
  * Função: realizaBackup
  ***************************************************************************/
 int realizaBackup(const std::string& destino_path) {
+  return realizaBackup(destino_path, OpcoesBackup());
+}
+
+int realizaBackup(const std::string& destino_path,
+                  const OpcoesBackup& opcoes) {
   assert(!destino_path.empty());
 
   std::ifstream param("Backup.parm");
   if (!param.is_open()) return ERRO_BACKUP_PARM_NAO_EXISTE;
 
-  int copiados = 0, ignorados = 0, erros = 0;
-  std::string nome_arquivo;
-
-  while (param >> nome_arquivo) {
-    const std::string origem = nome_arquivo;
-    const std::string destino = destino_path + "/" + nome_arquivo;
+  SessaoLog sessao_log(opcoes.log);
+  Manifesto manifesto;
+  TabelaDigests digests;
+  Operacao op = { destino_path, false, NULL, NULL, NULL, NULL,
+                  opcoes.pular_identicos, NULL, NULL, NULL, NULL,
+                  granularidadePendrive(destino_path, opcoes) };
+  std::unique_ptr<LoteDurabilidade> lote;
+  if (opcoes.durabilidade == DURABILIDADE_LOTE) {
+    lote.reset(new LoteDurabilidade(opcoes.arquivos_por_lote));
+    op.lote = lote.get();
+  }
 
-    time_t t_origem = getFileModTime(origem);
-    if (t_origem == 0) {
-      registrarLog("[ERRO] Arquivo inexistente: " + origem);
-      erros++;
-      continue;
+  std::unique_ptr<RepositorioFragmentos> fragmentos;
+  std::unique_ptr<Pacotes> pacotes;
+  std::unique_ptr<Snapshots> snapshots;
+  if (opcoes.formato == DESTINO_FRAGMENTOS ||
+      opcoes.formato == DESTINO_SNAPSHOTS) {
+    fragmentos.reset(new RepositorioFragmentos(
+        opcoes.fragmentos, opcoes.durabilidade == DURABILIDADE_LOTE));
+    if (!fragmentos->abrir(destino_path)) {
+      registrarLog("[ERRO] Sem permissão para escrever em: " + destino_path);
+      return ERRO_SEM_PERMISSAO;
     }
-
-    if (!temPermissaoEscrita(destino_path)) {
+    op.fragmentos = fragmentos.get();
+  }
+  if (opcoes.formato == DESTINO_SNAPSHOTS) {
+    // O snapshot novo entra no mesmo lote: só vale depois dos objetos
+    snapshots.reset(new Snapshots(fragmentos.get(), op.lote));
+    if (!snapshots->abrir(destino_path)) {
+      registrarLog("[AVISO] Último snapshot ilegível, recomeçado em: " +
+                   destino_path);
+    }
+    op.snapshots = snapshots.get();
+  } else if (opcoes.formato == DESTINO_PACOTES) {
+    // Os pacotes fechados entram no mesmo lote das cópias comuns
+    pacotes.reset(new Pacotes(opcoes.pacotes, op.lote));
+    if (!pacotes->abrir(destino_path)) {
       registrarLog("[ERRO] Sem permissão para escrever em: " + destino_path);
       return ERRO_SEM_PERMISSAO;
     }
+    op.pacotes = pacotes.get();
+  }
+  EstatisticasCompressao compressao;
+  if (opcoes.compressao.codec != CODEC_NENHUM &&
+      opcoes.formato == DESTINO_ESPELHO) {
+    op.compressao = &compressao;
+  }
+  // Com pacotes ou snapshots, o índice já dispensa as consultas ao destino
+  if (opcoes.usar_manifesto && !pacotes && !snapshots) {
+    if (!manifesto.carregar(destino_path, opcoes.amostras_manifesto)) {
+      registrarLog("[AVISO] Manifesto não usado: " + manifesto.motivo());
+    }
+    op.manifesto = &manifesto;
+  }
+  if (opcoes.calcular_digests) {
+    if (!digests.carregar(destino_path)) {
+      registrarLog("[AVISO] Tabela de digests ilegível, recomeçada em: " +
+                   destino_path);
+    }
+    op.digests = &digests;
+  }
 
-    time_t t_dest = getFileModTime(destino);
-    if (t_dest > t_origem) {
-      registrarLog("[ERRO] Destino mais novo: " + destino);
-      return ERRO_DESTINO_MAIS_NOVO;
-    } else if (t_origem > t_dest) {
-      copiarArquivo(origem, destino);
-      registrarLog("[OK] COPIADO: " + nome_arquivo);
-      copiados++;
-    } else {
-      registrarLog("[IGNORADO] " + nome_arquivo);
-      ignorados++;
+  ResumoBackup resumo;
+  int status = processar(param, op, opcoes, &resumo);
+  if (pacotes && !pacotes->fechar()) {
+    registrarLog("[ERRO] Falha ao gravar pacotes em: " + destino_path);
+    resumo.erros++;
+  }
+  uint32_t snapshot = 0;
+  if (snapshots && status == OPERACAO_SUCESSO) {
+    snapshot = snapshots->concluir();
+    if (snapshot == 0) {
+      registrarLog("[ERRO] Falha ao gravar snapshot em: " + destino_path);
+      resumo.erros++;
     }
   }
+  // Depois do snapshot, que também grava objetos
+  if (fragmentos && !fragmentos->concluir()) {
+    registrarLog("[AVISO] Falha ao gravar o índice de fragmentos em: " +
+                 destino_path);
+  }
+  if (lote && !lote->concluir()) {
+    registrarLog("[ERRO] Falha ao concluir o lote de cópias em: " +
+                 destino_path);
+    resumo.erros++;
+  }
+  if (op.manifesto && !manifesto.gravar() && status == OPERACAO_SUCESSO) {
+    registrarLog("[ERRO] Falha ao gravar manifesto em: " + destino_path);
+  }
+  if (op.digests && !digests.gravar() && status == OPERACAO_SUCESSO) {
+    registrarLog("[ERRO] Falha ao gravar digests em: " + destino_path);
+  }
+  if (status != OPERACAO_SUCESSO) return status;
 
-  registrarResumo(copiados, ignorados, erros);
-  if (erros > 0) return ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
+  std::string complemento;
+  if (fragmentos) {
+    complemento = resumoFragmentos(*fragmentos);
+  } else if (opcoes.copia.limite_delta > 0 && !op.compressao) {
+    complemento = " | Delta: " +
+                  std::to_string(resumo.delta_reaproveitados) +
+                  " bytes poupados, " +
+                  std::to_string(resumo.delta_escritos) + " escritos";
+  }
+  if (op.compressao) complemento += compressao.resumo();
+  if (snapshot != 0) complemento += " | Snapshot: " + std::to_string(snapshot);
+  registrarResumo(resumo.copiados, resumo.ignorados, resumo.erros,
+                  complemento);
+  if (resumo.erros > 0) return ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
   return OPERACAO_SUCESSO;
 }
 
@@ -126,23 +1190,61 @@ int realizaBackup(const std::string& destino_path) {
  * Função: realizaRestauracao
  ***************************************************************************/
 int realizaRestauracao(const std::string& origem_path) {
+  return realizaRestauracao(origem_path, OpcoesBackup());
+}
+
+int realizaRestauracao(const std::string& origem_path,
+                       const OpcoesBackup& opcoes) {
   assert(!origem_path.empty());
 
   std::ifstream param("Backup.parm");
   if (!param.is_open()) return ERRO_BACKUP_PARM_NAO_EXISTE;
 
-  std::string nome_arquivo;
-  while (param >> nome_arquivo) {
-    const std::string origem = origem_path + "/" + nome_arquivo;
-    const std::string destino = nome_arquivo;
-
-    time_t t_origem = getFileModTime(origem);
-    if (t_origem == 0) return ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
-
-    time_t t_dest = getFileModTime(destino);
-    if (t_origem < t_dest) return ERRO_ORIGEM_MAIS_ANTIGA;
-    else if (t_origem > t_dest) copiarArquivo(origem, destino);
+  SessaoLog sessao_log(opcoes.log);
+  Operacao op = { origem_path, true, NULL, NULL, NULL, NULL,
+                  opcoes.pular_identicos, NULL, NULL, NULL, NULL,
+                  granularidadePendrive(origem_path, opcoes) };
+  std::unique_ptr<RepositorioFragmentos> fragmentos;
+  std::unique_ptr<Pacotes> pacotes;
+  std::unique_ptr<Snapshots> snapshots;
+  if (opcoes.formato == DESTINO_FRAGMENTOS ||
+      opcoes.formato == DESTINO_SNAPSHOTS) {
+    fragmentos.reset(new RepositorioFragmentos(opcoes.fragmentos));
+    fragmentos->abrir(origem_path, true);
+    op.fragmentos = fragmentos.get();
+  }
+  if (opcoes.formato == DESTINO_SNAPSHOTS) {
+    snapshots.reset(new Snapshots(fragmentos.get()));
+    if (!snapshots->abrir(origem_path, opcoes.snapshot)) {
+      registrarLog("[ERRO] Snapshot inexistente ou ilegível: " +
+                   std::to_string(opcoes.snapshot));
+      return ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
+    }
+    op.snapshots = snapshots.get();
+  } else if (opcoes.formato == DESTINO_PACOTES) {
+    pacotes.reset(new Pacotes(opcoes.pacotes));
+    pacotes->abrir(origem_path, true);
+    op.pacotes = pacotes.get();
+  }
+  // Os arquivos comprimidos são reconhecidos pelo cabeçalho com qualquer
+  // codec; com um codec pedido, a restauração também usa o pool dele
+  EstatisticasCompressao compressao;
+  if (opcoes.compressao.codec != CODEC_NENHUM &&
+      opcoes.formato == DESTINO_ESPELHO) {
+    op.compressao = &compressao;
+  }
+  std::unique_ptr<LoteDurabilidade> lote;
+  if (opcoes.durabilidade == DURABILIDADE_LOTE) {
+    lote.reset(new LoteDurabilidade(opcoes.arquivos_por_lote));
+    op.lote = lote.get();
   }
 
-  return OPERACAO_SUCESSO;
+  ResumoBackup resumo;
+  int status = processar(param, op, opcoes, &resumo);
+  // Cópias que podem não ter chegado ao disco também falham a restauração
+  if (lote && !lote->concluir()) {
+    registrarLog("[ERRO] Falha ao concluir o lote de cópias restauradas");
+    if (status == OPERACAO_SUCESSO) status = ERRO_ARQUIVO_ORIGEM_NAO_EXISTE;
+  }
+  return status;
 }
@@ -5,6 +5,13 @@
 #include <string>
 #include <ctime>  // Adicionado para o tipo time_t
 
+#include "compressao.hpp"  // NOLINT
+#include "copia.hpp"  // NOLINT
+#include "durabilidade.hpp"  // NOLINT
+#include "fragmentos.hpp"  // NOLINT
+#include "pacotes.hpp"  // NOLINT
+#include "log_assincrono.hpp"  // NOLINT
+
 // Enum para os códigos de status da operação
 enum StatusOperacao {
   OPERACAO_SUCESSO,
@@ -15,9 +22,52 @@ enum StatusOperacao {
   ERRO_SEM_PERMISSAO
 };
 
+// Estratégia usada para percorrer as entradas do Backup.parm
+enum ModoExecucao {
+  EXECUCAO_SERIAL,    // uma entrada por vez, bloqueante
+  EXECUCAO_IO_URING,  // cópias de várias entradas em voo no io_uring
+  EXECUCAO_PARALELA,  // entradas distribuídas por um pool de threads
+  EXECUCAO_PIPELINE   // estágios stat → decisão → cópia → log sobrepostos
+};
+
+// Como os arquivos ficam no diretório de destino
+enum FormatoDestino {
+  DESTINO_ESPELHO,    // cópia de cada arquivo, com o mesmo caminho
+  DESTINO_FRAGMENTOS,  // receitas + fragmentos deduplicados (fragmentos.hpp)
+  DESTINO_PACOTES,     // arquivos pequenos em pacotes com índice (pacotes.hpp)
+  DESTINO_SNAPSHOTS    // uma versão por backup, com fragmentos (snapshots.hpp)
+};
+
+// Opções de execução do backup e da restauração
+struct OpcoesBackup {
+  OpcoesCopia copia;
+  OpcoesLog log;
+  ModoExecucao execucao = EXECUCAO_SERIAL;
+  unsigned profundidade_uring = 32;   // arquivos em voo no io_uring
+  unsigned threads = 0;               // 0 = um por núcleo
+  bool log_em_ordem = true;           // false: log na ordem de conclusão
+  unsigned capacidade_pipeline = 64;  // entradas por fila do pipeline
+  unsigned threads_varredura = 0;     // threads por diretório expandido
+  bool usar_manifesto = false;        // decide pelo manifesto do destino
+  unsigned amostras_manifesto = 16;   // stats reais que validam o manifesto
+  ModoDurabilidade durabilidade = DURABILIDADE_NENHUMA;
+  size_t arquivos_por_lote = 256;     // cópias por syncfs; 0 = só no fim
+  bool calcular_digests = false;      // CRC32C de cada cópia no destino
+  bool pular_identicos = false;       // mtime novo, conteúdo igual: utimensat
+  FormatoDestino formato = DESTINO_ESPELHO;
+  OpcoesFragmentos fragmentos;        // tamanhos do DESTINO_FRAGMENTOS
+  OpcoesPacotes pacotes;              // limites do DESTINO_PACOTES
+  OpcoesCompressao compressao;        // codec das cópias do DESTINO_ESPELHO
+  uint32_t snapshot = 0;              // a restaurar; 0 = o mais recente
+};
+
 // Declaração das funções
 int realizaBackup(const std::string& destino_path);
+int realizaBackup(const std::string& destino_path,
+                  const OpcoesBackup& opcoes);
 int realizaRestauracao(const std::string& origem_path);
+int realizaRestauracao(const std::string& origem_path,
+                       const OpcoesBackup& opcoes);
 void registrarLog(const std::string& contexto,
                   const std::string& arquivo,
                   const std::string& mensagem);
@@ -0,0 +1,492 @@
+// Copyright 2025 Alex Batista Resende
+// Benchmarks do sistema de backup: make bench [BENCH=nome]
+#include "backup.hpp"  // NOLINT
+#include "compressao.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+#include "digests.hpp"  // NOLINT
+#include "fragmentos.hpp"  // NOLINT
+#include "indice.hpp"  // NOLINT
+#include "manifesto.hpp"  // NOLINT
+#include "metadados.hpp"  // NOLINT
+#include "pool.hpp"  // NOLINT
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const DIRETORIO_BENCH = "bench_dados";
+
+/***************************************************************************
+ * Funções auxiliares do benchmark
+ ***************************************************************************/
+double agoraSegundos() {
+  using std::chrono::steady_clock;
+  return std::chrono::duration<double>(
+      steady_clock::now().time_since_epoch()).count();
+}
+
+size_t parametro(const char* nome, size_t padrao) {
+  const char* valor = getenv(nome);
+  return valor ? static_cast<size_t>(strtoull(valor, NULL, 10)) : padrao;
+}
+
+// Cria 'n' arquivos de 'tamanho' bytes e o Backup.parm que os lista
+std::vector<std::string> criarArquivos(const std::string& prefixo, size_t n,
+                                       size_t tamanho) {
+  std::vector<std::string> nomes;
+  std::string dados(tamanho, '\0');
+  for (size_t i = 0; i < tamanho; i++) {
+    dados[i] = static_cast<char>((i * 2654435761u) >> 13);
+  }
+  std::ofstream parm("Backup.parm");
+  for (size_t i = 0; i < n; i++) {
+    std::string nome = prefixo + std::to_string(i) + ".dat";
+    std::ofstream(nome, std::ios::binary) << dados;
+    parm << nome << "\n";
+    nomes.push_back(nome);
+  }
+  return nomes;
+}
+
+void removerArquivos(const std::vector<std::string>& nomes) {
+  for (size_t i = 0; i < nomes.size(); i++) {
+    remove(nomes[i].c_str());
+    remove(("pendrive/" + nomes[i]).c_str());
+  }
+}
+
+void limparDestino(const std::vector<std::string>& nomes) {
+  for (size_t i = 0; i < nomes.size(); i++) {
+    remove(("pendrive/" + nomes[i]).c_str());
+  }
+}
+
+// Tira dados e metadados do cache. Sem permissão para drop_caches, só os
+// dados dos arquivos podem ser descartados (POSIX_FADV_DONTNEED).
+bool esfriarCache(const std::vector<std::string>& nomes) {
+  sync();
+  std::ofstream drop("/proc/sys/vm/drop_caches");
+  if (drop.is_open() && (drop << "3" << std::flush)) return true;
+  for (size_t i = 0; i < nomes.size(); i++) {
+    int fd = open(nomes[i].c_str(), O_RDONLY);
+    if (fd < 0) continue;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+  return false;
+}
+
+double medirBackup(const OpcoesBackup& opcoes,
+                   const std::vector<std::string>& nomes, bool frio) {
+  limparDestino(nomes);
+  if (frio) esfriarCache(nomes);
+  remove("Backup.log");
+  double inicio = agoraSegundos();
+  realizaBackup("pendrive", opcoes);
+  return agoraSegundos() - inicio;
+}
+
+void imprimirLinha(const char* caso, double segundos, size_t arquivos,
+                   size_t bytes) {
+  printf("  %-28s %9.1f ms %10.0f arq/s %9.1f MB/s\n", caso,
+         segundos * 1e3, arquivos / segundos, bytes / segundos / 1e6);
+}
+
+/***************************************************************************
+ * Benchmark: execução serial x pipeline x paralela com cache frio
+ ***************************************************************************/
+void benchPipeline() {
+  const size_t n = parametro("BENCH_ARQUIVOS", 2000);
+  const size_t tamanho = parametro("BENCH_TAMANHO", 64 * 1024);
+  std::vector<std::string> nomes = criarArquivos("pipe_", n, tamanho);
+  bool frio = esfriarCache(nomes);
+
+  printf("[pipeline] %zu arquivos de %zu bytes, cache %s\n", n, tamanho,
+         frio ? "frio (drop_caches)" : "de dados frio (fadvise)");
+
+  OpcoesBackup serial;
+  OpcoesBackup pipeline;
+  pipeline.execucao = EXECUCAO_PIPELINE;
+  OpcoesBackup paralela;
+  paralela.execucao = EXECUCAO_PARALELA;
+
+  double t_serial = medirBackup(serial, nomes, true);
+  double t_pipeline = medirBackup(pipeline, nomes, true);
+  double t_paralela = medirBackup(paralela, nomes, true);
+  imprimirLinha("serial", t_serial, n, n * tamanho);
+  imprimirLinha("pipeline", t_pipeline, n, n * tamanho);
+  imprimirLinha("paralela", t_paralela, n, n * tamanho);
+  printf("  ganho do pipeline: %.2fx\n", t_serial / t_pipeline);
+
+  removerArquivos(nomes);
+}
+
+/***************************************************************************
+ * Benchmark: arquivo grande com cache x O_DIRECT (tempo e cache poluído)
+ ***************************************************************************/
+// Memória em cache de páginas (campo "Cached" de /proc/meminfo), em MB
+double cacheMB() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string campo;
+  double kb = 0;
+  while (meminfo >> campo >> kb) {
+    if (campo == "Cached:") return kb / 1024;
+    meminfo.ignore(64, '\n');
+  }
+  return 0;
+}
+
+void benchDireto() {
+  const size_t mb = parametro("BENCH_DIRETO_MB", 512);
+  std::vector<std::string> nomes = criarArquivos("direto_", 1, mb << 20);
+  esfriarCache(nomes);
+  printf("[odirect] 1 arquivo de %zu MB, cache frio\n", mb);
+
+  OpcoesBackup com_cache;
+  OpcoesBackup direto;
+  direto.copia.limite_direto = 1;
+
+  // O sync entra no tempo: com cache, os dados ainda estão sujos na memória
+  double antes = cacheMB();
+  double t_cache = medirBackup(com_cache, nomes, true);
+  double poluido_cache = cacheMB() - antes;
+  double inicio_sync = agoraSegundos();
+  sync();
+  t_cache += agoraSegundos() - inicio_sync;
+
+  esfriarCache(nomes);
+  antes = cacheMB();
+  double t_direto = medirBackup(direto, nomes, true);
+  double poluido_direto = cacheMB() - antes;
+  inicio_sync = agoraSegundos();
+  sync();
+  t_direto += agoraSegundos() - inicio_sync;
+
+  imprimirLinha("com cache", t_cache, 1, mb << 20);
+  printf("  %-28s %9.1f MB a mais no cache\n", "", poluido_cache);
+  imprimirLinha("O_DIRECT", t_direto, 1, mb << 20);
+  printf("  %-28s %9.1f MB a mais no cache\n", "", poluido_direto);
+
+  removerArquivos(nomes);
+}
+
+/***************************************************************************
+ * Benchmark: custo do CRC32C calculado junto com a cópia. Com cache
+ * quente o custo de CPU aparece inteiro; com cache frio, a leitura do
+ * disco esconde parte dele.
+ ***************************************************************************/
+void benchDigests() {
+  const size_t n = parametro("BENCH_ARQUIVOS", 64);
+  const size_t tamanho = parametro("BENCH_TAMANHO", 4 << 20);
+  std::vector<std::string> nomes = criarArquivos("digest_", n, tamanho);
+  printf("[digests] %zu arquivos de %zu bytes, CRC32C %s\n", n, tamanho,
+         implementacaoCrc32c());
+
+  OpcoesBackup sem_crc;
+  sem_crc.durabilidade = DURABILIDADE_NENHUMA;
+  OpcoesBackup com_crc = sem_crc;
+  com_crc.calcular_digests = true;
+
+  for (int frio = 0; frio < 2; frio++) {
+    // Melhor de três rodadas de cada, intercaladas
+    double t_sem = 1e9, t_com = 1e9;
+    for (int rodada = 0; rodada < 3; rodada++) {
+      t_sem = std::min(t_sem, medirBackup(sem_crc, nomes, frio));
+      t_com = std::min(t_com, medirBackup(com_crc, nomes, frio));
+    }
+    printf("  cache %s\n", frio ? "frio" : "quente");
+    imprimirLinha("sem CRC", t_sem, n, n * tamanho);
+    imprimirLinha("com CRC", t_com, n, n * tamanho);
+    printf("  custo do CRC: %+.1f%%\n", (t_com / t_sem - 1) * 100);
+  }
+
+  removerArquivos(nomes);
+  remove((std::string("pendrive/") + NOME_DIGESTS).c_str());
+}
+
+/***************************************************************************
+ * Benchmark: vazão da fragmentação por conteúdo (só CPU, dados em memória)
+ * e deduplicação de cópias quase iguais no formato de fragmentos
+ ***************************************************************************/
+void benchFragmentos() {
+  const size_t mb = parametro("BENCH_FRAGMENTOS_MB", 256);
+  std::string dados(mb << 20, '\0');
+  uint64_t x = 1;
+  for (size_t i = 0; i < dados.size(); i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    dados[i] = static_cast<char>(x >> 56);
+  }
+  printf("[fragmentos] %zu MB em memória\n", mb);
+
+  OpcoesFragmentos opcoes;
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(
+      dados.data());
+  size_t fragmentos = 0;
+  double inicio = agoraSegundos();
+  for (size_t pos = 0; pos < dados.size(); fragmentos++) {
+    pos += cortarFragmento(p + pos, dados.size() - pos, true, opcoes);
+  }
+  double t_corte = agoraSegundos() - inicio;
+  imprimirLinha("corte (gear hash)", t_corte, 1, dados.size());
+  printf("  %-28s %9.0f bytes por fragmento\n", "",
+         static_cast<double>(dados.size()) / fragmentos);
+
+  // Quatro versões do mesmo arquivo, cada uma com um byte alterado
+  const size_t n = 4;
+  std::vector<std::string> nomes = criarArquivos("frag_", n, 64 << 20);
+  for (size_t i = 0; i < n; i++) {
+    int fd = open(nomes[i].c_str(), O_WRONLY);
+    if (fd >= 0 && pwrite(fd, "x", 1, (i + 1) << 20) != 1) perror("pwrite");
+    if (fd >= 0) close(fd);
+  }
+  OpcoesBackup formato;
+  formato.formato = DESTINO_FRAGMENTOS;
+  formato.durabilidade = DURABILIDADE_NENHUMA;
+  double t_backup = medirBackup(formato, nomes, false);
+  imprimirLinha("backup em fragmentos", t_backup, n, n * (64 << 20));
+  std::ifstream log("Backup.log");
+  std::string linha;
+  while (std::getline(log, linha)) {
+    if (linha.find("[RESUMO]") == 0) printf("  %s\n", linha.c_str());
+  }
+
+  removerArquivos(nomes);
+  if (system("rm -rf pendrive/.backup_fragmentos") != 0) {
+    std::cerr << "[AVISO] Repositório de fragmentos não removido\n";
+  }
+}
+
+// Manifesto com BENCH_MANIFESTO_MIL mil arquivos em árvores de nomes
+// parecidos: gravação, carga (mmap), buscas e bytes por arquivo, contra o
+// formato anterior (40 bytes por registro mais o nome)
+void benchManifesto() {
+  const size_t n = parametro("BENCH_MANIFESTO_MIL", 1000) * 1000;
+  std::vector<std::string> nomes;
+  size_t bytes_nomes = 0;
+  char nome[96];
+  for (size_t i = 0; i < n; i++) {
+    snprintf(nome, sizeof(nome), "projeto%03zu/src/modulo%03zu/arquivo_%06zu.cpp",
+             i / 100000, (i / 1000) % 100, i);
+    nomes.push_back(nome);
+    bytes_nomes += nomes.back().size();
+  }
+  printf("[manifesto] %zu arquivos\n", n);
+
+  double inicio = agoraSegundos();
+  {
+    Manifesto manifesto;
+    manifesto.carregar("pendrive", 0);
+    RegistroManifesto r;
+    for (size_t i = 0; i < n; i++) {
+      r.tamanho = 4096 + i % 50000;
+      r.mtime_seg = 1700000000 + static_cast<int64_t>(i % 86400);
+      r.mtime_nseg = static_cast<uint32_t>(i * 7919 % 1000000000);
+      r.inode = 1000000 + i;
+      manifesto.atualizar(nomes[i], r);
+    }
+    manifesto.gravar();
+  }
+  printf("  %-28s %9.1f ms\n", "gravação", (agoraSegundos() - inicio) * 1e3);
+
+  Manifesto manifesto;
+  inicio = agoraSegundos();
+  bool carregado = manifesto.carregar("pendrive", 0);
+  printf("  %-28s %9.2f ms%s\n", "carga (mmap)",
+         (agoraSegundos() - inicio) * 1e3, carregado ? "" : " (falhou)");
+
+  const size_t buscas = std::min<size_t>(n, 1000000);
+  size_t achados = 0;
+  uint64_t y = 7;
+  inicio = agoraSegundos();
+  for (size_t i = 0; i < buscas; i++) {
+    y = y * 6364136223846793005ULL + 1442695040888963407ULL;
+    RegistroManifesto r;
+    achados += manifesto.buscar(nomes[(y >> 20) % n], &r);
+  }
+  double t = agoraSegundos() - inicio;
+  printf("  %-28s %9.1f ms %10.0f buscas/s (%zu achados)\n", "busca", t * 1e3,
+         buscas / t, achados);
+
+  const uint64_t tamanho = obterMetadados("pendrive/.backup_manifesto",
+                                          CAMPO_TAMANHO).tamanho;
+  printf("  %-28s %9.1f bytes/arquivo, %.1f MB mapeados\n", "manifesto",
+         static_cast<double>(tamanho) / n, tamanho / 1e6);
+  printf("  %-28s %9.1f bytes/arquivo\n", "formato anterior",
+         40.0 + static_cast<double>(bytes_nomes) / n);
+  remove("pendrive/.backup_manifesto");
+}
+
+// Índice de fragmentos com BENCH_INDICE_MILHOES milhões de identificadores:
+// inserção, buscas de presentes e de novos (respondidas pelo filtro) depois
+// de reabrir, e memória por milhão contra um unordered_set
+void benchIndice() {
+  const size_t n = parametro("BENCH_INDICE_MILHOES", 4) * 1000000;
+  std::vector<IdFragmento> ids(2 * n);
+  uint64_t x = 1;
+  for (size_t i = 0; i < ids.size(); i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    ids[i].h[0] = x ^ (x >> 29);
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    ids[i].h[1] = x ^ (x >> 29);
+  }
+  printf("[indice] %zu identificadores\n", n);
+
+  const std::string diretorio = "pendrive/indice_bench";
+  OpcoesFragmentos opcoes;
+  double inicio = agoraSegundos();
+  {
+    IndiceFragmentos indice(opcoes.ids_em_memoria, opcoes.maximo_tabelas);
+    indice.abrir(diretorio, false);
+    for (size_t i = 0; i < n; i++) {
+      if (!indice.contem(ids[i])) indice.inserir(ids[i]);
+    }
+    indice.concluir();
+  }
+  double t = agoraSegundos() - inicio;
+  printf("  %-28s %9.1f ms %10.0f ids/s\n", "inserção", t * 1e3, n / t);
+
+  IndiceFragmentos indice(opcoes.ids_em_memoria, opcoes.maximo_tabelas);
+  indice.abrir(diretorio, false);
+  const size_t buscas = std::min<size_t>(n, 1000000);
+  const char* casos[] = { "busca (presentes)", "busca (novos)" };
+  for (int novos = 0; novos < 2; novos++) {
+    size_t achados = 0;
+    uint64_t y = 7;
+    inicio = agoraSegundos();
+    for (size_t i = 0; i < buscas; i++) {
+      y = y * 6364136223846793005ULL + 1442695040888963407ULL;
+      achados += indice.contem(ids[(y >> 20) % n + novos * n]);
+    }
+    t = agoraSegundos() - inicio;
+    printf("  %-28s %9.1f ms %10.0f buscas/s (%zu achados)\n", casos[novos],
+           t * 1e3, buscas / t, achados);
+  }
+
+  const double milhoes = n / 1e6;
+  printf("  %-28s %zu tabelas, %.2f MB residentes/milhão, %.1f MB em "
+         "disco/milhão\n", "índice", indice.tabelas(),
+         indice.bytesEmMemoria() / milhoes / 1e6,
+         (n * sizeof(IdFragmento) + indice.bytesEmMemoria()) / milhoes / 1e6);
+  std::unordered_set<IdFragmento, HashIdFragmento> conjunto(ids.begin(),
+                                                            ids.begin() + n);
+  // Nó (próximo, identificador, hash guardado) e o balde
+  double bytes_conjunto =
+      conjunto.size() * (sizeof(void*) + sizeof(IdFragmento) +
+                         sizeof(size_t)) +
+      conjunto.bucket_count() * sizeof(void*);
+  printf("  %-28s %.2f MB residentes/milhão\n", "unordered_set",
+         bytes_conjunto / milhoes / 1e6);
+
+  if (system("rm -rf pendrive/indice_bench") != 0) {
+    std::cerr << "[AVISO] Índice do benchmark não removido\n";
+  }
+}
+
+// Compressão de um texto repetitivo em memória, nos dois codecs, e de um
+// arquivo grande em blocos paralelos com 1, 2, 4... threads
+void benchCompressao() {
+  const size_t mb = parametro("BENCH_COMPRESSAO_MB", 64);
+  std::string texto;
+  for (int i = 0; texto.size() < (mb << 20); i++) {
+    texto += "registro " + std::to_string(i) + ";status=ok;origem=hd\n";
+  }
+  printf("[compressao] %zu MB de texto em memória\n", mb);
+
+  const size_t bloco = 1 << 20;
+  std::vector<char> saida(limiteLz4(bloco));
+  std::vector<char> volta(bloco);
+  for (int denso = 0; denso < 2; denso++) {
+    size_t comprimido = 0;
+    double inicio = agoraSegundos();
+    for (size_t pos = 0; pos + bloco <= texto.size(); pos += bloco) {
+      comprimido += comprimirLz4(texto.data() + pos, bloco, &saida[0],
+                                 saida.size(), denso == 1);
+    }
+    double t = agoraSegundos() - inicio;
+    imprimirLinha(denso ? "lz4hc" : "lz4", t, 1, texto.size());
+    printf("  %-28s %9.2fx\n", "", static_cast<double>(texto.size()) /
+                                      comprimido);
+  }
+  size_t n = comprimirLz4(texto.data(), bloco, &saida[0], saida.size(),
+                          false);
+  double inicio = agoraSegundos();
+  for (size_t pos = 0; pos + bloco <= texto.size(); pos += bloco) {
+    descomprimirLz4(&saida[0], n, &volta[0], bloco);
+  }
+  imprimirLinha("descompressão", agoraSegundos() - inicio, 1, texto.size());
+
+  std::ofstream("comp_bench.txt", std::ios::binary) << texto;
+  const unsigned nucleos = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= nucleos; threads *= 2) {
+    PoolThreads pool(threads);
+    char rotulo[64];
+    inicio = agoraSegundos();
+    copiarComprimindo("comp_bench.txt", "pendrive/comp_bench.txt",
+                      CODEC_LZ4HC, bloco, true, NULL, NULL, &pool);
+    snprintf(rotulo, sizeof(rotulo), "lz4hc, %u threads", threads);
+    imprimirLinha(rotulo, agoraSegundos() - inicio, 1, texto.size());
+    inicio = agoraSegundos();
+    copiarDescomprimindo("pendrive/comp_bench.txt", "comp_volta.txt", true,
+                         &pool);
+    snprintf(rotulo, sizeof(rotulo), "restauração, %u threads", threads);
+    imprimirLinha(rotulo, agoraSegundos() - inicio, 1, texto.size());
+    // A última medida usa todos os núcleos
+    if (threads < nucleos && threads * 2 > nucleos) threads = nucleos / 2;
+  }
+  remove("comp_bench.txt");
+  remove("comp_volta.txt");
+  remove("pendrive/comp_bench.txt");
+}
+
+struct Benchmark {
+  const char* nome;
+  void (*executar)();
+};
+
+const Benchmark BENCHMARKS[] = {
+  { "pipeline", benchPipeline },
+  { "odirect", benchDireto },
+  { "digests", benchDigests },
+  { "fragmentos", benchFragmentos },
+  { "indice", benchIndice },
+  { "manifesto", benchManifesto },
+  { "compressao", benchCompressao },
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* filtro = argc > 1 ? argv[1] : NULL;
+
+  mkdir(DIRETORIO_BENCH, 0777);
+  if (chdir(DIRETORIO_BENCH) != 0) {
+    std::cerr << "[ERRO] Não foi possível entrar em " << DIRETORIO_BENCH
+              << "\n";
+    return 1;
+  }
+  mkdir("pendrive", 0777);
+
+  for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); i++) {
+    if (filtro && strcmp(filtro, BENCHMARKS[i].nome) != 0) continue;
+    BENCHMARKS[i].executar();
+  }
+
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+  if (chdir("..") == 0) rmdir(DIRETORIO_BENCH);
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Copyright 2025 Alex Batista Resende
+#include "caminho.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/***************************************************************************
+ * VisaoTexto
+ ***************************************************************************/
+const size_t VisaoTexto::npos;
+
+size_t VisaoTexto::rfind(char c) const {
+  for (size_t i = tamanho_; i > 0; i--) {
+    if (dados_[i - 1] == c) return i - 1;
+  }
+  return npos;
+}
+
+VisaoTexto VisaoTexto::substr(size_t inicio, size_t n) const {
+  if (inicio > tamanho_) inicio = tamanho_;
+  return VisaoTexto(dados_ + inicio, std::min(n, tamanho_ - inicio));
+}
+
+bool operator==(VisaoTexto a, VisaoTexto b) {
+  return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool operator<(VisaoTexto a, VisaoTexto b) {
+  int c = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+  return c < 0 || (c == 0 && a.size() < b.size());
+}
+
+size_t hashTexto(VisaoTexto texto) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < texto.size(); i++) {
+    h ^= static_cast<unsigned char>(texto[i]);
+    h *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(h);
+}
+
+/***************************************************************************
+ * BufferCaminho
+ ***************************************************************************/
+void BufferCaminho::limpar() {
+  tamanho_ = 0;
+  curto_[0] = '\0';
+  longo_.clear();
+}
+
+void BufferCaminho::acrescentar(VisaoTexto parte) {
+  if (longo_.empty() && tamanho_ + parte.size() < sizeof(curto_)) {
+    memcpy(curto_ + tamanho_, parte.data(), parte.size());
+    tamanho_ += parte.size();
+    curto_[tamanho_] = '\0';
+    return;
+  }
+  if (longo_.empty()) longo_.assign(curto_, tamanho_);
+  longo_.append(parte.data(), parte.size());
+  tamanho_ = longo_.size();
+}
+
+void BufferCaminho::montar(VisaoTexto base, VisaoTexto nome) {
+  limpar();
+  acrescentar(base);
+  acrescentar("/");
+  acrescentar(nome);
+}
+
+/***************************************************************************
+ * ArenaTexto
+ ***************************************************************************/
+VisaoTexto ArenaTexto::copiar(VisaoTexto texto) {
+  const size_t preciso = texto.size() + 1;
+  while (atual_ < blocos_.size() &&
+         blocos_[atual_].tamanho - usado_ < preciso) {
+    atual_++;
+    usado_ = 0;
+  }
+  if (atual_ == blocos_.size()) {
+    Bloco bloco;
+    bloco.tamanho = std::max(tamanho_bloco_, preciso);
+    bloco.dados.reset(new char[bloco.tamanho]);
+    blocos_.push_back(std::move(bloco));
+    usado_ = 0;
+  }
+  char* destino = blocos_[atual_].dados.get() + usado_;
+  memcpy(destino, texto.data(), texto.size());
+  destino[texto.size()] = '\0';
+  usado_ += preciso;
+  return VisaoTexto(destino, texto.size());
+}
+
+void ArenaTexto::limpar() {
+  atual_ = 0;
+  usado_ = 0;
+}
+
+size_t ArenaTexto::bytesReservados() const {
+  size_t total = 0;
+  for (size_t i = 0; i < blocos_.size(); i++) total += blocos_[i].tamanho;
+  return total;
+}
@@ -0,0 +1,109 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef CAMINHO_HPP_
+#define CAMINHO_HPP_
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/***************************************************************************
+ * Classe: VisaoTexto
+ * Ponteiro e tamanho de um texto que pertence a outro objeto (o
+ * std::string_view que o C++11 não tem). Aceita std::string e const char*
+ * sem copiar; vale enquanto o dono não mudar.
+ ***************************************************************************/
+class VisaoTexto {
+ public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  VisaoTexto() : dados_(""), tamanho_(0) {}
+  VisaoTexto(const char* texto)  // NOLINT(runtime/explicit)
+      : dados_(texto), tamanho_(strlen(texto)) {}
+  VisaoTexto(const std::string& texto)  // NOLINT(runtime/explicit)
+      : dados_(texto.data()), tamanho_(texto.size()) {}
+  VisaoTexto(const char* dados, size_t tamanho)
+      : dados_(dados), tamanho_(tamanho) {}
+
+  const char* data() const { return dados_; }
+  size_t size() const { return tamanho_; }
+  bool empty() const { return tamanho_ == 0; }
+  char operator[](size_t i) const { return dados_[i]; }
+
+  // Posição do último 'c' (ou npos) e o trecho [inicio, inicio + n)
+  size_t rfind(char c) const;
+  VisaoTexto substr(size_t inicio, size_t n = npos) const;
+
+  std::string str() const { return std::string(dados_, tamanho_); }
+
+ private:
+  const char* dados_;
+  size_t tamanho_;
+};
+
+bool operator==(VisaoTexto a, VisaoTexto b);
+bool operator<(VisaoTexto a, VisaoTexto b);
+
+// FNV-1a, para tabelas de visões
+size_t hashTexto(VisaoTexto texto);
+
+/***************************************************************************
+ * Classe: BufferCaminho
+ * Caminho montado num buffer fixo de PATH_MAX bytes, reaproveitado de uma
+ * entrada para a outra: montar e acrescentar não alocam. Um caminho maior
+ * que PATH_MAX vai para o heap só para chegar à chamada de sistema, que o
+ * recusa com ENAMETOOLONG como recusaria o std::string.
+ ***************************************************************************/
+class BufferCaminho {
+ public:
+  BufferCaminho() : tamanho_(0) { curto_[0] = '\0'; }
+
+  void limpar();
+  void acrescentar(VisaoTexto parte);
+  void montar(VisaoTexto base, VisaoTexto nome);  // base + "/" + nome
+
+  const char* c_str() const { return longo_.empty() ? curto_ : longo_.c_str(); }
+  size_t size() const { return tamanho_; }
+  VisaoTexto visao() const { return VisaoTexto(c_str(), tamanho_); }
+
+ private:
+  char curto_[PATH_MAX];
+  size_t tamanho_;
+  std::string longo_;  // só caminhos maiores que PATH_MAX
+};
+
+/***************************************************************************
+ * Classe: ArenaTexto
+ * Cópias de textos em blocos de 'tamanho_bloco' bytes, devolvidas como
+ * visões terminadas em '\0'. Não há liberação individual: limpar()
+ * invalida todas as cópias de uma vez e os blocos servem ao próximo ciclo,
+ * então quem limpa a cada lote deixa de alocar depois do primeiro.
+ ***************************************************************************/
+class ArenaTexto {
+ public:
+  explicit ArenaTexto(size_t tamanho_bloco = 64 * 1024)
+      : tamanho_bloco_(tamanho_bloco) {}
+
+  VisaoTexto copiar(VisaoTexto texto);
+  void limpar();
+
+  size_t bytesReservados() const;
+
+ private:
+  struct Bloco {
+    std::unique_ptr<char[]> dados;
+    size_t tamanho;
+  };
+
+  ArenaTexto(const ArenaTexto&);
+  ArenaTexto& operator=(const ArenaTexto&);
+
+  size_t tamanho_bloco_;
+  std::vector<Bloco> blocos_;
+  size_t atual_ = 0;  // bloco em uso
+  size_t usado_ = 0;  // bytes ocupados dele
+};
+
+#endif  // CAMINHO_HPP_
@@ -0,0 +1,849 @@
+// Copyright 2025 Alex Batista Resende
+#include "compressao.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+#include "pool.hpp"  // NOLINT
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Primeiros bytes de todo arquivo comprimido
+const char MARCA_COMPRIMIDO[8] = { 'B', 'K', 'C', 'O', 'M', 'P', '1', '\0' };
+
+// Bit do tamanho de um bloco guardado sem compressão
+const uint32_t BLOCO_ARMAZENADO = 1u << 31;
+
+struct CabecalhoComprimido {
+  char marca[8];
+  uint8_t codec;
+  uint8_t reservado[3];
+  uint32_t bloco;
+  uint64_t tamanho_original;
+  uint64_t inicio_indice;  // offset de cada bloco, no fim do arquivo
+};
+
+struct CabecalhoBloco {
+  uint32_t comprimido;  // com BLOCO_ARMAZENADO, os dados vão como estão
+  uint32_t original;
+};
+
+/***************************************************************************
+ * LZ4: sequências "token, literais, offset, resto do casamento". O último
+ * casamento termina a 5 bytes do fim e começa a 12 bytes dele, como no
+ * formato de referência.
+ ***************************************************************************/
+const size_t CASAMENTO_MINIMO = 4;
+const size_t LITERAIS_FINAIS = 5;
+const size_t LIMITE_CASAMENTO = 12;
+const size_t DISTANCIA_MAXIMA = 65535;
+const unsigned BITS_HASH = 16;
+const unsigned TENTATIVAS_DENSO = 64;
+
+uint32_t ler32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t hash4(const unsigned char* p) {
+  return (ler32(p) * 2654435761u) >> (32 - BITS_HASH);
+}
+
+size_t comprimentoComum(const unsigned char* a, const unsigned char* b,
+                        const unsigned char* limite) {
+  const unsigned char* inicio = a;
+  while (a < limite && *a == *b) {
+    a++;
+    b++;
+  }
+  return a - inicio;
+}
+
+// Escreve um comprimento >= 15 como sequência de bytes 255 e o resto
+bool escreverComprimento(size_t resto, unsigned char** op,
+                         const unsigned char* fim) {
+  while (resto >= 255) {
+    if (*op >= fim) return false;
+    *(*op)++ = 255;
+    resto -= 255;
+  }
+  if (*op >= fim) return false;
+  *(*op)++ = static_cast<unsigned char>(resto);
+  return true;
+}
+
+// Sequência com 'literais' bytes e, se 'casamento' > 0, o casamento
+bool emitirSequencia(const unsigned char* literal, size_t literais,
+                     size_t offset, size_t casamento, unsigned char** op,
+                     const unsigned char* fim) {
+  if (*op >= fim) return false;
+  unsigned char* token = (*op)++;
+  *token = static_cast<unsigned char>(std::min<size_t>(literais, 15) << 4);
+  if (literais >= 15 && !escreverComprimento(literais - 15, op, fim)) {
+    return false;
+  }
+  if (static_cast<size_t>(fim - *op) < literais) return false;
+  memcpy(*op, literal, literais);
+  *op += literais;
+  if (casamento == 0) return true;
+
+  if (fim - *op < 2) return false;
+  *(*op)++ = static_cast<unsigned char>(offset);
+  *(*op)++ = static_cast<unsigned char>(offset >> 8);
+  const size_t resto = casamento - CASAMENTO_MINIMO;
+  *token |= static_cast<unsigned char>(std::min<size_t>(resto, 15));
+  return resto < 15 || escreverComprimento(resto - 15, op, fim);
+}
+
+// Cadeias de hash do modo denso: posições anteriores com o mesmo hash
+class CadeiasHash {
+ public:
+  CadeiasHash() : cabeca_(1u << BITS_HASH, -1), anterior_(1u << 16, -1) {}
+
+  void inserir(const unsigned char* base, int32_t pos) {
+    uint32_t h = hash4(base + pos);
+    anterior_[pos & 0xffff] = cabeca_[h];
+    cabeca_[h] = pos;
+  }
+
+  // Maior casamento para a posição 'pos' (já inserida até pos - 1)
+  size_t procurar(const unsigned char* base, int32_t pos,
+                  const unsigned char* limite, int32_t* achado) const {
+    size_t melhor = 0;
+    int32_t candidato = cabeca_[hash4(base + pos)];
+    for (unsigned t = 0; t < TENTATIVAS_DENSO && candidato >= 0 &&
+                         pos - candidato <= static_cast<int32_t>(
+                                                DISTANCIA_MAXIMA);
+         t++) {
+      if (ler32(base + candidato) == ler32(base + pos)) {
+        size_t n = CASAMENTO_MINIMO +
+                   comprimentoComum(base + pos + CASAMENTO_MINIMO,
+                                    base + candidato + CASAMENTO_MINIMO,
+                                    limite);
+        if (n > melhor) {
+          melhor = n;
+          *achado = candidato;
+        }
+      }
+      int32_t proximo = anterior_[candidato & 0xffff];
+      if (proximo >= candidato) break;  // entrada já reaproveitada
+      candidato = proximo;
+    }
+    return melhor;
+  }
+
+ private:
+  std::vector<int32_t> cabeca_;
+  std::vector<int32_t> anterior_;
+};
+
+size_t comprimirRapido(const unsigned char* base, size_t tamanho,
+                       unsigned char* op, const unsigned char* fim) {
+  unsigned char* const inicio_saida = op;
+  const unsigned char* ip = base;
+  const unsigned char* ancora = base;
+  const unsigned char* const limite = base + tamanho - LITERAIS_FINAIS;
+  const unsigned char* const ultimo = base + tamanho - LIMITE_CASAMENTO;
+  std::vector<uint32_t> tabela(1u << BITS_HASH, UINT32_MAX);
+
+  unsigned falhas = 0;
+  while (ip <= ultimo) {
+    uint32_t h = hash4(ip);
+    uint32_t candidato = tabela[h];
+    tabela[h] = static_cast<uint32_t>(ip - base);
+    const unsigned char* m = base + candidato;
+    if (candidato == UINT32_MAX ||
+        static_cast<size_t>(ip - m) > DISTANCIA_MAXIMA ||
+        ler32(m) != ler32(ip)) {
+      ip += 1 + (falhas++ >> 6);  // dados sem repetição: passos maiores
+      continue;
+    }
+    falhas = 0;
+    while (ip > ancora && m > base && ip[-1] == m[-1]) {
+      ip--;
+      m--;
+    }
+    size_t n = CASAMENTO_MINIMO +
+               comprimentoComum(ip + CASAMENTO_MINIMO, m + CASAMENTO_MINIMO,
+                                limite);
+    if (!emitirSequencia(ancora, ip - ancora, ip - m, n, &op, fim)) return 0;
+    ip += n;
+    ancora = ip;
+    if (ip <= ultimo) {
+      tabela[hash4(ip - 2)] = static_cast<uint32_t>(ip - 2 - base);
+    }
+  }
+  if (!emitirSequencia(ancora, base + tamanho - ancora, 0, 0, &op, fim)) {
+    return 0;
+  }
+  return op - inicio_saida;
+}
+
+size_t comprimirDenso(const unsigned char* base, size_t tamanho,
+                      unsigned char* op, const unsigned char* fim) {
+  unsigned char* const inicio_saida = op;
+  const unsigned char* const limite = base + tamanho - LITERAIS_FINAIS;
+  const int32_t ultimo = static_cast<int32_t>(tamanho - LIMITE_CASAMENTO);
+  CadeiasHash cadeias;
+  int32_t inserido = 0;  // posições abaixo desta já estão nas cadeias
+  int32_t ancora = 0;
+  int32_t pos = 0;
+
+  while (pos <= ultimo) {
+    for (; inserido < pos; inserido++) cadeias.inserir(base, inserido);
+    int32_t achado = -1;
+    size_t n = cadeias.procurar(base, pos, limite, &achado);
+    if (n < CASAMENTO_MINIMO) {
+      pos++;
+      continue;
+    }
+    // Avaliação adiada: um casamento maior na posição seguinte vence
+    if (pos + 1 <= ultimo) {
+      cadeias.inserir(base, pos);
+      inserido = pos + 1;
+      int32_t achado_seguinte = -1;
+      size_t n_seguinte = cadeias.procurar(base, pos + 1, limite,
+                                           &achado_seguinte);
+      if (n_seguinte > n + 1) {
+        pos++;
+        n = n_seguinte;
+        achado = achado_seguinte;
+      }
+    }
+    if (!emitirSequencia(base + ancora, pos - ancora, pos - achado, n, &op,
+                         fim)) {
+      return 0;
+    }
+    pos += static_cast<int32_t>(n);
+    ancora = pos;
+  }
+  if (!emitirSequencia(base + ancora, tamanho - ancora, 0, 0, &op, fim)) {
+    return 0;
+  }
+  return op - inicio_saida;
+}
+
+/***************************************************************************
+ * E/S de blocos inteiros
+ ***************************************************************************/
+bool escreverTudo(int fd, const void* dados, size_t tamanho) {
+  const char* p = static_cast<const char*>(dados);
+  while (tamanho > 0) {
+    ssize_t n = write(fd, p, tamanho);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    tamanho -= n;
+  }
+  return true;
+}
+
+// Lê até 'tamanho' bytes a partir de 'offset'; menos só no fim do
+// arquivo. -1 em erro.
+ssize_t lerNoOffset(int fd, void* dados, size_t tamanho, uint64_t offset) {
+  char* p = static_cast<char*>(dados);
+  size_t lido = 0;
+  while (lido < tamanho) {
+    ssize_t n = pread(fd, p + lido, tamanho - lido, offset + lido);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    if (n == 0) break;
+    lido += n;
+  }
+  return static_cast<ssize_t>(lido);
+}
+
+bool escreverNoOffset(int fd, const void* dados, size_t tamanho,
+                      uint64_t offset) {
+  const char* p = static_cast<const char*>(dados);
+  while (tamanho > 0) {
+    ssize_t n = pwrite(fd, p, tamanho, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    offset += n;
+    tamanho -= n;
+  }
+  return true;
+}
+
+uint64_t nanossegundosDesde(std::chrono::steady_clock::time_point inicio) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - inicio).count();
+}
+
+}  // namespace
+
+/***************************************************************************
+ * Codecs
+ ***************************************************************************/
+const char* nomeCodec(CodecCompressao codec) {
+  switch (codec) {
+    case CODEC_LZ4:   return "lz4";
+    case CODEC_LZ4HC: return "lz4hc";
+    default:          return "nenhum";
+  }
+}
+
+size_t limiteLz4(size_t tamanho) {
+  return tamanho + tamanho / 255 + 16;
+}
+
+size_t comprimirLz4(const char* dados, size_t tamanho, char* saida,
+                    size_t capacidade, bool denso) {
+  const unsigned char* base = reinterpret_cast<const unsigned char*>(dados);
+  unsigned char* op = reinterpret_cast<unsigned char*>(saida);
+  const unsigned char* fim = op + capacidade;
+  if (tamanho < LIMITE_CASAMENTO + 1) {
+    return emitirSequencia(base, tamanho, 0, 0, &op, fim)
+               ? op - reinterpret_cast<unsigned char*>(saida) : 0;
+  }
+  return denso ? comprimirDenso(base, tamanho, op, fim)
+               : comprimirRapido(base, tamanho, op, fim);
+}
+
+bool descomprimirLz4(const char* dados, size_t tamanho, char* saida,
+                     size_t tamanho_original) {
+  const unsigned char* ip = reinterpret_cast<const unsigned char*>(dados);
+  const unsigned char* const fim_entrada = ip + tamanho;
+  unsigned char* op = reinterpret_cast<unsigned char*>(saida);
+  unsigned char* const inicio = op;
+  unsigned char* const fim_saida = op + tamanho_original;
+
+  while (ip < fim_entrada) {
+    const unsigned token = *ip++;
+    size_t literais = token >> 4;
+    if (literais == 15) {
+      unsigned char b;
+      do {
+        if (ip >= fim_entrada) return false;
+        b = *ip++;
+        literais += b;
+      } while (b == 255);
+    }
+    if (literais > static_cast<size_t>(fim_entrada - ip) ||
+        literais > static_cast<size_t>(fim_saida - op)) {
+      return false;
+    }
+    memcpy(op, ip, literais);
+    ip += literais;
+    op += literais;
+    if (ip == fim_entrada) break;  // última sequência: só literais
+
+    if (fim_entrada - ip < 2) return false;
+    const size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - inicio)) {
+      return false;
+    }
+    size_t casamento = token & 15;
+    if (casamento == 15) {
+      unsigned char b;
+      do {
+        if (ip >= fim_entrada) return false;
+        b = *ip++;
+        casamento += b;
+      } while (b == 255);
+    }
+    casamento += CASAMENTO_MINIMO;
+    if (casamento > static_cast<size_t>(fim_saida - op)) return false;
+    const unsigned char* m = op - offset;
+    if (offset >= casamento) {
+      memcpy(op, m, casamento);
+      op += casamento;
+    } else {
+      for (size_t i = 0; i < casamento; i++) *op++ = *m++;  // sobreposto
+    }
+  }
+  return op == fim_saida;
+}
+
+double entropiaBytes(const unsigned char* dados, size_t tamanho) {
+  if (tamanho == 0) return 0;
+  size_t contagem[256] = { 0 };
+  for (size_t i = 0; i < tamanho; i++) contagem[dados[i]]++;
+  double entropia = 0;
+  for (int b = 0; b < 256; b++) {
+    if (contagem[b] == 0) continue;
+    double p = static_cast<double>(contagem[b]) / tamanho;
+    entropia -= p * std::log2(p);
+  }
+  return entropia;
+}
+
+/***************************************************************************
+ * Estatísticas
+ ***************************************************************************/
+EstatisticasCompressao::EstatisticasCompressao() : pulados_(0) {
+  for (int c = 0; c < NUM_CODECS; c++) {
+    entrada_[c] = 0;
+    saida_[c] = 0;
+    nanossegundos_[c] = 0;
+  }
+}
+
+void EstatisticasCompressao::registrar(CodecCompressao codec,
+                                       uint64_t entrada, uint64_t saida,
+                                       uint64_t nanossegundos) {
+  entrada_[codec] += entrada;
+  saida_[codec] += saida;
+  nanossegundos_[codec] += nanossegundos;
+}
+
+std::string EstatisticasCompressao::resumo() const {
+  std::string texto;
+  for (int c = CODEC_LZ4; c < NUM_CODECS; c++) {
+    const uint64_t entrada = entrada_[c];
+    if (entrada == 0) continue;
+    const uint64_t saida = saida_[c];
+    const double segundos = nanossegundos_[c] / 1e9;
+    char linha[128];
+    snprintf(linha, sizeof(linha), " | %s: %.2fx a %.1f MB/s",
+             nomeCodec(static_cast<CodecCompressao>(c)),
+             saida ? static_cast<double>(entrada) / saida : 0.0,
+             segundos > 0 ? entrada / segundos / 1e6 : 0.0);
+    texto += linha;
+  }
+  return texto + " | Sem compressão: " + std::to_string(pulados_.load());
+}
+
+/***************************************************************************
+ * Amostragem
+ ***************************************************************************/
+AmostraCompressao amostrarCompressao(const std::string& origem,
+                                     const OpcoesCompressao& opcoes) {
+  AmostraCompressao amostra;
+  int fd = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+    if (fd >= 0) close(fd);
+    return amostra;
+  }
+  const uint64_t tamanho = st.st_size;
+  const unsigned n = std::max(1u, opcoes.amostras);
+  const size_t pedaco = std::min<uint64_t>(opcoes.tamanho_amostra, tamanho);
+  std::vector<char> dados(pedaco);
+  std::vector<char> comprimido(limiteLz4(pedaco));
+  uint64_t lidos = 0, saida = 0;
+  double entropia = 0;
+  unsigned feitas = 0;
+  for (unsigned i = 0; i < n; i++) {
+    // Amostras igualmente espaçadas, a primeira no início e a última no fim
+    uint64_t offset = n == 1 ? 0 : (tamanho - pedaco) * i / (n - 1);
+    ssize_t lido = pread(fd, &dados[0], pedaco, offset);
+    if (lido <= 0) break;
+    if (i == 0) {
+      amostra.cabecalho =
+          static_cast<size_t>(lido) >= sizeof(MARCA_COMPRIMIDO) &&
+          memcmp(&dados[0], MARCA_COMPRIMIDO, sizeof(MARCA_COMPRIMIDO)) == 0;
+    }
+    entropia += entropiaBytes(
+        reinterpret_cast<const unsigned char*>(&dados[0]), lido);
+    size_t c = comprimirLz4(&dados[0], lido, &comprimido[0],
+                            comprimido.size(), false);
+    lidos += lido;
+    saida += c ? c : lido;
+    feitas++;
+    if (pedaco == tamanho) break;  // arquivo inteiro na primeira
+  }
+  close(fd);
+  if (feitas == 0) return amostra;
+  amostra.entropia = entropia / feitas;
+  amostra.razao = saida ? static_cast<double>(lidos) / saida : 1;
+  amostra.comprimir = opcoes.codec != CODEC_NENHUM &&
+                      amostra.entropia <= opcoes.entropia_maxima &&
+                      amostra.razao >= opcoes.razao_minima;
+  return amostra;
+}
+
+bool ehArquivoComprimido(const std::string& caminho) {
+  int fd = open(caminho.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  char marca[sizeof(MARCA_COMPRIMIDO)];
+  bool comprimido = pread(fd, marca, sizeof(marca), 0) ==
+                        static_cast<ssize_t>(sizeof(marca)) &&
+                    memcmp(marca, MARCA_COMPRIMIDO, sizeof(marca)) == 0;
+  close(fd);
+  return comprimido;
+}
+
+namespace {
+
+// Bloco da origem em compressão: lido, com CRC e comprimido pela thread
+// que o pegou; gravado em ordem pela thread da cópia
+struct BlocoCompressao {
+  std::vector<char> dados;
+  std::vector<char> comprimido;
+  ssize_t lido = 0;
+  size_t tamanho = 0;       // bytes do corpo a gravar
+  bool armazenado = false;  // o corpo é 'dados', sem compressão
+  uint32_t crc = 0;
+  uint64_t nanossegundos = 0;
+  bool pronto = false;
+};
+
+void comprimirBloco(int in, uint64_t indice, size_t bloco,
+                    CodecCompressao codec, bool com_crc,
+                    BlocoCompressao* b) {
+  b->dados.resize(bloco);
+  b->lido = lerNoOffset(in, &b->dados[0], bloco, indice * bloco);
+  if (b->lido <= 0) return;
+  const size_t n = b->lido;
+  if (com_crc) b->crc = crc32c(0, &b->dados[0], n);
+  size_t c = 0;
+  b->nanossegundos = 0;
+  if (codec != CODEC_NENHUM) {
+    b->comprimido.resize(limiteLz4(bloco));
+    std::chrono::steady_clock::time_point inicio =
+        std::chrono::steady_clock::now();
+    c = comprimirLz4(&b->dados[0], n, &b->comprimido[0],
+                     b->comprimido.size(), codec == CODEC_LZ4HC);
+    b->nanossegundos = nanossegundosDesde(inicio);
+  }
+  b->armazenado = c == 0 || c >= n;
+  b->tamanho = b->armazenado ? n : c;
+}
+
+// Espera o bloco ficar pronto executando tarefas do pool enquanto isso,
+// como GrupoTarefas::esperar
+void esperarBloco(PoolThreads* pool, BlocoCompressao* b, std::mutex* mutex,
+                  std::condition_variable* terminou) {
+  std::unique_lock<std::mutex> trava(*mutex);
+  while (!b->pronto) {
+    trava.unlock();
+    const bool ajudou = pool != NULL && pool->executarPendente();
+    trava.lock();
+    if (!ajudou && !b->pronto) terminou->wait(trava);
+  }
+}
+
+bool lerCabecalho(int fd, CabecalhoComprimido* cabecalho) {
+  return lerNoOffset(fd, cabecalho, sizeof(*cabecalho), 0) ==
+             static_cast<ssize_t>(sizeof(*cabecalho)) &&
+         memcmp(cabecalho->marca, MARCA_COMPRIMIDO,
+                sizeof(MARCA_COMPRIMIDO)) == 0 &&
+         cabecalho->codec < NUM_CODECS && cabecalho->bloco != 0 &&
+         cabecalho->bloco < BLOCO_ARMAZENADO;
+}
+
+// Índice do fim do arquivo: offset do cabeçalho de cada bloco. Só o último
+// bloco pode ser menor, então o bloco i começa em i * bloco no original.
+bool lerIndice(int fd, const CabecalhoComprimido& cabecalho,
+               uint64_t tamanho_arquivo, std::vector<uint64_t>* indice) {
+  const uint64_t blocos =
+      (cabecalho.tamanho_original + cabecalho.bloco - 1) / cabecalho.bloco;
+  if (cabecalho.inicio_indice < sizeof(cabecalho) ||
+      cabecalho.inicio_indice > tamanho_arquivo ||
+      tamanho_arquivo - cabecalho.inicio_indice !=
+          blocos * sizeof(uint64_t)) {
+    return false;
+  }
+  indice->resize(blocos);
+  const size_t bytes = blocos * sizeof(uint64_t);
+  return blocos == 0 ||
+         lerNoOffset(fd, &(*indice)[0], bytes, cabecalho.inicio_indice) ==
+             static_cast<ssize_t>(bytes);
+}
+
+// Lê e descomprime o bloco 'i' em 'dados', com o tamanho original dele
+bool descomprimirBloco(int fd, const CabecalhoComprimido& cabecalho,
+                       const std::vector<uint64_t>& indice, uint64_t i,
+                       std::vector<char>* dados,
+                       std::vector<char>* comprimido) {
+  const uint64_t inicio = i * cabecalho.bloco;
+  const uint64_t esperado = std::min<uint64_t>(
+      cabecalho.bloco, cabecalho.tamanho_original - inicio);
+  CabecalhoBloco cb;
+  if (lerNoOffset(fd, &cb, sizeof(cb), indice[i]) !=
+          static_cast<ssize_t>(sizeof(cb)) ||
+      cb.original != esperado) {
+    return false;
+  }
+  const bool armazenado = (cb.comprimido & BLOCO_ARMAZENADO) != 0;
+  const uint32_t tamanho = cb.comprimido & ~BLOCO_ARMAZENADO;
+  if (armazenado ? tamanho != esperado
+                 : tamanho == 0 || tamanho > limiteLz4(esperado)) {
+    return false;
+  }
+  dados->resize(esperado);
+  const uint64_t corpo = indice[i] + sizeof(cb);
+  if (armazenado) {
+    return lerNoOffset(fd, &(*dados)[0], tamanho, corpo) ==
+           static_cast<ssize_t>(tamanho);
+  }
+  comprimido->resize(tamanho);
+  return lerNoOffset(fd, &(*comprimido)[0], tamanho, corpo) ==
+             static_cast<ssize_t>(tamanho) &&
+         descomprimirLz4(&(*comprimido)[0], tamanho, &(*dados)[0],
+                         esperado);
+}
+
+// Blocos divididos entre as threads: cada uma pega o próximo índice
+struct DescompressaoEmBlocos {
+  int in;
+  int out;
+  const CabecalhoComprimido* cabecalho;
+  const std::vector<uint64_t>* indice;
+  std::atomic<uint64_t> proximo;
+  std::atomic<bool> falhou;
+};
+
+void descomprimirBlocos(DescompressaoEmBlocos* d) {
+  std::vector<char> dados;
+  std::vector<char> comprimido;
+  for (;;) {
+    const uint64_t i = d->proximo++;
+    if (i >= d->indice->size() || d->falhou) return;
+    if (!descomprimirBloco(d->in, *d->cabecalho, *d->indice, i, &dados,
+                           &comprimido) ||
+        !escreverNoOffset(d->out, &dados[0], dados.size(),
+                          i * d->cabecalho->bloco)) {
+      d->falhou = true;
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+/***************************************************************************
+ * Função: copiarComprimindo
+ * Os blocos são lidos com offsets explícitos e comprimidos por tarefas do
+ * pool, numa janela de duas tarefas por thread; a thread da cópia grava
+ * cada bloco assim que ele e os anteriores ficam prontos.
+ ***************************************************************************/
+MetodoCopia copiarComprimindo(const std::string& origem,
+                              const std::string& destino,
+                              CodecCompressao codec, size_t bloco,
+                              bool renomear, uint32_t* crc,
+                              EstatisticasCompressao* estatisticas,
+                              PoolThreads* pool) {
+  const std::string temporario = caminhoTemporario(destino);
+  if (crc != NULL) *crc = 0;
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (in < 0 || fstat(in, &st) != 0) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    if (in >= 0) close(in);
+    return COPIA_FALHOU;
+  }
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  criarDiretorioPai(destino);
+  int saida = open(temporario.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  CabecalhoComprimido cabecalho;
+  memset(&cabecalho, 0, sizeof(cabecalho));
+  memcpy(cabecalho.marca, MARCA_COMPRIMIDO, sizeof(MARCA_COMPRIMIDO));
+  cabecalho.codec = static_cast<uint8_t>(codec);
+  cabecalho.bloco = static_cast<uint32_t>(bloco);
+  bool ok = saida >= 0 && escreverTudo(saida, &cabecalho, sizeof(cabecalho));
+
+  const uint64_t n_blocos = (st.st_size + bloco - 1) / bloco;
+  const size_t janela = pool ? 2 * pool->tamanho() : 1;
+  std::vector<BlocoCompressao> blocos(
+      std::max<uint64_t>(1, std::min<uint64_t>(janela, n_blocos)));
+  std::mutex mutex;
+  std::condition_variable terminou;
+  std::vector<uint64_t> indice;
+  uint64_t total = 0, escritos = sizeof(cabecalho), nanossegundos = 0;
+  const std::chrono::steady_clock::time_point inicio =
+      std::chrono::steady_clock::now();
+  {
+    // Destruído antes dos blocos: espera as tarefas ainda em voo
+    std::unique_ptr<GrupoTarefas> grupo(pool ? new GrupoTarefas(pool)
+                                             : NULL);
+    const bool com_crc = crc != NULL;
+    auto iniciar = [&](uint64_t i) {
+      BlocoCompressao* b = &blocos[i % blocos.size()];
+      b->pronto = false;
+      if (!grupo) {
+        comprimirBloco(in, i, bloco, codec, com_crc, b);
+        b->pronto = true;
+        return;
+      }
+      grupo->enviar([=, &mutex, &terminou] {
+        comprimirBloco(in, i, bloco, codec, com_crc, b);
+        std::lock_guard<std::mutex> trava(mutex);
+        b->pronto = true;
+        terminou.notify_all();
+      });
+    };
+    for (uint64_t i = 0; ok && i < std::min<uint64_t>(blocos.size(),
+                                                      n_blocos);
+         i++) {
+      iniciar(i);
+    }
+    for (uint64_t i = 0; ok && i < n_blocos; i++) {
+      BlocoCompressao& b = blocos[i % blocos.size()];
+      esperarBloco(pool, &b, &mutex, &terminou);
+      if (b.lido <= 0) {
+        ok = b.lido == 0;  // 0: a origem encolheu
+        break;
+      }
+      CabecalhoBloco cb;
+      cb.original = static_cast<uint32_t>(b.lido);
+      cb.comprimido = static_cast<uint32_t>(b.tamanho) |
+                      (b.armazenado ? BLOCO_ARMAZENADO : 0);
+      indice.push_back(escritos);
+      ok = escreverTudo(saida, &cb, sizeof(cb)) &&
+           escreverTudo(saida, b.armazenado ? &b.dados[0]
+                                            : &b.comprimido[0],
+                        b.tamanho);
+      if (crc != NULL) *crc = crc32cConcatenar(*crc, b.crc, b.lido);
+      total += b.lido;
+      escritos += sizeof(cb) + b.tamanho;
+      nanossegundos += b.nanossegundos;
+      if (static_cast<size_t>(b.lido) < bloco) break;  // último bloco
+      if (i + blocos.size() < n_blocos) iniciar(i + blocos.size());
+    }
+  }
+  close(in);
+  // Em paralelo, a vazão do codec é a do arquivo todo, não a de uma thread
+  if (pool) nanossegundos = nanossegundosDesde(inicio);
+
+  // Índice dos blocos e, no cabeçalho, o tamanho real (a origem pode ter
+  // mudado desde o fstat)
+  cabecalho.tamanho_original = total;
+  cabecalho.inicio_indice = escritos;
+  ok = ok && (indice.empty() ||
+              escreverTudo(saida, &indice[0],
+                           indice.size() * sizeof(uint64_t))) &&
+       escreverNoOffset(saida, &cabecalho, sizeof(cabecalho), 0);
+  escritos += indice.size() * sizeof(uint64_t);
+  if (ok) {
+    const struct timespec tempos[2] = { st.st_atim, st.st_mtim };
+    futimens(saida, tempos);
+  }
+  if (saida >= 0 && close(saida) != 0) ok = false;
+  if (!ok) {
+    std::cerr << "[ERRO] Falha ao comprimir: " << origem
+              << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (renomear && rename(temporario.c_str(), destino.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << destino << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (estatisticas != NULL && codec != CODEC_NENHUM) {
+    estatisticas->registrar(codec, total, escritos, nanossegundos);
+  }
+  return COPIA_COMPRIMIDA;
+}
+
+/***************************************************************************
+ * Função: copiarDescomprimindo
+ ***************************************************************************/
+MetodoCopia copiarDescomprimindo(const std::string& origem,
+                                 const std::string& destino,
+                                 bool renomear, PoolThreads* pool) {
+  const std::string temporario = caminhoTemporario(destino);
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  CabecalhoComprimido cabecalho;
+  std::vector<uint64_t> indice;
+  if (in < 0 || fstat(in, &st) != 0 || !lerCabecalho(in, &cabecalho) ||
+      !lerIndice(in, cabecalho, st.st_size, &indice)) {
+    std::cerr << "[ERRO] Arquivo comprimido inválido: " << origem << "\n";
+    if (in >= 0) close(in);
+    return COPIA_FALHOU;
+  }
+  criarDiretorioPai(destino);
+  int saida = open(temporario.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  DescompressaoEmBlocos blocos;
+  blocos.in = in;
+  blocos.out = saida;
+  blocos.cabecalho = &cabecalho;
+  blocos.indice = &indice;
+  blocos.proximo = 0;
+  blocos.falhou = false;
+  bool ok = saida >= 0;
+  if (ok && pool && indice.size() > 1) {
+    // Tamanho final desde já: os blocos terminam em qualquer ordem
+    ok = ftruncate(saida, cabecalho.tamanho_original) == 0;
+    GrupoTarefas grupo(pool);
+    for (unsigned i = 0; ok && i < pool->tamanho(); i++) {
+      grupo.enviar([&blocos] { descomprimirBlocos(&blocos); });
+    }
+    grupo.esperar();
+  } else if (ok) {
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    descomprimirBlocos(&blocos);
+  }
+  close(in);
+  ok = ok && !blocos.falhou;
+  if (ok) {
+    const struct timespec tempos[2] = { st.st_atim, st.st_mtim };
+    futimens(saida, tempos);
+  }
+  if (saida >= 0 && close(saida) != 0) ok = false;
+  if (!ok) {
+    std::cerr << "[ERRO] Falha ao descomprimir: " << origem << "\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (renomear && rename(temporario.c_str(), destino.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << destino << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  return COPIA_COMPRIMIDA;
+}
+
+/***************************************************************************
+ * Função: lerTrechoComprimido
+ ***************************************************************************/
+ssize_t lerTrechoComprimido(const std::string& caminho, uint64_t offset,
+                            char* dados, size_t tamanho) {
+  int fd = open(caminho.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  CabecalhoComprimido cabecalho;
+  std::vector<uint64_t> indice;
+  if (fd < 0 || fstat(fd, &st) != 0 || !lerCabecalho(fd, &cabecalho) ||
+      !lerIndice(fd, cabecalho, st.st_size, &indice)) {
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  if (offset >= cabecalho.tamanho_original) {
+    close(fd);
+    return 0;
+  }
+  tamanho = std::min<uint64_t>(tamanho, cabecalho.tamanho_original - offset);
+  std::vector<char> bloco;
+  std::vector<char> comprimido;
+  size_t copiado = 0;
+  for (uint64_t i = offset / cabecalho.bloco; copiado < tamanho; i++) {
+    if (!descomprimirBloco(fd, cabecalho, indice, i, &bloco, &comprimido)) {
+      close(fd);
+      return -1;
+    }
+    const size_t dentro = offset + copiado - i * cabecalho.bloco;
+    const size_t n = std::min(tamanho - copiado, bloco.size() - dentro);
+    memcpy(dados + copiado, &bloco[dentro], n);
+    copiado += n;
+  }
+  close(fd);
+  return static_cast<ssize_t>(copiado);
+}
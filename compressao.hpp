@@ -0,0 +1,119 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef COMPRESSAO_HPP_
+#define COMPRESSAO_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+#include "copia.hpp"  // NOLINT
+
+// Codec dos blocos de um arquivo comprimido. Os dois geram o formato de
+// bloco do LZ4 e usam o mesmo descompressor; o denso procura casamentos
+// em cadeias de hash, com avaliação adiada, trocando velocidade por razão.
+enum CodecCompressao {
+  CODEC_NENHUM,  // sem compressão (blocos armazenados)
+  CODEC_LZ4,     // rápido: um candidato por posição
+  CODEC_LZ4HC,   // denso: cadeias de hash e casamento adiado
+  NUM_CODECS
+};
+
+// Compressão no caminho de cópia do backup
+struct OpcoesCompressao {
+  CodecCompressao codec = CODEC_NENHUM;
+
+  // O arquivo é dividido em blocos independentes deste tamanho; a partir
+  // de 'limite_paralelo' bytes (0 = nunca), os blocos de um mesmo arquivo
+  // são comprimidos e descomprimidos pelas threads do pool da operação
+  size_t bloco = 1 << 20;
+  uint64_t limite_paralelo = 64 << 20;
+
+  // Amostragem antes de comprimir: 'amostras' trechos de 'tamanho_amostra'
+  // bytes espalhados pelo arquivo. Acima de 'entropia_maxima' bits por
+  // byte, ou com razão estimada abaixo de 'razao_minima', o arquivo é
+  // copiado como está (JPEG, zip, dumps já comprimidos).
+  unsigned amostras = 8;
+  size_t tamanho_amostra = 16 << 10;
+  double entropia_maxima = 7.9;
+  double razao_minima = 1.1;
+};
+
+// Resultado da amostragem de um arquivo
+struct AmostraCompressao {
+  double entropia = 0;     // bits por byte, média das amostras
+  double razao = 1;        // original / comprimido, nas amostras
+  bool comprimir = false;
+  bool cabecalho = false;  // começa como um arquivo comprimido
+};
+
+// Totais por codec de uma execução (thread-safe)
+class EstatisticasCompressao {
+ public:
+  EstatisticasCompressao();
+  void registrar(CodecCompressao codec, uint64_t entrada, uint64_t saida,
+                 uint64_t nanossegundos);
+  void registrarPulado() { pulados_++; }
+
+  // Complemento do [RESUMO]: razão e vazão de cada codec usado e quantos
+  // arquivos foram copiados sem compressão pela amostragem
+  std::string resumo() const;
+
+ private:
+  std::atomic<uint64_t> entrada_[NUM_CODECS];
+  std::atomic<uint64_t> saida_[NUM_CODECS];
+  std::atomic<uint64_t> nanossegundos_[NUM_CODECS];
+  std::atomic<uint64_t> pulados_;
+};
+
+const char* nomeCodec(CodecCompressao codec);
+
+// Bloco LZ4: 'capacidade' deve ser ao menos limiteLz4(tamanho). Devolve o
+// tamanho comprimido; descomprimirLz4 exige o tamanho original exato.
+size_t limiteLz4(size_t tamanho);
+size_t comprimirLz4(const char* dados, size_t tamanho, char* saida,
+                    size_t capacidade, bool denso);
+bool descomprimirLz4(const char* dados, size_t tamanho, char* saida,
+                     size_t tamanho_original);
+
+// Entropia de Shannon dos bytes, em bits por byte (0 a 8)
+double entropiaBytes(const unsigned char* dados, size_t tamanho);
+
+// Amostra 'origem' e decide se vale comprimir com opcoes.codec
+AmostraCompressao amostrarCompressao(const std::string& origem,
+                                     const OpcoesCompressao& opcoes);
+
+// Verdadeiro se 'caminho' começa com o cabeçalho de arquivo comprimido
+bool ehArquivoComprimido(const std::string& caminho);
+
+/***************************************************************************
+ * Copia 'origem' para caminhoTemporario(destino) comprimindo com 'codec'
+ * (CODEC_NENHUM só enquadra os blocos) e renomeia se 'renomear'. Formato:
+ * cabeçalho (marca, codec, tamanho do bloco, tamanho original, início do
+ * índice); para cada bloco, tamanho comprimido (bit 31: armazenado sem
+ * compressão), tamanho original e os dados; no fim, o índice com o offset
+ * de cada bloco. Os blocos são independentes: com 'pool', são comprimidos
+ * em paralelo e gravados em ordem. O destino fica com os tempos da
+ * origem. Com 'crc', o CRC32C da origem é calculado na mesma leitura.
+ ***************************************************************************/
+MetodoCopia copiarComprimindo(const std::string& origem,
+                              const std::string& destino,
+                              CodecCompressao codec, size_t bloco,
+                              bool renomear, uint32_t* crc,
+                              EstatisticasCompressao* estatisticas,
+                              PoolThreads* pool = NULL);
+
+// Restaura um arquivo escrito por copiarComprimindo, com os tempos dele;
+// com 'pool', os blocos são descomprimidos em paralelo pelo índice
+MetodoCopia copiarDescomprimindo(const std::string& origem,
+                                 const std::string& destino, bool renomear,
+                                 PoolThreads* pool = NULL);
+
+// Lê 'tamanho' bytes do conteúdo original a partir de 'offset',
+// descomprimindo só os blocos do trecho. Retorna os bytes lidos (menos no
+// fim do arquivo) ou -1.
+ssize_t lerTrechoComprimido(const std::string& caminho, uint64_t offset,
+                            char* dados, size_t tamanho);
+
+#endif  // COMPRESSAO_HPP_
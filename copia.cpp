@@ -0,0 +1,820 @@
+// Copyright 2025 Alex Batista Resende
+#include "copia.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+#include "pool.hpp"  // NOLINT
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cassert>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+namespace {
+
+// Sufixo dos arquivos ainda em escrita (ver caminhoTemporario)
+const char* const SUFIXO_TEMPORARIO = ".parcial";
+
+// Maior bloco pedido ao kernel em uma única chamada
+const size_t BLOCO_KERNEL = 1 << 30;
+
+// Buffer do pread/pwrite (sem copy_file_range ou com CRC)
+const size_t TAMANHO_BUFFER_FAIXA = 128 * 1024;
+
+// O_DIRECT: offsets, tamanhos e endereços múltiplos do bloco lógico
+const size_t ALINHAMENTO_DIRETO = 4096;
+const size_t TAMANHO_BUFFER_DIRETO = 1 << 20;
+const size_t MAX_BUFFERS_LIVRES = 16;
+
+// Resultado de uma tentativa de cópia por um dos caminhos do kernel
+enum ResultadoTentativa {
+  TENTATIVA_OK,
+  TENTATIVA_NAO_SUPORTADA,
+  TENTATIVA_ERRO
+};
+
+/***************************************************************************
+ * Função auxiliar: Indica se o errno significa "caminho não suportado"
+ * (sistemas de arquivos diferentes, kernel antigo, tipo de arquivo etc.)
+ ***************************************************************************/
+bool erroNaoSuportado(int erro) {
+  return erro == ENOSYS || erro == EXDEV || erro == EINVAL ||
+         erro == EOPNOTSUPP || erro == ENOTTY || erro == EBADF;
+}
+
+size_t restante(off_t tamanho, off_t copiado) {
+  off_t falta = tamanho - copiado;
+  return falta > static_cast<off_t>(BLOCO_KERNEL) ? BLOCO_KERNEL
+                                                  : static_cast<size_t>(falta);
+}
+
+/***************************************************************************
+ * Função auxiliar: Buffers de pread/pwrite da thread (dois, para comparar
+ * arquivos), alocados na primeira cópia e reaproveitados nas seguintes
+ ***************************************************************************/
+char* bufferFaixa(int qual) {
+  static thread_local std::unique_ptr<char[]> buffers;
+  if (!buffers) buffers.reset(new char[2 * TAMANHO_BUFFER_FAIXA]);
+  return buffers.get() + qual * TAMANHO_BUFFER_FAIXA;
+}
+
+/***************************************************************************
+ * Função auxiliar: CRC32C dos primeiros 'tamanho' bytes de um arquivo
+ ***************************************************************************/
+ResultadoTentativa calcularCrc(int fd, off_t tamanho, uint32_t* crc) {
+  char* buffer = bufferFaixa(0);
+  for (off_t lido = 0; lido < tamanho;) {
+    size_t pedir = std::min<off_t>(tamanho - lido, TAMANHO_BUFFER_FAIXA);
+    ssize_t n = pread(fd, buffer, pedir, lido);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return TENTATIVA_ERRO;
+    if (n == 0) break;
+    *crc = crc32c(*crc, buffer, n);
+    lido += n;
+  }
+  return TENTATIVA_OK;
+}
+
+/***************************************************************************
+ * Tentativa de clone (reflink): o destino passa a compartilhar os extents
+ * da origem, sem mover dados. Só vale para o arquivo inteiro.
+ ***************************************************************************/
+ResultadoTentativa clonarArquivo(int in, int out, off_t tamanho,
+                                 off_t* copiado, uint32_t* crc) {
+  if (*copiado != 0) return TENTATIVA_NAO_SUPORTADA;
+  if (ioctl(out, FICLONE, in) != 0) {
+    // EPERM/EACCES também aparecem quando o fs não aceita o clone
+    return (erroNaoSuportado(errno) || errno == EPERM || errno == EACCES)
+               ? TENTATIVA_NAO_SUPORTADA : TENTATIVA_ERRO;
+  }
+  *copiado = tamanho;
+  // O clone não move dados: a única leitura é a do CRC
+  return crc != NULL ? calcularCrc(in, tamanho, crc) : TENTATIVA_OK;
+}
+
+/***************************************************************************
+ * Tentativas de cópia. Todas continuam a partir de *copiado, de modo que um
+ * caminho que falhe no meio do arquivo pode ser retomado pelo próximo; o
+ * CRC, quando pedido, acompanha *copiado. Os caminhos do kernel não
+ * passam os dados pelo processo e só entram no plano sem CRC.
+ ***************************************************************************/
+ResultadoTentativa copiarComCopyFileRange(int in, int out, off_t tamanho,
+                                          off_t* copiado, uint32_t*) {
+  while (*copiado < tamanho) {
+    loff_t off_in = *copiado, off_out = *copiado;
+    ssize_t n = copy_file_range(in, &off_in, out, &off_out,
+                                restante(tamanho, *copiado), 0);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return erroNaoSuportado(errno) ? TENTATIVA_NAO_SUPORTADA
+                                     : TENTATIVA_ERRO;
+    }
+    if (n == 0) break;  // arquivo encolheu durante a cópia
+    *copiado += n;
+  }
+  return TENTATIVA_OK;
+}
+
+ResultadoTentativa copiarComSendfile(int in, int out, off_t tamanho,
+                                     off_t* copiado, uint32_t*) {
+  if (lseek(out, *copiado, SEEK_SET) < 0) return TENTATIVA_ERRO;
+  while (*copiado < tamanho) {
+    off_t off_in = *copiado;
+    ssize_t n = sendfile(out, in, &off_in, restante(tamanho, *copiado));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return erroNaoSuportado(errno) ? TENTATIVA_NAO_SUPORTADA
+                                     : TENTATIVA_ERRO;
+    }
+    if (n == 0) break;
+    *copiado += n;
+  }
+  return TENTATIVA_OK;
+}
+
+ResultadoTentativa copiarComSplice(int in, int out, off_t tamanho,
+                                   off_t* copiado, uint32_t*) {
+  int tubo[2];
+  if (pipe2(tubo, O_CLOEXEC) != 0) return TENTATIVA_NAO_SUPORTADA;
+
+  ResultadoTentativa resultado = TENTATIVA_OK;
+  while (*copiado < tamanho) {
+    loff_t off_in = *copiado;
+    ssize_t lidos = splice(in, &off_in, tubo[1], NULL,
+                           restante(tamanho, *copiado), SPLICE_F_MOVE);
+    if (lidos < 0) {
+      if (errno == EINTR) continue;
+      resultado = erroNaoSuportado(errno) ? TENTATIVA_NAO_SUPORTADA
+                                          : TENTATIVA_ERRO;
+      break;
+    }
+    if (lidos == 0) break;
+
+    // Esvazia o pipe no destino; o que entrou no pipe precisa sair
+    ssize_t pendente = lidos;
+    while (pendente > 0) {
+      loff_t off_out = *copiado;
+      ssize_t escritos = splice(tubo[0], NULL, out, &off_out, pendente,
+                                SPLICE_F_MOVE);
+      if (escritos < 0 && errno == EINTR) continue;
+      if (escritos <= 0) {
+        resultado = TENTATIVA_ERRO;
+        break;
+      }
+      pendente -= escritos;
+      *copiado += escritos;
+    }
+    if (resultado != TENTATIVA_OK) break;
+  }
+
+  close(tubo[0]);
+  close(tubo[1]);
+  return resultado;
+}
+
+/***************************************************************************
+ * Cópia de uma faixa [*copiado, fim) por copy_file_range ou, sem ele ou
+ * com CRC, por pread/pwrite com buffer próprio. *copiado avança junto;
+ * termina antes de 'fim' se o arquivo encolher durante a cópia.
+ ***************************************************************************/
+ResultadoTentativa copiarFaixa(int in, int out, off_t* copiado, off_t fim,
+                               uint32_t* crc) {
+  while (crc == NULL && *copiado < fim) {
+    loff_t off_in = *copiado, off_out = *copiado;
+    ssize_t n = copy_file_range(in, &off_in, out, &off_out,
+                                restante(fim, *copiado), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && !erroNaoSuportado(errno)) return TENTATIVA_ERRO;
+    if (n == 0) return TENTATIVA_OK;  // arquivo encolheu durante a cópia
+    if (n < 0) break;                 // copy_file_range indisponível
+    *copiado += n;
+  }
+
+  char* buffer = bufferFaixa(0);
+  while (*copiado < fim) {
+    size_t pedir = restante(fim, *copiado);
+    if (pedir > TAMANHO_BUFFER_FAIXA) pedir = TAMANHO_BUFFER_FAIXA;
+    ssize_t lidos = pread(in, buffer, pedir, *copiado);
+    if (lidos < 0 && errno == EINTR) continue;
+    if (lidos < 0) return TENTATIVA_ERRO;
+    if (lidos == 0) return TENTATIVA_OK;
+    for (ssize_t feito = 0; feito < lidos;) {
+      ssize_t escritos = pwrite(out, &buffer[feito], lidos - feito,
+                                *copiado + feito);
+      if (escritos < 0 && errno == EINTR) continue;
+      if (escritos <= 0) return TENTATIVA_ERRO;
+      feito += escritos;
+    }
+    // O CRC sai do buffer ainda no cache da CPU: sem segunda leitura
+    if (crc != NULL) *crc = crc32c(*crc, buffer, lidos);
+    *copiado += lidos;
+  }
+  return TENTATIVA_OK;
+}
+
+// Leitura e escrita pelo processo: o caminho comum quando há CRC
+ResultadoTentativa copiarComLeitura(int in, int out, off_t tamanho,
+                                    off_t* copiado, uint32_t* crc) {
+  return copiarFaixa(in, out, copiado, tamanho, crc);
+}
+
+/***************************************************************************
+ * Cópia esparsa: percorre as regiões com dados (SEEK_DATA/SEEK_HOLE) e
+ * copia só elas; os saltos deixam buracos no destino e o ftruncate final
+ * recria o buraco do fim do arquivo. No CRC, os buracos contam como zeros.
+ ***************************************************************************/
+ResultadoTentativa copiarEsparso(int in, int out, off_t tamanho,
+                                 off_t* copiado, uint32_t* crc) {
+  while (*copiado < tamanho) {
+    off_t dados = lseek(in, *copiado, SEEK_DATA);
+    if (dados < 0) {
+      if (errno == ENXIO) break;  // só buraco daqui até o fim
+      return erroNaoSuportado(errno) ? TENTATIVA_NAO_SUPORTADA
+                                     : TENTATIVA_ERRO;
+    }
+    if (dados >= tamanho) break;
+    off_t buraco = lseek(in, dados, SEEK_HOLE);
+    if (buraco < 0) return TENTATIVA_ERRO;
+    if (buraco > tamanho) buraco = tamanho;
+
+    if (crc != NULL) *crc = crc32cZeros(*crc, dados - *copiado);
+    *copiado = dados;
+    ResultadoTentativa r = copiarFaixa(in, out, copiado, buraco, crc);
+    if (r != TENTATIVA_OK) return r;
+  }
+  if (ftruncate(out, tamanho) != 0) return TENTATIVA_ERRO;
+  if (crc != NULL) *crc = crc32cZeros(*crc, tamanho - *copiado);
+  *copiado = tamanho;
+  return TENTATIVA_OK;
+}
+
+/***************************************************************************
+ * Classe: PoolBuffersAlinhados
+ * Buffers alinhados para O_DIRECT, reaproveitados entre arquivos e threads
+ * em vez de um posix_memalign/free por cópia.
+ ***************************************************************************/
+class PoolBuffersAlinhados {
+ public:
+  PoolBuffersAlinhados() {}
+  ~PoolBuffersAlinhados() {
+    for (size_t i = 0; i < livres_.size(); i++) free(livres_[i]);
+  }
+
+  void* obter() {
+    {
+      std::lock_guard<std::mutex> trava(mutex_);
+      if (!livres_.empty()) {
+        void* buffer = livres_.back();
+        livres_.pop_back();
+        return buffer;
+      }
+    }
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, ALINHAMENTO_DIRETO,
+                       TAMANHO_BUFFER_DIRETO) != 0) {
+      return NULL;
+    }
+    return buffer;
+  }
+
+  void devolver(void* buffer) {
+    std::lock_guard<std::mutex> trava(mutex_);
+    if (livres_.size() < MAX_BUFFERS_LIVRES) livres_.push_back(buffer);
+    else free(buffer);
+  }
+
+ private:
+  PoolBuffersAlinhados(const PoolBuffersAlinhados&);
+  PoolBuffersAlinhados& operator=(const PoolBuffersAlinhados&);
+
+  std::mutex mutex_;
+  std::vector<void*> livres_;
+};
+
+PoolBuffersAlinhados pool_buffers;
+
+// Buffer emprestado do pool durante uma cópia
+struct BufferDireto {
+  BufferDireto() : dados(static_cast<char*>(pool_buffers.obter())) {}
+  ~BufferDireto() {
+    if (dados != NULL) pool_buffers.devolver(dados);
+  }
+  char* dados;
+};
+
+/***************************************************************************
+ * Cópia direta: a parte alinhada do arquivo passa por O_DIRECT (ativado
+ * com fcntl nos próprios descritores), sem tocar no cache de páginas; a
+ * cauda desalinhada segue pelo caminho com cache.
+ ***************************************************************************/
+ResultadoTentativa copiarDireto(int in, int out, off_t tamanho,
+                                off_t* copiado, uint32_t* crc) {
+  const off_t alinhamento = static_cast<off_t>(ALINHAMENTO_DIRETO);
+  if (*copiado % alinhamento != 0) return TENTATIVA_NAO_SUPORTADA;
+  BufferDireto buffer;
+  if (buffer.dados == NULL) return TENTATIVA_NAO_SUPORTADA;
+
+  int flags_in = fcntl(in, F_GETFL);
+  int flags_out = fcntl(out, F_GETFL);
+  if (flags_in < 0 || flags_out < 0 ||
+      fcntl(in, F_SETFL, flags_in | O_DIRECT) != 0) {
+    return TENTATIVA_NAO_SUPORTADA;
+  }
+  if (fcntl(out, F_SETFL, flags_out | O_DIRECT) != 0) {
+    fcntl(in, F_SETFL, flags_in);
+    return TENTATIVA_NAO_SUPORTADA;
+  }
+
+  const off_t inicio = *copiado;
+  const off_t fim_alinhado = tamanho - tamanho % alinhamento;
+  ResultadoTentativa resultado = TENTATIVA_OK;
+  while (*copiado < fim_alinhado) {
+    size_t pedir = restante(fim_alinhado, *copiado);
+    if (pedir > TAMANHO_BUFFER_DIRETO) pedir = TAMANHO_BUFFER_DIRETO;
+    ssize_t lidos = pread(in, buffer.dados, pedir, *copiado);
+    if (lidos < 0 && errno == EINTR) continue;
+    // Leitura curta: o arquivo encolheu; o resto vai pela cauda
+    size_t alinhados = lidos > 0 ? static_cast<size_t>(lidos) -
+                                       static_cast<size_t>(lidos) %
+                                           ALINHAMENTO_DIRETO
+                                 : 0;
+    ssize_t escritos = alinhados > 0
+        ? pwrite(out, buffer.dados, alinhados, *copiado) : 0;
+    if (lidos < 0 || escritos < 0) {
+      // EINVAL no primeiro bloco: fs sem suporte real a O_DIRECT
+      resultado = (erroNaoSuportado(errno) && *copiado == inicio)
+                      ? TENTATIVA_NAO_SUPORTADA : TENTATIVA_ERRO;
+      break;
+    }
+    if (alinhados == 0 || static_cast<size_t>(escritos) != alinhados) break;
+    if (crc != NULL) *crc = crc32c(*crc, buffer.dados, alinhados);
+    *copiado += escritos;
+  }
+
+  fcntl(in, F_SETFL, flags_in);
+  fcntl(out, F_SETFL, flags_out);
+  if (resultado != TENTATIVA_OK) return resultado;
+
+  return copiarFaixa(in, out, copiado, tamanho, crc);
+}
+
+/***************************************************************************
+ * Cópia em blocos paralelos: cada tarefa copia uma faixa com offsets
+ * explícitos e depois se reenvia para a próxima faixa livre. Só há uma
+ * tarefa do arquivo por thread na fila do pool, então as outras entradas
+ * continuam sendo atendidas enquanto um arquivo enorme é copiado.
+ ***************************************************************************/
+struct CopiaEmBlocos {
+  int in;
+  int out;
+  off_t tamanho;
+  off_t bloco;
+  std::atomic<off_t> proximo;
+  std::atomic<bool> falhou;
+  std::atomic<int> erro;
+  off_t inicio;
+  std::vector<off_t>* copiados;  // bytes copiados de cada bloco
+  std::vector<uint32_t>* crcs;  // um por bloco, unidos no fim (ou NULL)
+};
+
+void copiarProximoBloco(CopiaEmBlocos* copia, GrupoTarefas* grupo) {
+  off_t inicio = copia->proximo.fetch_add(copia->bloco);
+  if (inicio >= copia->tamanho || copia->falhou) return;
+  off_t fim = std::min(copia->tamanho, inicio + copia->bloco);
+  const size_t indice = (inicio - copia->inicio) / copia->bloco;
+  uint32_t* crc = NULL;
+  if (copia->crcs != NULL) crc = &(*copia->crcs)[indice];
+  off_t copiado = inicio;
+  if (copiarFaixa(copia->in, copia->out, &copiado, fim, crc) !=
+      TENTATIVA_OK) {
+    copia->erro = errno;
+    copia->falhou = true;
+    return;
+  }
+  (*copia->copiados)[indice] = copiado - inicio;  // menos: origem encolheu
+  grupo->enviar([copia, grupo] { copiarProximoBloco(copia, grupo); });
+}
+
+ResultadoTentativa copiarEmParalelo(int in, int out, off_t tamanho,
+                                    off_t* copiado, uint32_t* crc,
+                                    PoolThreads* pool,
+                                    const OpcoesCopia& opcoes) {
+  // Tamanho final desde já: os blocos podem terminar em qualquer ordem
+  if (ftruncate(out, tamanho) != 0) return TENTATIVA_ERRO;
+
+  CopiaEmBlocos copia;
+  copia.in = in;
+  copia.out = out;
+  copia.tamanho = tamanho;
+  copia.bloco = std::max<off_t>(static_cast<off_t>(opcoes.bloco_paralelo),
+                                1 << 20);
+  copia.proximo = *copiado;
+  copia.falhou = false;
+  copia.erro = 0;
+  copia.inicio = *copiado;
+  const size_t blocos = (tamanho - *copiado + copia.bloco - 1) / copia.bloco;
+  std::vector<off_t> copiados(blocos);
+  copia.copiados = &copiados;
+  std::vector<uint32_t> crcs;
+  if (crc != NULL) {
+    crcs.resize(blocos);
+    copia.crcs = &crcs;
+  } else {
+    copia.crcs = NULL;
+  }
+  {
+    GrupoTarefas grupo(pool);
+    for (unsigned i = 0; i < pool->tamanho(); i++) {
+      grupo.enviar([&copia, &grupo] { copiarProximoBloco(&copia, &grupo); });
+    }
+    grupo.esperar();  // ajuda o pool em vez de bloquear uma thread
+  }
+  if (copia.falhou) {
+    errno = copia.erro;
+    return TENTATIVA_ERRO;
+  }
+  // Como no caminho serial, a cópia termina no primeiro bloco curto (a
+  // origem encolheu): o que o ftruncate reservou depois dele sai, e o CRC
+  // cobre só os bytes lidos
+  off_t fim = copia.inicio;
+  for (size_t b = 0; b < blocos; b++) {
+    if (crc != NULL) *crc = crc32cConcatenar(*crc, crcs[b], copiados[b]);
+    fim += copiados[b];
+    off_t inicio = copia.inicio + static_cast<off_t>(b) * copia.bloco;
+    if (copiados[b] < std::min(copia.bloco, tamanho - inicio)) break;
+  }
+  if (fim < tamanho && ftruncate(out, fim) != 0) return TENTATIVA_ERRO;
+  *copiado = fim;
+  return TENTATIVA_OK;
+}
+
+typedef ResultadoTentativa (*Tentativa)(int, int, off_t, off_t*,
+                                         uint32_t*);
+
+/***************************************************************************
+ * Cache de páginas: a cópia não deve expulsar o conjunto quente da máquina
+ * nem deixar gigabytes sujos para o fim. O destino é pré-alocado, a origem
+ * é lida como sequencial e, a cada bloco, o writeback começa cedo; o bloco
+ * anterior já gravado sai do cache nos dois arquivos.
+ ***************************************************************************/
+void prepararCache(int in, int out, off_t tamanho, bool esparso,
+                   const OpcoesCopia& opcoes) {
+  if (opcoes.pre_alocar && !esparso && tamanho > 0) {
+    // KEEP_SIZE: se a origem encolher, o tamanho final continua certo
+    fallocate(out, FALLOC_FL_KEEP_SIZE, 0, tamanho);
+  }
+  if (opcoes.fadvise) posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void liberarCache(int in, int out, off_t inicio, off_t fim,
+                  const OpcoesCopia& opcoes) {
+  if (!opcoes.fadvise || fim <= inicio) return;
+  // Páginas sujas não saem com DONTNEED: espera o writeback do trecho
+  sync_file_range(out, inicio, fim - inicio,
+                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                      SYNC_FILE_RANGE_WAIT_AFTER);
+  posix_fadvise(out, inicio, fim - inicio, POSIX_FADV_DONTNEED);
+  posix_fadvise(in, inicio, fim - inicio, POSIX_FADV_DONTNEED);
+}
+
+// Executa a tentativa em blocos de 'bloco_writeback' bytes (ou de uma vez,
+// com 0), iniciando o writeback de cada bloco assim que é copiado
+ResultadoTentativa copiarEmBlocos(Tentativa tentativa, int in, int out,
+                                  off_t tamanho, off_t* copiado,
+                                  uint32_t* crc, const OpcoesCopia& opcoes) {
+  off_t bloco = static_cast<off_t>(opcoes.bloco_writeback);
+  off_t anterior = *copiado;  // início do trecho ainda no cache
+  while (*copiado < tamanho) {
+    off_t inicio = *copiado;
+    off_t fim = (bloco > 0 && tamanho - inicio > bloco) ? inicio + bloco
+                                                        : tamanho;
+    ResultadoTentativa r = tentativa(in, out, fim, copiado, crc);
+    if (r != TENTATIVA_OK) return r;
+    if (bloco == 0) break;
+    if (*copiado > inicio) {
+      sync_file_range(out, inicio, *copiado - inicio,
+                      SYNC_FILE_RANGE_WRITE);
+    }
+    liberarCache(in, out, anterior, inicio, opcoes);
+    anterior = inicio;
+    if (*copiado < fim) break;  // arquivo encolheu durante a cópia
+  }
+  liberarCache(in, out, anterior, *copiado, opcoes);
+  return TENTATIVA_OK;
+}
+
+/***************************************************************************
+ * Fallback: copia pelo buffer de usuário do iostream
+ ***************************************************************************/
+bool copiarComStream(const std::string& origem, const std::string& destino,
+                     uint32_t* crc) {
+  std::ifstream src(origem, std::ios::binary);
+  if (!src.is_open()) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    return false;
+  }
+
+  std::ofstream dst(destino, std::ios::binary);
+  if (!dst.is_open()) {
+    std::cerr << "[ERRO] Não foi possível criar destino: "
+              << destino << " (errno=" << errno << ")\n";
+    return false;
+  }
+
+  if (crc == NULL) {
+    if (src.peek() != std::ifstream::traits_type::eof()) dst << src.rdbuf();
+    return static_cast<bool>(dst);
+  }
+  std::vector<char> buffer(TAMANHO_BUFFER_FAIXA);
+  while (src.read(&buffer[0], buffer.size()) || src.gcount() > 0) {
+    *crc = crc32c(*crc, &buffer[0], static_cast<size_t>(src.gcount()));
+    if (!dst.write(&buffer[0], src.gcount())) return false;
+  }
+  return static_cast<bool>(dst);
+}
+
+}  // namespace
+
+/***************************************************************************
+ * Função auxiliar: Nome do método de cópia para o Backup.log
+ ***************************************************************************/
+const char* nomeMetodoCopia(MetodoCopia metodo) {
+  switch (metodo) {
+    case COPIA_CLONE:           return "reflink";
+    case COPIA_COPY_FILE_RANGE: return "copy_file_range";
+    case COPIA_SENDFILE:        return "sendfile";
+    case COPIA_SPLICE:          return "splice";
+    case COPIA_STREAM:          return "iostream";
+    case COPIA_IO_URING:        return "io_uring";
+    case COPIA_ESPARSA:         return "sparse";
+    case COPIA_DIRETA:          return "o_direct";
+    case COPIA_PARALELA:        return "parallel";
+    case COPIA_LEITURA_ESCRITA: return "pread_pwrite";
+    case COPIA_DELTA:           return "delta";
+    case COPIA_FRAGMENTOS:      return "fragmentos";
+    case COPIA_PACOTE:          return "pacote";
+    case COPIA_COMPRIMIDA:      return "comprimida";
+    default:                    return "falhou";
+  }
+}
+
+bool pareceEsparso(uint64_t tamanho, uint64_t blocos) {
+  return blocos * 512 + 4096 <= tamanho;
+}
+
+/***************************************************************************
+ * Funções auxiliares: CRC e comparação de conteúdo sem copiar
+ ***************************************************************************/
+bool calcularCrcArquivo(const std::string& caminho, uint32_t* crc) {
+  int fd = open(caminho.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  *crc = 0;
+  bool ok = fstat(fd, &st) == 0 &&
+            calcularCrc(fd, st.st_size, crc) == TENTATIVA_OK;
+  close(fd);
+  return ok;
+}
+
+bool conteudoIgual(const std::string& a, const std::string& b,
+                   uint32_t* crc_a) {
+  int fd_a = open(a.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_a < 0) return false;
+  int fd_b = open(b.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_b < 0) {
+    close(fd_a);
+    return false;
+  }
+  char* buffer_a = bufferFaixa(0);
+  char* buffer_b = bufferFaixa(1);
+  *crc_a = 0;
+  bool igual = true;
+  for (off_t offset = 0; igual;) {
+    ssize_t lidos = pread(fd_a, buffer_a, TAMANHO_BUFFER_FAIXA, offset);
+    if (lidos < 0 && errno == EINTR) continue;
+    if (lidos <= 0) {
+      // Fim de 'a': 'b' também precisa ter acabado
+      char extra;
+      igual = lidos == 0 && pread(fd_b, &extra, 1, offset) == 0;
+      break;
+    }
+    ssize_t feito = 0;
+    while (feito < lidos) {
+      ssize_t n = pread(fd_b, &buffer_b[feito], lidos - feito,
+                        offset + feito);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      feito += n;
+    }
+    igual = feito == lidos && memcmp(buffer_a, buffer_b, lidos) == 0;
+    *crc_a = crc32c(*crc_a, buffer_a, lidos);
+    offset += lidos;
+  }
+  close(fd_a);
+  close(fd_b);
+  return igual;
+}
+
+/***************************************************************************
+ * Funções auxiliares: Nome temporário de um destino ("dir/.nome.parcial")
+ ***************************************************************************/
+std::string caminhoTemporario(const std::string& destino) {
+  BufferCaminho temporario;
+  caminhoTemporario(destino, &temporario);
+  return std::string(temporario.c_str(), temporario.size());
+}
+
+void caminhoTemporario(VisaoTexto destino, BufferCaminho* temporario) {
+  size_t barra = destino.rfind('/');
+  size_t inicio = (barra == VisaoTexto::npos) ? 0 : barra + 1;
+  temporario->limpar();
+  temporario->acrescentar(destino.substr(0, inicio));
+  temporario->acrescentar(".");
+  temporario->acrescentar(destino.substr(inicio));
+  temporario->acrescentar(SUFIXO_TEMPORARIO);
+}
+
+bool ehCaminhoTemporario(const std::string& caminho) {
+  size_t barra = caminho.find_last_of('/');
+  size_t inicio = (barra == std::string::npos) ? 0 : barra + 1;
+  const size_t sufixo = strlen(SUFIXO_TEMPORARIO);
+  return caminho.size() > inicio + 1 + sufixo && caminho[inicio] == '.' &&
+         caminho.compare(caminho.size() - sufixo, sufixo,
+                         SUFIXO_TEMPORARIO) == 0;
+}
+
+/***************************************************************************
+ * Função auxiliar: Cria o diretório pai do arquivo de destino, e os
+ * intermediários que faltarem (entradas vindas de diretórios expandidos)
+ ***************************************************************************/
+void criarDiretorioPai(VisaoTexto destino) {
+  size_t pos = destino.rfind('/');
+  if (pos == VisaoTexto::npos || pos == 0) return;
+  BufferCaminho dir;
+  dir.acrescentar(destino.substr(0, pos));
+  if (mkdir(dir.c_str(), 0777) == 0 || errno != ENOENT) return;
+  criarDiretorioPai(dir.visao());
+  mkdir(dir.c_str(), 0777);
+}
+
+namespace {
+
+// Copia o conteúdo da origem para 'destino' (aqui, o nome temporário)
+MetodoCopia copiarConteudo(const std::string& origem, const char* destino,
+                           const OpcoesCopia& opcoes, PoolThreads* pool,
+                           uint32_t* crc) {
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    return COPIA_FALHOU;
+  }
+
+  struct stat st;
+  if (fstat(in, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(in);
+    return copiarComStream(origem, destino, crc) ? COPIA_STREAM
+                                                 : COPIA_FALHOU;
+  }
+
+  int out = open(destino, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (out < 0) {
+    std::cerr << "[ERRO] Não foi possível criar destino: "
+              << destino << " (errno=" << errno << ")\n";
+    close(in);
+    return COPIA_FALHOU;
+  }
+
+  // Caminhos a tentar, em ordem. O clone já preserva os buracos e não
+  // passa pelo cache; um arquivo esparso tem os buracos pulados e um
+  // grande vai em blocos paralelos (limite_paralelo) ou por O_DIRECT
+  // (limite_direto) antes dos caminhos comuns. Com CRC, o caminho comum é
+  // o pread/pwrite, que calcula o CRC sobre o próprio buffer da cópia.
+  Tentativa tentativas[5];
+  MetodoCopia metodos[5];
+  size_t n = 0;
+  const uint64_t tamanho = static_cast<uint64_t>(st.st_size);
+  bool esparso = pareceEsparso(st.st_size, st.st_blocks);
+  bool direto = opcoes.limite_direto > 0 && tamanho >= opcoes.limite_direto;
+  bool em_blocos = pool != NULL && opcoes.limite_paralelo > 0 &&
+                   tamanho >= opcoes.limite_paralelo;
+  if (opcoes.clonar) {
+    tentativas[n] = clonarArquivo;
+    metodos[n++] = COPIA_CLONE;
+  }
+  if (esparso) {
+    tentativas[n] = copiarEsparso;
+    metodos[n++] = COPIA_ESPARSA;
+  } else if (em_blocos) {
+    tentativas[n] = NULL;  // precisa do pool: tratada no laço
+    metodos[n++] = COPIA_PARALELA;
+  } else if (direto) {
+    tentativas[n] = copiarDireto;
+    metodos[n++] = COPIA_DIRETA;
+  }
+  if (crc != NULL) {
+    tentativas[n] = copiarComLeitura;
+    metodos[n++] = COPIA_LEITURA_ESCRITA;
+  } else {
+    tentativas[n] = copiarComCopyFileRange;
+    metodos[n++] = COPIA_COPY_FILE_RANGE;
+    tentativas[n] = copiarComSendfile;
+    metodos[n++] = COPIA_SENDFILE;
+    tentativas[n] = copiarComSplice;
+    metodos[n++] = COPIA_SPLICE;
+  }
+
+  MetodoCopia metodo = COPIA_STREAM;
+  off_t copiado = 0;
+  int erro = 0;
+  bool cache_preparado = false;
+  for (size_t i = 0; i < n; i++) {
+    ResultadoTentativa r;
+    if (metodos[i] == COPIA_PARALELA) {
+      r = copiarEmParalelo(in, out, st.st_size, &copiado, crc, pool,
+                           opcoes);
+    } else if (metodos[i] == COPIA_CLONE || metodos[i] == COPIA_DIRETA) {
+      r = tentativas[i](in, out, st.st_size, &copiado, crc);
+    } else {
+      if (!cache_preparado) {
+        prepararCache(in, out, st.st_size, esparso, opcoes);
+        cache_preparado = true;
+      }
+      r = copiarEmBlocos(tentativas[i], in, out, st.st_size, &copiado, crc,
+                         opcoes);
+    }
+    if (r == TENTATIVA_NAO_SUPORTADA) continue;
+    metodo = (r == TENTATIVA_OK) ? metodos[i] : COPIA_FALHOU;
+    erro = errno;
+    break;
+  }
+
+  // O destino recebe o mtime da origem, base da comparação exata da
+  // próxima execução
+  const struct timespec tempos[2] = { st.st_atim, st.st_mtim };
+  if (metodo != COPIA_FALHOU && metodo != COPIA_STREAM) futimens(out, tempos);
+
+  close(in);
+  if (close(out) != 0 && metodo != COPIA_STREAM) {
+    metodo = COPIA_FALHOU;
+    erro = errno;
+  }
+
+  if (metodo == COPIA_FALHOU) {
+    std::cerr << "[ERRO] Falha ao copiar: " << origem
+              << " (errno=" << erro << ")\n";
+  } else if (metodo == COPIA_STREAM) {
+    if (crc != NULL) *crc = 0;
+    if (!copiarComStream(origem, destino, crc)) metodo = COPIA_FALHOU;
+    else utimensat(AT_FDCWD, destino, tempos, 0);
+  }
+  return metodo;
+}
+
+}  // namespace
+
+/***************************************************************************
+ * Função auxiliar: Copia o conteúdo de um arquivo de origem para destino.
+ * Os dados vão para um nome temporário no mesmo diretório, renomeado sobre
+ * o destino só depois da cópia completa: uma execução interrompida nunca
+ * deixa um destino pela metade.
+ ***************************************************************************/
+MetodoCopia copiarArquivo(const std::string& origem,
+                          const std::string& destino,
+                          const OpcoesCopia& opcoes, PoolThreads* pool,
+                          uint32_t* crc) {
+  assert(!origem.empty());
+  assert(!destino.empty());
+
+  criarDiretorioPai(destino);
+  BufferCaminho temporario;
+  caminhoTemporario(destino, &temporario);
+  if (crc != NULL) *crc = 0;
+  MetodoCopia metodo = copiarConteudo(origem, temporario.c_str(), opcoes,
+                                      pool, crc);
+  if (metodo == COPIA_FALHOU) {
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (opcoes.renomear && rename(temporario.c_str(), destino.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << destino << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  return metodo;
+}
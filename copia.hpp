@@ -0,0 +1,108 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef COPIA_HPP_
+#define COPIA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "caminho.hpp"  // NOLINT
+
+class PoolThreads;
+
+// Caminho efetivamente usado para copiar os dados de um arquivo
+enum MetodoCopia {
+  COPIA_FALHOU,
+  COPIA_CLONE,
+  COPIA_COPY_FILE_RANGE,
+  COPIA_SENDFILE,
+  COPIA_SPLICE,
+  COPIA_STREAM,
+  COPIA_IO_URING,
+  COPIA_ESPARSA,          // só as regiões com dados (SEEK_DATA/SEEK_HOLE)
+  COPIA_DIRETA,           // O_DIRECT, sem passar pelo cache de páginas
+  COPIA_PARALELA,         // blocos do mesmo arquivo em paralelo
+  COPIA_LEITURA_ESCRITA,  // pread/pwrite pelo processo (cópia com CRC)
+  COPIA_DELTA,            // só os blocos que mudaram (ver delta.hpp)
+  COPIA_FRAGMENTOS,       // receita + repositório (ver fragmentos.hpp)
+  COPIA_PACOTE,           // acrescentado a um pacote (ver pacotes.hpp)
+  COPIA_COMPRIMIDA        // blocos comprimidos (ver compressao.hpp)
+};
+
+// Ajustes do motor de cópia
+struct OpcoesCopia {
+  // Tenta clonar (reflink/CoW via FICLONE) antes de copiar os dados;
+  // só tem efeito quando origem e destino estão no mesmo btrfs/XFS.
+  bool clonar = false;
+
+  // Cache de páginas (para não atrapalhar a máquina durante o backup):
+  // fallocate do destino antes da cópia, FADV_SEQUENTIAL na origem e
+  // FADV_DONTNEED nos dois arquivos depois de cada bloco gravado, e
+  // sync_file_range a cada 'bloco_writeback' bytes (0 = arquivo inteiro).
+  bool pre_alocar = false;
+  bool fadvise = false;
+  size_t bloco_writeback = 0;
+
+  // Arquivos com ao menos 'limite_direto' bytes (0 = nunca) são copiados
+  // com O_DIRECT a partir de buffers alinhados; a cauda desalinhada usa o
+  // cache. Sistemas de arquivos sem O_DIRECT voltam aos caminhos comuns.
+  uint64_t limite_direto = 0;
+
+  // Arquivos com ao menos 'limite_paralelo' bytes (0 = nunca) são divididos
+  // em blocos de 'bloco_paralelo' bytes, copiados com offsets explícitos
+  // pelas threads do pool passado a copiarArquivo.
+  uint64_t limite_paralelo = 0;
+  size_t bloco_paralelo = 64 << 20;
+
+  // Arquivos com ao menos 'limite_delta' bytes (0 = nunca) cujo destino já
+  // existe são atualizados por copiarDelta, em blocos de 'bloco_delta'
+  // bytes: só o que mudou é escrito.
+  uint64_t limite_delta = 0;
+  size_t bloco_delta = 64 << 10;
+
+  // false: os dados ficam em caminhoTemporario(destino) e quem chamou
+  // renomeia depois (ex.: LoteDurabilidade, após um syncfs)
+  bool renomear = true;
+};
+
+// Copia origem para destino tentando primeiro os caminhos do kernel
+// (clone, copy_file_range, sendfile, splice) e, por último, o iostream.
+// Arquivos esparsos têm só as regiões com dados copiadas e os buracos
+// recriados no destino. O destino fica com os tempos de acesso e
+// modificação da origem. Com 'pool', arquivos grandes são copiados em
+// blocos paralelos e o destino só é finalizado depois do último bloco.
+// Os dados são escritos em caminhoTemporario(destino) e renomeados sobre
+// o destino ao final, então o destino nunca fica pela metade. Com 'crc',
+// o CRC32C do conteúdo é calculado durante a própria cópia, sobre os
+// buffers já lidos; os caminhos do kernel dão lugar ao pread/pwrite.
+MetodoCopia copiarArquivo(const std::string& origem,
+                          const std::string& destino,
+                          const OpcoesCopia& opcoes = OpcoesCopia(),
+                          PoolThreads* pool = NULL, uint32_t* crc = NULL);
+
+// CRC32C do conteúdo de um arquivo; false se ele não puder ser lido
+bool calcularCrcArquivo(const std::string& caminho, uint32_t* crc);
+
+// Compara dois arquivos byte a byte, calculando na mesma leitura o CRC32C
+// de 'a'; false se diferem ou se algum deles não pode ser lido
+bool conteudoIgual(const std::string& a, const std::string& b,
+                   uint32_t* crc_a);
+
+// Nome, no diretório do destino, em que a cópia é escrita antes de ser
+// renomeada; ehCaminhoTemporario reconhece esses nomes. A segunda forma
+// monta o nome num buffer reaproveitado, sem alocar.
+std::string caminhoTemporario(const std::string& destino);
+void caminhoTemporario(VisaoTexto destino, BufferCaminho* temporario);
+bool ehCaminhoTemporario(const std::string& caminho);
+
+// Verdadeiro quando o arquivo ocupa ao menos uma página a menos do que o
+// seu tamanho, isto é, provavelmente tem buracos ('blocos' de 512 bytes)
+bool pareceEsparso(uint64_t tamanho, uint64_t blocos);
+
+// Cria o diretório que conterá o arquivo de destino (e os que faltarem)
+void criarDiretorioPai(VisaoTexto destino);
+
+// Nome do método, no formato registrado em Backup.log
+const char* nomeMetodoCopia(MetodoCopia metodo);
+
+#endif  // COPIA_HPP_
@@ -0,0 +1,493 @@
+// Copyright 2025 Alex Batista Resende
+#include "copia_uring.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+namespace {
+
+// Buffer registrado de cada arquivo em voo
+const size_t TAMANHO_BUFFER_URING = 128 * 1024;
+
+// Operações codificadas no user_data de cada SQE (slot << 3 | operação)
+enum OperacaoUring {
+  OP_ABRIR_ORIGEM,
+  OP_ABRIR_DESTINO,
+  OP_LER,
+  OP_ESCREVER,
+  OP_FECHAR
+};
+
+int ioUringSetup(unsigned entradas, io_uring_params* p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entradas, p));
+}
+
+int ioUringEnter(int fd, unsigned submeter, unsigned minimo, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, submeter, minimo,
+                                  flags, NULL, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned n) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg,
+                                  n));
+}
+
+/***************************************************************************
+ * Classe: AnelUring
+ * Mapeia as filas de submissão e conclusão de um io_uring sem liburing.
+ ***************************************************************************/
+class AnelUring {
+ public:
+  AnelUring() {}
+  ~AnelUring() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, tamanho_sqes_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+      munmap(cq_ptr_, tamanho_cq_);
+    }
+    if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, tamanho_sq_);
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool iniciar(unsigned entradas) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd_ = ioUringSetup(entradas, &p);
+    if (fd_ < 0) return false;
+
+    tamanho_sq_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    tamanho_cq_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool mapa_unico = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (mapa_unico && tamanho_cq_ > tamanho_sq_) tamanho_sq_ = tamanho_cq_;
+
+    sq_ptr_ = mmap(NULL, tamanho_sq_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) return false;
+    cq_ptr_ = mapa_unico ? sq_ptr_
+                         : mmap(NULL, tamanho_cq_, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd_,
+                                IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) return false;
+
+    tamanho_sqes_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL, tamanho_sqes_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    entradas_sq_ = p.sq_entries;
+    cauda_local_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  // Verifica se o kernel implementa todas as operações do motor
+  bool suportaOperacoes(const unsigned* ops, size_t n) const {
+    const unsigned max_ops = 256;
+    std::vector<char> memoria(sizeof(io_uring_probe) +
+                              max_ops * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(&memoria[0]);
+    if (ioUringRegister(fd_, IORING_REGISTER_PROBE, probe, max_ops) < 0) {
+      return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (ops[i] > probe->last_op) return false;
+      if (!(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+  }
+
+  // Próxima SQE livre (zerada) ou NULL se a fila estiver cheia
+  io_uring_sqe* novaSqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (cauda_local_ - head >= entradas_sq_) return NULL;
+    unsigned idx = cauda_local_ & sq_mask_;
+    sq_array_[idx] = idx;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    cauda_local_++;
+    return sqe;
+  }
+
+  // Publica as SQEs preparadas e espera por pelo menos 'minimo' conclusões
+  int submeter(unsigned minimo) {
+    unsigned novas = cauda_local_ - *sq_tail_;
+    __atomic_store_n(sq_tail_, cauda_local_, __ATOMIC_RELEASE);
+    unsigned flags = minimo ? IORING_ENTER_GETEVENTS : 0;
+    int r;
+    do {
+      r = ioUringEnter(fd_, novas, minimo, flags);
+    } while (r < 0 && errno == EINTR);
+    return r;
+  }
+
+  bool proximaCqe(io_uring_cqe* saida) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;
+    *saida = cqes_[head & cq_mask_];
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  int fd() const { return fd_; }
+
+ private:
+  AnelUring(const AnelUring&);
+  AnelUring& operator=(const AnelUring&);
+
+  int fd_ = -1;
+  void* sq_ptr_ = MAP_FAILED;
+  void* cq_ptr_ = MAP_FAILED;
+  io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t tamanho_sq_ = 0, tamanho_cq_ = 0, tamanho_sqes_ = 0;
+  unsigned* sq_head_ = NULL;
+  unsigned* sq_tail_ = NULL;
+  unsigned* sq_array_ = NULL;
+  unsigned sq_mask_ = 0, entradas_sq_ = 0, cauda_local_ = 0;
+  unsigned* cq_head_ = NULL;
+  unsigned* cq_tail_ = NULL;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = NULL;
+};
+
+// Copia atime/mtime da origem para o destino, como em copiarArquivo
+void preservarTempos(int fd_origem, int fd_destino) {
+  struct stat st;
+  if (fstat(fd_origem, &st) != 0) return;
+  const struct timespec tempos[2] = { st.st_atim, st.st_mtim };
+  futimens(fd_destino, tempos);
+}
+
+// Estado de um arquivo em voo
+struct SlotUring {
+  size_t tarefa = 0;
+  bool ativo = false;
+  bool falhou = false;
+  int fd_origem = -1, fd_destino = -1;
+  off_t offset = 0;
+  unsigned lidos = 0, escritos = 0;
+  int fechamentos_pendentes = 0;
+};
+
+/***************************************************************************
+ * Classe: MotorUring
+ * Máquina de estados abrir → (ler → escrever)* → fechar para cada slot.
+ ***************************************************************************/
+class MotorUring {
+ public:
+  MotorUring(AnelUring* anel, std::vector<TarefaCopia>* tarefas,
+             unsigned profundidade)
+      : anel_(anel), tarefas_(tarefas), slots_(profundidade) {}
+
+  ~MotorUring() {
+    if (arquivos_registrados_) {
+      ioUringRegister(anel_->fd(), IORING_UNREGISTER_FILES, NULL, 0);
+    }
+    if (buffers_registrados_) {
+      ioUringRegister(anel_->fd(), IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    free(memoria_);
+  }
+
+  bool preparar() {
+    size_t n = slots_.size();
+    if (posix_memalign(&memoria_, 4096, n * TAMANHO_BUFFER_URING) != 0) {
+      memoria_ = NULL;
+      return false;
+    }
+
+    // Buffers e arquivos registrados são otimizações: sem eles (limite de
+    // memlock, kernel antigo) o motor usa READ/WRITE e fds comuns.
+    std::vector<iovec> iov(n);
+    for (size_t i = 0; i < n; i++) {
+      iov[i].iov_base = buffer(i);
+      iov[i].iov_len = TAMANHO_BUFFER_URING;
+    }
+    buffers_registrados_ = ioUringRegister(anel_->fd(),
+                                           IORING_REGISTER_BUFFERS,
+                                           &iov[0], n) == 0;
+
+    std::vector<int> vazios(2 * n, -1);
+    arquivos_registrados_ = ioUringRegister(anel_->fd(),
+                                            IORING_REGISTER_FILES,
+                                            &vazios[0], 2 * n) == 0;
+    return true;
+  }
+
+  void executar() {
+    size_t proxima = 0, ativos = 0;
+    while (proxima < tarefas_->size() || ativos > 0) {
+      for (size_t s = 0; s < slots_.size() && proxima < tarefas_->size();
+           s++) {
+        if (slots_[s].ativo) continue;
+        iniciar(s, proxima++);
+        ativos++;
+      }
+
+      if (anel_->submeter(1) < 0) {
+        std::cerr << "[ERRO] io_uring_enter falhou (errno=" << errno
+                  << ")\n";
+        abortar();
+        return;
+      }
+
+      io_uring_cqe cqe;
+      while (anel_->proximaCqe(&cqe)) {
+        if (tratar(cqe)) ativos--;
+      }
+    }
+  }
+
+ private:
+  char* buffer(size_t slot) {
+    return static_cast<char*>(memoria_) + slot * TAMANHO_BUFFER_URING;
+  }
+
+  io_uring_sqe* sqe(size_t slot, OperacaoUring op) {
+    io_uring_sqe* s = anel_->novaSqe();
+    assert(s != NULL);  // no máximo duas operações em voo por slot
+    s->user_data = (static_cast<uint64_t>(slot) << 3) | op;
+    return s;
+  }
+
+  void iniciar(size_t slot, size_t tarefa) {
+    SlotUring& s = slots_[slot];
+    s = SlotUring();
+    s.tarefa = tarefa;
+    s.ativo = true;
+    const TarefaCopia& t = (*tarefas_)[tarefa];
+    criarDiretorioPai(t.destino);
+    abrir(slot, OP_ABRIR_ORIGEM, t.origem, O_RDONLY | O_CLOEXEC);
+  }
+
+  void abrir(size_t slot, OperacaoUring op, const std::string& caminho,
+             int flags) {
+    io_uring_sqe* s = sqe(slot, op);
+    s->opcode = IORING_OP_OPENAT;
+    s->fd = AT_FDCWD;
+    s->addr = reinterpret_cast<uint64_t>(caminho.c_str());
+    s->open_flags = flags;
+    s->len = 0666;
+  }
+
+  // Índice do arquivo no conjunto registrado, ou o próprio fd
+  int alvo(size_t slot, bool destino, io_uring_sqe* s) {
+    if (!arquivos_registrados_) {
+      return destino ? slots_[slot].fd_destino : slots_[slot].fd_origem;
+    }
+    s->flags |= IOSQE_FIXED_FILE;
+    return static_cast<int>(2 * slot + (destino ? 1 : 0));
+  }
+
+  void registrarArquivo(size_t slot, bool destino, int fd) {
+    if (!arquivos_registrados_) return;
+    io_uring_files_update atualizacao;
+    memset(&atualizacao, 0, sizeof(atualizacao));
+    atualizacao.offset = static_cast<unsigned>(2 * slot + (destino ? 1 : 0));
+    atualizacao.fds = reinterpret_cast<uint64_t>(&fd);
+    ioUringRegister(anel_->fd(), IORING_REGISTER_FILES_UPDATE,
+                    &atualizacao, 1);
+  }
+
+  void ler(size_t slot) {
+    SlotUring& st = slots_[slot];
+    io_uring_sqe* s = sqe(slot, OP_LER);
+    s->opcode = buffers_registrados_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    s->fd = alvo(slot, false, s);
+    s->addr = reinterpret_cast<uint64_t>(buffer(slot));
+    s->len = TAMANHO_BUFFER_URING;
+    s->off = st.offset;
+    s->buf_index = static_cast<uint16_t>(slot);
+  }
+
+  void escrever(size_t slot) {
+    SlotUring& st = slots_[slot];
+    io_uring_sqe* s = sqe(slot, OP_ESCREVER);
+    s->opcode = buffers_registrados_ ? IORING_OP_WRITE_FIXED
+                                     : IORING_OP_WRITE;
+    s->fd = alvo(slot, true, s);
+    s->addr = reinterpret_cast<uint64_t>(buffer(slot) + st.escritos);
+    s->len = st.lidos - st.escritos;
+    s->off = st.offset + st.escritos;
+    s->buf_index = static_cast<uint16_t>(slot);
+  }
+
+  void fechar(size_t slot) {
+    SlotUring& st = slots_[slot];
+    if (!st.falhou && st.fd_origem >= 0 && st.fd_destino >= 0) {
+      preservarTempos(st.fd_origem, st.fd_destino);
+    }
+    int fds[2] = { st.fd_origem, st.fd_destino };
+    for (int i = 0; i < 2; i++) {
+      if (fds[i] < 0) continue;
+      registrarArquivo(slot, i == 1, -1);
+      io_uring_sqe* s = sqe(slot, OP_FECHAR);
+      s->opcode = IORING_OP_CLOSE;
+      s->fd = fds[i];
+      st.fechamentos_pendentes++;
+    }
+    st.fd_origem = st.fd_destino = -1;
+  }
+
+  // Encerra o slot; retorna true (para a contagem de ativos)
+  bool concluir(size_t slot) {
+    SlotUring& st = slots_[slot];
+    TarefaCopia& t = (*tarefas_)[st.tarefa];
+    t.metodo = st.falhou ? COPIA_FALHOU : COPIA_IO_URING;
+    st.ativo = false;
+    return true;
+  }
+
+  void falhar(size_t slot, int erro) {
+    SlotUring& st = slots_[slot];
+    if (!st.falhou) {
+      std::cerr << "[ERRO] Falha ao copiar: "
+                << (*tarefas_)[st.tarefa].origem
+                << " (errno=" << erro << ")\n";
+    }
+    st.falhou = true;
+  }
+
+  // Trata uma conclusão; retorna true quando o slot terminou
+  bool tratar(const io_uring_cqe& cqe) {
+    size_t slot = static_cast<size_t>(cqe.user_data >> 3);
+    OperacaoUring op = static_cast<OperacaoUring>(cqe.user_data & 7);
+    SlotUring& st = slots_[slot];
+
+    switch (op) {
+      case OP_ABRIR_ORIGEM:
+        if (cqe.res < 0) {
+          falhar(slot, -cqe.res);
+          return concluir(slot);
+        }
+        st.fd_origem = cqe.res;
+        registrarArquivo(slot, false, st.fd_origem);
+        abrir(slot, OP_ABRIR_DESTINO, (*tarefas_)[st.tarefa].destino,
+              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC);
+        return false;
+
+      case OP_ABRIR_DESTINO:
+        if (cqe.res < 0) {
+          falhar(slot, -cqe.res);
+          fechar(slot);
+          return false;
+        }
+        st.fd_destino = cqe.res;
+        registrarArquivo(slot, true, st.fd_destino);
+        ler(slot);
+        return false;
+
+      case OP_LER:
+        if (cqe.res <= 0) {
+          if (cqe.res < 0) falhar(slot, -cqe.res);
+          fechar(slot);
+          return false;
+        }
+        st.lidos = static_cast<unsigned>(cqe.res);
+        st.escritos = 0;
+        if ((*tarefas_)[st.tarefa].calcular_crc) {
+          // As leituras de um slot são sequenciais: o CRC segue o offset
+          TarefaCopia& t = (*tarefas_)[st.tarefa];
+          t.crc = crc32c(t.crc, buffer(slot), st.lidos);
+        }
+        escrever(slot);
+        return false;
+
+      case OP_ESCREVER:
+        if (cqe.res <= 0) {
+          falhar(slot, cqe.res < 0 ? -cqe.res : EIO);
+          fechar(slot);
+          return false;
+        }
+        st.escritos += static_cast<unsigned>(cqe.res);
+        if (st.escritos < st.lidos) {
+          escrever(slot);
+        } else {
+          st.offset += st.lidos;
+          ler(slot);
+        }
+        return false;
+
+      case OP_FECHAR:
+        if (cqe.res < 0) falhar(slot, -cqe.res);
+        if (--st.fechamentos_pendentes > 0) return false;
+        return concluir(slot);
+    }
+    return false;
+  }
+
+  // io_uring_enter falhou de vez: fecha tudo de forma síncrona
+  void abortar() {
+    for (size_t s = 0; s < slots_.size(); s++) {
+      SlotUring& st = slots_[s];
+      if (!st.ativo) continue;
+      if (st.fd_origem >= 0) close(st.fd_origem);
+      if (st.fd_destino >= 0) close(st.fd_destino);
+      st.falhou = true;
+      concluir(s);
+    }
+  }
+
+  AnelUring* anel_;
+  std::vector<TarefaCopia>* tarefas_;
+  std::vector<SlotUring> slots_;
+  void* memoria_ = NULL;
+  bool buffers_registrados_ = false;
+  bool arquivos_registrados_ = false;
+};
+
+}  // namespace
+
+/***************************************************************************
+ * Função: copiarComIoUring
+ ***************************************************************************/
+bool copiarComIoUring(std::vector<TarefaCopia>* tarefas,
+                      unsigned profundidade) {
+  assert(tarefas != NULL);
+  if (tarefas->empty()) return true;
+  if (profundidade == 0) profundidade = 1;
+  if (profundidade > tarefas->size()) {
+    profundidade = static_cast<unsigned>(tarefas->size());
+  }
+
+  // Cada slot tem no máximo duas operações em voo (os dois fechamentos)
+  AnelUring anel;
+  if (!anel.iniciar(2 * profundidade)) return false;
+
+  static const unsigned necessarias[] = {
+    IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_READ, IORING_OP_WRITE
+  };
+  if (!anel.suportaOperacoes(necessarias,
+                             sizeof(necessarias) / sizeof(necessarias[0]))) {
+    return false;
+  }
+
+  MotorUring motor(&anel, tarefas, profundidade);
+  if (!motor.preparar()) return false;
+  motor.executar();
+  return true;
+}
@@ -0,0 +1,28 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef COPIA_URING_HPP_
+#define COPIA_URING_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "copia.hpp"  // NOLINT
+
+// Um arquivo a ser copiado pelo motor assíncrono
+struct TarefaCopia {
+  std::string origem;
+  std::string destino;
+  MetodoCopia metodo = COPIA_FALHOU;  // preenchido pelo motor
+  bool calcular_crc = false;          // CRC32C de cada leitura concluída
+  uint32_t crc = 0;
+};
+
+// Copia todas as tarefas mantendo até 'profundidade' arquivos em voo no
+// io_uring (aberturas, leituras, escritas e fechamentos assíncronos, com
+// buffers e arquivos registrados quando o kernel permite).
+// Retorna false, sem tocar em nenhum arquivo, quando o kernel não oferece
+// io_uring ou as operações necessárias; o chamador deve usar copiarArquivo.
+bool copiarComIoUring(std::vector<TarefaCopia>* tarefas,
+                      unsigned profundidade);
+
+#endif  // COPIA_URING_HPP_
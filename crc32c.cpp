@@ -0,0 +1,284 @@
+// Copyright 2025 Alex Batista Resende
+#include "crc32c.hpp"  // NOLINT
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM 1
+#endif
+
+namespace {
+
+// Polinômio de Castagnoli, com os bits refletidos
+const uint32_t POLINOMIO = 0x82F63B78;
+
+// Faixas processadas ao mesmo tempo pela instrução crc32: três cadeias
+// independentes escondem a latência de 3 ciclos da instrução
+const size_t TAMANHO_FAIXA = 4096;
+
+// Funções internas trabalham com o registrador, sem as inversões do início
+// e do fim (feitas só em crc32c)
+typedef uint32_t (*FuncaoCrc)(uint32_t, const unsigned char*, size_t);
+
+/***************************************************************************
+ * Aritmética de polinômios módulo o polinômio do CRC (como no zlib): o
+ * registrador depois de n bytes zero é o registrador vezes x^(8n).
+ ***************************************************************************/
+uint32_t multiplicarMod(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ POLINOMIO : b >> 1;
+  }
+  return p;
+}
+
+struct PotenciasX {
+  uint32_t x2n[32];  // x^(2^n)
+  PotenciasX() {
+    uint32_t p = 1u << 30;  // x^1
+    x2n[0] = p;
+    for (int n = 1; n < 32; n++) x2n[n] = p = multiplicarMod(p, p);
+  }
+};
+
+// x^n módulo o polinômio
+uint32_t potenciaX(uint64_t n) {
+  static const PotenciasX potencias;
+  uint32_t p = 1u << 31;  // x^0
+  for (unsigned k = 0; n != 0; n >>= 1, k++) {
+    if (n & 1) p = multiplicarMod(potencias.x2n[k & 31], p);
+  }
+  return p;
+}
+
+uint32_t potenciaBytes(uint64_t bytes) {
+  return potenciaX(8 * bytes);
+}
+
+/***************************************************************************
+ * Fallback portátil: tabelas de 8 bytes por iteração (slicing-by-8)
+ ***************************************************************************/
+struct TabelasCrc {
+  uint32_t t[8][256];
+  TabelasCrc() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t r = i;
+      for (int b = 0; b < 8; b++) r = (r & 1) ? (r >> 1) ^ POLINOMIO : r >> 1;
+      t[0][i] = r;
+    }
+    for (int k = 1; k < 8; k++) {
+      for (int i = 0; i < 256; i++) {
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+uint32_t crcTabela(uint32_t r, const unsigned char* p, size_t n) {
+  static const TabelasCrc tabelas;
+  const uint32_t (*t)[256] = tabelas.t;
+  for (; n >= 8; p += 8, n -= 8) {
+    r ^= static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+         static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+    r = t[7][r & 0xff] ^ t[6][(r >> 8) & 0xff] ^ t[5][(r >> 16) & 0xff] ^
+        t[4][r >> 24] ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+  }
+  for (; n > 0; p++, n--) r = (r >> 8) ^ t[0][(r ^ *p) & 0xff];
+  return r;
+}
+
+uint64_t ler64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/***************************************************************************
+ * Instrução crc32 (SSE4.2 / ARMv8): três faixas por vez, unidas depois
+ * com a multiplicação por x^(8 * TAMANHO_FAIXA)
+ ***************************************************************************/
+#if defined(CRC32C_X86)
+#define CRC32C_ALVO __attribute__((target("sse4.2")))
+#define CRC32C_U8(r, v) _mm_crc32_u8((r), (v))
+#define CRC32C_U64(r, v) _mm_crc32_u64((r), (v))
+#elif defined(CRC32C_ARM)
+#define CRC32C_ALVO
+#define CRC32C_U8(r, v) __crc32cb((r), (v))
+#define CRC32C_U64(r, v) __crc32cd((r), (v))
+#endif
+
+#if defined(CRC32C_U64) && (defined(__x86_64__) || defined(__aarch64__))
+CRC32C_ALVO uint32_t crcInstrucao(uint32_t r, const unsigned char* p,
+                                  size_t n) {
+  static const uint32_t deslocamento = potenciaBytes(TAMANHO_FAIXA);
+  for (; n > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; p++, n--) {
+    r = CRC32C_U8(r, *p);
+  }
+  for (; n >= 3 * TAMANHO_FAIXA; p += 3 * TAMANHO_FAIXA,
+                                 n -= 3 * TAMANHO_FAIXA) {
+    uint64_t c0 = r, c1 = 0, c2 = 0;
+    for (size_t i = 0; i < TAMANHO_FAIXA; i += 8) {
+      c0 = CRC32C_U64(c0, ler64(p + i));
+      c1 = CRC32C_U64(c1, ler64(p + TAMANHO_FAIXA + i));
+      c2 = CRC32C_U64(c2, ler64(p + 2 * TAMANHO_FAIXA + i));
+    }
+    r = multiplicarMod(deslocamento, static_cast<uint32_t>(c0)) ^
+        static_cast<uint32_t>(c1);
+    r = multiplicarMod(deslocamento, r) ^ static_cast<uint32_t>(c2);
+  }
+  uint64_t c = r;
+  for (; n >= 8; p += 8, n -= 8) c = CRC32C_U64(c, ler64(p));
+  r = static_cast<uint32_t>(c);
+  for (; n > 0; p++, n--) r = CRC32C_U8(r, *p);
+  return r;
+}
+#define CRC32C_INSTRUCAO 1
+#endif
+
+/***************************************************************************
+ * Dobramento com multiplicação sem transporte (VPCLMULQDQ, AVX-512): 256
+ * bytes por iteração em quatro registradores de 512 bits. Cada faixa de
+ * 128 bits X é levada D bytes adiante como X * x^(8D) mod P, com as duas
+ * metades multiplicadas por constantes de 32 bits; o que sobra no fim é
+ * um bloco de 16 bytes com o mesmo resto, reduzido pela instrução crc32.
+ ***************************************************************************/
+#if defined(CRC32C_INSTRUCAO) && defined(CRC32C_X86)
+#define CRC32C_DOBRAMENTO 1
+#define CRC32C_ALVO_AVX512 \
+  __attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.2")))
+
+// Constantes para avançar D bytes: x^(8D+63) para a metade de grau maior
+// e x^(8D-1) para a outra (o produto sem transporte já multiplica por x)
+struct ConstantesDobra {
+  uint64_t alta;
+  uint64_t baixa;
+  explicit ConstantesDobra(uint64_t bytes)
+      : alta(static_cast<uint64_t>(potenciaX(8 * bytes + 63)) << 32),
+        baixa(static_cast<uint64_t>(potenciaX(8 * bytes - 1)) << 32) {}
+};
+
+CRC32C_ALVO_AVX512 __m128i dobrar128(__m128i x, __m128i k, __m128i dado) {
+  return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                                     _mm_clmulepi64_si128(x, k, 0x11)),
+                       dado);
+}
+
+CRC32C_ALVO_AVX512 __m512i dobrar512(__m512i x, __m512i k, __m512i dado) {
+  return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00),
+                                   _mm512_clmulepi64_epi128(x, k, 0x11),
+                                   dado, 0x96);  // xor dos três
+}
+
+CRC32C_ALVO_AVX512 uint32_t crcDobramento(uint32_t r, const unsigned char* p,
+                                          size_t n) {
+  if (n < 256) return crcInstrucao(r, p, n);
+  static const ConstantesDobra c256(256), c64(64), c16(16);
+  const __m512i k256 = _mm512_set_epi64(c256.baixa, c256.alta, c256.baixa,
+                                        c256.alta, c256.baixa, c256.alta,
+                                        c256.baixa, c256.alta);
+  const __m512i k64 = _mm512_set_epi64(c64.baixa, c64.alta, c64.baixa,
+                                       c64.alta, c64.baixa, c64.alta,
+                                       c64.baixa, c64.alta);
+  const __m128i k16 = _mm_set_epi64x(c16.baixa, c16.alta);
+
+  // O registrador inicial entra somado aos primeiros 4 bytes
+  __m512i z0 = _mm512_xor_si512(_mm512_loadu_si512(p),
+                                _mm512_maskz_mov_epi32(1,
+                                    _mm512_set1_epi32(r)));
+  __m512i z1 = _mm512_loadu_si512(p + 64);
+  __m512i z2 = _mm512_loadu_si512(p + 128);
+  __m512i z3 = _mm512_loadu_si512(p + 192);
+  for (p += 256, n -= 256; n >= 256; p += 256, n -= 256) {
+    z0 = dobrar512(z0, k256, _mm512_loadu_si512(p));
+    z1 = dobrar512(z1, k256, _mm512_loadu_si512(p + 64));
+    z2 = dobrar512(z2, k256, _mm512_loadu_si512(p + 128));
+    z3 = dobrar512(z3, k256, _mm512_loadu_si512(p + 192));
+  }
+  z0 = dobrar512(z0, k64, z1);
+  z0 = dobrar512(z0, k64, z2);
+  z0 = dobrar512(z0, k64, z3);
+  for (; n >= 64; p += 64, n -= 64) {
+    z0 = dobrar512(z0, k64, _mm512_loadu_si512(p));
+  }
+
+  // As quatro faixas de 128 bits do último registrador, em ordem
+  uint64_t faixas[8];
+  _mm512_storeu_si512(faixas, z0);
+  const __m128i* faixa = reinterpret_cast<const __m128i*>(faixas);
+  __m128i x = _mm_loadu_si128(faixa);
+  for (int i = 1; i < 4; i++) x = dobrar128(x, k16, _mm_loadu_si128(faixa + i));
+  for (; n >= 16; p += 16, n -= 16) {
+    x = dobrar128(x, k16,
+                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+
+  uint64_t c = _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(x)));
+  c = _mm_crc32_u64(c, static_cast<uint64_t>(_mm_extract_epi64(x, 1)));
+  return crcInstrucao(static_cast<uint32_t>(c), p, n);
+}
+#endif
+
+struct Implementacao {
+  FuncaoCrc funcao;
+  const char* nome;
+};
+
+Implementacao escolherImplementacao() {
+  Implementacao tabela = { crcTabela, "tabela" };
+#if defined(CRC32C_INSTRUCAO) && defined(CRC32C_X86)
+  __builtin_cpu_init();
+#if defined(CRC32C_DOBRAMENTO)
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("vpclmulqdq") &&
+      __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.2")) {
+    Implementacao avx512 = { crcDobramento, "vpclmulqdq" };
+    return avx512;
+  }
+#endif
+  if (__builtin_cpu_supports("sse4.2")) {
+    Implementacao sse = { crcInstrucao, "sse4.2" };
+    return sse;
+  }
+#elif defined(CRC32C_INSTRUCAO)
+  Implementacao arm = { crcInstrucao, "armv8" };
+  return arm;
+#endif
+  return tabela;
+}
+
+const Implementacao& implementacao() {
+  static const Implementacao escolhida = escolherImplementacao();
+  return escolhida;
+}
+
+}  // namespace
+
+uint32_t crc32c(uint32_t crc, const void* dados, size_t tamanho) {
+  const unsigned char* p = static_cast<const unsigned char*>(dados);
+  return ~implementacao().funcao(~crc, p, tamanho);
+}
+
+uint32_t crc32cConcatenar(uint32_t crc_a, uint32_t crc_b,
+                          uint64_t tamanho_b) {
+  return multiplicarMod(potenciaBytes(tamanho_b), crc_a) ^ crc_b;
+}
+
+uint32_t crc32cZeros(uint32_t crc, uint64_t tamanho) {
+  return ~multiplicarMod(potenciaBytes(tamanho), ~crc);
+}
+
+const char* implementacaoCrc32c() {
+  return implementacao().nome;
+}
@@ -0,0 +1,24 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef CRC32C_HPP_
+#define CRC32C_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli) de 'tamanho' bytes, continuando 'crc' (0 no início
+// do arquivo). Usa dobramento com VPCLMULQDQ (AVX-512) ou a instrução
+// crc32 do SSE4.2/ARMv8 quando o processador tem; senão, tabelas.
+uint32_t crc32c(uint32_t crc, const void* dados, size_t tamanho);
+
+// CRC de A seguido de B, a partir do CRC de cada parte e do tamanho de B
+// (blocos copiados em paralelo)
+uint32_t crc32cConcatenar(uint32_t crc_a, uint32_t crc_b, uint64_t tamanho_b);
+
+// CRC de 'crc' seguido de 'tamanho' bytes zero (buracos de arquivos
+// esparsos), sem ler os zeros
+uint32_t crc32cZeros(uint32_t crc, uint64_t tamanho);
+
+// Implementação escolhida: "vpclmulqdq", "sse4.2", "armv8" ou "tabela"
+const char* implementacaoCrc32c();
+
+#endif  // CRC32C_HPP_
@@ -0,0 +1,415 @@
+// Copyright 2025 Alex Batista Resende
+#include "delta.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+namespace {
+
+// A origem é lida em pedaços deste tamanho (mais uma janela)
+const size_t TAMANHO_LEITURA = 4 << 20;
+
+// Filtro de somas fracas: descarta quase todas as janelas sem busca
+const unsigned BITS_FILTRO = 20;
+
+/***************************************************************************
+ * XXH64: constantes e rodadas
+ ***************************************************************************/
+const uint64_t PRIMO1 = 11400714785074694791ULL;
+const uint64_t PRIMO2 = 14029467366897019727ULL;
+const uint64_t PRIMO3 = 1609587929392839161ULL;
+const uint64_t PRIMO4 = 9650029242287828579ULL;
+const uint64_t PRIMO5 = 2870177450012600261ULL;
+
+uint64_t rotacionar(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+uint64_t ler64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t ler32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint64_t rodada(uint64_t acc, uint64_t entrada) {
+  acc += entrada * PRIMO2;
+  return rotacionar(acc, 31) * PRIMO1;
+}
+
+uint64_t misturar(uint64_t acc, uint64_t v) {
+  acc ^= rodada(0, v);
+  return acc * PRIMO1 + PRIMO4;
+}
+
+/***************************************************************************
+ * Assinaturas dos blocos do destino, ordenadas pela soma fraca
+ ***************************************************************************/
+struct AssinaturaBloco {
+  uint32_t fraca;
+  uint32_t indice;
+  uint64_t forte;
+  bool operator<(const AssinaturaBloco& outra) const {
+    return fraca < outra.fraca ||
+           (fraca == outra.fraca && indice < outra.indice);
+  }
+};
+
+class Assinaturas {
+ public:
+  explicit Assinaturas(size_t bloco)
+      : bloco_(bloco), filtro_((1u << BITS_FILTRO) / 64, 0) {}
+
+  // Lê o destino inteiro; blocos incompletos no fim ficam de fora
+  bool calcular(int fd, off_t tamanho) {
+    std::vector<unsigned char> buffer(bloco_);
+    SomaRolante soma;
+    for (off_t offset = 0; offset + static_cast<off_t>(bloco_) <= tamanho;
+         offset += bloco_) {
+      size_t feito = 0;
+      while (feito < bloco_) {
+        ssize_t n = pread(fd, &buffer[feito], bloco_ - feito, offset + feito);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        feito += n;
+      }
+      soma.iniciar(&buffer[0], bloco_);
+      AssinaturaBloco a;
+      a.fraca = soma.valor();
+      a.indice = static_cast<uint32_t>(offset / bloco_);
+      a.forte = xxh64(&buffer[0], bloco_);
+      blocos_.push_back(a);
+      uint32_t h = chaveFiltro(a.fraca);
+      filtro_[h / 64] |= 1ULL << (h % 64);
+    }
+    std::sort(blocos_.begin(), blocos_.end());
+    return true;
+  }
+
+  // Bloco do destino igual à janela em 'dados' (no offset 'offset' do
+  // arquivo novo), ou -1. Um bloco na mesma posição tem preferência; os
+  // que começam antes de 'minimo' não servem.
+  int64_t procurar(uint32_t fraca, const unsigned char* dados, off_t offset,
+                   off_t minimo) const {
+    uint32_t h = chaveFiltro(fraca);
+    if ((filtro_[h / 64] & (1ULL << (h % 64))) == 0) return -1;
+    AssinaturaBloco chave = { fraca, 0, 0 };
+    std::vector<AssinaturaBloco>::const_iterator it =
+        std::lower_bound(blocos_.begin(), blocos_.end(), chave);
+    const int64_t no_lugar = (offset % bloco_) == 0
+                                 ? static_cast<int64_t>(offset / bloco_)
+                                 : -1;
+    bool calculada = false;
+    uint64_t forte = 0;
+    int64_t achado = -1;
+    for (; it != blocos_.end() && it->fraca == fraca; ++it) {
+      if (!calculada) {
+        forte = xxh64(dados, bloco_);
+        calculada = true;
+      }
+      if (it->forte != forte) continue;
+      if (it->indice == no_lugar) return no_lugar;
+      if (static_cast<off_t>(it->indice * bloco_) < minimo) continue;
+      if (achado < 0) achado = it->indice;
+    }
+    return achado;
+  }
+
+ private:
+  static uint32_t chaveFiltro(uint32_t fraca) {
+    return (fraca ^ (fraca >> BITS_FILTRO)) & ((1u << BITS_FILTRO) - 1);
+  }
+
+  size_t bloco_;
+  std::vector<AssinaturaBloco> blocos_;
+  std::vector<uint64_t> filtro_;
+};
+
+/***************************************************************************
+ * Escrita do arquivo novo: trechos literais da origem e blocos do destino
+ * antigo que mudaram de posição
+ ***************************************************************************/
+bool escreverTudo(int fd, const unsigned char* dados, size_t tamanho,
+                  off_t offset) {
+  while (tamanho > 0) {
+    ssize_t n = pwrite(fd, dados, tamanho, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    dados += n;
+    tamanho -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool copiarBlocoAntigo(int antigo, off_t de, int saida, off_t para,
+                       size_t tamanho) {
+  while (tamanho > 0) {
+    loff_t in = de, out = para;
+    ssize_t n = copy_file_range(antigo, &in, saida, &out, tamanho, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      // Sem copy_file_range: pelo processo
+      std::vector<unsigned char> buffer(tamanho);
+      ssize_t lidos = pread(antigo, &buffer[0], tamanho, de);
+      return lidos == static_cast<ssize_t>(tamanho) &&
+             escreverTudo(saida, &buffer[0], tamanho, para);
+    }
+    de += n;
+    para += n;
+    tamanho -= n;
+  }
+  return true;
+}
+
+// Percorre a origem com a janela deslizante e monta o arquivo novo em
+// 'saida', que já tem o conteúdo antigo: um bloco na mesma posição não é
+// tocado e um que mudou de posição é copiado de 'antigo'. 'no_lugar':
+// 'saida' é o próprio destino, e o que fica antes do offset atual já foi
+// reescrito, então só blocos antigos daí em diante servem.
+bool aplicarDelta(int in, int antigo, int saida, bool no_lugar,
+                  const Assinaturas& assinaturas, size_t bloco,
+                  ResultadoDelta* resultado, uint32_t* crc) {
+  std::vector<unsigned char> dados(TAMANHO_LEITURA + bloco);
+  unsigned char* const d = &dados[0];
+  off_t base = 0;      // offset, no arquivo, de dados[0]
+  size_t fim = 0;      // bytes válidos em 'dados'
+  size_t pos = 0;      // início da janela
+  size_t literal = 0;  // início do trecho ainda não escrito
+  bool eof = false;
+  bool janela_valida = false;
+  SomaRolante soma;
+
+  for (;;) {
+    if (fim - pos < bloco && !eof) {
+      // Escreve o literal pendente e traz mais dados da origem
+      if (!escreverTudo(saida, d + literal, pos - literal,
+                        base + literal)) {
+        return false;
+      }
+      resultado->escritos += pos - literal;
+      memmove(d, d + pos, fim - pos);
+      base += pos;
+      fim -= pos;
+      literal = pos = 0;
+      while (fim < dados.size()) {
+        ssize_t n = read(in, d + fim, dados.size() - fim);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) {
+          eof = true;
+          break;
+        }
+        if (crc != NULL) *crc = crc32c(*crc, d + fim, n);
+        fim += n;
+      }
+    }
+    if (fim - pos < bloco) break;  // cauda menor que um bloco: literal
+
+    if (!janela_valida) {
+      soma.iniciar(d + pos, bloco);
+      janela_valida = true;
+    }
+    const off_t offset = base + pos;
+    int64_t achado = assinaturas.procurar(soma.valor(), d + pos, offset,
+                                          no_lugar ? offset : 0);
+    if (achado >= 0) {
+      if (!escreverTudo(saida, d + literal, pos - literal,
+                        base + literal)) {
+        return false;
+      }
+      resultado->escritos += pos - literal;
+      const off_t antigo_offset = static_cast<off_t>(achado) * bloco;
+      if (antigo_offset == offset) {
+        resultado->reaproveitados += bloco;
+      } else if (copiarBlocoAntigo(antigo, antigo_offset, saida, offset,
+                                   bloco)) {
+        resultado->escritos += bloco;
+      } else {
+        return false;
+      }
+      pos += bloco;
+      literal = pos;
+      janela_valida = false;
+    } else {
+      if (pos + bloco < fim) {
+        soma.rolar(d[pos], d[pos + bloco]);
+      } else {
+        janela_valida = false;
+      }
+      pos++;
+    }
+  }
+
+  if (!escreverTudo(saida, d + literal, fim - literal, base + literal)) {
+    return false;
+  }
+  resultado->escritos += fim - literal;
+  return true;
+}
+
+}  // namespace
+
+void SomaRolante::iniciar(const unsigned char* dados, size_t tamanho) {
+  a_ = b_ = 0;
+  tamanho_ = tamanho;
+  for (size_t i = 0; i < tamanho; i++) {
+    a_ += dados[i];
+    b_ += static_cast<uint32_t>(tamanho - i) * dados[i];
+  }
+}
+
+uint64_t xxh64(const void* dados, size_t tamanho, uint64_t semente) {
+  const unsigned char* p = static_cast<const unsigned char*>(dados);
+  const unsigned char* const fim = p + tamanho;
+  uint64_t h;
+  if (tamanho >= 32) {
+    uint64_t v1 = semente + PRIMO1 + PRIMO2;
+    uint64_t v2 = semente + PRIMO2;
+    uint64_t v3 = semente;
+    uint64_t v4 = semente - PRIMO1;
+    for (; fim - p >= 32; p += 32) {
+      v1 = rodada(v1, ler64(p));
+      v2 = rodada(v2, ler64(p + 8));
+      v3 = rodada(v3, ler64(p + 16));
+      v4 = rodada(v4, ler64(p + 24));
+    }
+    h = rotacionar(v1, 1) + rotacionar(v2, 7) + rotacionar(v3, 12) +
+        rotacionar(v4, 18);
+    h = misturar(h, v1);
+    h = misturar(h, v2);
+    h = misturar(h, v3);
+    h = misturar(h, v4);
+  } else {
+    h = semente + PRIMO5;
+  }
+  h += tamanho;
+  for (; fim - p >= 8; p += 8) {
+    h ^= rodada(0, ler64(p));
+    h = rotacionar(h, 27) * PRIMO1 + PRIMO4;
+  }
+  if (fim - p >= 4) {
+    h ^= ler32(p) * PRIMO1;
+    h = rotacionar(h, 23) * PRIMO2 + PRIMO3;
+    p += 4;
+  }
+  for (; p < fim; p++) {
+    h ^= *p * PRIMO5;
+    h = rotacionar(h, 11) * PRIMO1;
+  }
+  h ^= h >> 33;
+  h *= PRIMO2;
+  h ^= h >> 29;
+  h *= PRIMO3;
+  h ^= h >> 32;
+  return h;
+}
+
+/***************************************************************************
+ * Função: copiarDelta
+ ***************************************************************************/
+MetodoCopia copiarDelta(const std::string& origem,
+                        const std::string& destino,
+                        const OpcoesCopia& opcoes, ResultadoDelta* resultado,
+                        uint32_t* crc) {
+  assert(opcoes.bloco_delta > 0);
+  const size_t bloco = opcoes.bloco_delta;
+  const std::string temporario = caminhoTemporario(destino);
+  *resultado = ResultadoDelta();
+  if (crc != NULL) *crc = 0;
+
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    return COPIA_FALHOU;
+  }
+  int antigo = open(destino.c_str(), O_RDONLY | O_CLOEXEC);
+  if (antigo < 0 && errno == ENOENT) {
+    close(in);  // destino sumiu (manifesto desatualizado): cópia comum
+    return copiarArquivo(origem, destino, opcoes, NULL, crc);
+  }
+  struct stat st_origem, st_antigo;
+  if (antigo < 0 || fstat(in, &st_origem) != 0 ||
+      fstat(antigo, &st_antigo) != 0 || !S_ISREG(st_origem.st_mode) ||
+      !S_ISREG(st_antigo.st_mode)) {
+    std::cerr << "[ERRO] Destino não serve para delta: "
+              << destino << " (errno=" << errno << ")\n";
+    if (antigo >= 0) close(antigo);
+    close(in);
+    return COPIA_FALHOU;
+  }
+  // Temporário clonado do destino. Sem clone, o destino é corrigido no
+  // lugar e o temporário vazio fica como marca até o fim; se o rename
+  // fica para o lote, o destino tem de continuar intacto até lá e a cópia
+  // é comum, sem ler o destino à toa.
+  int saida = open(temporario.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  const bool no_lugar = saida >= 0 && ioctl(saida, FICLONE, antigo) != 0;
+  if (no_lugar) {
+    close(saida);
+    if (!opcoes.renomear) {
+      unlink(temporario.c_str());
+      close(antigo);
+      close(in);
+      return copiarArquivo(origem, destino, opcoes, NULL, crc);
+    }
+    saida = open(destino.c_str(), O_WRONLY | O_CLOEXEC);
+  }
+  resultado->no_lugar = no_lugar;
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  posix_fadvise(antigo, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  Assinaturas assinaturas(bloco);
+  bool ok = saida >= 0 && assinaturas.calcular(antigo, st_antigo.st_size) &&
+            aplicarDelta(in, antigo, saida, no_lugar, assinaturas, bloco,
+                         resultado, crc) &&
+            ftruncate(saida, st_origem.st_size) == 0;
+  int erro = errno;
+  if (ok) {
+    const struct timespec tempos[2] = { st_origem.st_atim,
+                                        st_origem.st_mtim };
+    futimens(saida, tempos);
+  }
+  if (saida >= 0 && close(saida) != 0 && ok) {
+    ok = false;
+    erro = errno;
+  }
+  close(antigo);
+  close(in);
+
+  if (!ok) {
+    std::cerr << "[ERRO] Falha na cópia delta: " << origem
+              << " (errno=" << erro << ")\n";
+    // No lugar, a marca fica: o destino está pela metade
+    if (!no_lugar) unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (no_lugar) {
+    unlink(temporario.c_str());
+  } else if (opcoes.renomear &&
+             rename(temporario.c_str(), destino.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << destino << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  return COPIA_DELTA;
+}
@@ -0,0 +1,65 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef DELTA_HPP_
+#define DELTA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "copia.hpp"  // NOLINT
+
+// Bytes de uma cópia delta: os que ficaram onde estavam no destino, sem
+// serem escritos, e os escritos (blocos que mudaram de posição incluídos)
+struct ResultadoDelta {
+  uint64_t reaproveitados = 0;
+  uint64_t escritos = 0;
+  bool no_lugar = false;  // destino corrigido sem temporário
+};
+
+// Soma fraca do rsync sobre uma janela de 'tamanho' bytes, deslizada um
+// byte por vez em O(1): a = soma dos bytes, b = soma ponderada pela
+// distância ao fim da janela, ambas módulo 2^16
+class SomaRolante {
+ public:
+  void iniciar(const unsigned char* dados, size_t tamanho);
+  void rolar(unsigned char sai, unsigned char entra) {
+    a_ += entra - sai;
+    b_ += a_ - static_cast<uint32_t>(tamanho_) * sai;
+  }
+  uint32_t valor() const { return (a_ & 0xffff) | (b_ << 16); }
+
+ private:
+  uint32_t a_ = 0;
+  uint32_t b_ = 0;
+  size_t tamanho_ = 0;
+};
+
+// XXH64, a soma forte que confirma os candidatos da soma fraca
+uint64_t xxh64(const void* dados, size_t tamanho, uint64_t semente = 0);
+
+/***************************************************************************
+ * Atualiza um destino existente com o conteúdo da origem escrevendo só o
+ * que mudou, como o rsync: o destino é dividido em blocos de
+ * opcoes.bloco_delta bytes, com soma fraca e XXH64 de cada um, e a origem
+ * é percorrida com a soma rolante; uma janela que confere com um bloco é
+ * reaproveitada, o resto é escrito.
+ *
+ * Se o sistema de arquivos clona (FICLONE), o resultado fica num clone do
+ * destino em caminhoTemporario(destino), renomeado como em copiarArquivo,
+ * e o destino não é tocado antes disso. Sem clone (ext4, FAT), o destino é
+ * corrigido no lugar, e só blocos antigos que ainda não foram sobrescritos
+ * podem ser reaproveitados. Durante a correção, o temporário vazio marca o
+ * destino como incompleto: uma queda (ou falha) no meio deixa o destino
+ * com parte do conteúdo novo e o mtime da queda, e o backup seguinte,
+ * vendo a marca, copia de novo em vez de acusar um destino mais novo. Uma
+ * restauração nesse intervalo traria o arquivo misturado. Sem clone e sem
+ * opcoes.renomear (lote), o destino precisa ficar intacto e é feita uma
+ * cópia comum. Com 'crc', o CRC32C da origem é calculado na mesma
+ * leitura. Sem destino, é uma cópia comum.
+ ***************************************************************************/
+MetodoCopia copiarDelta(const std::string& origem,
+                        const std::string& destino,
+                        const OpcoesCopia& opcoes, ResultadoDelta* resultado,
+                        uint32_t* crc = NULL);
+
+#endif  // DELTA_HPP_
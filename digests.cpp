@@ -0,0 +1,85 @@
+// Copyright 2025 Alex Batista Resende
+#include "digests.hpp"  // NOLINT
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+const char* const NOME_DIGESTS = ".backup_crc32c";
+
+bool TabelaDigests::carregar(const std::string& destino_path) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  caminho_ = destino_path + "/" + NOME_DIGESTS;
+  digests_.clear();
+  alterada_ = false;
+
+  std::ifstream entrada(caminho_.c_str());
+  if (!entrada.is_open()) return errno == ENOENT;
+  std::string linha;
+  while (std::getline(entrada, linha)) {
+    // "crc32c tamanho seg.nseg caminho": o caminho vai até o fim da linha
+    DigestArquivo digest;
+    int64_t seg = 0;
+    unsigned nseg = 0;
+    int inicio_nome = 0;
+    if (sscanf(linha.c_str(), "%" SCNx32 " %" SCNu64 " %" SCNd64 ".%u %n",
+               &digest.crc32c, &digest.tamanho, &seg, &nseg,
+               &inicio_nome) != 4 ||
+        inicio_nome == 0 ||
+        static_cast<size_t>(inicio_nome) >= linha.size()) {
+      continue;
+    }
+    digest.mtime_seg = seg;
+    digest.mtime_nseg = nseg;
+    digests_[linha.substr(inicio_nome)] = digest;
+  }
+  return !entrada.bad();
+}
+
+bool TabelaDigests::buscar(const std::string& nome,
+                           DigestArquivo* digest) const {
+  std::lock_guard<std::mutex> trava(mutex_);
+  std::map<std::string, DigestArquivo>::const_iterator it =
+      digests_.find(nome);
+  if (it == digests_.end()) return false;
+  *digest = it->second;
+  return true;
+}
+
+void TabelaDigests::atualizar(const std::string& nome,
+                              const DigestArquivo& digest) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  digests_[nome] = digest;
+  alterada_ = true;
+}
+
+void TabelaDigests::descartar(const std::string& nome) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  if (digests_.erase(nome) > 0) alterada_ = true;
+}
+
+bool TabelaDigests::gravar() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  if (!alterada_) return true;
+  const std::string temporario = caminho_ + ".tmp";
+
+  FILE* saida = fopen(temporario.c_str(), "w");
+  if (saida == NULL) return false;
+  std::map<std::string, DigestArquivo>::const_iterator it;
+  for (it = digests_.begin(); it != digests_.end(); ++it) {
+    fprintf(saida, "%08" PRIx32 " %" PRIu64 " %" PRId64 ".%09u %s\n",
+            it->second.crc32c, it->second.tamanho, it->second.mtime_seg,
+            it->second.mtime_nseg, it->first.c_str());
+  }
+  bool escreveu = !ferror(saida);
+  if (fclose(saida) != 0 || !escreveu) {
+    remove(temporario.c_str());
+    return false;
+  }
+  alterada_ = false;
+  return rename(temporario.c_str(), caminho_.c_str()) == 0;
+}
@@ -0,0 +1,56 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef DIGESTS_HPP_
+#define DIGESTS_HPP_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Nome da tabela de digests dentro do diretório de destino
+extern const char* const NOME_DIGESTS;
+
+// Conteúdo de um arquivo copiado: CRC32C, tamanho em bytes e o mtime que
+// o destino recebeu (a linha só vale enquanto o destino não mudar)
+struct DigestArquivo {
+  uint32_t crc32c = 0;
+  uint64_t tamanho = 0;
+  int64_t mtime_seg = 0;
+  uint32_t mtime_nseg = 0;
+};
+
+/***************************************************************************
+ * Classe: TabelaDigests
+ * Tabela, ao lado do backup, com o CRC32C de cada arquivo copiado,
+ * calculado durante a própria cópia. Serve para verificar o backup e para
+ * detectar mudanças de conteúdo sem reler o destino. Formato texto, uma
+ * linha por arquivo ("crc32c tamanho mtime caminho"), ordenado por
+ * caminho.
+ ***************************************************************************/
+class TabelaDigests {
+ public:
+  TabelaDigests() {}
+
+  // Lê a tabela de 'destino_path'; sem tabela, começa vazia. Devolve false
+  // se a tabela existe e não pôde ser lida.
+  bool carregar(const std::string& destino_path);
+
+  // Consultas e alterações podem vir de várias threads
+  bool buscar(const std::string& nome, DigestArquivo* digest) const;
+  void atualizar(const std::string& nome, const DigestArquivo& digest);
+  void descartar(const std::string& nome);
+
+  // Grava a tabela (se mudou) em um temporário e troca a anterior
+  bool gravar();
+
+ private:
+  TabelaDigests(const TabelaDigests&);
+  TabelaDigests& operator=(const TabelaDigests&);
+
+  std::string caminho_;
+  std::map<std::string, DigestArquivo> digests_;
+  bool alterada_ = false;
+  mutable std::mutex mutex_;
+};
+
+#endif  // DIGESTS_HPP_
@@ -0,0 +1,165 @@
+// Copyright 2025 Alex Batista Resende
+#include "durabilidade.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Diretório de um caminho, como trecho dele (ou "." e "/")
+VisaoTexto diretorioDe(VisaoTexto caminho) {
+  size_t barra = caminho.rfind('/');
+  if (barra == VisaoTexto::npos) return ".";
+  if (barra == 0) return "/";
+  return caminho.substr(0, barra);
+}
+
+void reportarFalha(const char* chamada, const char* diretorio) {
+  std::cerr << "[ERRO] " << chamada << " falhou em: " << diretorio
+            << " (errno=" << errno << ")\n";
+}
+
+// Descritor do diretório para syncfs ou fsync; -1 (já reportado) se falhar
+int abrirDiretorio(const char* diretorio) {
+  int fd = open(diretorio, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) reportarFalha("open", diretorio);
+  return fd;
+}
+
+}  // namespace
+
+void LoteDurabilidade::adicionar(VisaoTexto temporario, VisaoTexto destino) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  VisaoTexto copia_destino = caminhos_.copiar(destino);
+  pendentes_.push_back(std::make_pair(caminhos_.copiar(temporario),
+                                      copia_destino));
+  marcarDestino(copia_destino);
+  if (limite_ > 0 && pendentes_.size() >= limite_) concluirTravado();
+}
+
+void LoteDurabilidade::concluirSePendente(VisaoTexto destino) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  if (destinoMarcado(destino)) concluirTravado();
+}
+
+bool LoteDurabilidade::concluir() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  concluirTravado();
+  return !falhou_;
+}
+
+// Tabela mantida no máximo meio cheia: a sondagem linear acha logo uma
+// posição livre
+void LoteDurabilidade::marcarDestino(VisaoTexto destino) {
+  if (2 * (marcados_ + 1) > destinos_.size()) {
+    std::vector<VisaoTexto> antigos(std::max<size_t>(64, 2 * destinos_.size()));
+    antigos.swap(destinos_);
+    marcados_ = 0;
+    for (size_t i = 0; i < antigos.size(); i++) {
+      if (!antigos[i].empty()) marcarDestino(antigos[i]);
+    }
+  }
+  const size_t mascara = destinos_.size() - 1;
+  for (size_t i = hashTexto(destino) & mascara;; i = (i + 1) & mascara) {
+    if (destinos_[i].empty()) {
+      destinos_[i] = destino;
+      marcados_++;
+      return;
+    }
+    if (destinos_[i] == destino) return;
+  }
+}
+
+bool LoteDurabilidade::destinoMarcado(VisaoTexto destino) const {
+  if (marcados_ == 0) return false;
+  const size_t mascara = destinos_.size() - 1;
+  for (size_t i = hashTexto(destino) & mascara; !destinos_[i].empty();
+       i = (i + 1) & mascara) {
+    if (destinos_[i] == destino) return true;
+  }
+  return false;
+}
+
+void LoteDurabilidade::concluirTravado() {
+  if (pendentes_.empty()) return;
+
+  // 1. dados e inodes dos temporários no disco: um syncfs por dispositivo.
+  // Cada diretório é aberto e fechado em seguida, então um lote com
+  // muitos diretórios não esgota os descritores.
+  diretorios_.clear();
+  diretorios_.reserve(pendentes_.size());
+  for (size_t i = 0; i < pendentes_.size(); i++) {
+    diretorios_.push_back(diretorioDe(pendentes_[i].second));
+  }
+  std::sort(diretorios_.begin(), diretorios_.end());
+  diretorios_.erase(std::unique(diretorios_.begin(), diretorios_.end()),
+                    diretorios_.end());
+  sincronizados_.clear();
+  BufferCaminho dir;
+  for (size_t i = 0; i < diretorios_.size(); i++) {
+    dir.limpar();
+    dir.acrescentar(diretorios_[i]);
+    int fd = abrirDiretorio(dir.c_str());
+    if (fd < 0) {
+      falhou_ = true;
+      continue;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      reportarFalha("fstat", dir.c_str());
+      falhou_ = true;
+    } else if (std::find(sincronizados_.begin(), sincronizados_.end(),
+                         st.st_dev) == sincronizados_.end()) {
+      sincronizados_.push_back(st.st_dev);
+      if (syncfs(fd) != 0) {
+        reportarFalha("syncfs", dir.c_str());
+        falhou_ = true;
+      }
+    }
+    close(fd);
+  }
+
+  // 2. os destinos passam a apontar para as cópias completas (os textos
+  // da arena terminam em '\0')
+  for (size_t i = 0; i < pendentes_.size(); i++) {
+    const char* temporario = pendentes_[i].first.data();
+    const char* destino = pendentes_[i].second.data();
+    if (rename(temporario, destino) != 0 && errno != ENOENT) {
+      // ENOENT: destino repetido no lote, já renomeado pela entrada anterior
+      std::cerr << "[ERRO] Não foi possível renomear para: " << destino
+                << " (errno=" << errno << ")\n";
+      unlink(temporario);
+      falhou_ = true;
+    }
+  }
+
+  // 3. os renames ficam duráveis com o fsync de cada diretório, um
+  // diretório aberto por vez
+  for (size_t i = 0; i < diretorios_.size(); i++) {
+    dir.limpar();
+    dir.acrescentar(diretorios_[i]);
+    int fd = abrirDiretorio(dir.c_str());
+    if (fd < 0) {
+      falhou_ = true;
+      continue;
+    }
+    if (fsync(fd) != 0) {
+      reportarFalha("fsync", dir.c_str());
+      falhou_ = true;
+    }
+    close(fd);
+  }
+
+  pendentes_.clear();
+  std::fill(destinos_.begin(), destinos_.end(), VisaoTexto());
+  marcados_ = 0;
+  caminhos_.limpar();
+}
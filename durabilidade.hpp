@@ -0,0 +1,71 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef DURABILIDADE_HPP_
+#define DURABILIDADE_HPP_
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+#include "caminho.hpp"  // NOLINT
+
+// Quando as cópias escritas em nomes temporários passam a valer
+enum ModoDurabilidade {
+  DURABILIDADE_NENHUMA,  // rename logo após a cópia, sem sync
+  DURABILIDADE_LOTE      // syncfs por lote, depois rename e fsync dos dirs
+};
+
+/***************************************************************************
+ * Classe: LoteDurabilidade
+ * Acumula cópias já completas em nomes temporários. Ao concluir um lote:
+ * um syncfs por sistema de arquivos leva os dados ao disco, os
+ * temporários são renomeados sobre os destinos e um fsync em cada
+ * diretório tocado torna os renames duráveis. Uma queda no meio deixa só
+ * temporários; os destinos antigos continuam intactos e a próxima execução
+ * copia de novo. Lotes maiores significam menos syncs e uma janela maior
+ * de trabalho a refazer. Os caminhos ficam numa arena reaproveitada de um
+ * lote para o outro: depois do primeiro lote, adicionar não aloca.
+ ***************************************************************************/
+class LoteDurabilidade {
+ public:
+  // arquivos_por_lote == 0: um lote só, concluído no fim da operação
+  explicit LoteDurabilidade(size_t arquivos_por_lote)
+      : limite_(arquivos_por_lote) {
+    pendentes_.reserve(limite_);
+  }
+  ~LoteDurabilidade() { concluir(); }
+
+  // Entrega um arquivo completo; pode concluir o lote (thread-safe)
+  void adicionar(VisaoTexto temporario, VisaoTexto destino);
+
+  // Conclui o lote se 'destino' está nele, para que seja consultado já
+  // com o conteúdo novo (entradas repetidas no Backup.parm)
+  void concluirSePendente(VisaoTexto destino);
+
+  // Conclui o lote atual; false se algum syncfs, rename ou fsync falhou
+  // até aqui
+  bool concluir();
+
+ private:
+  LoteDurabilidade(const LoteDurabilidade&);
+  LoteDurabilidade& operator=(const LoteDurabilidade&);
+
+  void concluirTravado();
+  void marcarDestino(VisaoTexto destino);
+  bool destinoMarcado(VisaoTexto destino) const;
+
+  std::mutex mutex_;
+  ArenaTexto caminhos_;  // donos do texto de pendentes_ e destinos_
+  std::vector<std::pair<VisaoTexto, VisaoTexto> > pendentes_;
+  // Destinos do lote com endereçamento aberto; vazia = posição livre
+  std::vector<VisaoTexto> destinos_;
+  size_t marcados_ = 0;
+  // Diretórios e dispositivos da conclusão, reaproveitados entre lotes
+  std::vector<VisaoTexto> diretorios_;
+  std::vector<dev_t> sincronizados_;
+  size_t limite_;
+  bool falhou_ = false;
+};
+
+#endif  // DURABILIDADE_HPP_
@@ -0,0 +1,64 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef FILA_HPP_
+#define FILA_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/***************************************************************************
+ * Classe: FilaLimitada
+ * Fila bloqueante de capacidade fixa que liga dois estágios do pipeline.
+ * inserir() espera quando a fila está cheia (backpressure) e retirar()
+ * espera quando está vazia. fechar() acorda os dois lados: inserções
+ * passam a falhar e retiradas esvaziam o que sobrou e então falham.
+ ***************************************************************************/
+template <typename T>
+class FilaLimitada {
+ public:
+  explicit FilaLimitada(size_t capacidade)
+      : capacidade_(capacidade ? capacidade : 1) {}
+
+  bool inserir(T valor) {
+    std::unique_lock<std::mutex> trava(mutex_);
+    nao_cheia_.wait(trava, [this] {
+      return fechada_ || itens_.size() < capacidade_;
+    });
+    if (fechada_) return false;
+    itens_.push_back(std::move(valor));
+    nao_vazia_.notify_one();
+    return true;
+  }
+
+  bool retirar(T* valor) {
+    std::unique_lock<std::mutex> trava(mutex_);
+    nao_vazia_.wait(trava, [this] { return fechada_ || !itens_.empty(); });
+    if (itens_.empty()) return false;
+    *valor = std::move(itens_.front());
+    itens_.pop_front();
+    nao_cheia_.notify_one();
+    return true;
+  }
+
+  void fechar() {
+    std::lock_guard<std::mutex> trava(mutex_);
+    fechada_ = true;
+    nao_cheia_.notify_all();
+    nao_vazia_.notify_all();
+  }
+
+ private:
+  FilaLimitada(const FilaLimitada&);
+  FilaLimitada& operator=(const FilaLimitada&);
+
+  const size_t capacidade_;
+  std::deque<T> itens_;
+  std::mutex mutex_;
+  std::condition_variable nao_cheia_;
+  std::condition_variable nao_vazia_;
+  bool fechada_ = false;
+};
+
+#endif  // FILA_HPP_
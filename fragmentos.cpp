@@ -0,0 +1,495 @@
+// Copyright 2025 Alex Batista Resende
+#include "fragmentos.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+#include "delta.hpp"  // NOLINT
+#include "indice.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* const NOME_FRAGMENTOS = ".backup_fragmentos";
+namespace {
+
+// A origem é lida em pedaços deste tamanho (mais um fragmento máximo)
+const size_t TAMANHO_LEITURA = 4 << 20;
+
+// Diretório do índice dentro do repositório
+const char* const NOME_INDICE = "indice";
+
+// Primeira linha de uma receita
+const char* const CABECALHO_RECEITA = "fragmentos";
+
+// Sementes dos dois XXH64 do identificador
+const uint64_t SEMENTE_ID_1 = 0;
+const uint64_t SEMENTE_ID_2 = 0x9E3779B97F4A7C15ULL;
+
+/***************************************************************************
+ * Gear hash: h = (h << 1) + GEAR[byte]. Depois de 64 bytes a contribuição
+ * de um byte sai do registrador, então o hash só depende da vizinhança.
+ * A tabela vem de um splitmix64 com semente fixa: mudar a tabela mudaria
+ * todos os cortes e acabaria com a deduplicação contra backups antigos.
+ ***************************************************************************/
+struct TabelaGear {
+  uint64_t g[256];
+  TabelaGear() {
+    uint64_t estado = 0x6A09E667F3BCC908ULL;
+    for (int i = 0; i < 256; i++) {
+      uint64_t z = (estado += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      g[i] = z ^ (z >> 31);
+    }
+  }
+};
+
+const TabelaGear& tabelaGear() {
+  static const TabelaGear tabela;
+  return tabela;
+}
+
+// Máscara com os 'bits' bits mais altos (os que dependem da janela toda)
+uint64_t mascara(unsigned bits) {
+  return bits == 0 ? 0 : ~0ULL << (64 - bits);
+}
+
+unsigned log2Piso(size_t n) {
+  unsigned bits = 0;
+  while (n > 1) {
+    n >>= 1;
+    bits++;
+  }
+  return bits;
+}
+
+bool escreverTudo(int fd, const unsigned char* dados, size_t tamanho) {
+  while (tamanho > 0) {
+    ssize_t n = write(fd, dados, tamanho);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    dados += n;
+    tamanho -= n;
+  }
+  return true;
+}
+
+bool lerTudo(int fd, unsigned char* dados, size_t tamanho) {
+  while (tamanho > 0) {
+    ssize_t n = read(fd, dados, tamanho);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    dados += n;
+    tamanho -= n;
+  }
+  return true;
+}
+
+uint64_t nanossegundosDesde(std::chrono::steady_clock::time_point inicio) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - inicio).count();
+}
+
+}  // namespace
+
+/***************************************************************************
+ * Função: cortarFragmento
+ * FastCDC com normalização: antes do tamanho médio a máscara tem dois bits
+ * a mais (corte menos provável), depois dele dois a menos. O laço é
+ * escalar de propósito: uma busca na tabela, um deslocamento e uma soma
+ * por byte (~1,7 GB/s); calcular 8 posições por vez como prefixo em
+ * registradores SIMD ficou em menos da metade disso, limitado pelas
+ * buscas na tabela.
+ ***************************************************************************/
+size_t cortarFragmento(const unsigned char* dados, size_t tamanho,
+                       bool fim_dos_dados, const OpcoesFragmentos& opcoes) {
+  assert(opcoes.minimo > 0 && opcoes.minimo <= opcoes.medio &&
+         opcoes.medio <= opcoes.maximo);
+  if (tamanho <= opcoes.minimo) return fim_dos_dados ? tamanho : 0;
+
+  const uint64_t* gear = tabelaGear().g;
+  const size_t limite = std::min(tamanho, opcoes.maximo);
+  const size_t normal = std::min(opcoes.medio, limite);
+  const unsigned bits = log2Piso(opcoes.medio);
+  const uint64_t mascara_antes = mascara(bits + 2);
+  const uint64_t mascara_depois = mascara(bits > 2 ? bits - 2 : 1);
+
+  uint64_t h = 0;
+  size_t i = opcoes.minimo;
+  for (; i < normal; i++) {
+    h = (h << 1) + gear[dados[i]];
+    if ((h & mascara_antes) == 0) return i + 1;
+  }
+  for (; i < limite; i++) {
+    h = (h << 1) + gear[dados[i]];
+    if ((h & mascara_depois) == 0) return i + 1;
+  }
+  return (limite == opcoes.maximo || fim_dos_dados) ? limite : 0;
+}
+
+/***************************************************************************
+ * Identificadores
+ ***************************************************************************/
+IdFragmento identificarFragmento(const void* dados, size_t tamanho) {
+  IdFragmento id;
+  id.h[0] = xxh64(dados, tamanho, SEMENTE_ID_1);
+  id.h[1] = xxh64(dados, tamanho, SEMENTE_ID_2);
+  return id;
+}
+
+std::string IdFragmento::hex() const {
+  char texto[33];
+  snprintf(texto, sizeof(texto), "%016" PRIx64 "%016" PRIx64, h[0], h[1]);
+  return texto;
+}
+
+bool IdFragmento::deHex(const std::string& texto) {
+  if (texto.size() != 32 ||
+      texto.find_first_not_of("0123456789abcdef") != std::string::npos) {
+    return false;
+  }
+  h[0] = strtoull(texto.substr(0, 16).c_str(), NULL, 16);
+  h[1] = strtoull(texto.substr(16).c_str(), NULL, 16);
+  return true;
+}
+
+/***************************************************************************
+ * Classe: RepositorioFragmentos
+ ***************************************************************************/
+RepositorioFragmentos::RepositorioFragmentos(const OpcoesFragmentos& opcoes,
+                                             bool duravel)
+    : opcoes_(opcoes), duravel_(duravel) {}
+
+RepositorioFragmentos::~RepositorioFragmentos() {}
+
+bool RepositorioFragmentos::abrir(const std::string& destino_path,
+                                  bool somente_leitura) {
+  raiz_ = destino_path + "/" + NOME_FRAGMENTOS;
+  indice_.reset();
+  if (somente_leitura) return true;
+  if (mkdir(raiz_.c_str(), 0777) != 0 && errno != EEXIST) return false;
+
+  const std::string diretorio = raiz_ + "/" + NOME_INDICE;
+  struct stat st;
+  const bool criar = stat(diretorio.c_str(), &st) != 0;
+  indice_.reset(new IndiceFragmentos(opcoes_.ids_em_memoria,
+                                     opcoes_.maximo_tabelas));
+  if (!indice_->abrir(diretorio, duravel_)) return false;
+  if (!criar) return true;
+
+  // Subdiretórios "00".."ff" com o resto do identificador como nome
+  for (int d = 0; d < 256; d++) {
+    char sub[3];
+    snprintf(sub, sizeof(sub), "%02x", d);
+    DIR* dir = opendir((raiz_ + "/" + sub).c_str());
+    if (dir == NULL) continue;
+    while (struct dirent* entrada = readdir(dir)) {
+      IdFragmento id;
+      if (id.deHex(std::string(sub) + entrada->d_name)) indice_->inserir(id);
+    }
+    closedir(dir);
+  }
+  return indice_->concluir();
+}
+
+bool RepositorioFragmentos::concluir() {
+  return !indice_ || indice_->concluir();
+}
+
+std::string RepositorioFragmentos::caminhoFragmento(
+    const IdFragmento& id) const {
+  const std::string hex = id.hex();
+  return raiz_ + "/" + hex.substr(0, 2) + "/" + hex.substr(2);
+}
+
+// Grava o fragmento se o repositório ainda não o tem. Duas threads com o
+// mesmo fragmento escrevem temporários distintos; o rename é atômico e o
+// conteúdo é o mesmo, e só a primeira a registrá-lo o conta como novo.
+bool RepositorioFragmentos::gravarFragmento(const IdFragmento& id,
+                                            const unsigned char* dados,
+                                            size_t tamanho, bool* novo) {
+  *novo = false;
+  if (indice_ && indice_->contem(id)) return true;
+
+  const std::string caminho = caminhoFragmento(id);
+  const std::string temporario = caminhoTemporario(
+      caminho + "." + std::to_string(contador_temporarios_++));
+  criarDiretorioPai(caminho);
+  int fd = open(temporario.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0444);
+  if (fd < 0) return false;
+  bool ok = escreverTudo(fd, dados, tamanho);
+  if (close(fd) != 0) ok = false;
+  if (!ok || rename(temporario.c_str(), caminho.c_str()) != 0) {
+    unlink(temporario.c_str());
+    return false;
+  }
+
+  *novo = !indice_ || indice_->inserir(id);
+  return true;
+}
+
+bool RepositorioFragmentos::gravarObjeto(const std::string& dados,
+                                         IdFragmento* id) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(
+      dados.data());
+  *id = identificarFragmento(p, dados.size());
+  bool novo;
+  return gravarFragmento(*id, p, dados.size(), &novo);
+}
+
+bool RepositorioFragmentos::lerObjeto(const IdFragmento& id,
+                                      std::string* dados) const {
+  int fd = open(caminhoFragmento(id).c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  dados->resize(st.st_size);
+  bool ok = st.st_size == 0 ||
+            lerTudo(fd, reinterpret_cast<unsigned char*>(&(*dados)[0]),
+                    dados->size());
+  close(fd);
+  return ok && identificarFragmento(dados->data(), dados->size()) == id;
+}
+
+// Fragmenta o arquivo aberto em 'in', grava os fragmentos que faltam e
+// monta o texto da receita
+bool RepositorioFragmentos::fragmentar(int in, uint64_t tamanho,
+                                       std::string* texto, uint32_t* crc) {
+  *texto = std::string(CABECALHO_RECEITA) + " " + std::to_string(tamanho) +
+           "\n";
+  std::vector<unsigned char> dados(TAMANHO_LEITURA + opcoes_.maximo);
+  unsigned char* const d = &dados[0];
+  size_t fim = 0;
+  bool eof = false;
+  bool ok = true;
+  uint64_t total = 0;
+  uint64_t quantidade = 0;
+  while (ok && !eof) {
+    while (fim < dados.size()) {
+      ssize_t n = read(in, d + fim, dados.size() - fim);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) ok = false;
+      if (n <= 0) {
+        eof = true;
+        break;
+      }
+      if (crc != NULL) *crc = crc32c(*crc, d + fim, n);
+      fim += n;
+    }
+
+    size_t pos = 0;
+    while (ok && pos < fim) {
+      std::chrono::steady_clock::time_point inicio =
+          std::chrono::steady_clock::now();
+      size_t n = cortarFragmento(d + pos, fim - pos, eof, opcoes_);
+      if (n == 0) break;  // o resto vai com a próxima leitura
+      IdFragmento id = identificarFragmento(d + pos, n);
+      nanossegundos_corte_ += nanossegundosDesde(inicio);
+
+      bool novo;
+      ok = gravarFragmento(id, d + pos, n, &novo);
+      if (novo) {
+        bytes_novos_ += n;
+        fragmentos_novos_++;
+      }
+      *texto += id.hex() + " " + std::to_string(n) + "\n";
+      total += n;
+      quantidade++;
+      pos += n;
+    }
+    memmove(d, d + pos, fim - pos);
+    fim -= pos;
+  }
+  bytes_ += total;
+  fragmentos_ += quantidade;
+  return ok && total == tamanho;
+}
+
+MetodoCopia RepositorioFragmentos::guardar(const std::string& origem,
+                                           const std::string& receita,
+                                           bool renomear, uint32_t* crc) {
+  const std::string temporario = caminhoTemporario(receita);
+  if (crc != NULL) *crc = 0;
+
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (in < 0 || fstat(in, &st) != 0) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    if (in >= 0) close(in);
+    return COPIA_FALHOU;
+  }
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  std::string texto;
+  bool ok = fragmentar(in, st.st_size, &texto, crc);
+  close(in);
+
+  // Receita com os tempos da origem
+  criarDiretorioPai(receita);
+  int saida = -1;
+  if (ok) {
+    saida = open(temporario.c_str(),
+                 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    ok = saida >= 0 &&
+         escreverTudo(saida,
+                      reinterpret_cast<const unsigned char*>(texto.data()),
+                      texto.size());
+  }
+  if (ok) {
+    const struct timespec tempos[2] = { st.st_atim, st.st_mtim };
+    futimens(saida, tempos);
+  }
+  if (saida >= 0 && close(saida) != 0) ok = false;
+  if (!ok) {
+    std::cerr << "[ERRO] Falha ao guardar fragmentos: " << origem
+              << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (renomear && rename(temporario.c_str(), receita.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << receita << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  return COPIA_FRAGMENTOS;
+}
+
+MetodoCopia RepositorioFragmentos::guardarObjeto(const std::string& origem,
+                                                 IdFragmento* receita,
+                                                 uint32_t* crc) {
+  if (crc != NULL) *crc = 0;
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (in < 0 || fstat(in, &st) != 0) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    if (in >= 0) close(in);
+    return COPIA_FALHOU;
+  }
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  std::string texto;
+  bool ok = fragmentar(in, st.st_size, &texto, crc);
+  close(in);
+  if (!ok || !gravarObjeto(texto, receita)) {
+    std::cerr << "[ERRO] Falha ao guardar fragmentos: " << origem
+              << " (errno=" << errno << ")\n";
+    return COPIA_FALHOU;
+  }
+  return COPIA_FRAGMENTOS;
+}
+
+// Remonta em 'destino' o arquivo descrito pelo texto de uma receita
+MetodoCopia RepositorioFragmentos::remontar(const std::string& texto,
+                                            const struct timespec tempos[2],
+                                            const std::string& nome,
+                                            const std::string& destino,
+                                            bool renomear) {
+  const std::string temporario = caminhoTemporario(destino);
+  std::istringstream entrada(texto);
+  std::string cabecalho;
+  uint64_t esperado = 0;
+  if (!(entrada >> cabecalho >> esperado) || cabecalho != CABECALHO_RECEITA) {
+    std::cerr << "[ERRO] Receita de fragmentos inválida: " << nome << "\n";
+    return COPIA_FALHOU;
+  }
+
+  criarDiretorioPai(destino);
+  int saida = open(temporario.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  bool ok = saida >= 0;
+  uint64_t total = 0;
+  std::vector<unsigned char> dados;
+  std::string hex;
+  size_t tamanho;
+  while (ok && entrada >> hex >> tamanho) {
+    IdFragmento id;
+    if (!id.deHex(hex) || tamanho == 0) {
+      ok = false;
+      break;
+    }
+    dados.resize(tamanho);
+    int fd = open(caminhoFragmento(id).c_str(), O_RDONLY | O_CLOEXEC);
+    ok = fd >= 0 && lerTudo(fd, &dados[0], tamanho);
+    if (fd >= 0) close(fd);
+    // Fragmento ausente, truncado ou corrompido: o arquivo não volta
+    ok = ok && identificarFragmento(&dados[0], tamanho) == id &&
+         escreverTudo(saida, &dados[0], tamanho);
+    total += tamanho;
+  }
+  ok = ok && !entrada.bad() && total == esperado;
+  if (ok) futimens(saida, tempos);
+  if (saida >= 0 && close(saida) != 0) ok = false;
+  if (!ok) {
+    std::cerr << "[ERRO] Falha ao remontar: " << nome << "\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (renomear && rename(temporario.c_str(), destino.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << destino << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  return COPIA_FRAGMENTOS;
+}
+
+MetodoCopia RepositorioFragmentos::restaurar(const std::string& receita,
+                                             const std::string& destino,
+                                             bool renomear) {
+  std::ifstream entrada(receita.c_str());
+  struct stat st;
+  if (!entrada.is_open() || stat(receita.c_str(), &st) != 0) {
+    std::cerr << "[ERRO] Receita de fragmentos inválida: " << receita << "\n";
+    return COPIA_FALHOU;
+  }
+  std::string texto((std::istreambuf_iterator<char>(entrada)),
+                    std::istreambuf_iterator<char>());
+  const struct timespec tempos[2] = { st.st_atim, st.st_mtim };
+  return remontar(texto, tempos, receita, destino, renomear);
+}
+
+MetodoCopia RepositorioFragmentos::restaurarObjeto(
+    const IdFragmento& receita, int64_t mtime_seg, uint32_t mtime_nseg,
+    const std::string& destino, bool renomear) {
+  std::string texto;
+  if (!lerObjeto(receita, &texto)) {
+    std::cerr << "[ERRO] Receita de fragmentos inválida: " << receita.hex()
+              << "\n";
+    return COPIA_FALHOU;
+  }
+  struct timespec tempos[2];
+  tempos[0].tv_sec = tempos[1].tv_sec = static_cast<time_t>(mtime_seg);
+  tempos[0].tv_nsec = tempos[1].tv_nsec = mtime_nseg;
+  return remontar(texto, tempos, receita.hex(), destino, renomear);
+}
+
+ResultadoFragmentos RepositorioFragmentos::totais() const {
+  ResultadoFragmentos resultado;
+  resultado.bytes = bytes_;
+  resultado.bytes_novos = bytes_novos_;
+  resultado.fragmentos = fragmentos_;
+  resultado.fragmentos_novos = fragmentos_novos_;
+  return resultado;
+}
+
+double RepositorioFragmentos::segundosFragmentacao() const {
+  return nanossegundos_corte_ / 1e9;
+}
@@ -0,0 +1,152 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef FRAGMENTOS_HPP_
+#define FRAGMENTOS_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include "copia.hpp"  // NOLINT
+
+class IndiceFragmentos;
+
+// Nome do repositório de fragmentos dentro do diretório de destino
+extern const char* const NOME_FRAGMENTOS;
+
+// Tamanhos dos fragmentos (FastCDC): nenhum corte antes de 'minimo', corte
+// forçado em 'maximo' e, entre eles, cortes que tendem a 'medio' (potência
+// de 2). O índice dos fragmentos guarda até 'ids_em_memoria'
+// identificadores novos antes de gravar uma tabela e funde tabelas acima de
+// 'maximo_tabelas' (ver indice.hpp).
+struct OpcoesFragmentos {
+  size_t minimo = 2 << 10;
+  size_t medio = 8 << 10;
+  size_t maximo = 64 << 10;
+  size_t ids_em_memoria = 1 << 22;
+  size_t maximo_tabelas = 8;
+};
+
+// Tamanho do próximo fragmento de 'dados'. A fronteira depende só dos
+// bytes próximos a ela (gear hash), então uma inserção no começo de um
+// arquivo não desloca os cortes do resto. Com 'fim_dos_dados' false e
+// menos de 'maximo' bytes sem corte, devolve 0 (faltam dados).
+size_t cortarFragmento(const unsigned char* dados, size_t tamanho,
+                       bool fim_dos_dados, const OpcoesFragmentos& opcoes);
+
+// Identificador de um fragmento: dois XXH64 de sementes diferentes
+struct IdFragmento {
+  uint64_t h[2];
+  bool operator==(const IdFragmento& outro) const {
+    return h[0] == outro.h[0] && h[1] == outro.h[1];
+  }
+  std::string hex() const;
+  bool deHex(const std::string& texto);
+};
+
+IdFragmento identificarFragmento(const void* dados, size_t tamanho);
+
+struct HashIdFragmento {
+  size_t operator()(const IdFragmento& id) const {
+    return static_cast<size_t>(id.h[0]);
+  }
+};
+
+// Bytes e fragmentos lidos das origens e os que faltavam no repositório
+// (gravados); bytes / bytes_novos é a taxa de deduplicação
+struct ResultadoFragmentos {
+  uint64_t bytes = 0;
+  uint64_t bytes_novos = 0;
+  uint64_t fragmentos = 0;
+  uint64_t fragmentos_novos = 0;
+};
+
+/***************************************************************************
+ * Classe: RepositorioFragmentos
+ * Formato de destino com deduplicação: cada arquivo é cortado em
+ * fragmentos definidos pelo conteúdo e cada fragmento é guardado uma vez
+ * só, em NOME_FRAGMENTOS/ab/cdef..., com o nome derivado do conteúdo. No
+ * lugar do arquivo, o destino recebe uma receita (texto: "fragmentos
+ * tamanho" e uma linha "id tamanho" por fragmento) com os tempos da
+ * origem, então as decisões por mtime valem como no espelho. Os
+ * fragmentos são escritos em temporários e renomeados antes da receita;
+ * uma queda deixa no máximo fragmentos sem receita. Quais fragmentos já
+ * existem vem do índice em NOME_FRAGMENTOS/indice, não de listar o
+ * repositório.
+ ***************************************************************************/
+class RepositorioFragmentos {
+ public:
+  // 'duravel' (DURABILIDADE_LOTE): o índice só registra fragmentos que já
+  // chegaram ao disco
+  explicit RepositorioFragmentos(const OpcoesFragmentos& opcoes,
+                                 bool duravel = false);
+  ~RepositorioFragmentos();
+
+  // Cria o repositório em 'destino_path', se preciso, e abre o índice; um
+  // repositório sem índice (versão anterior) é listado uma vez para
+  // criá-lo. Para restaurar basta 'somente_leitura'.
+  bool abrir(const std::string& destino_path, bool somente_leitura = false);
+
+  // Grava em disco a parte do índice ainda em memória
+  bool concluir();
+
+  // Fragmenta 'origem', grava os fragmentos que faltam e escreve a receita
+  // em caminhoTemporario(receita), renomeada como em copiarArquivo. Com
+  // 'crc', o CRC32C da origem é calculado na mesma leitura. Pode ser
+  // chamada de várias threads.
+  MetodoCopia guardar(const std::string& origem, const std::string& receita,
+                      bool renomear, uint32_t* crc = NULL);
+
+  // Remonta o arquivo da 'receita' em 'destino' (pelo temporário), com os
+  // tempos da receita; cada fragmento é conferido pelo identificador
+  MetodoCopia restaurar(const std::string& receita,
+                        const std::string& destino, bool renomear);
+
+  // Objetos: dados pequenos guardados como um fragmento só, pelo próprio
+  // identificador (receitas e nós de snapshots, ver snapshots.hpp).
+  // lerObjeto confere o identificador do que leu.
+  bool gravarObjeto(const std::string& dados, IdFragmento* id);
+  bool lerObjeto(const IdFragmento& id, std::string* dados) const;
+
+  // Como guardar e restaurar, com a receita guardada como objeto; os
+  // tempos do arquivo ficam com quem guarda o identificador
+  MetodoCopia guardarObjeto(const std::string& origem, IdFragmento* receita,
+                            uint32_t* crc = NULL);
+  MetodoCopia restaurarObjeto(const IdFragmento& receita, int64_t mtime_seg,
+                              uint32_t mtime_nseg,
+                              const std::string& destino, bool renomear);
+
+  // Totais desde abrir(): bytes lidos e gravados, e o tempo gasto cortando
+  // e identificando fragmentos (vazão da fragmentação)
+  ResultadoFragmentos totais() const;
+  double segundosFragmentacao() const;
+
+ private:
+  RepositorioFragmentos(const RepositorioFragmentos&);
+  RepositorioFragmentos& operator=(const RepositorioFragmentos&);
+
+  std::string caminhoFragmento(const IdFragmento& id) const;
+  bool gravarFragmento(const IdFragmento& id, const unsigned char* dados,
+                       size_t tamanho, bool* novo);
+  bool fragmentar(int in, uint64_t tamanho, std::string* texto,
+                  uint32_t* crc);
+  MetodoCopia remontar(const std::string& texto,
+                       const struct timespec tempos[2],
+                       const std::string& nome, const std::string& destino,
+                       bool renomear);
+
+  OpcoesFragmentos opcoes_;
+  bool duravel_;
+  std::string raiz_;
+  std::unique_ptr<IndiceFragmentos> indice_;
+  std::atomic<uint64_t> contador_temporarios_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> bytes_novos_{0};
+  std::atomic<uint64_t> fragmentos_{0};
+  std::atomic<uint64_t> fragmentos_novos_{0};
+  std::atomic<uint64_t> nanossegundos_corte_{0};
+};
+
+#endif  // FRAGMENTOS_HPP_
@@ -0,0 +1,478 @@
+// Copyright 2025 Alex Batista Resende
+#include "indice.hpp"  // NOLINT
+#include "copia.hpp"  // NOLINT
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MARCA_TABELA[8] = "BKIDX01";
+
+// Filtro: 10 bits por identificador em blocos de 512 bits (uma linha de
+// cache); 7 bits por identificador, todos no mesmo bloco. Falsos
+// positivos: ~1%.
+const uint64_t BITS_POR_ID = 10;
+const unsigned BITS_BLOCO = 512;
+const unsigned PALAVRAS_BLOCO = BITS_BLOCO / 64;
+const unsigned FUNCOES_FILTRO = 7;
+
+// Identificadores gravados por pwrite
+const size_t IDS_POR_ESCRITA = 1 << 16;
+
+struct CabecalhoTabela {
+  char marca[8];
+  uint64_t quantidade;
+  uint64_t blocos;  // do filtro, BITS_BLOCO bits cada
+  uint64_t reservado;
+};
+
+bool menor(const IdFragmento& a, const IdFragmento& b) {
+  return a.h[0] < b.h[0] || (a.h[0] == b.h[0] && a.h[1] < b.h[1]);
+}
+
+// floor(h * n / 2^64): posição proporcional ao hash em [0, n)
+uint64_t escalar(uint64_t h, uint64_t n) {
+  return static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(h) * n) >> 64);
+}
+
+uint64_t blocosFiltro(uint64_t capacidade) {
+  return std::max<uint64_t>(
+      1, (capacidade * BITS_POR_ID + BITS_BLOCO - 1) / BITS_BLOCO);
+}
+
+size_t inicioIds(uint64_t blocos) {
+  return sizeof(CabecalhoTabela) + blocos * (BITS_BLOCO / 8);
+}
+
+bool escreverEm(int fd, const void* dados, size_t tamanho, off_t offset) {
+  const char* p = static_cast<const char*>(dados);
+  while (tamanho > 0) {
+    ssize_t n = pwrite(fd, p, tamanho, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    tamanho -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool sincronizarDiretorio(const std::string& diretorio) {
+  int fd = open(diretorio.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return false;
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+/***************************************************************************
+ * Classe: EscritorTabela
+ * Grava uma tabela a partir de identificadores em ordem crescente. O
+ * filtro é dimensionado pela 'capacidade' (repetidos são descartados) e
+ * escrito por último, junto com o cabeçalho.
+ ***************************************************************************/
+class EscritorTabela {
+ public:
+  ~EscritorTabela() { descartar(); }
+
+  bool abrir(const std::string& caminho, uint64_t capacidade) {
+    caminho_ = caminho;
+    blocos_ = blocosFiltro(capacidade);
+    filtro_.assign(blocos_ * PALAVRAS_BLOCO, 0);
+    buffer_.reserve(IDS_POR_ESCRITA);
+    offset_ = inicioIds(blocos_);
+    fd_ = open(caminho.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+               0444);
+    return fd_ >= 0;
+  }
+
+  bool adicionar(const IdFragmento& id) {
+    if (quantidade_ > 0 && !menor(ultimo_, id)) return true;  // repetido
+    ultimo_ = id;
+    quantidade_++;
+    uint64_t* bloco = &filtro_[escalar(id.h[0], blocos_) * PALAVRAS_BLOCO];
+    for (unsigned i = 0; i < FUNCOES_FILTRO; i++) {
+      unsigned bit = (id.h[1] >> (9 * i)) & (BITS_BLOCO - 1);
+      bloco[bit / 64] |= 1ULL << (bit % 64);
+    }
+    buffer_.push_back(id);
+    return buffer_.size() < IDS_POR_ESCRITA || esvaziar();
+  }
+
+  bool fechar(bool sincronizar) {
+    CabecalhoTabela cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.marca, MARCA_TABELA, sizeof(cab.marca));
+    cab.quantidade = quantidade_;
+    cab.blocos = blocos_;
+    bool ok = esvaziar() &&
+              escreverEm(fd_, &filtro_[0], filtro_.size() * 8,
+                         sizeof(cab)) &&
+              escreverEm(fd_, &cab, sizeof(cab), 0) &&
+              (!sincronizar || fdatasync(fd_) == 0);
+    if (close(fd_) != 0) ok = false;
+    fd_ = -1;
+    if (!ok) unlink(caminho_.c_str());
+    return ok;
+  }
+
+  void descartar() {
+    if (fd_ < 0) return;
+    close(fd_);
+    fd_ = -1;
+    unlink(caminho_.c_str());
+  }
+
+ private:
+  bool esvaziar() {
+    size_t bytes = buffer_.size() * sizeof(IdFragmento);
+    bool ok = bytes == 0 || escreverEm(fd_, &buffer_[0], bytes, offset_);
+    offset_ += bytes;
+    buffer_.clear();
+    return ok;
+  }
+
+  int fd_ = -1;
+  std::string caminho_;
+  uint64_t blocos_ = 0;
+  uint64_t quantidade_ = 0;
+  IdFragmento ultimo_;
+  std::vector<uint64_t> filtro_;
+  std::vector<IdFragmento> buffer_;
+  off_t offset_ = 0;
+};
+
+}  // namespace
+
+/***************************************************************************
+ * Tabela mapeada. O mapa vive enquanto alguma busca ainda a usa, mesmo
+ * depois de fundida e apagada.
+ ***************************************************************************/
+struct IndiceFragmentos::Tabela {
+  uint32_t numero = 0;
+  std::string caminho;
+  void* mapa = NULL;
+  size_t tamanho_mapa = 0;
+  const uint64_t* filtro = NULL;
+  uint64_t blocos = 0;
+  const IdFragmento* ids = NULL;
+  uint64_t quantidade = 0;
+
+  ~Tabela() {
+    if (mapa != NULL) munmap(mapa, tamanho_mapa);
+  }
+
+  bool mapear(const std::string& nome, uint32_t num) {
+    caminho = nome;
+    numero = num;
+    int fd = open(nome.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        st.st_size < static_cast<off_t>(sizeof(CabecalhoTabela))) {
+      if (fd >= 0) close(fd);
+      return false;
+    }
+    tamanho_mapa = static_cast<size_t>(st.st_size);
+    mapa = mmap(NULL, tamanho_mapa, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+      mapa = NULL;
+      return false;
+    }
+    const CabecalhoTabela* cab = static_cast<CabecalhoTabela*>(mapa);
+    blocos = cab->blocos;
+    quantidade = cab->quantidade;
+    if (memcmp(cab->marca, MARCA_TABELA, sizeof(cab->marca)) != 0 ||
+        blocos == 0 || blocos > tamanho_mapa / (BITS_BLOCO / 8) ||
+        quantidade > tamanho_mapa / sizeof(IdFragmento) ||
+        tamanho_mapa != inicioIds(blocos) +
+                            quantidade * sizeof(IdFragmento)) {
+      return false;
+    }
+    const char* base = static_cast<const char*>(mapa);
+    filtro = reinterpret_cast<const uint64_t*>(base + sizeof(*cab));
+    ids = reinterpret_cast<const IdFragmento*>(base + inicioIds(blocos));
+    // O filtro é consultado a cada busca; os identificadores, aos saltos
+    madvise(mapa, inicioIds(blocos), MADV_WILLNEED);
+    return true;
+  }
+
+  bool contem(const IdFragmento& id) const {
+    const uint64_t* bloco = filtro + escalar(id.h[0], blocos) * PALAVRAS_BLOCO;
+    for (unsigned i = 0; i < FUNCOES_FILTRO; i++) {
+      unsigned bit = (id.h[1] >> (9 * i)) & (BITS_BLOCO - 1);
+      if ((bloco[bit / 64] & (1ULL << (bit % 64))) == 0) return false;
+    }
+    if (quantidade == 0) return false;
+
+    // Começa onde o hash cairia numa distribuição uniforme e avança em
+    // passos dobrados até cercar a posição; a busca binária final fica
+    // dentro de poucas páginas
+    const uint64_t n = quantidade;
+    uint64_t pos = escalar(id.h[0], n);
+    uint64_t inicio, fim;
+    uint64_t passo = 1;
+    if (menor(ids[pos], id)) {
+      inicio = pos + 1;
+      fim = inicio;
+      while (fim < n && menor(ids[fim], id)) {
+        inicio = fim + 1;
+        fim += passo;
+        passo *= 2;
+      }
+      fim = std::min(fim, n);
+    } else {
+      fim = pos;
+      inicio = fim;
+      while (inicio > 0 && !menor(ids[inicio - 1], id)) {
+        fim = inicio - 1;
+        inicio = fim >= passo ? fim - passo : 0;
+        passo *= 2;
+      }
+    }
+    const IdFragmento* achado = std::lower_bound(ids + inicio, ids + fim, id,
+                                                 menor);
+    return achado != ids + n && *achado == id;
+  }
+};
+
+/***************************************************************************
+ * Classe: IndiceFragmentos
+ ***************************************************************************/
+IndiceFragmentos::~IndiceFragmentos() {
+  concluir();
+}
+
+std::string IndiceFragmentos::caminhoTabela(uint32_t numero) const {
+  char nome[32];
+  snprintf(nome, sizeof(nome), "/indice-%06u", numero);
+  return diretorio_ + nome;
+}
+
+bool IndiceFragmentos::abrir(const std::string& diretorio,
+                             bool sincronizar) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  diretorio_ = diretorio;
+  sincronizar_ = sincronizar;
+  memoria_.clear();
+  proxima_ = 1;
+  std::shared_ptr<Tabelas> tabelas(new Tabelas);
+  std::atomic_store(&tabelas_, std::shared_ptr<const Tabelas>(tabelas));
+  if (mkdir(diretorio.c_str(), 0777) != 0 && errno != EEXIST) return false;
+
+  DIR* dir = opendir(diretorio.c_str());
+  if (dir == NULL) return false;
+  std::vector<std::string> descartados;
+  while (struct dirent* entrada = readdir(dir)) {
+    const std::string nome = entrada->d_name;
+    unsigned numero = 0;
+    char resto;
+    if (ehCaminhoTemporario(nome)) {
+      descartados.push_back(diretorio + "/" + nome);  // tabela incompleta
+    } else if (nome.size() == 13 &&
+               sscanf(nome.c_str(), "indice-%6u%c", &numero, &resto) == 1 &&
+               numero > 0) {
+      std::shared_ptr<Tabela> tabela(new Tabela);
+      if (tabela->mapear(caminhoTabela(numero), numero)) {
+        tabelas->push_back(tabela);
+      } else {
+        // Os fragmentos dela só serão gravados (e registrados) de novo
+        std::cerr << "[AVISO] Tabela do índice ilegível, descartada: "
+                  << nome << "\n";
+        descartados.push_back(diretorio + "/" + nome);
+      }
+      proxima_ = std::max(proxima_, numero + 1);
+    }
+  }
+  closedir(dir);
+  for (size_t i = 0; i < descartados.size(); i++) {
+    unlink(descartados[i].c_str());
+  }
+  return true;
+}
+
+bool IndiceFragmentos::contem(const IdFragmento& id) const {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    if (memoria_.count(id) > 0) return true;
+  }
+  std::shared_ptr<const Tabelas> tabelas = std::atomic_load(&tabelas_);
+  if (!tabelas) return false;
+  for (size_t i = 0; i < tabelas->size(); i++) {
+    if ((*tabelas)[i]->contem(id)) return true;
+  }
+  return false;
+}
+
+bool IndiceFragmentos::inserir(const IdFragmento& id) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  bool novo = memoria_.insert(id).second;
+  if (memoria_.size() >= limite_memoria_ && !gravarTravado()) {
+    std::cerr << "[AVISO] Falha ao gravar tabela do índice em: "
+              << diretorio_ << " (errno=" << errno << ")\n";
+  }
+  return novo;
+}
+
+bool IndiceFragmentos::concluir() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  return gravarTravado();
+}
+
+// Renomeia a tabela completa para o nome definitivo e a mapeia
+std::shared_ptr<const IndiceFragmentos::Tabela> IndiceFragmentos::publicar(
+    const std::string& temporario, uint32_t numero) {
+  const std::string caminho = caminhoTabela(numero);
+  if (rename(temporario.c_str(), caminho.c_str()) != 0) {
+    unlink(temporario.c_str());
+    return std::shared_ptr<const Tabela>();
+  }
+  if (sincronizar_) sincronizarDiretorio(diretorio_);
+  std::shared_ptr<Tabela> tabela(new Tabela);
+  if (!tabela->mapear(caminho, numero)) return std::shared_ptr<const Tabela>();
+  return tabela;
+}
+
+// Funde 'fontes' numa tabela nova (intercalação das listas ordenadas) e
+// apaga as fontes depois que ela tem o nome definitivo
+std::shared_ptr<const IndiceFragmentos::Tabela> IndiceFragmentos::fundir(
+    const Tabelas& fontes) {
+  const uint32_t numero = proxima_++;
+  const std::string temporario = caminhoTemporario(caminhoTabela(numero));
+  uint64_t capacidade = 0;
+  for (size_t i = 0; i < fontes.size(); i++) {
+    capacidade += fontes[i]->quantidade;
+  }
+  EscritorTabela escritor;
+  if (!escritor.abrir(temporario, capacidade)) {
+    return std::shared_ptr<const Tabela>();
+  }
+  std::vector<uint64_t> pos(fontes.size(), 0);
+  for (;;) {
+    size_t escolhida = fontes.size();
+    for (size_t i = 0; i < fontes.size(); i++) {
+      if (pos[i] < fontes[i]->quantidade &&
+          (escolhida == fontes.size() ||
+           menor(fontes[i]->ids[pos[i]],
+                 fontes[escolhida]->ids[pos[escolhida]]))) {
+        escolhida = i;
+      }
+    }
+    if (escolhida == fontes.size()) break;
+    if (!escritor.adicionar(fontes[escolhida]->ids[pos[escolhida]++])) {
+      return std::shared_ptr<const Tabela>();
+    }
+  }
+  if (!escritor.fechar(sincronizar_)) return std::shared_ptr<const Tabela>();
+  std::shared_ptr<const Tabela> fundida = publicar(temporario, numero);
+  if (fundida) {
+    for (size_t i = 0; i < fontes.size(); i++) {
+      unlink(fontes[i]->caminho.c_str());
+    }
+  }
+  return fundida;
+}
+
+// Grava a tabela em memória e funde tabelas se passaram do máximo. As
+// buscas seguem pelas tabelas antigas até a troca; a tabela em memória só
+// é esvaziada depois dela.
+bool IndiceFragmentos::gravarTravado() {
+  if (memoria_.empty()) return true;
+  if (diretorio_.empty()) return false;
+
+  // Os fragmentos citados precisam chegar ao disco antes da tabela
+  if (sincronizar_) {
+    int fd = open(diretorio_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+      syncfs(fd);
+      close(fd);
+    }
+  }
+
+  std::vector<IdFragmento> ids(memoria_.begin(), memoria_.end());
+  std::sort(ids.begin(), ids.end(), menor);
+  const uint32_t numero = proxima_++;
+  const std::string temporario = caminhoTemporario(caminhoTabela(numero));
+  EscritorTabela escritor;
+  bool ok = escritor.abrir(temporario, ids.size());
+  for (size_t i = 0; ok && i < ids.size(); i++) {
+    ok = escritor.adicionar(ids[i]);
+  }
+  if (!ok || !escritor.fechar(sincronizar_)) return false;
+  std::shared_ptr<const Tabela> nova = publicar(temporario, numero);
+  if (!nova) return false;
+
+  std::shared_ptr<const Tabelas> atuais = std::atomic_load(&tabelas_);
+  Tabelas tabelas(*atuais);
+  tabelas.push_back(nova);
+
+  // Fusão por tamanho: as menores se juntam; a maior entra quando as
+  // outras somadas a alcançam, então cada identificador é reescrito
+  // O(log n) vezes
+  while (tabelas.size() > maximo_tabelas_ && tabelas.size() > 1) {
+    std::sort(tabelas.begin(), tabelas.end(),
+              [](const std::shared_ptr<const Tabela>& a,
+                 const std::shared_ptr<const Tabela>& b) {
+                return a->quantidade > b->quantidade;
+              });
+    uint64_t resto = 0;
+    for (size_t i = 1; i < tabelas.size(); i++) {
+      resto += tabelas[i]->quantidade;
+    }
+    size_t primeira = (resto >= tabelas[0]->quantidade ||
+                       tabelas.size() < 3) ? 0 : 1;
+    Tabelas fontes(tabelas.begin() + primeira, tabelas.end());
+    std::shared_ptr<const Tabela> fundida = fundir(fontes);
+    if (!fundida) break;  // fica com mais tabelas, mas correto
+    tabelas.erase(tabelas.begin() + primeira, tabelas.end());
+    tabelas.push_back(fundida);
+  }
+
+  std::atomic_store(&tabelas_, std::shared_ptr<const Tabelas>(
+                                   new Tabelas(tabelas)));
+  memoria_.clear();
+  return true;
+}
+
+size_t IndiceFragmentos::quantidade() const {
+  std::shared_ptr<const Tabelas> tabelas = std::atomic_load(&tabelas_);
+  std::lock_guard<std::mutex> trava(mutex_);
+  size_t total = memoria_.size();
+  for (size_t i = 0; tabelas && i < tabelas->size(); i++) {
+    total += (*tabelas)[i]->quantidade;
+  }
+  return total;
+}
+
+size_t IndiceFragmentos::bytesEmMemoria() const {
+  std::shared_ptr<const Tabelas> tabelas = std::atomic_load(&tabelas_);
+  std::lock_guard<std::mutex> trava(mutex_);
+  // Nó do unordered_set: próximo, identificador e hash guardado
+  size_t total = memoria_.size() * (sizeof(void*) + sizeof(IdFragmento) +
+                                    sizeof(size_t)) +
+                 memoria_.bucket_count() * sizeof(void*);
+  for (size_t i = 0; tabelas && i < tabelas->size(); i++) {
+    total += (*tabelas)[i]->blocos * (BITS_BLOCO / 8);
+  }
+  return total;
+}
+
+size_t IndiceFragmentos::tabelas() const {
+  std::shared_ptr<const Tabelas> tabelas = std::atomic_load(&tabelas_);
+  return tabelas ? tabelas->size() : 0;
+}
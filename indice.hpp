@@ -0,0 +1,83 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef INDICE_HPP_
+#define INDICE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "fragmentos.hpp"  // NOLINT
+
+/***************************************************************************
+ * Classe: IndiceFragmentos
+ * Índice persistente dos fragmentos de um repositório, no estilo LSM: os
+ * identificadores novos ficam numa tabela em memória e, ao concluir (ou
+ * ao passar de 'ids_em_memoria'), viram uma tabela imutável em disco,
+ * indice-NNNNNN: cabeçalho, filtro de Bloom em blocos de 64 bytes e os
+ * identificadores em ordem. As tabelas são mapeadas com mmap; só o filtro
+ * precisa ficar residente (10 bits por fragmento, ~1,25 MB por milhão) e
+ * responde "certamente novo" com uma linha de cache por tabela. Quando o
+ * filtro deixa passar, a busca começa na posição estimada pelo próprio
+ * hash (os identificadores são uniformes) e toca poucas páginas. Passando
+ * de 'maximo_tabelas', as tabelas menores são fundidas numa só.
+ *
+ * Uma tabela só pode citar fragmentos que já estão no disco: com
+ * 'sincronizar', cada tabela nova é precedida de um syncfs do repositório
+ * e gravada com fsync antes do rename. Faltar um identificador no índice
+ * custa só regravar o fragmento.
+ ***************************************************************************/
+class IndiceFragmentos {
+ public:
+  explicit IndiceFragmentos(size_t ids_em_memoria = 1 << 22,
+                            size_t maximo_tabelas = 8)
+      : limite_memoria_(ids_em_memoria), maximo_tabelas_(maximo_tabelas) {}
+  ~IndiceFragmentos();  // grava o que estiver em memória
+
+  // Mapeia as tabelas de 'diretorio', criando-o se preciso. 'sincronizar'
+  // ordena as tabelas novas depois dos fragmentos (ver acima).
+  bool abrir(const std::string& diretorio, bool sincronizar);
+
+  // Thread-safe. inserir devolve false se o identificador já estava na
+  // tabela em memória (outra thread o gravou antes).
+  bool contem(const IdFragmento& id) const;
+  bool inserir(const IdFragmento& id);
+
+  // Grava a tabela em memória em disco; false em falha
+  bool concluir();
+
+  // Identificadores nas tabelas em disco e em memória (pode contar
+  // repetidos entre tabelas) e bytes residentes: filtros e tabela em
+  // memória
+  size_t quantidade() const;
+  size_t bytesEmMemoria() const;
+  size_t tabelas() const;
+
+ private:
+  struct Tabela;
+  typedef std::vector<std::shared_ptr<const Tabela> > Tabelas;
+
+  IndiceFragmentos(const IndiceFragmentos&);
+  IndiceFragmentos& operator=(const IndiceFragmentos&);
+
+  std::string caminhoTabela(uint32_t numero) const;
+  bool gravarTravado();
+  std::shared_ptr<const Tabela> fundir(const Tabelas& fontes);
+  std::shared_ptr<const Tabela> publicar(const std::string& temporario,
+                                         uint32_t numero);
+
+  size_t limite_memoria_;
+  size_t maximo_tabelas_;
+  std::string diretorio_;
+  bool sincronizar_ = false;
+  uint32_t proxima_ = 1;
+  // Lido sem trava (atomic_load) e trocado inteiro a cada tabela nova
+  std::shared_ptr<const Tabelas> tabelas_;
+  std::unordered_set<IdFragmento, HashIdFragmento> memoria_;
+  mutable std::mutex mutex_;
+};
+
+#endif  // INDICE_HPP_
@@ -0,0 +1,350 @@
+// Copyright 2025 Alex Batista Resende
+#include "log_assincrono.hpp"  // NOLINT
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const ARQUIVO_LOG = "Backup.log";
+
+// Sinais que ainda dão chance de levar o log ao arquivo antes de morrer
+const int SINAIS_FATAIS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT,
+                              SIGTERM, SIGINT };
+const size_t NUM_SINAIS = sizeof(SINAIS_FATAIS) / sizeof(SINAIS_FATAIS[0]);
+
+// Texto reservado em cada célula do anel; linhas maiores crescem a
+// célula uma vez e ela fica com a capacidade
+const size_t RESERVA_LINHA = 256;
+
+// Espera máxima da escritora adormecida; o anel avisa antes disso
+const std::chrono::milliseconds ESPERA_ESCRITORA(10);
+
+// write completo, tolerando EINTR e escritas parciais
+void escreverTudo(int fd, const char* dados, size_t tamanho) {
+  while (tamanho > 0) {
+    ssize_t escritos = write(fd, dados, tamanho);
+    if (escritos < 0 && errno == EINTR) continue;
+    if (escritos <= 0) return;
+    dados += escritos;
+    tamanho -= static_cast<size_t>(escritos);
+  }
+}
+
+size_t potenciaDeDois(size_t n) {
+  size_t p = 2;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+/***************************************************************************
+ * Classe: LogAssincrono
+ * Anel limitado de linhas com números de sequência por célula: produtores
+ * reservam uma posição com CAS e publicam a linha; a escritora é o único
+ * consumidor. Com o anel cheio, o produtor espera (nenhuma linha é
+ * descartada).
+ ***************************************************************************/
+class LogAssincrono {
+ public:
+  LogAssincrono(const OpcoesLog& opcoes, int fd);
+  ~LogAssincrono();
+
+  void enviar(VisaoTexto linha);
+  void descarregar();
+
+  // Chamado de um tratador de sinal: só write e atômicos, sem alocação
+  void descarregarEmSinal();
+
+ private:
+  LogAssincrono(const LogAssincrono&);
+  LogAssincrono& operator=(const LogAssincrono&);
+
+  struct Celula {
+    std::atomic<size_t> sequencia;
+    std::string linha;
+  };
+
+  bool vazio() const;
+  void consumir(bool forcar);
+  void escreverLote();
+  void trabalhar();
+
+  OpcoesLog opcoes_;
+  int fd_;
+  size_t capacidade_;
+  std::unique_ptr<Celula[]> celulas_;
+  std::atomic<size_t> pos_inserir_;
+  std::atomic<size_t> pos_retirar_;
+
+  // Dono do lado consumidor: a escritora ou um tratador de sinal
+  std::atomic<bool> consumindo_;
+  std::string lote_;
+  size_t linhas_lote_ = 0;
+  std::chrono::steady_clock::time_point ultimo_write_;
+
+  std::atomic<size_t> escritas_;  // linhas já entregues ao descritor
+  std::atomic<bool> dormindo_;
+  bool forcar_ = false;
+  bool encerrar_ = false;
+  std::mutex mutex_;
+  std::condition_variable acordar_;
+  std::condition_variable descarregado_;
+  std::thread escritora_;
+};
+
+LogAssincrono::LogAssincrono(const OpcoesLog& opcoes, int fd)
+    : opcoes_(opcoes), fd_(fd),
+      capacidade_(potenciaDeDois(opcoes.capacidade)),
+      celulas_(new Celula[capacidade_]), pos_inserir_(0), pos_retirar_(0),
+      consumindo_(false), ultimo_write_(std::chrono::steady_clock::now()),
+      escritas_(0), dormindo_(false) {
+  for (size_t i = 0; i < capacidade_; i++) {
+    celulas_[i].sequencia = i;
+    celulas_[i].linha.reserve(RESERVA_LINHA);
+  }
+  lote_.reserve(opcoes_.tamanho_lote);
+  escritora_ = std::thread(&LogAssincrono::trabalhar, this);
+}
+
+LogAssincrono::~LogAssincrono() {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    encerrar_ = true;
+  }
+  acordar_.notify_one();
+  escritora_.join();
+  close(fd_);
+}
+
+void LogAssincrono::enviar(VisaoTexto linha) {
+  size_t pos = pos_inserir_.load(std::memory_order_relaxed);
+  Celula* celula;
+  for (;;) {
+    celula = &celulas_[pos & (capacidade_ - 1)];
+    size_t sequencia = celula->sequencia.load(std::memory_order_acquire);
+    if (sequencia == pos) {
+      if (pos_inserir_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequencia < pos) {
+      // Anel cheio: acorda a escritora e tenta de novo
+      {
+        std::lock_guard<std::mutex> trava(mutex_);
+        acordar_.notify_one();
+      }
+      std::this_thread::yield();
+      pos = pos_inserir_.load(std::memory_order_relaxed);
+    } else {
+      pos = pos_inserir_.load(std::memory_order_relaxed);
+    }
+  }
+  celula->linha.assign(linha.data(), linha.size());
+  celula->sequencia.store(pos + 1, std::memory_order_release);
+
+  if (dormindo_.load() &&
+      (opcoes_.politica == FLUSH_LINHA || pos % 64 == 0)) {
+    std::lock_guard<std::mutex> trava(mutex_);
+    acordar_.notify_one();
+  }
+}
+
+bool LogAssincrono::vazio() const {
+  size_t pos = pos_retirar_.load(std::memory_order_relaxed);
+  const Celula& celula = celulas_[pos & (capacidade_ - 1)];
+  return celula.sequencia.load(std::memory_order_acquire) != pos + 1;
+}
+
+void LogAssincrono::descarregar() {
+  size_t alvo = pos_inserir_.load();
+  std::unique_lock<std::mutex> trava(mutex_);
+  forcar_ = true;
+  acordar_.notify_one();
+  descarregado_.wait(trava, [this, alvo] { return escritas_ >= alvo; });
+}
+
+/***************************************************************************
+ * Lado consumidor
+ ***************************************************************************/
+void LogAssincrono::escreverLote() {
+  if (linhas_lote_ == 0) return;
+  escreverTudo(fd_, lote_.data(), lote_.size());
+  if (opcoes_.sincronizar) fdatasync(fd_);
+  lote_.clear();
+  escritas_ += linhas_lote_;
+  linhas_lote_ = 0;
+  ultimo_write_ = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> trava(mutex_);
+  descarregado_.notify_all();
+}
+
+void LogAssincrono::consumir(bool forcar) {
+  if (consumindo_.exchange(true, std::memory_order_acquire)) return;
+
+  size_t pos = pos_retirar_.load(std::memory_order_relaxed);
+  for (;;) {
+    Celula& celula = celulas_[pos & (capacidade_ - 1)];
+    if (celula.sequencia.load(std::memory_order_acquire) != pos + 1) break;
+    lote_ += celula.linha;
+    linhas_lote_++;
+    celula.sequencia.store(pos + capacidade_, std::memory_order_release);
+    pos_retirar_.store(++pos, std::memory_order_relaxed);
+    if (opcoes_.politica == FLUSH_LINHA ||
+        lote_.size() >= opcoes_.tamanho_lote) {
+      escreverLote();
+    }
+  }
+
+  // Anel vazio: o que sobrou no lote vai agora ou espera o intervalo
+  bool venceu = std::chrono::steady_clock::now() - ultimo_write_ >=
+                std::chrono::milliseconds(opcoes_.intervalo_ms);
+  if (forcar || opcoes_.politica != FLUSH_INTERVALO || venceu) {
+    escreverLote();
+  }
+  consumindo_.store(false, std::memory_order_release);
+}
+
+void LogAssincrono::trabalhar() {
+  for (;;) {
+    bool forcar, encerrar;
+    {
+      std::unique_lock<std::mutex> trava(mutex_);
+      dormindo_ = true;
+      acordar_.wait_for(trava, ESPERA_ESCRITORA, [this] {
+        return forcar_ || encerrar_ || !vazio();
+      });
+      dormindo_ = false;
+      forcar = forcar_ || encerrar_;
+      encerrar = encerrar_;
+      forcar_ = false;
+    }
+    consumir(forcar);
+    if (encerrar) {
+      // Produtores já terminaram: o que restar no anel sai agora
+      consumir(true);
+      return;
+    }
+  }
+}
+
+void LogAssincrono::descarregarEmSinal() {
+  // A escritora pode estar no meio de um lote: espera até ~100 ms
+  for (int tentativa = 0; consumindo_.exchange(true); tentativa++) {
+    if (tentativa == 100) return;
+    struct timespec espera = { 0, 1000000 };
+    nanosleep(&espera, NULL);
+  }
+
+  escreverTudo(fd_, lote_.data(), lote_.size());
+  escritas_ += linhas_lote_;
+  lote_.clear();  // mantém a capacidade: não libera memória
+  linhas_lote_ = 0;
+
+  size_t pos = pos_retirar_.load(std::memory_order_relaxed);
+  for (;;) {
+    Celula& celula = celulas_[pos & (capacidade_ - 1)];
+    if (celula.sequencia.load(std::memory_order_acquire) != pos + 1) break;
+    escreverTudo(fd_, celula.linha.data(), celula.linha.size());
+    escritas_++;
+    celula.sequencia.store(pos + capacidade_, std::memory_order_release);
+    pos_retirar_.store(++pos, std::memory_order_relaxed);
+  }
+  consumindo_.store(false, std::memory_order_release);
+}
+
+/***************************************************************************
+ * Sessões, saída do processo e sinais fatais
+ ***************************************************************************/
+std::atomic<LogAssincrono*> log_ativo(NULL);
+std::mutex mutex_sessoes;
+unsigned sessoes = 0;
+struct sigaction acoes_anteriores[NUM_SINAIS];
+
+void descarregarNaSaida() {
+  LogAssincrono* log = log_ativo.load();
+  if (log != NULL) log->descarregar();
+}
+
+void tratarSinalFatal(int sinal) {
+  LogAssincrono* log = log_ativo.load();
+  if (log != NULL) log->descarregarEmSinal();
+
+  // Devolve o sinal ao tratamento anterior (normalmente, encerrar)
+  for (size_t i = 0; i < NUM_SINAIS; i++) {
+    if (SINAIS_FATAIS[i] == sinal) {
+      sigaction(sinal, &acoes_anteriores[i], NULL);
+    }
+  }
+  raise(sinal);
+}
+
+void instalarTratadores() {
+  static bool saida_registrada = false;
+  if (!saida_registrada) {
+    atexit(descarregarNaSaida);
+    saida_registrada = true;
+  }
+
+  struct sigaction acao;
+  acao.sa_handler = tratarSinalFatal;
+  sigemptyset(&acao.sa_mask);
+  acao.sa_flags = 0;
+  for (size_t i = 0; i < NUM_SINAIS; i++) {
+    sigaction(SINAIS_FATAIS[i], &acao, &acoes_anteriores[i]);
+  }
+}
+
+void restaurarTratadores() {
+  for (size_t i = 0; i < NUM_SINAIS; i++) {
+    sigaction(SINAIS_FATAIS[i], &acoes_anteriores[i], NULL);
+  }
+}
+
+}  // namespace
+
+SessaoLog::SessaoLog(const OpcoesLog& opcoes) : ativa_(false) {
+  std::lock_guard<std::mutex> trava(mutex_sessoes);
+  if (sessoes == 0) {
+    int fd = open(ARQUIVO_LOG, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                  0644);
+    if (fd < 0) return;  // registrarLog volta a abrir o arquivo por linha
+    log_ativo.store(new LogAssincrono(opcoes, fd));
+    instalarTratadores();
+  }
+  sessoes++;
+  ativa_ = true;
+}
+
+SessaoLog::~SessaoLog() {
+  if (!ativa_) return;
+  std::lock_guard<std::mutex> trava(mutex_sessoes);
+  if (--sessoes > 0) return;
+  LogAssincrono* log = log_ativo.exchange(NULL);
+  delete log;  // descarrega o anel e fecha o arquivo
+  restaurarTratadores();
+}
+
+bool enviarLog(VisaoTexto linha) {
+  LogAssincrono* log = log_ativo.load(std::memory_order_acquire);
+  if (log == NULL) return false;
+  log->enviar(linha);
+  return true;
+}
+
+void descarregarLog() {
+  std::lock_guard<std::mutex> trava(mutex_sessoes);
+  LogAssincrono* log = log_ativo.load();
+  if (log != NULL) log->descarregar();
+}
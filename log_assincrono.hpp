@@ -0,0 +1,54 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef LOG_ASSINCRONO_HPP_
+#define LOG_ASSINCRONO_HPP_
+
+#include <cstddef>
+#include <string>
+
+#include "caminho.hpp"  // NOLINT
+
+// Quando a thread escritora leva as linhas acumuladas ao Backup.log
+enum PoliticaFlush {
+  FLUSH_LOTE,       // quando o anel esvazia ou o lote enche
+  FLUSH_INTERVALO,  // a cada 'intervalo_ms' ou com o lote cheio
+  FLUSH_LINHA       // uma escrita por linha, como o log original
+};
+
+// Opções do log assíncrono
+struct OpcoesLog {
+  PoliticaFlush politica = FLUSH_LOTE;
+  unsigned intervalo_ms = 100;      // usado por FLUSH_INTERVALO
+  size_t capacidade = 4096;         // linhas no anel (potência de 2)
+  size_t tamanho_lote = 64 * 1024;  // bytes acumulados antes de um write
+  bool sincronizar = false;         // fdatasync depois de cada write
+};
+
+/***************************************************************************
+ * Classe: SessaoLog
+ * Enquanto existir, as linhas do Backup.log passam por um anel sem travas
+ * (vários produtores, um consumidor) esvaziado por uma thread escritora
+ * num único descritor aberto. O destrutor descarrega tudo e fecha o
+ * arquivo; saída do processo e sinais fatais também descarregam. As
+ * células do anel guardam a linha num texto reservado na abertura e
+ * reaproveitado a cada volta: enviar uma linha não aloca.
+ ***************************************************************************/
+class SessaoLog {
+ public:
+  explicit SessaoLog(const OpcoesLog& opcoes);
+  ~SessaoLog();
+
+ private:
+  SessaoLog(const SessaoLog&);
+  SessaoLog& operator=(const SessaoLog&);
+
+  bool ativa_;
+};
+
+// Enfileira (copia) uma linha já terminada em '\n'; false se não há
+// sessão ativa
+bool enviarLog(VisaoTexto linha);
+
+// Espera as linhas enviadas até aqui chegarem ao arquivo
+void descarregarLog();
+
+#endif  // LOG_ASSINCRONO_HPP_
@@ -0,0 +1,522 @@
+// Copyright 2025 Alex Batista Resende
+#include "manifesto.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "metadados.hpp"  // NOLINT
+
+const char* const NOME_MANIFESTO = ".backup_manifesto";
+
+namespace {
+
+const char MAGICA_MANIFESTO[8] = { 'B', 'K', 'P', 'M', 'A', 'N', 'I', '1' };
+const uint32_t VERSAO_MANIFESTO = 2;
+
+// Registros por bloco: cada busca decodifica no máximo um bloco
+const size_t REGISTROS_POR_BLOCO = 32;
+
+// Formato em disco (ordem de bytes da máquina):
+//   cabeçalho | blocos | offsets dos blocos (uint64_t cada)
+// Os registros vêm ordenados por nome, em blocos de REGISTROS_POR_BLOCO
+// (o último pode ter menos; os offsets começam alinhados a 8 bytes).
+// Cada registro é uma sequência de varints: bytes do nome em comum com o
+// anterior, tamanho e bytes do resto do nome, tamanho, mtime_seg (zigzag,
+// diferença para o anterior), mtime_nseg e inode (zigzag, diferença). O
+// primeiro registro de um bloco não tem anterior: nome inteiro e valores
+// absolutos, então a busca binária pelos blocos lê só o primeiro nome.
+struct CabecalhoManifesto {
+  char magica[8];
+  uint32_t versao;
+  uint32_t sujo;          // 1 enquanto uma execução está em andamento
+  uint64_t quantidade;
+  uint64_t dispositivo;   // do diretório de destino
+  uint64_t inode;         // do diretório de destino
+  uint64_t tamanho_arquivo;
+  uint64_t blocos;
+  uint64_t inicio_indice;  // offsets dos blocos
+};
+
+static_assert(sizeof(CabecalhoManifesto) == 64, "cabeçalho de 64 bytes");
+
+std::string caminhoManifesto(const std::string& destino_path) {
+  return destino_path + "/" + NOME_MANIFESTO;
+}
+
+void escreverVarint(std::string* saida, uint64_t valor) {
+  while (valor >= 0x80) {
+    saida->push_back(static_cast<char>(valor | 0x80));
+    valor >>= 7;
+  }
+  saida->push_back(static_cast<char>(valor));
+}
+
+bool lerVarint(const unsigned char** p, const unsigned char* fim,
+               uint64_t* valor) {
+  *valor = 0;
+  for (unsigned deslocamento = 0; deslocamento < 64; deslocamento += 7) {
+    if (*p == fim) return false;
+    unsigned char byte = *(*p)++;
+    *valor |= static_cast<uint64_t>(byte & 0x7F) << deslocamento;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+uint64_t zigzag(int64_t valor) {
+  return (static_cast<uint64_t>(valor) << 1) ^
+         static_cast<uint64_t>(valor >> 63);
+}
+
+int64_t dezigzag(uint64_t valor) {
+  return static_cast<int64_t>(valor >> 1) ^ -static_cast<int64_t>(valor & 1);
+}
+
+// Um registro decodificado: o resto do nome aponta para o arquivo mapeado
+// e 'registro' já tem as diferenças aplicadas sobre o anterior
+struct EntradaBloco {
+  uint64_t comum;
+  const char* resto;
+  uint64_t tamanho_resto;
+  RegistroManifesto registro;
+};
+
+bool lerEntrada(const unsigned char** p, const unsigned char* fim,
+                EntradaBloco* entrada) {
+  uint64_t mtime, nseg, inode;
+  if (!lerVarint(p, fim, &entrada->comum) ||
+      !lerVarint(p, fim, &entrada->tamanho_resto) ||
+      entrada->tamanho_resto > static_cast<uint64_t>(fim - *p)) {
+    return false;
+  }
+  entrada->resto = reinterpret_cast<const char*>(*p);
+  *p += entrada->tamanho_resto;
+  RegistroManifesto& r = entrada->registro;
+  if (!lerVarint(p, fim, &r.tamanho) || !lerVarint(p, fim, &mtime) ||
+      !lerVarint(p, fim, &nseg) || !lerVarint(p, fim, &inode)) {
+    return false;
+  }
+  r.mtime_seg += dezigzag(mtime);
+  r.mtime_nseg = static_cast<uint32_t>(nseg);
+  r.inode += static_cast<uint64_t>(dezigzag(inode));
+  return true;
+}
+
+/***************************************************************************
+ * Classe: LeitorManifesto
+ * Percorre os registros do arquivo mapeado em ordem, remontando os nomes.
+ * Um bloco ilegível encerra a leitura (os registros seguintes se perdem e
+ * os arquivos voltam a ser consultados no destino).
+ ***************************************************************************/
+class LeitorManifesto {
+ public:
+  LeitorManifesto(const char* base, const uint64_t* offsets,
+                  size_t quantidade, uint64_t inicio_indice)
+      : base_(base), offsets_(offsets), quantidade_(quantidade),
+        inicio_indice_(inicio_indice) {}
+
+  bool proximo(std::string* nome, RegistroManifesto* registro) {
+    if (lidos_ == quantidade_) return false;
+    if (lidos_ % REGISTROS_POR_BLOCO == 0) {
+      const size_t b = lidos_ / REGISTROS_POR_BLOCO;
+      p_ = reinterpret_cast<const unsigned char*>(base_ + offsets_[b]);
+      fim_ = reinterpret_cast<const unsigned char*>(
+          base_ + (lidos_ + REGISTROS_POR_BLOCO < quantidade_
+                       ? offsets_[b + 1] : inicio_indice_));
+      entrada_.registro = RegistroManifesto();
+      nome_.clear();
+    }
+    if (!lerEntrada(&p_, fim_, &entrada_) || entrada_.comum > nome_.size()) {
+      lidos_ = quantidade_;
+      return false;
+    }
+    lidos_++;
+    nome_.resize(entrada_.comum);
+    nome_.append(entrada_.resto, entrada_.tamanho_resto);
+    *nome = nome_;
+    *registro = entrada_.registro;
+    return true;
+  }
+
+ private:
+  const char* base_;
+  const uint64_t* offsets_;
+  size_t quantidade_;
+  uint64_t inicio_indice_;
+  size_t lidos_ = 0;
+  const unsigned char* p_ = NULL;
+  const unsigned char* fim_ = NULL;
+  std::string nome_;
+  EntradaBloco entrada_;
+};
+
+/***************************************************************************
+ * Classe: EscritorManifesto
+ * Grava registros já em ordem, fechando um bloco a cada
+ * REGISTROS_POR_BLOCO; concluir acrescenta os offsets e o cabeçalho.
+ ***************************************************************************/
+class EscritorManifesto {
+ public:
+  explicit EscritorManifesto(std::ofstream* saida) : saida_(saida) {
+    CabecalhoManifesto vazio;
+    memset(&vazio, 0, sizeof(vazio));
+    saida_->write(reinterpret_cast<const char*>(&vazio), sizeof(vazio));
+  }
+
+  void adicionar(const std::string& nome, const RegistroManifesto& registro) {
+    if (no_bloco_ == REGISTROS_POR_BLOCO) esvaziar();
+    if (no_bloco_ == 0) {
+      offsets_.push_back(offset_);
+      anterior_.clear();
+      registro_anterior_ = RegistroManifesto();
+    }
+    size_t comum = 0;
+    const size_t limite = std::min(nome.size(), anterior_.size());
+    while (comum < limite && nome[comum] == anterior_[comum]) comum++;
+    escreverVarint(&bloco_, comum);
+    escreverVarint(&bloco_, nome.size() - comum);
+    bloco_.append(nome, comum, std::string::npos);
+    escreverVarint(&bloco_, registro.tamanho);
+    escreverVarint(&bloco_, zigzag(registro.mtime_seg -
+                                   registro_anterior_.mtime_seg));
+    escreverVarint(&bloco_, registro.mtime_nseg);
+    escreverVarint(&bloco_, zigzag(static_cast<int64_t>(
+                                registro.inode - registro_anterior_.inode)));
+    anterior_ = nome;
+    registro_anterior_ = registro;
+    no_bloco_++;
+    quantidade_++;
+  }
+
+  // Completa 'cab' com quantidade, blocos e tamanho e o grava no início
+  void concluir(CabecalhoManifesto* cab) {
+    bloco_.append((sizeof(uint64_t) - (offset_ + bloco_.size()) %
+                   sizeof(uint64_t)) % sizeof(uint64_t), '\0');
+    esvaziar();
+    cab->quantidade = quantidade_;
+    cab->blocos = offsets_.size();
+    cab->inicio_indice = offset_;
+    cab->tamanho_arquivo = offset_ + offsets_.size() * sizeof(uint64_t);
+    if (!offsets_.empty()) {
+      saida_->write(reinterpret_cast<const char*>(&offsets_[0]),
+                    offsets_.size() * sizeof(uint64_t));
+    }
+    saida_->seekp(0);
+    saida_->write(reinterpret_cast<const char*>(cab), sizeof(*cab));
+  }
+
+ private:
+  void esvaziar() {
+    saida_->write(bloco_.data(), bloco_.size());
+    offset_ += bloco_.size();
+    bloco_.clear();
+    no_bloco_ = 0;
+  }
+
+  std::ofstream* saida_;
+  std::string bloco_;
+  std::string anterior_;
+  RegistroManifesto registro_anterior_;
+  std::vector<uint64_t> offsets_;
+  uint64_t offset_ = sizeof(CabecalhoManifesto);
+  size_t no_bloco_ = 0;
+  uint64_t quantidade_ = 0;
+};
+
+}  // namespace
+
+Manifesto::~Manifesto() { liberar(); }
+
+void Manifesto::liberar() {
+  if (mapa_ != NULL) munmap(mapa_, tamanho_mapa_);
+  mapa_ = NULL;
+  tamanho_mapa_ = 0;
+  quantidade_ = 0;
+  blocos_ = 0;
+  inicio_indice_ = 0;
+}
+
+bool Manifesto::invalidar(const std::string& motivo) {
+  liberar();
+  motivo_ = motivo;
+  return false;
+}
+
+const uint64_t* Manifesto::offsetsBlocos() const {
+  return reinterpret_cast<const uint64_t*>(static_cast<const char*>(mapa_) +
+                                           inicio_indice_);
+}
+
+// Início, fim e número de registros do bloco 'b' no arquivo mapeado
+const unsigned char* Manifesto::bloco(size_t b, const unsigned char** fim,
+                                      size_t* registros) const {
+  const unsigned char* base = static_cast<const unsigned char*>(mapa_);
+  const uint64_t* offsets = offsetsBlocos();
+  *fim = base + (b + 1 < blocos_ ? offsets[b + 1] : inicio_indice_);
+  *registros = std::min(REGISTROS_POR_BLOCO,
+                        quantidade_ - b * REGISTROS_POR_BLOCO);
+  return base + offsets[b];
+}
+
+/***************************************************************************
+ * Carga e verificação de consistência
+ ***************************************************************************/
+bool Manifesto::carregar(const std::string& destino_path,
+                         unsigned amostras) {
+  destino_path_ = destino_path;
+  const std::string caminho = caminhoManifesto(destino_path);
+
+  int fd = open(caminho.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) return invalidar("manifesto ausente");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(CabecalhoManifesto))) {
+    close(fd);
+    return invalidar("manifesto truncado");
+  }
+  tamanho_mapa_ = static_cast<size_t>(st.st_size);
+  mapa_ = mmap(NULL, tamanho_mapa_, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapa_ == MAP_FAILED) {
+    mapa_ = NULL;
+    close(fd);
+    return invalidar("falha no mmap do manifesto");
+  }
+
+  const CabecalhoManifesto* cab = static_cast<CabecalhoManifesto*>(mapa_);
+  quantidade_ = static_cast<size_t>(cab->quantidade);
+  blocos_ = static_cast<size_t>(cab->blocos);
+  inicio_indice_ = cab->inicio_indice;
+  const char* motivo = NULL;
+  if (memcmp(cab->magica, MAGICA_MANIFESTO, sizeof(cab->magica)) != 0 ||
+      cab->versao != VERSAO_MANIFESTO) {
+    motivo = "formato de manifesto desconhecido";
+  } else if (cab->tamanho_arquivo != tamanho_mapa_ ||
+             inicio_indice_ < sizeof(CabecalhoManifesto) ||
+             inicio_indice_ > tamanho_mapa_ ||
+             inicio_indice_ % sizeof(uint64_t) != 0 ||
+             blocos_ != (tamanho_mapa_ - inicio_indice_) / sizeof(uint64_t) ||
+             blocos_ != (quantidade_ + REGISTROS_POR_BLOCO - 1) /
+                            REGISTROS_POR_BLOCO) {
+    motivo = "manifesto truncado";
+  } else if (cab->sujo) {
+    motivo = "execução anterior interrompida";
+  }
+
+  if (motivo == NULL) {
+    MetadadosArquivo raiz = obterMetadados(destino_path, CAMPO_INODE);
+    if (!raiz.existe() || raiz.dispositivo != cab->dispositivo ||
+        raiz.inode != cab->inode) {
+      motivo = "destino trocado desde a última execução";
+    }
+  }
+
+  if (motivo == NULL) {
+    // Os blocos precisam estar em ordem dentro do arquivo; o conteúdo é
+    // conferido ao decodificar, sem percorrer os registros aqui
+    const uint64_t* offsets = offsetsBlocos();
+    uint64_t anterior = sizeof(CabecalhoManifesto);
+    for (size_t b = 0; b < blocos_ && motivo == NULL; b++) {
+      if (offsets[b] < anterior || offsets[b] >= inicio_indice_ ||
+          (b == 0 && offsets[b] != anterior)) {
+        motivo = "manifesto corrompido";
+      }
+      anterior = offsets[b] + 1;
+    }
+  }
+
+  if (motivo == NULL && !verificarAmostras(amostras)) {
+    motivo = "amostra divergente do destino";
+  }
+
+  if (motivo != NULL) {
+    close(fd);
+    return invalidar(motivo);
+  }
+
+  // Marca a execução em andamento: se ela for interrompida, o manifesto
+  // não será confiável na próxima.
+  uint32_t sujo = 1;
+  bool marcado = pwrite(fd, &sujo, sizeof(sujo),
+                        offsetof(CabecalhoManifesto, sujo)) ==
+                     static_cast<ssize_t>(sizeof(sujo)) &&
+                 fdatasync(fd) == 0;
+  close(fd);
+  if (!marcado) return invalidar("manifesto somente leitura");
+  motivo_.clear();
+  return true;
+}
+
+// Compara algumas entradas, espalhadas pelo manifesto (as primeiras de
+// alguns blocos), com stats reais
+bool Manifesto::verificarAmostras(unsigned amostras) {
+  if (blocos_ == 0 || amostras == 0) return true;
+  size_t passo = blocos_ / amostras;
+  if (passo == 0) passo = 1;
+
+  for (size_t b = passo / 2; b < blocos_; b += passo) {
+    const unsigned char* fim;
+    size_t registros;
+    const unsigned char* p = bloco(b, &fim, &registros);
+    EntradaBloco entrada;
+    if (!lerEntrada(&p, fim, &entrada) || entrada.comum != 0) return false;
+    const RegistroManifesto& r = entrada.registro;
+    MetadadosArquivo real = obterMetadados(
+        destino_path_ + "/" + std::string(entrada.resto,
+                                          entrada.tamanho_resto),
+        CAMPO_MTIME | CAMPO_TAMANHO | CAMPO_INODE);
+    if (!real.existe() || real.tamanho != r.tamanho ||
+        real.inode != r.inode || real.mtime_seg != r.mtime_seg ||
+        real.mtime_nseg != r.mtime_nseg) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/***************************************************************************
+ * Busca: binária pelos primeiros nomes dos blocos e linear dentro do
+ * bloco. A varredura compara só o necessário: 'igual' é quanto do nome
+ * buscado coincide com o registro anterior (menor que ele); um registro
+ * que compartilha menos que isso com o anterior já passou do nome, e um
+ * que compartilha mais ainda é menor.
+ ***************************************************************************/
+bool Manifesto::buscar(const std::string& nome,
+                       RegistroManifesto* registro) const {
+  if (mapa_ == NULL) return false;
+
+  size_t ini = 0, fim = blocos_;
+  while (ini < fim) {
+    size_t meio = ini + (fim - ini) / 2;
+    const unsigned char* fim_bloco;
+    size_t registros;
+    const unsigned char* p = bloco(meio, &fim_bloco, &registros);
+    EntradaBloco primeiro;
+    if (!lerEntrada(&p, fim_bloco, &primeiro)) return false;
+    int cmp = nome.compare(0, std::string::npos, primeiro.resto,
+                           primeiro.tamanho_resto);
+    if (cmp == 0) {
+      *registro = primeiro.registro;
+      return true;
+    }
+    if (cmp < 0) fim = meio;
+    else ini = meio + 1;
+  }
+  if (ini == 0) return false;  // antes do primeiro nome
+
+  const unsigned char* fim_bloco;
+  size_t registros;
+  const unsigned char* p = bloco(ini - 1, &fim_bloco, &registros);
+  EntradaBloco entrada;
+  if (!lerEntrada(&p, fim_bloco, &entrada)) return false;
+  size_t tamanho_anterior = entrada.tamanho_resto;
+  size_t igual = 0;
+  const size_t limite = std::min<size_t>(nome.size(), tamanho_anterior);
+  while (igual < limite && nome[igual] == entrada.resto[igual]) igual++;
+  for (size_t i = 1; i < registros; i++) {
+    if (!lerEntrada(&p, fim_bloco, &entrada) ||
+        entrada.comum > tamanho_anterior) {
+      return false;
+    }
+    tamanho_anterior = entrada.comum + entrada.tamanho_resto;
+    if (entrada.comum < igual) return false;  // passou do nome
+    if (entrada.comum > igual) continue;      // ainda menor
+
+    const char* resto = nome.data() + igual;
+    const size_t faltam = nome.size() - igual;
+    const size_t n = std::min<size_t>(faltam, entrada.tamanho_resto);
+    size_t k = 0;
+    while (k < n && resto[k] == entrada.resto[k]) k++;
+    if (k == n) {
+      if (faltam == entrada.tamanho_resto) {
+        *registro = entrada.registro;
+        return true;
+      }
+      if (faltam < entrada.tamanho_resto) return false;
+    } else if (static_cast<unsigned char>(entrada.resto[k]) >
+               static_cast<unsigned char>(resto[k])) {
+      return false;
+    }
+    igual += k;
+  }
+  return false;
+}
+
+void Manifesto::atualizar(const std::string& nome,
+                          const RegistroManifesto& registro) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  Alteracao& alteracao = alteracoes_[nome];
+  alteracao.removido = false;
+  alteracao.registro = registro;
+}
+
+void Manifesto::descartar(const std::string& nome) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  alteracoes_[nome].removido = true;
+}
+
+/***************************************************************************
+ * Gravação: intercala o manifesto antigo com as alterações (ambos em
+ * ordem) num arquivo temporário e o renomeia sobre o anterior
+ ***************************************************************************/
+bool Manifesto::gravar() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  const std::string caminho = caminhoManifesto(destino_path_);
+  const std::string temporario = caminho + ".tmp";
+
+  MetadadosArquivo raiz = obterMetadados(destino_path_, CAMPO_INODE);
+  if (!raiz.existe()) return false;
+
+  CabecalhoManifesto cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magica, MAGICA_MANIFESTO, sizeof(cab.magica));
+  cab.versao = VERSAO_MANIFESTO;
+  cab.dispositivo = raiz.dispositivo;
+  cab.inode = raiz.inode;
+
+  std::ofstream saida(temporario.c_str(), std::ios::binary | std::ios::trunc);
+  if (!saida.is_open()) return false;
+  EscritorManifesto escritor(&saida);
+  LeitorManifesto antigos(static_cast<const char*>(mapa_),
+                          mapa_ == NULL ? NULL : offsetsBlocos(), quantidade_,
+                          inicio_indice_);
+  std::string nome;
+  RegistroManifesto registro;
+  bool tem_antigo = antigos.proximo(&nome, &registro);
+  std::map<std::string, Alteracao>::const_iterator alt = alteracoes_.begin();
+  while (tem_antigo || alt != alteracoes_.end()) {
+    if (alt == alteracoes_.end() || (tem_antigo && nome < alt->first)) {
+      escritor.adicionar(nome, registro);
+      tem_antigo = antigos.proximo(&nome, &registro);
+      continue;
+    }
+    if (tem_antigo && nome == alt->first) {
+      tem_antigo = antigos.proximo(&nome, &registro);
+    }
+    if (!alt->second.removido) {
+      escritor.adicionar(alt->first, alt->second.registro);
+    }
+    ++alt;
+  }
+  escritor.concluir(&cab);
+  saida.close();
+  if (!saida) {
+    remove(temporario.c_str());
+    return false;
+  }
+
+  liberar();
+  alteracoes_.clear();
+  return rename(temporario.c_str(), caminho.c_str()) == 0;
+}
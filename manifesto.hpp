@@ -0,0 +1,85 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef MANIFESTO_HPP_
+#define MANIFESTO_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Nome do manifesto dentro do diretório de destino
+extern const char* const NOME_MANIFESTO;
+
+// Estado de um arquivo do destino, como ficou ao final da última execução
+struct RegistroManifesto {
+  uint64_t tamanho = 0;
+  int64_t mtime_seg = 0;
+  uint32_t mtime_nseg = 0;
+  uint64_t inode = 0;
+};
+
+/***************************************************************************
+ * Classe: Manifesto
+ * Registro binário, ordenado por caminho, dos arquivos que o backup deixou
+ * no destino: blocos de registros com os nomes em codificação frontal
+ * (só o que difere do anterior) e os metadados em varints, mais um índice
+ * esparso com o offset de cada bloco (~20 bytes por arquivo). A execução
+ * seguinte mapeia o arquivo com mmap, sem decodificar nada na carga, e
+ * decide copiar/ignorar sem consultar o destino. Antes de ser usado, o
+ * manifesto passa por uma verificação de consistência (dispositivo e
+ * inode do destino, marca de execução interrompida e uma amostra de stats
+ * reais); se falhar, o backup volta a consultar o destino arquivo por
+ * arquivo.
+ ***************************************************************************/
+class Manifesto {
+ public:
+  Manifesto() {}
+  ~Manifesto();
+
+  // Mapeia o manifesto de 'destino_path' e verifica 'amostras' entradas
+  // contra o destino. Devolve false se ele não puder ser usado; o motivo
+  // fica em motivo(). Em seguida marca a execução como em andamento.
+  bool carregar(const std::string& destino_path, unsigned amostras);
+
+  bool valido() const { return mapa_ != NULL; }
+  const std::string& motivo() const { return motivo_; }
+
+  // Busca no manifesto carregado (somente leitura, pode ser concorrente)
+  bool buscar(const std::string& nome, RegistroManifesto* registro) const;
+
+  // Alterações desta execução, aplicadas por gravar()
+  void atualizar(const std::string& nome, const RegistroManifesto& registro);
+  void descartar(const std::string& nome);
+
+  // Grava o manifesto novo (antigo + alterações) e troca o anterior
+  bool gravar();
+
+ private:
+  Manifesto(const Manifesto&);
+  Manifesto& operator=(const Manifesto&);
+
+  struct Alteracao {
+    bool removido;
+    RegistroManifesto registro;
+  };
+
+  bool invalidar(const std::string& motivo);
+  void liberar();
+  bool verificarAmostras(unsigned amostras);
+  const uint64_t* offsetsBlocos() const;
+  const unsigned char* bloco(size_t b, const unsigned char** fim,
+                             size_t* registros) const;
+
+  std::string destino_path_;
+  std::string motivo_;
+  void* mapa_ = NULL;
+  size_t tamanho_mapa_ = 0;
+  size_t quantidade_ = 0;
+  size_t blocos_ = 0;
+  uint64_t inicio_indice_ = 0;
+  std::map<std::string, Alteracao> alteracoes_;
+  std::mutex mutex_;
+};
+
+#endif  // MANIFESTO_HPP_
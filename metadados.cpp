@@ -0,0 +1,130 @@
+// Copyright 2025 Alex Batista Resende
+#include "metadados.hpp"  // NOLINT
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+
+namespace {
+
+// f_type do statfs dos sistemas de arquivos com mtime grosso
+const int64_t FS_MSDOS = 0x4d44;
+const int64_t FS_EXFAT = 0x2011bab0;
+const int64_t FS_NTFS = 0x5346544e;
+
+const int64_t NSEG_POR_SEG = 1000000000;
+
+ErroMetadados classificarErro(int erro) {
+  switch (erro) {
+    case ENOENT:
+    case ENOTDIR:
+      return METADADOS_INEXISTENTE;
+    case EACCES:
+    case EPERM:
+      return METADADOS_SEM_PERMISSAO;
+    default:
+      return METADADOS_ERRO;
+  }
+}
+
+unsigned mascaraStatx(unsigned campos) {
+  unsigned mascara = 0;
+  if (campos & CAMPO_MTIME) mascara |= STATX_MTIME;
+  if (campos & CAMPO_TAMANHO) mascara |= STATX_SIZE;
+  if (campos & CAMPO_INODE) mascara |= STATX_INO;
+  if (campos & CAMPO_MODO) mascara |= STATX_TYPE | STATX_MODE;
+  if (campos & CAMPO_BLOCOS) mascara |= STATX_BLOCKS;
+  return mascara;
+}
+
+// Kernels sem statx (< 4.11): stat comum, que já traz os nanossegundos
+MetadadosArquivo obterComStat(const std::string& caminho) {
+  MetadadosArquivo meta;
+  struct stat st;
+  if (stat(caminho.c_str(), &st) != 0) {
+    meta.codigo_errno = errno;
+    meta.erro = classificarErro(errno);
+    return meta;
+  }
+  meta.erro = METADADOS_OK;
+  meta.mtime_seg = st.st_mtim.tv_sec;
+  meta.mtime_nseg = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+  meta.tamanho = static_cast<uint64_t>(st.st_size);
+  meta.inode = st.st_ino;
+  meta.dispositivo = st.st_dev;
+  meta.modo = st.st_mode;
+  meta.blocos = static_cast<uint64_t>(st.st_blocks);
+  return meta;
+}
+
+}  // namespace
+
+/***************************************************************************
+ * Função auxiliar: Consulta os metadados de um arquivo
+ ***************************************************************************/
+MetadadosArquivo obterMetadados(const std::string& caminho, unsigned campos) {
+  assert(!caminho.empty());
+  static std::atomic<bool> sem_statx(false);
+  if (sem_statx) return obterComStat(caminho);
+
+  MetadadosArquivo meta;
+  struct statx stx;
+  if (statx(AT_FDCWD, caminho.c_str(), 0, mascaraStatx(campos), &stx) != 0) {
+    if (errno == ENOSYS) {
+      sem_statx = true;
+      return obterComStat(caminho);
+    }
+    meta.codigo_errno = errno;
+    meta.erro = classificarErro(errno);
+    return meta;
+  }
+
+  meta.erro = METADADOS_OK;
+  meta.mtime_seg = stx.stx_mtime.tv_sec;
+  meta.mtime_nseg = stx.stx_mtime.tv_nsec;
+  meta.tamanho = stx.stx_size;
+  meta.inode = stx.stx_ino;
+  meta.dispositivo = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  meta.modo = stx.stx_mode;
+  meta.blocos = stx.stx_blocks;
+  return meta;
+}
+
+int64_t granularidadeMtime(const std::string& caminho) {
+  struct statfs st;
+  if (statfs(caminho.c_str(), &st) != 0) return 1;
+  switch (static_cast<int64_t>(st.f_type)) {
+    case FS_MSDOS:
+      return 2 * NSEG_POR_SEG;
+    case FS_EXFAT:
+      return 10000000;
+    case FS_NTFS:
+      return 100;
+    default:
+      return 1;
+  }
+}
+
+int compararMtime(const MetadadosArquivo& a, const MetadadosArquivo& b,
+                  int64_t granularidade) {
+  int64_t seg_a = a.mtime_seg, seg_b = b.mtime_seg;
+  int64_t nseg_a = a.mtime_nseg, nseg_b = b.mtime_nseg;
+  if (granularidade >= NSEG_POR_SEG) {
+    // Passos de segundos inteiros (FAT): trunca os segundos
+    const int64_t passo = granularidade / NSEG_POR_SEG;
+    seg_a -= ((seg_a % passo) + passo) % passo;
+    seg_b -= ((seg_b % passo) + passo) % passo;
+    nseg_a = nseg_b = 0;
+  } else if (granularidade > 1) {
+    nseg_a -= nseg_a % granularidade;
+    nseg_b -= nseg_b % granularidade;
+  }
+  if (seg_a != seg_b) return seg_a < seg_b ? -1 : 1;
+  if (nseg_a != nseg_b) return nseg_a < nseg_b ? -1 : 1;
+  return 0;
+}
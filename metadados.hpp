@@ -0,0 +1,56 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef METADADOS_HPP_
+#define METADADOS_HPP_
+
+#include <cstdint>
+#include <string>
+
+// Resultado da consulta de metadados
+enum ErroMetadados {
+  METADADOS_OK,
+  METADADOS_INEXISTENTE,    // ENOENT / ENOTDIR
+  METADADOS_SEM_PERMISSAO,  // EACCES / EPERM
+  METADADOS_ERRO            // qualquer outro errno
+};
+
+// Campos pedidos ao statx; só o necessário é consultado
+enum CamposMetadados {
+  CAMPO_MTIME = 1 << 0,
+  CAMPO_TAMANHO = 1 << 1,
+  CAMPO_INODE = 1 << 2,
+  CAMPO_MODO = 1 << 3,
+  CAMPO_BLOCOS = 1 << 4
+};
+
+// Metadados de um arquivo; o dispositivo vem sempre junto
+struct MetadadosArquivo {
+  ErroMetadados erro = METADADOS_INEXISTENTE;
+  int codigo_errno = 0;
+  int64_t mtime_seg = 0;
+  uint32_t mtime_nseg = 0;
+  uint64_t tamanho = 0;
+  uint64_t inode = 0;
+  uint64_t dispositivo = 0;
+  uint32_t modo = 0;
+  uint64_t blocos = 0;  // alocados, em unidades de 512 bytes
+
+  bool existe() const { return erro == METADADOS_OK; }
+};
+
+// Consulta 'campos' (máscara de CamposMetadados) com statx, ou stat em
+// kernels sem statx.
+MetadadosArquivo obterMetadados(const std::string& caminho, unsigned campos);
+
+// Menor passo, em nanossegundos, dos mtimes que o sistema de arquivos de
+// 'caminho' grava: 2 s no FAT, 10 ms no exFAT, 100 ns no NTFS e 1 ns nos
+// demais (ou se a consulta falhar)
+int64_t granularidadeMtime(const std::string& caminho);
+
+// Compara os mtimes com precisão de nanossegundos: <0, 0 ou >0. Com
+// 'granularidade' (ns), os dois são truncados a ela antes: um mtime
+// arredondado pelo pendrive não parece mais antigo que o original, mas
+// uma mudança dentro do mesmo passo não é vista.
+int compararMtime(const MetadadosArquivo& a, const MetadadosArquivo& b,
+                  int64_t granularidade = 1);
+
+#endif  // METADADOS_HPP_
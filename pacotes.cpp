@@ -0,0 +1,377 @@
+// Copyright 2025 Alex Batista Resende
+#include "pacotes.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+#include "durabilidade.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* const NOME_PACOTES = ".backup_pacotes";
+
+namespace {
+
+// Acréscimos acumulados em memória até uma escrita deste tamanho
+const size_t TAMANHO_BUFFER_PACOTE = 4 << 20;
+
+// Fim de todo pacote fechado: offset e quantidade de entradas do índice,
+// CRC32C do índice e a marca
+const char MARCA_PACOTE[8] = { 'B', 'K', 'P', 'A', 'C', 'O', 'T', '1' };
+
+struct RodapePacote {
+  uint64_t inicio_indice;
+  uint64_t quantidade;
+  uint32_t crc_indice;
+  uint32_t reservado;
+  char marca[8];
+};
+
+// Entrada do índice, seguida do caminho (sem terminador)
+struct EntradaIndice {
+  uint64_t offset;
+  uint64_t tamanho;
+  int64_t mtime_seg;
+  uint32_t mtime_nseg;
+  uint32_t pacote;
+  uint32_t tamanho_nome;
+  uint32_t reservado;
+};
+
+bool escreverTudo(int fd, const char* dados, size_t tamanho, off_t offset) {
+  while (tamanho > 0) {
+    ssize_t n = pwrite(fd, dados, tamanho, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    dados += n;
+    tamanho -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool lerTudo(int fd, char* dados, size_t tamanho, off_t offset) {
+  while (tamanho > 0) {
+    ssize_t n = pread(fd, dados, tamanho, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    dados += n;
+    tamanho -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Número de "pacote-NNNNNN.pk"; 0 para qualquer outro nome
+uint32_t numeroPacote(const char* nome) {
+  unsigned numero = 0;
+  int fim = 0;
+  if (sscanf(nome, "pacote-%6u.pk%n", &numero, &fim) != 1 ||
+      nome[fim] != '\0' || strlen(nome) != 16) {
+    return 0;
+  }
+  return numero;
+}
+
+}  // namespace
+
+Pacotes::~Pacotes() {
+  fechar();
+}
+
+std::string Pacotes::caminhoPacote(uint32_t numero) const {
+  char nome[32];
+  snprintf(nome, sizeof(nome), "/pacote-%06u.pk", numero);
+  return raiz_ + nome;
+}
+
+bool Pacotes::abrir(const std::string& destino_path, bool somente_leitura) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  raiz_ = destino_path + "/" + NOME_PACOTES;
+  indice_.clear();
+  if (!somente_leitura && mkdir(raiz_.c_str(), 0777) != 0 &&
+      errno != EEXIST) {
+    return false;
+  }
+
+  std::vector<uint32_t> numeros;
+  DIR* dir = opendir(raiz_.c_str());
+  if (dir != NULL) {
+    while (struct dirent* entrada = readdir(dir)) {
+      uint32_t numero = numeroPacote(entrada->d_name);
+      if (numero > 0) numeros.push_back(numero);
+    }
+    closedir(dir);
+  }
+
+  // Em ordem: a versão do pacote mais novo substitui as anteriores
+  std::sort(numeros.begin(), numeros.end());
+  for (size_t i = 0; i < numeros.size(); i++) {
+    if (!lerRodape(numeros[i])) {
+      std::cerr << "[AVISO] Pacote sem índice válido: "
+                << caminhoPacote(numeros[i]) << "\n";
+    }
+  }
+  atual_ = numeros.empty() ? 1 : numeros.back() + 1;
+  return true;
+}
+
+bool Pacotes::lerRodape(uint32_t numero) {
+  int fd = open(caminhoPacote(numero).c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(RodapePacote))) {
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  RodapePacote rodape;
+  const uint64_t fim_indice = st.st_size - sizeof(rodape);
+  std::vector<char> indice;
+  bool ok = lerTudo(fd, reinterpret_cast<char*>(&rodape), sizeof(rodape),
+                    fim_indice) &&
+            memcmp(rodape.marca, MARCA_PACOTE, sizeof(MARCA_PACOTE)) == 0 &&
+            rodape.inicio_indice <= fim_indice;
+  if (ok) {
+    indice.resize(fim_indice - rodape.inicio_indice);
+    ok = indice.empty() ||
+         lerTudo(fd, &indice[0], indice.size(), rodape.inicio_indice);
+  }
+  close(fd);
+  if (!ok || crc32c(0, indice.data(), indice.size()) != rodape.crc_indice) {
+    return false;
+  }
+
+  size_t pos = 0;
+  for (uint64_t i = 0; i < rodape.quantidade; i++) {
+    EntradaIndice entrada;
+    if (indice.size() - pos < sizeof(entrada)) return false;
+    memcpy(&entrada, &indice[pos], sizeof(entrada));
+    pos += sizeof(entrada);
+    if (indice.size() - pos < entrada.tamanho_nome) return false;
+    LocalPacote local;
+    local.pacote = entrada.pacote == 0 ? 0 : numero;
+    local.offset = entrada.offset;
+    local.tamanho = entrada.tamanho;
+    local.mtime_seg = entrada.mtime_seg;
+    local.mtime_nseg = entrada.mtime_nseg;
+    indice_[std::string(&indice[pos], entrada.tamanho_nome)] = local;
+    pos += entrada.tamanho_nome;
+  }
+  return true;
+}
+
+bool Pacotes::buscar(const std::string& nome, LocalPacote* local) const {
+  std::lock_guard<std::mutex> trava(mutex_);
+  std::map<std::string, LocalPacote>::const_iterator it = indice_.find(nome);
+  if (it == indice_.end()) return false;
+  *local = it->second;
+  return true;
+}
+
+bool Pacotes::listar(const std::string& nome,
+                     std::vector<std::string>* nomes) const {
+  std::string prefixo = nome;
+  while (!prefixo.empty() && prefixo[prefixo.size() - 1] == '/') {
+    prefixo.erase(prefixo.size() - 1);
+  }
+  prefixo += '/';
+  std::lock_guard<std::mutex> trava(mutex_);
+  if (indice_.count(nome)) return false;
+  nomes->clear();
+  std::map<std::string, LocalPacote>::const_iterator it;
+  for (it = indice_.lower_bound(prefixo);
+       it != indice_.end() && it->first.compare(0, prefixo.size(),
+                                                prefixo) == 0;
+       ++it) {
+    nomes->push_back(it->first);
+  }
+  return !nomes->empty();
+}
+
+MetodoCopia Pacotes::adicionar(const std::string& origem,
+                               const std::string& nome, uint32_t* crc) {
+  // O arquivo é lido fora da trava; só o acréscimo ao buffer é serial
+  int in = open(origem.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (in < 0 || fstat(in, &st) != 0) {
+    std::cerr << "[ERRO] Não foi possível abrir origem: "
+              << origem << " (errno=" << errno << ")\n";
+    if (in >= 0) close(in);
+    return COPIA_FALHOU;
+  }
+  std::vector<char> dados(st.st_size);
+  bool ok = dados.empty() || lerTudo(in, &dados[0], dados.size(), 0);
+  close(in);
+  if (!ok) {
+    std::cerr << "[ERRO] Falha ao ler: " << origem << "\n";
+    return COPIA_FALHOU;
+  }
+  if (crc != NULL) *crc = crc32c(0, dados.data(), dados.size());
+
+  std::lock_guard<std::mutex> trava(mutex_);
+  if (fd_ < 0) {
+    fd_ = open(caminhoTemporario(caminhoPacote(atual_)).c_str(),
+               O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    offset_buffer_ = 0;
+    if (fd_ < 0) {
+      std::cerr << "[ERRO] Não foi possível criar pacote em: " << raiz_
+                << " (errno=" << errno << ")\n";
+      return COPIA_FALHOU;
+    }
+  }
+  LocalPacote local;
+  local.pacote = atual_;
+  local.offset = offset_buffer_ + buffer_.size();
+  local.tamanho = dados.size();
+  local.mtime_seg = st.st_mtim.tv_sec;
+  local.mtime_nseg = st.st_mtim.tv_nsec;
+  buffer_.insert(buffer_.end(), dados.begin(), dados.end());
+  if (buffer_.size() >= TAMANHO_BUFFER_PACOTE && !descarregarTravado()) {
+    return COPIA_FALHOU;
+  }
+  entradas_[nome] = local;
+  indice_[nome] = local;
+  if (offset_buffer_ + buffer_.size() >= opcoes_.tamanho_pacote &&
+      !fecharTravado()) {
+    return COPIA_FALHOU;
+  }
+  return COPIA_PACOTE;
+}
+
+void Pacotes::registrarEspelho(const std::string& nome, uint64_t tamanho,
+                               int64_t mtime_seg, uint32_t mtime_nseg) {
+  LocalPacote local;
+  local.tamanho = tamanho;
+  local.mtime_seg = mtime_seg;
+  local.mtime_nseg = mtime_nseg;
+  std::lock_guard<std::mutex> trava(mutex_);
+  entradas_[nome] = local;
+  indice_[nome] = local;
+}
+
+bool Pacotes::descarregarTravado() {
+  if (buffer_.empty()) return true;
+  if (!escreverTudo(fd_, buffer_.data(), buffer_.size(), offset_buffer_)) {
+    falhou_ = true;
+    return false;
+  }
+  offset_buffer_ += buffer_.size();
+  buffer_.clear();
+  return true;
+}
+
+// Índice ordenado (o std::map já está) e rodapé no fim do temporário; o
+// nome definitivo vem com o lote de durabilidade ou logo em seguida
+bool Pacotes::fecharTravado() {
+  if (entradas_.empty() && fd_ < 0) return !falhou_;
+  const std::string definitivo = caminhoPacote(atual_);
+  const std::string temporario = caminhoTemporario(definitivo);
+  if (fd_ < 0) {
+    fd_ = open(temporario.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+               0666);
+    offset_buffer_ = 0;
+  }
+  bool ok = fd_ >= 0 && descarregarTravado();
+
+  std::vector<char> indice;
+  std::map<std::string, LocalPacote>::const_iterator it;
+  for (it = entradas_.begin(); it != entradas_.end(); ++it) {
+    EntradaIndice entrada;
+    memset(&entrada, 0, sizeof(entrada));
+    entrada.offset = it->second.offset;
+    entrada.tamanho = it->second.tamanho;
+    entrada.mtime_seg = it->second.mtime_seg;
+    entrada.mtime_nseg = it->second.mtime_nseg;
+    entrada.pacote = it->second.pacote;
+    entrada.tamanho_nome = it->first.size();
+    const char* bytes = reinterpret_cast<const char*>(&entrada);
+    indice.insert(indice.end(), bytes, bytes + sizeof(entrada));
+    indice.insert(indice.end(), it->first.begin(), it->first.end());
+  }
+  RodapePacote rodape;
+  memset(&rodape, 0, sizeof(rodape));
+  rodape.inicio_indice = offset_buffer_;
+  rodape.quantidade = entradas_.size();
+  rodape.crc_indice = crc32c(0, indice.data(), indice.size());
+  memcpy(rodape.marca, MARCA_PACOTE, sizeof(MARCA_PACOTE));
+  const char* bytes = reinterpret_cast<const char*>(&rodape);
+  indice.insert(indice.end(), bytes, bytes + sizeof(rodape));
+
+  ok = ok && escreverTudo(fd_, indice.data(), indice.size(), offset_buffer_);
+  if (fd_ >= 0 && close(fd_) != 0) ok = false;
+  fd_ = -1;
+  if (ok && lote_ != NULL) {
+    lote_->adicionar(temporario, definitivo);
+  } else if (!ok || rename(temporario.c_str(), definitivo.c_str()) != 0) {
+    std::cerr << "[ERRO] Falha ao fechar o pacote: " << definitivo
+              << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    ok = false;
+  }
+  if (!ok) falhou_ = true;
+
+  entradas_.clear();
+  buffer_.clear();
+  offset_buffer_ = 0;
+  atual_++;
+  return !falhou_;
+}
+
+bool Pacotes::fechar() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  return fecharTravado();
+}
+
+MetodoCopia Pacotes::extrair(const std::string& nome,
+                             const std::string& destino, bool renomear) {
+  LocalPacote local;
+  if (!buscar(nome, &local) || local.pacote == 0) return COPIA_FALHOU;
+  const std::string temporario = caminhoTemporario(destino);
+  int in = open(caminhoPacote(local.pacote).c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    std::cerr << "[ERRO] Não foi possível abrir o pacote de: "
+              << nome << " (errno=" << errno << ")\n";
+    return COPIA_FALHOU;
+  }
+  criarDiretorioPai(destino);
+  int saida = open(temporario.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  bool ok = saida >= 0;
+  std::vector<char> buffer(std::min<uint64_t>(local.tamanho,
+                                              TAMANHO_BUFFER_PACOTE));
+  for (uint64_t feito = 0; ok && feito < local.tamanho;) {
+    size_t n = std::min<uint64_t>(buffer.size(), local.tamanho - feito);
+    ok = lerTudo(in, &buffer[0], n, local.offset + feito) &&
+         escreverTudo(saida, &buffer[0], n, feito);
+    feito += n;
+  }
+  close(in);
+  if (ok) {
+    struct timespec tempos[2];
+    tempos[0].tv_sec = tempos[1].tv_sec = local.mtime_seg;
+    tempos[0].tv_nsec = tempos[1].tv_nsec = local.mtime_nseg;
+    futimens(saida, tempos);
+  }
+  if (saida >= 0 && close(saida) != 0) ok = false;
+  if (!ok) {
+    std::cerr << "[ERRO] Falha ao extrair do pacote: " << nome << "\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  if (renomear && rename(temporario.c_str(), destino.c_str()) != 0) {
+    std::cerr << "[ERRO] Não foi possível renomear para: "
+              << destino << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return COPIA_FALHOU;
+  }
+  return COPIA_PACOTE;
+}
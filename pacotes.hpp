@@ -0,0 +1,111 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef PACOTES_HPP_
+#define PACOTES_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "copia.hpp"  // NOLINT
+
+class LoteDurabilidade;
+
+// Diretório dos pacotes dentro do diretório de destino
+extern const char* const NOME_PACOTES;
+
+// Arquivos com menos de 'limite_arquivo' bytes vão para os pacotes; um
+// pacote é fechado ao passar de 'tamanho_pacote' bytes
+struct OpcoesPacotes {
+  uint64_t limite_arquivo = 1 << 20;
+  uint64_t tamanho_pacote = 256 << 20;
+};
+
+// Onde está a versão mais recente de um arquivo no destino
+struct LocalPacote {
+  uint32_t pacote = 0;  // 0: arquivo comum, no caminho espelhado
+  uint64_t offset = 0;
+  uint64_t tamanho = 0;
+  int64_t mtime_seg = 0;
+  uint32_t mtime_nseg = 0;
+};
+
+/***************************************************************************
+ * Classe: Pacotes
+ * Formato de destino para muitos arquivos pequenos: em vez de criar um
+ * arquivo por entrada, o conteúdo é acrescentado ao fim de um pacote
+ * (NOME_PACOTES/pacote-NNNNNN.pk) por escritas grandes e sequenciais. Ao
+ * ser fechado, o pacote recebe um rodapé com o índice ordenado por
+ * caminho (local, tamanho e mtime de cada arquivo) e só então ganha o nome
+ * definitivo; um pacote sem rodapé é descartado e os arquivos dele são
+ * copiados de novo. Arquivos grandes continuam como cópias comuns, mas
+ * também entram no índice, que decide sozinho o backup e a restauração.
+ * Pacotes nunca são reescritos: a versão de um arquivo no pacote mais novo
+ * vale sobre as anteriores, que ficam como espaço morto.
+ ***************************************************************************/
+class Pacotes {
+ public:
+  // Com 'lote', cada pacote fechado ganha o nome definitivo no próximo
+  // syncfs do lote; sem ele, logo ao ser fechado
+  explicit Pacotes(const OpcoesPacotes& opcoes,
+                   LoteDurabilidade* lote = NULL)
+      : opcoes_(opcoes), lote_(lote) {}
+  ~Pacotes();  // fecha o pacote atual
+
+  // Lê os rodapés dos pacotes de 'destino_path'; sem 'somente_leitura',
+  // cria o diretório e prepara o próximo pacote
+  bool abrir(const std::string& destino_path, bool somente_leitura = false);
+
+  const OpcoesPacotes& opcoes() const { return opcoes_; }
+
+  // Consultas ao índice (concorrentes). listar devolve true se 'nome' é um
+  // diretório no índice e preenche os caminhos abaixo dele, em ordem.
+  bool buscar(const std::string& nome, LocalPacote* local) const;
+  bool listar(const std::string& nome, std::vector<std::string>* nomes) const;
+
+  // Acrescenta o conteúdo de 'origem' ao pacote atual como 'nome'. Com
+  // 'crc', calcula o CRC32C do conteúdo. Thread-safe.
+  MetodoCopia adicionar(const std::string& origem, const std::string& nome,
+                        uint32_t* crc = NULL);
+
+  // Registra no índice um arquivo copiado para o caminho espelhado
+  void registrarEspelho(const std::string& nome, uint64_t tamanho,
+                        int64_t mtime_seg, uint32_t mtime_nseg);
+
+  // Extrai 'nome' do seu pacote para caminhoTemporario(destino), com o
+  // mtime do índice, e renomeia se 'renomear'
+  MetodoCopia extrair(const std::string& nome, const std::string& destino,
+                      bool renomear);
+
+  // Grava o restante do buffer e o rodapé do pacote atual; false se algum
+  // pacote falhou até aqui
+  bool fechar();
+
+ private:
+  Pacotes(const Pacotes&);
+  Pacotes& operator=(const Pacotes&);
+
+  std::string caminhoPacote(uint32_t numero) const;
+  bool lerRodape(uint32_t numero);
+  bool descarregarTravado();
+  bool fecharTravado();
+
+  OpcoesPacotes opcoes_;
+  LoteDurabilidade* lote_;
+  std::string raiz_;
+  std::map<std::string, LocalPacote> indice_;
+  mutable std::mutex mutex_;
+
+  // Pacote em escrita: fd do temporário, entradas dele e o buffer ainda
+  // não gravado (que começa em 'offset_buffer_')
+  uint32_t atual_ = 0;
+  int fd_ = -1;
+  std::map<std::string, LocalPacote> entradas_;
+  std::vector<char> buffer_;
+  uint64_t offset_buffer_ = 0;
+  bool falhou_ = false;
+};
+
+#endif  // PACOTES_HPP_
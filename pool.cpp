@@ -0,0 +1,93 @@
+// Copyright 2025 Alex Batista Resende
+#include "pool.hpp"  // NOLINT
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/***************************************************************************
+ * PoolThreads
+ ***************************************************************************/
+PoolThreads::PoolThreads(unsigned threads) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  for (unsigned i = 0; i < threads; i++) {
+    threads_.push_back(std::thread(&PoolThreads::trabalhar, this));
+  }
+}
+
+PoolThreads::~PoolThreads() {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    encerrando_ = true;
+  }
+  tem_tarefa_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++) threads_[i].join();
+}
+
+void PoolThreads::enviar(std::function<void()> tarefa) {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    fila_.push_back(std::move(tarefa));
+  }
+  tem_tarefa_.notify_one();
+}
+
+bool PoolThreads::executarPendente() {
+  std::function<void()> tarefa;
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    if (fila_.empty()) return false;
+    tarefa = std::move(fila_.front());
+    fila_.pop_front();
+  }
+  tarefa();
+  return true;
+}
+
+void PoolThreads::trabalhar() {
+  for (;;) {
+    std::function<void()> tarefa;
+    {
+      std::unique_lock<std::mutex> trava(mutex_);
+      tem_tarefa_.wait(trava,
+                       [this] { return encerrando_ || !fila_.empty(); });
+      if (fila_.empty()) return;  // encerrando e sem trabalho
+      tarefa = std::move(fila_.front());
+      fila_.pop_front();
+    }
+    tarefa();
+  }
+}
+
+/***************************************************************************
+ * GrupoTarefas
+ ***************************************************************************/
+void GrupoTarefas::enviar(std::function<void()> tarefa) {
+  {
+    std::lock_guard<std::mutex> trava(mutex_);
+    pendentes_++;
+  }
+  pool_->enviar([this, tarefa] {
+    tarefa();
+    std::lock_guard<std::mutex> trava(mutex_);
+    if (--pendentes_ == 0) terminou_.notify_all();
+  });
+}
+
+void GrupoTarefas::esperar() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> trava(mutex_);
+      if (pendentes_ == 0) return;
+    }
+    // Ajuda o pool; sem nada na fila, as tarefas do grupo estão rodando
+    // em outras threads e basta aguardar a conclusão delas.
+    if (pool_->executarPendente()) continue;
+    std::unique_lock<std::mutex> trava(mutex_);
+    terminou_.wait_for(trava, std::chrono::milliseconds(1),
+                       [this] { return pendentes_ == 0; });
+  }
+}
@@ -0,0 +1,66 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef POOL_HPP_
+#define POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***************************************************************************
+ * Classe: PoolThreads
+ * Conjunto fixo de threads que consome uma fila de tarefas.
+ ***************************************************************************/
+class PoolThreads {
+ public:
+  // threads == 0 usa o número de núcleos da máquina
+  explicit PoolThreads(unsigned threads);
+  ~PoolThreads();
+
+  void enviar(std::function<void()> tarefa);
+
+  // Executa uma tarefa pendente na thread chamadora; false se não havia
+  bool executarPendente();
+
+  unsigned tamanho() const { return static_cast<unsigned>(threads_.size()); }
+
+ private:
+  PoolThreads(const PoolThreads&);
+  PoolThreads& operator=(const PoolThreads&);
+
+  void trabalhar();
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()> > fila_;
+  std::mutex mutex_;
+  std::condition_variable tem_tarefa_;
+  bool encerrando_ = false;
+};
+
+/***************************************************************************
+ * Classe: GrupoTarefas
+ * Acompanha um conjunto de tarefas enviadas ao pool. esperar() ajuda a
+ * executar a fila enquanto aguarda, então pode ser chamado de dentro de
+ * uma tarefa do próprio pool sem travar as threads.
+ ***************************************************************************/
+class GrupoTarefas {
+ public:
+  explicit GrupoTarefas(PoolThreads* pool) : pool_(pool) {}
+  ~GrupoTarefas() { esperar(); }
+
+  void enviar(std::function<void()> tarefa);
+  void esperar();
+
+ private:
+  GrupoTarefas(const GrupoTarefas&);
+  GrupoTarefas& operator=(const GrupoTarefas&);
+
+  PoolThreads* pool_;
+  std::mutex mutex_;
+  std::condition_variable terminou_;
+  size_t pendentes_ = 0;
+};
+
+#endif  // POOL_HPP_
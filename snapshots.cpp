@@ -0,0 +1,344 @@
+// Copyright 2025 Alex Batista Resende
+#include "snapshots.hpp"  // NOLINT
+#include "durabilidade.hpp"  // NOLINT
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* const NOME_SNAPSHOTS = ".backup_snapshots";
+
+namespace {
+
+// Primeira linha de um nó de diretório
+const char* const CABECALHO_NO = "snapshot-no";
+
+// Tira o próximo campo (até o espaço) do começo de 'linha'
+bool proximoCampo(std::string* linha, std::string* campo) {
+  size_t espaco = linha->find(' ');
+  if (espaco == std::string::npos) return false;
+  *campo = linha->substr(0, espaco);
+  linha->erase(0, espaco + 1);
+  return true;
+}
+
+}  // namespace
+
+// Linha de um nó: um arquivo ("a receita tamanho seg nseg nome") ou um
+// subdiretório ("d no nome"); o nome vai por último e pode ter espaços
+struct Snapshots::EntradaNo {
+  bool diretorio = false;
+  IdFragmento id;
+  ArquivoSnapshot arquivo;
+  std::string nome;
+};
+
+/***************************************************************************
+ * Classe: Snapshots
+ ***************************************************************************/
+std::string Snapshots::caminhoSnapshot(uint32_t numero) const {
+  char nome[32];
+  snprintf(nome, sizeof(nome), "/snapshot-%06u", numero);
+  return raiz_ + nome;
+}
+
+std::vector<uint32_t> Snapshots::numeros() const {
+  std::vector<uint32_t> numeros;
+  DIR* dir = opendir(raiz_.c_str());
+  if (dir == NULL) return numeros;
+  while (struct dirent* entrada = readdir(dir)) {
+    unsigned numero;
+    char resto;
+    if (sscanf(entrada->d_name, "snapshot-%u%c", &numero, &resto) == 1 &&
+        numero > 0) {
+      numeros.push_back(numero);
+    }
+  }
+  closedir(dir);
+  std::sort(numeros.begin(), numeros.end());
+  return numeros;
+}
+
+bool Snapshots::lerRaiz(uint32_t numero, IdFragmento* raiz) const {
+  std::ifstream entrada(caminhoSnapshot(numero).c_str());
+  std::string campo, hex;
+  return entrada >> campo >> hex && campo == "raiz" && raiz->deHex(hex);
+}
+
+bool Snapshots::lerNo(const IdFragmento& id,
+                      std::vector<EntradaNo>* entradas) const {
+  std::string texto;
+  if (!objetos_->lerObjeto(id, &texto)) return false;
+  std::istringstream entrada(texto);
+  std::string linha;
+  if (!std::getline(entrada, linha) || linha != CABECALHO_NO) return false;
+  entradas->clear();
+  while (std::getline(entrada, linha)) {
+    EntradaNo no;
+    std::string tipo, hex, tamanho, seg, nseg;
+    if (!proximoCampo(&linha, &tipo) || !proximoCampo(&linha, &hex) ||
+        !no.id.deHex(hex)) {
+      return false;
+    }
+    no.diretorio = tipo == "d";
+    if (!no.diretorio) {
+      if (tipo != "a" || !proximoCampo(&linha, &tamanho) ||
+          !proximoCampo(&linha, &seg) || !proximoCampo(&linha, &nseg)) {
+        return false;
+      }
+      no.arquivo.receita = no.id;
+      no.arquivo.tamanho = strtoull(tamanho.c_str(), NULL, 10);
+      no.arquivo.mtime_seg = strtoll(seg.c_str(), NULL, 10);
+      no.arquivo.mtime_nseg = strtoul(nseg.c_str(), NULL, 10);
+    }
+    no.nome = linha;
+    entradas->push_back(no);
+  }
+  return true;
+}
+
+bool Snapshots::carregar(const IdFragmento& no, const std::string& prefixo) {
+  std::vector<EntradaNo> entradas;
+  if (!lerNo(no, &entradas)) return false;
+  for (size_t i = 0; i < entradas.size(); i++) {
+    const EntradaNo& entrada = entradas[i];
+    if (entrada.diretorio) {
+      if (!carregar(entrada.id, prefixo + entrada.nome + "/")) return false;
+    } else {
+      indice_[prefixo + entrada.nome] = entrada.arquivo;
+    }
+  }
+  return true;
+}
+
+bool Snapshots::abrir(const std::string& destino_path, uint32_t numero) {
+  raiz_ = destino_path + "/" + NOME_SNAPSHOTS;
+  aberto_ = 0;
+  fixo_ = numero != 0;
+  indice_.clear();
+  novo_.clear();
+  if (numero == 0) {
+    std::vector<uint32_t> existentes = numeros();
+    if (existentes.empty()) return true;
+    numero = existentes.back();
+  }
+  IdFragmento raiz;
+  if (!lerRaiz(numero, &raiz) || !carregar(raiz, "")) {
+    indice_.clear();
+    return false;
+  }
+  aberto_ = numero;
+  return true;
+}
+
+bool Snapshots::buscar(const std::string& nome,
+                       ArquivoSnapshot* arquivo) const {
+  Indice::const_iterator it = indice_.find(nome);
+  if (it == indice_.end()) return false;
+  *arquivo = it->second;
+  return true;
+}
+
+bool Snapshots::listar(const std::string& nome,
+                       std::vector<std::string>* nomes) const {
+  std::string prefixo = nome;
+  while (!prefixo.empty() && prefixo[prefixo.size() - 1] == '/') {
+    prefixo.erase(prefixo.size() - 1);
+  }
+  prefixo += '/';
+  if (indice_.count(nome)) return false;
+  nomes->clear();
+  Indice::const_iterator it;
+  for (it = indice_.lower_bound(prefixo);
+       it != indice_.end() && it->first.compare(0, prefixo.size(),
+                                                prefixo) == 0;
+       ++it) {
+    nomes->push_back(it->first);
+  }
+  return !nomes->empty();
+}
+
+void Snapshots::registrar(const std::string& nome,
+                          const ArquivoSnapshot& arquivo) {
+  std::lock_guard<std::mutex> trava(mutex_);
+  novo_[nome] = arquivo;
+}
+
+bool Snapshots::manter(const std::string& nome) {
+  ArquivoSnapshot arquivo;
+  if (!buscar(nome, &arquivo)) return false;
+  registrar(nome, arquivo);
+  return true;
+}
+
+// Grava o nó do diretório 'prefixo' com as entradas de '*it' em diante que
+// estão abaixo dele. Os caminhos de um diretório são contíguos no mapa
+// ordenado, e o texto do nó depende só deles: o mesmo conteúdo gera o
+// mesmo nó, que o repositório não grava de novo.
+IdFragmento Snapshots::gravarNo(Indice::const_iterator* it,
+                                Indice::const_iterator fim,
+                                const std::string& prefixo, bool* ok) {
+  std::string texto = std::string(CABECALHO_NO) + "\n";
+  while (*it != fim &&
+         (*it)->first.compare(0, prefixo.size(), prefixo) == 0) {
+    const std::string resto = (*it)->first.substr(prefixo.size());
+    const size_t barra = resto.find('/');
+    if (barra == std::string::npos) {
+      const ArquivoSnapshot& arquivo = (*it)->second;
+      texto += "a " + arquivo.receita.hex() + " " +
+               std::to_string(arquivo.tamanho) + " " +
+               std::to_string(arquivo.mtime_seg) + " " +
+               std::to_string(arquivo.mtime_nseg) + " " + resto + "\n";
+      ++*it;
+    } else {
+      const std::string sub = resto.substr(0, barra);
+      IdFragmento filho = gravarNo(it, fim, prefixo + sub + "/", ok);
+      texto += "d " + filho.hex() + " " + sub + "\n";
+    }
+  }
+  IdFragmento id;
+  if (!objetos_->gravarObjeto(texto, &id)) *ok = false;
+  return id;
+}
+
+uint32_t Snapshots::concluir() {
+  std::lock_guard<std::mutex> trava(mutex_);
+  if (mkdir(raiz_.c_str(), 0777) != 0 && errno != EEXIST) return 0;
+  bool ok = true;
+  Indice::const_iterator it = novo_.begin();
+  IdFragmento raiz = gravarNo(&it, novo_.end(), "", &ok);
+  if (!ok) return 0;
+
+  std::vector<uint32_t> existentes = numeros();
+  const uint32_t numero = existentes.empty() ? 1 : existentes.back() + 1;
+  const std::string definitivo = caminhoSnapshot(numero);
+  const std::string temporario = caminhoTemporario(definitivo);
+  const std::string texto = "raiz " + raiz.hex() + "\n";
+  int fd = open(temporario.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0444);
+  ok = fd >= 0 && write(fd, texto.data(), texto.size()) ==
+                      static_cast<ssize_t>(texto.size());
+  if (fd >= 0 && close(fd) != 0) ok = false;
+  // Com lote, o rename só acontece depois do syncfs que leva os objetos
+  if (ok && lote_ != NULL) {
+    lote_->adicionar(temporario, definitivo);
+  } else if (!ok || rename(temporario.c_str(), definitivo.c_str()) != 0) {
+    std::cerr << "[ERRO] Falha ao gravar o snapshot: " << definitivo
+              << " (errno=" << errno << ")\n";
+    unlink(temporario.c_str());
+    return 0;
+  }
+  return numero;
+}
+
+// Todos os arquivos abaixo de um nó, como adicionados ou removidos
+bool Snapshots::listarNo(const IdFragmento& no, const std::string& prefixo,
+                         MudancaSnapshot mudanca,
+                         std::vector<DiferencaSnapshot>* diferencas) const {
+  std::vector<EntradaNo> entradas;
+  if (!lerNo(no, &entradas)) return false;
+  for (size_t i = 0; i < entradas.size(); i++) {
+    const EntradaNo& entrada = entradas[i];
+    if (entrada.diretorio) {
+      if (!listarNo(entrada.id, prefixo + entrada.nome + "/", mudanca,
+                    diferencas)) {
+        return false;
+      }
+    } else {
+      DiferencaSnapshot diferenca = { prefixo + entrada.nome, mudanca };
+      diferencas->push_back(diferenca);
+    }
+  }
+  return true;
+}
+
+// Nós iguais encerram a descida: o custo segue o que mudou
+bool Snapshots::compararNos(const IdFragmento& a, const IdFragmento& b,
+                            const std::string& prefixo,
+                            std::vector<DiferencaSnapshot>* diferencas)
+    const {
+  if (a == b) return true;
+  std::vector<EntradaNo> lista_a, lista_b;
+  if (!lerNo(a, &lista_a) || !lerNo(b, &lista_b)) return false;
+  std::map<std::string, const EntradaNo*> entradas_a, entradas_b;
+  for (size_t i = 0; i < lista_a.size(); i++) {
+    entradas_a[lista_a[i].nome] = &lista_a[i];
+  }
+  for (size_t i = 0; i < lista_b.size(); i++) {
+    entradas_b[lista_b[i].nome] = &lista_b[i];
+  }
+
+  bool ok = true;
+  std::map<std::string, const EntradaNo*>::const_iterator it;
+  for (it = entradas_a.begin(); ok && it != entradas_a.end(); ++it) {
+    const EntradaNo& antes = *it->second;
+    const std::string caminho = prefixo + antes.nome;
+    std::map<std::string, const EntradaNo*>::const_iterator outro =
+        entradas_b.find(it->first);
+    if (outro == entradas_b.end() ||
+        outro->second->diretorio != antes.diretorio) {
+      // Removido (ou trocou de tipo: o novo entra no laço de 'b')
+      if (antes.diretorio) {
+        ok = listarNo(antes.id, caminho + "/", SNAPSHOT_REMOVIDO,
+                      diferencas);
+      } else {
+        DiferencaSnapshot diferenca = { caminho, SNAPSHOT_REMOVIDO };
+        diferencas->push_back(diferenca);
+      }
+      continue;
+    }
+    const EntradaNo& depois = *outro->second;
+    if (antes.diretorio) {
+      ok = compararNos(antes.id, depois.id, caminho + "/", diferencas);
+    } else if (!(antes.id == depois.id) ||
+               antes.arquivo.tamanho != depois.arquivo.tamanho ||
+               antes.arquivo.mtime_seg != depois.arquivo.mtime_seg ||
+               antes.arquivo.mtime_nseg != depois.arquivo.mtime_nseg) {
+      DiferencaSnapshot diferenca = { caminho, SNAPSHOT_ALTERADO };
+      diferencas->push_back(diferenca);
+    }
+  }
+  for (it = entradas_b.begin(); ok && it != entradas_b.end(); ++it) {
+    const EntradaNo& depois = *it->second;
+    std::map<std::string, const EntradaNo*>::const_iterator outro =
+        entradas_a.find(it->first);
+    if (outro != entradas_a.end() &&
+        outro->second->diretorio == depois.diretorio) {
+      continue;
+    }
+    const std::string caminho = prefixo + depois.nome;
+    if (depois.diretorio) {
+      ok = listarNo(depois.id, caminho + "/", SNAPSHOT_ADICIONADO,
+                    diferencas);
+    } else {
+      DiferencaSnapshot diferenca = { caminho, SNAPSHOT_ADICIONADO };
+      diferencas->push_back(diferenca);
+    }
+  }
+  return ok;
+}
+
+bool Snapshots::diferenca(uint32_t a, uint32_t b,
+                          std::vector<DiferencaSnapshot>* diferencas) const {
+  diferencas->clear();
+  IdFragmento raiz_a, raiz_b;
+  if (!lerRaiz(a, &raiz_a) || !lerRaiz(b, &raiz_b) ||
+      !compararNos(raiz_a, raiz_b, "", diferencas)) {
+    return false;
+  }
+  std::sort(diferencas->begin(), diferencas->end(),
+            [](const DiferencaSnapshot& x, const DiferencaSnapshot& y) {
+              return x.nome < y.nome;
+            });
+  return true;
+}
@@ -0,0 +1,116 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef SNAPSHOTS_HPP_
+#define SNAPSHOTS_HPP_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fragmentos.hpp"  // NOLINT
+
+class LoteDurabilidade;
+
+// Diretório dos snapshots dentro do diretório de destino
+extern const char* const NOME_SNAPSHOTS;
+
+// Arquivo de um snapshot: a receita (objeto) e os metadados da origem
+struct ArquivoSnapshot {
+  IdFragmento receita;
+  uint64_t tamanho = 0;
+  int64_t mtime_seg = 0;
+  uint32_t mtime_nseg = 0;
+};
+
+enum MudancaSnapshot {
+  SNAPSHOT_ADICIONADO,
+  SNAPSHOT_REMOVIDO,
+  SNAPSHOT_ALTERADO
+};
+
+struct DiferencaSnapshot {
+  std::string nome;
+  MudancaSnapshot mudanca;
+};
+
+/***************************************************************************
+ * Classe: Snapshots
+ * Formato de destino com versões: cada backup gera um snapshot imutável,
+ * descrito por uma árvore de Merkle. Cada diretório é um nó de texto com
+ * uma linha por entrada (receita e metadados de um arquivo, ou o nó de um
+ * subdiretório), guardado como objeto no repositório de fragmentos; o
+ * identificador do nó é o hash do texto, então um diretório sem mudanças
+ * tem o mesmo nó em todos os snapshots e é gravado uma vez só. O arquivo
+ * NOME_SNAPSHOTS/snapshot-NNNNNN guarda só a raiz e é escrito depois dos
+ * objetos; uma queda antes dele deixa apenas objetos sem referência.
+ * Comparar dois snapshots desce só pelos nós que diferem.
+ ***************************************************************************/
+class Snapshots {
+ public:
+  // 'objetos' guarda receitas e nós; com 'lote', o snapshot novo ganha o
+  // nome definitivo no próximo syncfs do lote
+  explicit Snapshots(RepositorioFragmentos* objetos,
+                     LoteDurabilidade* lote = NULL)
+      : objetos_(objetos), lote_(lote) {}
+
+  // Lê o snapshot 'numero' (0 = o mais recente) de 'destino_path'. Sem
+  // nenhum snapshot e com 'numero' 0, começa vazio. false se o snapshot
+  // não existe ou está ilegível.
+  bool abrir(const std::string& destino_path, uint32_t numero = 0);
+  uint32_t aberto() const { return aberto_; }  // 0 = nenhum
+  bool fixo() const { return fixo_; }          // aberto pelo número
+
+  // Números dos snapshots existentes, em ordem crescente
+  std::vector<uint32_t> numeros() const;
+
+  // Consultas ao snapshot aberto (concorrentes). listar devolve true se
+  // 'nome' é um diretório nele e preenche os caminhos abaixo, em ordem.
+  bool buscar(const std::string& nome, ArquivoSnapshot* arquivo) const;
+  bool listar(const std::string& nome, std::vector<std::string>* nomes) const;
+
+  // Próximo snapshot: 'nome' com uma receita nova, ou como está no
+  // snapshot aberto (false se não está nele). Thread-safe.
+  void registrar(const std::string& nome, const ArquivoSnapshot& arquivo);
+  bool manter(const std::string& nome);
+
+  // Grava os nós que ainda não existem e o snapshot novo; devolve o número
+  // dele ou 0 em falha
+  uint32_t concluir();
+
+  // Arquivos adicionados, removidos e alterados de 'a' para 'b', em ordem
+  bool diferenca(uint32_t a, uint32_t b,
+                 std::vector<DiferencaSnapshot>* diferencas) const;
+
+ private:
+  struct EntradaNo;
+  typedef std::map<std::string, ArquivoSnapshot> Indice;
+
+  Snapshots(const Snapshots&);
+  Snapshots& operator=(const Snapshots&);
+
+  std::string caminhoSnapshot(uint32_t numero) const;
+  bool lerRaiz(uint32_t numero, IdFragmento* raiz) const;
+  bool lerNo(const IdFragmento& id, std::vector<EntradaNo>* entradas) const;
+  bool carregar(const IdFragmento& no, const std::string& prefixo);
+  IdFragmento gravarNo(Indice::const_iterator* it,
+                       Indice::const_iterator fim,
+                       const std::string& prefixo, bool* ok);
+  bool compararNos(const IdFragmento& a, const IdFragmento& b,
+                   const std::string& prefixo,
+                   std::vector<DiferencaSnapshot>* diferencas) const;
+  bool listarNo(const IdFragmento& no, const std::string& prefixo,
+                MudancaSnapshot mudanca,
+                std::vector<DiferencaSnapshot>* diferencas) const;
+
+  RepositorioFragmentos* objetos_;
+  LoteDurabilidade* lote_;
+  std::string raiz_;
+  uint32_t aberto_ = 0;
+  bool fixo_ = false;
+  Indice indice_;  // arquivos do snapshot aberto
+  Indice novo_;    // arquivos do próximo snapshot
+  std::mutex mutex_;
+};
+
+#endif  // SNAPSHOTS_HPP_
@@ -2,11 +2,28 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 #include "backup.hpp"  // NOLINT
+#include "compressao.hpp"  // NOLINT
+#include "crc32c.hpp"  // NOLINT
+#include "delta.hpp"  // NOLINT
+#include "digests.hpp"  // NOLINT
+#include "fragmentos.hpp"  // NOLINT
+#include "indice.hpp"  // NOLINT
+#include "manifesto.hpp"  // NOLINT
+#include "metadados.hpp"  // NOLINT
+#include "snapshots.hpp"  // NOLINT
 
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <map>
+#include <new>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <ftw.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <utime.h>
@@ -60,8 +77,13 @@ TEST_CASE("Backup nao copia arquivos com datas iguais", "[backup-data-igual]") {
   std::ofstream("Backup.parm") << "arquivo_data_igual.txt";
   std::ofstream("arquivo_data_igual.txt") << "conteudonovo";
   std::ofstream("pendrive/arquivo_data_igual.txt") << "conteudoantigo";
+  // Mtimes iguais até o nanossegundo: escritos em sequência, o destino
+  // seria mais novo
+  struct timespec tempos[2] = { { 1000000000, 42 }, { 1000000000, 42 } };
+  utimensat(AT_FDCWD, "arquivo_data_igual.txt", tempos, 0);
+  utimensat(AT_FDCWD, "pendrive/arquivo_data_igual.txt", tempos, 0);
 
-  realizaBackup("pendrive");
+  REQUIRE(realizaBackup("pendrive") == OPERACAO_SUCESSO);
 
   std::ifstream arquivo_atualizado("pendrive/arquivo_data_igual.txt");
   std::stringstream buffer;
@@ -237,3 +259,1760 @@ TEST_CASE("Backup gera resumo no log com contagens corretas", "[backup-log-resum
   rmdir("pendrive");
   remove("Backup.log");
 }
+
+TEST_CASE("Backup copia conteudo integro e registra o metodo de copia", "[backup-metodo-copia]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "arquivo_grande.bin";
+  std::string dados;
+  for (int i = 0; i < (3 << 20); i++) dados += static_cast<char>((i * 131) % 251);
+  std::ofstream("arquivo_grande.bin", std::ios::binary) << dados;
+  remove("Backup.log");
+
+  realizaBackup("pendrive");
+
+  std::ifstream copiado("pendrive/arquivo_grande.bin", std::ios::binary);
+  std::stringstream buffer;
+  buffer << copiado.rdbuf();
+  REQUIRE(buffer.str() == dados);
+
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  bool registrou_metodo =
+      conteudo_log.find("(copy_file_range)") != std::string::npos ||
+      conteudo_log.find("(sendfile)") != std::string::npos ||
+      conteudo_log.find("(splice)") != std::string::npos ||
+      conteudo_log.find("(iostream)") != std::string::npos;
+  REQUIRE(registrou_metodo);
+
+  remove("Backup.parm");
+  remove("arquivo_grande.bin");
+  remove("pendrive/arquivo_grande.bin");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup em modo clone copia e mantem o resumo correto", "[backup-clone]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "clone_a.txt\nclone_b.txt\nclone_inexistente.txt";
+  std::ofstream("clone_a.txt") << "conteudoA";
+  std::ofstream("clone_b.txt") << "conteudoB";
+  remove("Backup.log");
+
+  OpcoesBackup opcoes;
+  opcoes.copia.clonar = true;
+  realizaBackup("pendrive", opcoes);
+
+  std::ifstream copiado("pendrive/clone_b.txt");
+  std::stringstream buffer;
+  buffer << copiado.rdbuf();
+  REQUIRE(buffer.str() == "conteudoB");
+
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[RESUMO] Copiados: 2 | Ignorados: 0 | Erros: 1")
+          != std::string::npos);
+
+  remove("Backup.parm");
+  remove("clone_a.txt");
+  remove("clone_b.txt");
+  remove("pendrive/clone_a.txt");
+  remove("pendrive/clone_b.txt");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup e restauracao com io_uring copiam varios arquivos", "[backup-io-uring]") {
+  mkdir("pendrive", 0777);
+  // uring_a.txt repetido: a repetição só é decidida depois da cópia
+  std::ofstream("Backup.parm") << "uring_a.txt\nuring_b.bin\nuring_a.txt\n"
+                                  "uring_c.txt\nuring_inexistente.txt";
+  std::string grande(700 * 1024, 'x');
+  for (size_t i = 0; i < grande.size(); i += 4096) grande[i] = static_cast<char>(i % 97);
+  std::ofstream("uring_a.txt") << "conteudoA";
+  std::ofstream("uring_b.bin", std::ios::binary) << grande;
+  std::ofstream("uring_c.txt");
+  remove("Backup.log");
+
+  OpcoesBackup opcoes;
+  opcoes.execucao = EXECUCAO_IO_URING;
+  opcoes.profundidade_uring = 2;
+  REQUIRE(realizaBackup("pendrive", opcoes) == ERRO_ARQUIVO_ORIGEM_NAO_EXISTE);
+
+  std::ifstream copiado("pendrive/uring_b.bin", std::ios::binary);
+  std::stringstream buffer;
+  buffer << copiado.rdbuf();
+  REQUIRE(buffer.str() == grande);
+
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[RESUMO] Copiados: 3 | Ignorados: 1 | Erros: 1")
+          != std::string::npos);
+  REQUIRE(conteudo_log.find("[IGNORADO] uring_a.txt") != std::string::npos);
+
+  std::ofstream("Backup.parm") << "uring_a.txt";
+  remove("uring_a.txt");
+  REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream restaurado("uring_a.txt");
+  std::stringstream buffer_rest;
+  buffer_rest << restaurado.rdbuf();
+  REQUIRE(buffer_rest.str() == "conteudoA");
+
+  remove("Backup.parm");
+  remove("uring_a.txt");
+  remove("uring_b.bin");
+  remove("uring_c.txt");
+  remove("pendrive/uring_a.txt");
+  remove("pendrive/uring_b.bin");
+  remove("pendrive/uring_c.txt");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup paralelo gera o mesmo log e resumo do serial", "[backup-paralelo]") {
+  mkdir("pendrive", 0777);
+  std::ofstream parm("Backup.parm");
+  for (int i = 0; i < 40; i++) {
+    std::string nome = "par_" + std::to_string(i) + ".txt";
+    parm << nome << "\n";
+    if (i % 7 == 3) continue;
+    std::ofstream(nome) << "conteudo" << i;
+    struct utimbuf passado = { 1000000000, 1000000000 };
+    utime(nome.c_str(), &passado);
+  }
+  parm << "par_0.txt\n";
+  parm.close();
+
+  remove("Backup.log");
+  int status_serial = realizaBackup("pendrive");
+  std::ifstream log_serial("Backup.log");
+  std::string conteudo_serial((std::istreambuf_iterator<char>(log_serial)),
+                              std::istreambuf_iterator<char>());
+  for (int i = 0; i < 40; i++) {
+    remove(("pendrive/par_" + std::to_string(i) + ".txt").c_str());
+  }
+
+  remove("Backup.log");
+  OpcoesBackup opcoes;
+  opcoes.execucao = EXECUCAO_PARALELA;
+  opcoes.threads = 4;
+  REQUIRE(realizaBackup("pendrive", opcoes) == status_serial);
+  std::ifstream log_paralelo("Backup.log");
+  std::string conteudo_paralelo((std::istreambuf_iterator<char>(log_paralelo)),
+                                std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_paralelo == conteudo_serial);
+
+  for (int i = 0; i < 40; i++) {
+    std::string nome = "par_" + std::to_string(i) + ".txt";
+    remove(nome.c_str());
+    remove(("pendrive/" + nome).c_str());
+  }
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup paralelo para no primeiro destino mais novo", "[backup-paralelo-conflito]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "conf_a.txt\nconf_b.txt\nconf_c.txt";
+  std::ofstream("conf_a.txt") << "A";
+  std::ofstream("conf_b.txt") << "B";
+  std::ofstream("conf_c.txt") << "C";
+  sleep(1);
+  std::ofstream("pendrive/conf_b.txt") << "B-novo";
+
+  OpcoesBackup opcoes;
+  opcoes.execucao = EXECUCAO_PARALELA;
+  opcoes.threads = 3;
+  REQUIRE(realizaBackup("pendrive", opcoes) == ERRO_DESTINO_MAIS_NOVO);
+  REQUIRE(std::ifstream("pendrive/conf_a.txt").good());
+  REQUIRE(!std::ifstream("pendrive/conf_c.txt").good());
+
+  remove("Backup.parm");
+  remove("conf_a.txt");
+  remove("conf_b.txt");
+  remove("conf_c.txt");
+  remove("pendrive/conf_a.txt");
+  remove("pendrive/conf_b.txt");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup em pipeline gera o mesmo log e resumo do serial", "[backup-pipeline]") {
+  mkdir("pendrive", 0777);
+  std::ofstream parm("Backup.parm");
+  for (int i = 0; i < 30; i++) {
+    std::string nome = "pipe_" + std::to_string(i) + ".txt";
+    parm << nome << "\n";
+    // Repetida logo em seguida: decidida só depois da primeira cópia
+    if (i == 3) parm << nome << "\n";
+    if (i % 5 == 2) continue;
+    std::ofstream(nome) << "conteudo" << i;
+  }
+  parm.close();
+
+  remove("Backup.log");
+  int status_serial = realizaBackup("pendrive");
+  std::ifstream log_serial("Backup.log");
+  std::string conteudo_serial((std::istreambuf_iterator<char>(log_serial)),
+                              std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_serial.find("[IGNORADO] pipe_3.txt") != std::string::npos);
+  for (int i = 0; i < 30; i++) {
+    remove(("pendrive/pipe_" + std::to_string(i) + ".txt").c_str());
+  }
+
+  remove("Backup.log");
+  OpcoesBackup opcoes;
+  opcoes.execucao = EXECUCAO_PIPELINE;
+  opcoes.capacidade_pipeline = 2;
+  REQUIRE(realizaBackup("pendrive", opcoes) == status_serial);
+  std::ifstream log_pipeline("Backup.log");
+  std::string conteudo_pipeline((std::istreambuf_iterator<char>(log_pipeline)),
+                                std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_pipeline == conteudo_serial);
+
+  for (int i = 0; i < 30; i++) {
+    std::string nome = "pipe_" + std::to_string(i) + ".txt";
+    remove(nome.c_str());
+    remove(("pendrive/" + nome).c_str());
+  }
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup expande diretorios do Backup.parm recursivamente", "[backup-diretorio]") {
+  mkdir("pendrive", 0777);
+  mkdir("arvore", 0777);
+  mkdir("arvore/sub", 0777);
+  mkdir("arvore/sub/fundo", 0777);
+  std::ofstream("arvore/a.txt") << "A";
+  std::ofstream("arvore/sub/b.txt") << "B";
+  std::ofstream("arvore/sub/fundo/c.txt") << "C";
+  std::ofstream("Backup.parm") << "arvore/";
+  remove("Backup.log");
+
+  OpcoesBackup opcoes;
+  opcoes.threads_varredura = 3;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+  std::ifstream copiado("pendrive/arvore/sub/fundo/c.txt");
+  std::stringstream buffer;
+  buffer << copiado.rdbuf();
+  REQUIRE(buffer.str() == "C");
+
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[RESUMO] Copiados: 3 | Ignorados: 0 | Erros: 0")
+          != std::string::npos);
+
+  remove("arvore/sub/b.txt");
+  REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(std::ifstream("arvore/sub/b.txt").good());
+
+  const char* arquivos[] = { "a.txt", "sub/b.txt", "sub/fundo/c.txt" };
+  for (int i = 0; i < 3; i++) {
+    remove((std::string("arvore/") + arquivos[i]).c_str());
+    remove((std::string("pendrive/arvore/") + arquivos[i]).c_str());
+  }
+  const char* diretorios[] = { "sub/fundo", "sub", "" };
+  for (int i = 0; i < 3; i++) {
+    rmdir((std::string("arvore/") + diretorios[i]).c_str());
+    rmdir((std::string("pendrive/arvore/") + diretorios[i]).c_str());
+  }
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup registra e conta o diretorio que a varredura nao abre", "[backup-diretorio-ilegivel]") {
+  mkdir("pendrive", 0777);
+  mkdir("ilegivel", 0777);
+  mkdir("ilegivel/fechado", 0777);
+  std::ofstream("ilegivel/a.txt") << "A";
+  std::ofstream("ilegivel/fechado/b.txt") << "B";
+  std::ofstream("Backup.parm") << "ilegivel";
+  chmod("ilegivel/fechado", 0);
+  int fd = open("ilegivel/fechado", O_RDONLY | O_DIRECTORY);
+  if (fd >= 0) {
+    close(fd);
+    WARN("Permissoes nao negam a leitura (root); teste ignorado");
+  } else {
+    remove("Backup.log");
+    OpcoesBackup opcoes;
+    opcoes.threads_varredura = 2;
+    REQUIRE(realizaBackup("pendrive", opcoes) ==
+            ERRO_ARQUIVO_ORIGEM_NAO_EXISTE);
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("[ERRO] Não foi possível abrir diretório: "
+                              "ilegivel/fechado (errno=13)") !=
+            std::string::npos);
+    REQUIRE(conteudo_log.find("[RESUMO] Copiados: 1 | Ignorados: 0 | "
+                              "Erros: 1") != std::string::npos);
+  }
+  chmod("ilegivel/fechado", 0777);
+  remove("ilegivel/fechado/b.txt");
+  remove("ilegivel/a.txt");
+  rmdir("ilegivel/fechado");
+  rmdir("ilegivel");
+  remove("pendrive/ilegivel/a.txt");
+  rmdir("pendrive/ilegivel");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup registra o arquivo com nome de copia temporaria", "[backup-nome-temporario]") {
+  mkdir("pendrive", 0777);
+  mkdir("reservado", 0777);
+  std::ofstream("reservado/a.txt") << "A";
+  std::ofstream("reservado/.b.txt.parcial") << "do usuario";
+  std::ofstream("Backup.parm") << "reservado";
+  remove("Backup.log");
+
+  REQUIRE(realizaBackup("pendrive") == ERRO_ARQUIVO_ORIGEM_NAO_EXISTE);
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[ERRO] Nome reservado às cópias temporárias: "
+                            "reservado/.b.txt.parcial") != std::string::npos);
+  REQUIRE(conteudo_log.find("[RESUMO] Copiados: 1 | Ignorados: 0 | "
+                            "Erros: 1") != std::string::npos);
+
+  remove("reservado/a.txt");
+  remove("reservado/.b.txt.parcial");
+  rmdir("reservado");
+  remove("pendrive/reservado/a.txt");
+  rmdir("pendrive/reservado");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Metadados distinguem arquivo inexistente e trazem tamanho", "[metadados]") {
+  remove("meta_inexistente.txt");
+  REQUIRE(obterMetadados("meta_inexistente.txt", CAMPO_MTIME).erro ==
+          METADADOS_INEXISTENTE);
+
+  std::ofstream("meta.txt") << "12345";
+  MetadadosArquivo meta = obterMetadados("meta.txt", CAMPO_MTIME | CAMPO_TAMANHO);
+  REQUIRE(meta.existe());
+  REQUIRE(meta.tamanho == 5);
+  REQUIRE(granularidadeMtime(".") >= 1);
+  remove("meta.txt");
+}
+
+TEST_CASE("Mtimes sao comparados na granularidade do pendrive", "[metadados-granularidade]") {
+  MetadadosArquivo original, gravado;
+  original.mtime_seg = 1000000001;
+  original.mtime_nseg = 500000000;
+  gravado.mtime_seg = 1000000000;  // FAT: passos de 2 s, truncado
+  REQUIRE(compararMtime(original, gravado) > 0);
+  REQUIRE(compararMtime(original, gravado, 2000000000) == 0);
+  REQUIRE(compararMtime(gravado, original, 2000000000) == 0);
+
+  // Mudança além do passo continua visível
+  original.mtime_seg = 1000000002;
+  REQUIRE(compararMtime(original, gravado, 2000000000) > 0);
+
+  // exFAT: passos de 10 ms
+  gravado.mtime_seg = original.mtime_seg;
+  gravado.mtime_nseg = 500000000;
+  original.mtime_nseg = 509999999;
+  REQUIRE(compararMtime(original, gravado, 10000000) == 0);
+  original.mtime_nseg = 510000000;
+  REQUIRE(compararMtime(original, gravado, 10000000) > 0);
+}
+
+TEST_CASE("Backup copia mudancas no mesmo segundo (mtime em nanossegundos)", "[backup-nanossegundos]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "arquivo_ns.txt";
+  std::ofstream("arquivo_ns.txt") << "versao1";
+  struct timespec tempos[2] = { { 1000000000, 100 }, { 1000000000, 100 } };
+  utimensat(AT_FDCWD, "arquivo_ns.txt", tempos, 0);
+  REQUIRE(realizaBackup("pendrive") == OPERACAO_SUCESSO);
+
+  // Nova versão no mesmo segundo: só os nanossegundos mudam
+  std::ofstream("arquivo_ns.txt") << "versao2";
+  tempos[0].tv_nsec = tempos[1].tv_nsec = 900;
+  utimensat(AT_FDCWD, "arquivo_ns.txt", tempos, 0);
+  REQUIRE(realizaBackup("pendrive") == OPERACAO_SUCESSO);
+
+  std::ifstream copiado("pendrive/arquivo_ns.txt");
+  std::stringstream buffer;
+  buffer << copiado.rdbuf();
+  REQUIRE(buffer.str() == "versao2");
+
+  // O destino recebe o mtime da origem, então a terceira execução ignora
+  remove("Backup.log");
+  REQUIRE(realizaBackup("pendrive") == OPERACAO_SUCESSO);
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[IGNORADO] arquivo_ns.txt") != std::string::npos);
+
+  remove("Backup.parm");
+  remove("arquivo_ns.txt");
+  remove("pendrive/arquivo_ns.txt");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Manifesto evita consultar o destino e e validado por amostras", "[backup-manifesto]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "man_1.txt\nman_2.txt";
+  std::ofstream("man_1.txt") << "um";
+  std::ofstream("man_2.txt") << "dois";
+  OpcoesBackup opcoes;
+  opcoes.usar_manifesto = true;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(obterMetadados("pendrive/.backup_manifesto", CAMPO_TAMANHO).existe());
+
+  // Sem amostras, o manifesto é aceito e o destino removido não é notado
+  remove("pendrive/man_1.txt");
+  remove("Backup.log");
+  opcoes.amostras_manifesto = 0;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[IGNORADO] man_1.txt") != std::string::npos);
+
+  // Com amostras, a divergência invalida o manifesto e o stat real copia
+  remove("Backup.log");
+  opcoes.amostras_manifesto = 16;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream log2("Backup.log");
+  std::string conteudo_log2((std::istreambuf_iterator<char>(log2)),
+                            std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log2.find("[AVISO] Manifesto não usado") !=
+          std::string::npos);
+  REQUIRE(conteudo_log2.find("COPIADO: man_1.txt") != std::string::npos);
+  REQUIRE(obterMetadados("pendrive/man_1.txt", CAMPO_TAMANHO).tamanho == 2);
+
+  remove("Backup.parm");
+  remove("man_1.txt");
+  remove("man_2.txt");
+  remove("pendrive/man_1.txt");
+  remove("pendrive/man_2.txt");
+  remove("pendrive/.backup_manifesto");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Manifesto em blocos com prefixos comuns acha cada nome e so eles", "[manifesto]") {
+  mkdir("pendrive", 0777);
+  std::map<std::string, RegistroManifesto> esperado;
+  for (int i = 0; i < 1000; i++) {
+    RegistroManifesto r;
+    r.tamanho = i * 1000;
+    r.mtime_seg = 1700000000 - i * 37 * (i % 2 ? 1 : -1);
+    r.mtime_nseg = i;
+    r.inode = (i % 3) ? 5000000000ULL + i : 12;
+    esperado["dir" + std::to_string(i % 7) + "/sub" +
+             std::to_string(i % 13) + "/arq" + std::to_string(i) + ".txt"] = r;
+  }
+  // Nomes que são prefixos de outros e bytes acima de 0x7F (UTF-8)
+  const char* extras[] = { "a", "a/b", "ab", "dir1", "dir1/sub1",
+                           "acao.txt", "a\xc3\xa7\xc3\xa3o.txt" };
+  for (size_t i = 0; i < sizeof(extras) / sizeof(extras[0]); i++) {
+    esperado[extras[i]].tamanho = i;
+  }
+
+  {
+    Manifesto manifesto;
+    REQUIRE_FALSE(manifesto.carregar("pendrive", 0));  // ausente
+    std::map<std::string, RegistroManifesto>::const_iterator it;
+    for (it = esperado.begin(); it != esperado.end(); ++it) {
+      manifesto.atualizar(it->first, it->second);
+    }
+    REQUIRE(manifesto.gravar());
+  }
+  // No formato anterior, 40 bytes por registro mais o nome inteiro
+  REQUIRE(obterMetadados("pendrive/.backup_manifesto",
+                         CAMPO_TAMANHO).tamanho < esperado.size() * 30);
+
+  Manifesto manifesto;
+  REQUIRE(manifesto.carregar("pendrive", 0));
+  size_t certos = 0, ausentes = 0;
+  std::map<std::string, RegistroManifesto>::const_iterator it;
+  for (it = esperado.begin(); it != esperado.end(); ++it) {
+    RegistroManifesto r;
+    if (manifesto.buscar(it->first, &r) && r.tamanho == it->second.tamanho &&
+        r.mtime_seg == it->second.mtime_seg &&
+        r.mtime_nseg == it->second.mtime_nseg &&
+        r.inode == it->second.inode) {
+      certos++;
+    }
+    const std::string vizinhos[] = {
+      it->first + "x", it->first.substr(0, it->first.size() - 1),
+      it->first + "/" };
+    for (size_t v = 0; v < 3; v++) {
+      if (esperado.count(vizinhos[v]) == 0 &&
+          !manifesto.buscar(vizinhos[v], &r)) {
+        ausentes++;
+      }
+    }
+  }
+  REQUIRE(certos == esperado.size());
+  RegistroManifesto r;
+  REQUIRE_FALSE(manifesto.buscar("", &r));
+  REQUIRE_FALSE(manifesto.buscar("zzz", &r));
+  REQUIRE(ausentes > 2 * esperado.size());
+
+  // Alterações e remoções intercaladas com o manifesto mapeado
+  manifesto.descartar("a/b");
+  manifesto.descartar("dir0/sub0/arq0.txt");
+  RegistroManifesto novo;
+  novo.tamanho = 77;
+  manifesto.atualizar("dir0/sub0/arq0.txt0", novo);
+  manifesto.atualizar("a", novo);
+  REQUIRE(manifesto.gravar());
+  REQUIRE(manifesto.carregar("pendrive", 0));
+  REQUIRE_FALSE(manifesto.buscar("a/b", &r));
+  REQUIRE_FALSE(manifesto.buscar("dir0/sub0/arq0.txt", &r));
+  REQUIRE(manifesto.buscar("dir0/sub0/arq0.txt0", &r));
+  REQUIRE(r.tamanho == 77);
+  REQUIRE(manifesto.buscar("a", &r));
+  REQUIRE(r.tamanho == 77);
+  REQUIRE(manifesto.buscar("ab", &r));
+  REQUIRE(manifesto.buscar("dir5/sub11/arq999.txt", &r));
+  REQUIRE(r.tamanho == 999000);
+
+  remove("pendrive/.backup_manifesto");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Log assincrono preserva todas as linhas e a ordem de cada thread", "[log-assincrono]") {
+  remove("Backup.log");
+  OpcoesLog opcoes;
+  opcoes.capacidade = 8;  // anel pequeno: produtores esperam a escritora
+  opcoes.politica = FLUSH_INTERVALO;
+  {
+    SessaoLog sessao(opcoes);
+    std::vector<std::thread> produtores;
+    for (int t = 0; t < 4; t++) {
+      produtores.push_back(std::thread([t] {
+        for (int i = 0; i < 500; i++) {
+          enviarLog(std::to_string(t) + " " + std::to_string(i) + "\n");
+        }
+      }));
+    }
+    for (size_t t = 0; t < produtores.size(); t++) produtores[t].join();
+  }
+  REQUIRE_FALSE(enviarLog("fora da sessao\n"));
+
+  std::ifstream log("Backup.log");
+  int proxima[4] = { 0, 0, 0, 0 };
+  int linhas = 0;
+  bool em_ordem = true;
+  int t, i;
+  while (log >> t >> i) {
+    if (t < 0 || t > 3 || proxima[t] != i) em_ordem = false;
+    else proxima[t]++;
+    linhas++;
+  }
+  REQUIRE(linhas == 2000);
+  REQUIRE(em_ordem);
+  remove("Backup.log");
+}
+
+TEST_CASE("Backup e restauracao preservam os buracos de arquivos esparsos", "[backup-esparso]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "esparso.img";
+  remove("esparso.img");
+  remove("pendrive/esparso.img");
+
+  // 8 MiB de tamanho, com só duas páginas de dados
+  int fd = open("esparso.img", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  REQUIRE(fd >= 0);
+  std::string pagina(4096, 'x');
+  REQUIRE(pwrite(fd, pagina.data(), pagina.size(), 1 << 20) == 4096);
+  REQUIRE(pwrite(fd, pagina.data(), pagina.size(), (6 << 20) + 100) == 4096);
+  REQUIRE(ftruncate(fd, 8 << 20) == 0);
+  close(fd);
+  MetadadosArquivo origem = obterMetadados("esparso.img",
+                                           CAMPO_TAMANHO | CAMPO_BLOCOS);
+  if (!pareceEsparso(origem.tamanho, origem.blocos)) {
+    WARN("Sistema de arquivos sem buracos; teste ignorado");
+  } else {
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive") == OPERACAO_SUCESSO);
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("COPIADO: esparso.img (sparse)") !=
+            std::string::npos);
+
+    MetadadosArquivo copia = obterMetadados("pendrive/esparso.img",
+                                            CAMPO_TAMANHO | CAMPO_BLOCOS);
+    REQUIRE(copia.tamanho == (8 << 20));
+    REQUIRE(copia.blocos <= origem.blocos);
+
+    std::ifstream a("esparso.img", std::ios::binary);
+    std::ifstream b("pendrive/esparso.img", std::ios::binary);
+    std::string dados_a((std::istreambuf_iterator<char>(a)),
+                        std::istreambuf_iterator<char>());
+    std::string dados_b((std::istreambuf_iterator<char>(b)),
+                        std::istreambuf_iterator<char>());
+    REQUIRE(dados_a == dados_b);
+
+    // Restauração pelo mesmo caminho
+    remove("esparso.img");
+    REQUIRE(realizaRestauracao("pendrive") == OPERACAO_SUCESSO);
+    MetadadosArquivo restaurado = obterMetadados(
+        "esparso.img", CAMPO_TAMANHO | CAMPO_BLOCOS);
+    REQUIRE(restaurado.tamanho == (8 << 20));
+    REQUIRE(restaurado.blocos <= origem.blocos);
+  }
+
+  remove("Backup.parm");
+  remove("esparso.img");
+  remove("pendrive/esparso.img");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup com controle do cache de paginas copia em blocos", "[backup-cache]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "cache.bin";
+  std::string conteudo;
+  for (int i = 0; i < 300000; i++) conteudo += std::to_string(i % 10);
+  std::ofstream("cache.bin") << conteudo;
+  remove("pendrive/cache.bin");
+
+  OpcoesBackup opcoes;
+  opcoes.copia.pre_alocar = true;
+  opcoes.copia.fadvise = true;
+  opcoes.copia.bloco_writeback = 64 * 1024;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+  std::ifstream copiado("pendrive/cache.bin", std::ios::binary);
+  std::string dados((std::istreambuf_iterator<char>(copiado)),
+                    std::istreambuf_iterator<char>());
+  REQUIRE(dados == conteudo);
+
+  remove("Backup.parm");
+  remove("cache.bin");
+  remove("pendrive/cache.bin");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup copia arquivos grandes com O_DIRECT e cauda desalinhada", "[backup-direto]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "direto.bin";
+  std::string conteudo;
+  for (int i = 0; i < 700000; i++) conteudo += static_cast<char>('a' + i % 26);
+  conteudo += "cauda";  // tamanho não múltiplo de 4096
+  std::ofstream("direto.bin", std::ios::binary) << conteudo;
+  remove("pendrive/direto.bin");
+  remove("Backup.log");
+
+  OpcoesBackup opcoes;
+  opcoes.copia.limite_direto = 64 * 1024;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  // Sem O_DIRECT no fs, a cópia cai para os caminhos comuns
+  REQUIRE(conteudo_log.find("[OK] COPIADO: direto.bin") != std::string::npos);
+  std::ifstream copiado("pendrive/direto.bin", std::ios::binary);
+  std::string dados((std::istreambuf_iterator<char>(copiado)),
+                    std::istreambuf_iterator<char>());
+  REQUIRE(dados == conteudo);
+
+  remove("Backup.parm");
+  remove("direto.bin");
+  remove("pendrive/direto.bin");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Arquivo grande e copiado em blocos paralelos no pool", "[backup-blocos]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "blocos.bin\npequeno_1.txt\npequeno_2.txt";
+  std::string conteudo;
+  for (int i = 0; i < (5 << 20) + 123; i++) {
+    conteudo += static_cast<char>((i * 2654435761u) >> 13);
+  }
+  std::ofstream("blocos.bin", std::ios::binary) << conteudo;
+  std::ofstream("pequeno_1.txt") << "um";
+  std::ofstream("pequeno_2.txt") << "dois";
+
+  OpcoesBackup opcoes;
+  opcoes.copia.limite_paralelo = 2 << 20;
+  opcoes.copia.bloco_paralelo = 1 << 20;
+  opcoes.threads = 3;
+  ModoExecucao modos[] = { EXECUCAO_SERIAL, EXECUCAO_PARALELA,
+                           EXECUCAO_PIPELINE };
+  for (size_t m = 0; m < 3; m++) {
+    remove("pendrive/blocos.bin");
+    remove("pendrive/pequeno_1.txt");
+    remove("pendrive/pequeno_2.txt");
+    remove("Backup.log");
+    opcoes.execucao = modos[m];
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("COPIADO: blocos.bin (parallel)") !=
+            std::string::npos);
+    REQUIRE(conteudo_log.find("Copiados: 3") != std::string::npos);
+    std::ifstream copiado("pendrive/blocos.bin", std::ios::binary);
+    std::string dados((std::istreambuf_iterator<char>(copiado)),
+                      std::istreambuf_iterator<char>());
+    REQUIRE(dados == conteudo);
+  }
+
+  remove("Backup.parm");
+  remove("blocos.bin");
+  remove("pequeno_1.txt");
+  remove("pequeno_2.txt");
+  remove("pendrive/blocos.bin");
+  remove("pendrive/pequeno_1.txt");
+  remove("pendrive/pequeno_2.txt");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Copias ficam em temporarios ate o lote de durabilidade concluir", "[backup-durabilidade]") {
+  mkdir("pendrive", 0777);
+  mkdir("lote", 0777);
+  std::ofstream("lote/a.txt") << "A";
+  std::ofstream("lote/b.txt") << "B";
+  std::ofstream("lote/c.txt") << "C";
+  // c.txt repetido: a segunda consulta precisa ver o destino já renomeado
+  std::ofstream("Backup.parm") << "lote/a.txt\nlote/b.txt\nlote/c.txt\n"
+                                  "lote/c.txt";
+
+  OpcoesBackup opcoes;
+  opcoes.arquivos_por_lote = 2;
+  ModoDurabilidade modos[] = { DURABILIDADE_LOTE, DURABILIDADE_NENHUMA };
+  for (size_t m = 0; m < 2; m++) {
+    remove("pendrive/lote/a.txt");
+    remove("pendrive/lote/b.txt");
+    remove("pendrive/lote/c.txt");
+    remove("Backup.log");
+    opcoes.durabilidade = modos[m];
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("Copiados: 3 | Ignorados: 1 | Erros: 0") !=
+            std::string::npos);
+    std::ifstream copiado("pendrive/lote/c.txt");
+    std::stringstream buffer;
+    buffer << copiado.rdbuf();
+    REQUIRE(buffer.str() == "C");
+    REQUIRE(!std::ifstream("pendrive/lote/.c.txt.parcial").good());
+  }
+
+  // Sobra de uma execução interrompida não é restaurada como arquivo
+  std::ofstream("pendrive/lote/.a.txt.parcial") << "pela metade";
+  std::ofstream("Backup.parm") << "lote/";
+  remove("lote/a.txt");
+  REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(std::ifstream("lote/a.txt").good());
+  REQUIRE(!std::ifstream("lote/.a.txt.parcial").good());
+  REQUIRE(!std::ifstream("pendrive/lote/.a.txt.parcial").good());
+
+  // Nem fica no pendrive quando a origem da entrada sumiu
+  std::ofstream("pendrive/lote/.e.txt.parcial") << "pela metade";
+  std::ofstream("Backup.parm") << "lote/e.txt";
+  REQUIRE(realizaBackup("pendrive", opcoes) ==
+          ERRO_ARQUIVO_ORIGEM_NAO_EXISTE);
+  REQUIRE(!std::ifstream("pendrive/lote/.e.txt.parcial").good());
+
+  // Rename que falha na conclusão do lote falha a restauração
+  mkdir("lote/d.txt", 0777);
+  std::ofstream("lote/d.txt/ocupado") << "X";
+  struct utimbuf passado = { 1000000000, 1000000000 };
+  utime("lote/d.txt", &passado);
+  std::ofstream("pendrive/lote/d.txt") << "D";
+  std::ofstream("Backup.parm") << "lote/d.txt";
+  opcoes.durabilidade = DURABILIDADE_LOTE;
+  REQUIRE(realizaRestauracao("pendrive", opcoes) ==
+          ERRO_ARQUIVO_ORIGEM_NAO_EXISTE);
+  REQUIRE(std::ifstream("lote/d.txt/ocupado").good());
+  remove("lote/d.txt/ocupado");
+  rmdir("lote/d.txt");
+  remove("pendrive/lote/d.txt");
+
+  const char* arquivos[] = { "a.txt", "b.txt", "c.txt", ".a.txt.parcial" };
+  for (int i = 0; i < 4; i++) {
+    remove((std::string("lote/") + arquivos[i]).c_str());
+    remove((std::string("pendrive/lote/") + arquivos[i]).c_str());
+  }
+  rmdir("lote");
+  rmdir("pendrive/lote");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("CRC32C confere com o valor de referencia e pode ser dividido", "[crc32c]") {
+  REQUIRE(crc32c(0, "123456789", 9) == 0xE3069283);
+  std::string dados;
+  for (int i = 0; i < 100000; i++) {
+    dados += static_cast<char>((i * 2654435761u) >> 13);
+  }
+  uint32_t inteiro = crc32c(0, dados.data(), dados.size());
+  uint32_t a = crc32c(0, dados.data(), 12345);
+  uint32_t b = crc32c(0, dados.data() + 12345, dados.size() - 12345);
+  REQUIRE(crc32c(a, dados.data() + 12345, dados.size() - 12345) == inteiro);
+  REQUIRE(crc32cConcatenar(a, b, dados.size() - 12345) == inteiro);
+  std::string zeros(70000, '\0');
+  REQUIRE(crc32cZeros(a, zeros.size()) ==
+          crc32c(a, zeros.data(), zeros.size()));
+}
+
+TEST_CASE("Backup grava o CRC32C de cada copia na tabela de digests", "[backup-digests]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "dig_pequeno.txt\ndig_blocos.bin\n"
+                                  "dig_esparso.img";
+  std::string pequeno = "conteudo pequeno";
+  std::string blocos;
+  for (int i = 0; i < (3 << 20) + 77; i++) {
+    blocos += static_cast<char>((i * 2654435761u) >> 13);
+  }
+  std::ofstream("dig_pequeno.txt") << pequeno;
+  std::ofstream("dig_blocos.bin", std::ios::binary) << blocos;
+  int fd = open("dig_esparso.img", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  REQUIRE(fd >= 0);
+  REQUIRE(pwrite(fd, "dados", 5, 1 << 20) == 5);
+  REQUIRE(ftruncate(fd, 3 << 20) == 0);
+  close(fd);
+  std::string esparso(3 << 20, '\0');
+  esparso.replace(1 << 20, 5, "dados");
+
+  // Tempos fixos para a linha esperada ("crc tamanho mtime caminho")
+  struct timespec tempos[2] = { { 1000000000, 5 }, { 1000000000, 5 } };
+  utimensat(AT_FDCWD, "dig_pequeno.txt", tempos, 0);
+  utimensat(AT_FDCWD, "dig_blocos.bin", tempos, 0);
+  utimensat(AT_FDCWD, "dig_esparso.img", tempos, 0);
+  char esperado[256];
+  snprintf(esperado, sizeof(esperado),
+           "%08x %zu 1000000000.000000005 dig_blocos.bin\n"
+           "%08x %zu 1000000000.000000005 dig_esparso.img\n"
+           "%08x %zu 1000000000.000000005 dig_pequeno.txt\n",
+           crc32c(0, blocos.data(), blocos.size()), blocos.size(),
+           crc32c(0, esparso.data(), esparso.size()), esparso.size(),
+           crc32c(0, pequeno.data(), pequeno.size()), pequeno.size());
+
+  OpcoesBackup opcoes;
+  opcoes.calcular_digests = true;
+  opcoes.copia.limite_paralelo = 2 << 20;
+  opcoes.copia.bloco_paralelo = 1 << 20;
+  opcoes.threads = 2;
+  ModoExecucao modos[] = { EXECUCAO_SERIAL, EXECUCAO_IO_URING,
+                           EXECUCAO_PARALELA };
+  for (size_t m = 0; m < 3; m++) {
+    remove("pendrive/dig_pequeno.txt");
+    remove("pendrive/dig_blocos.bin");
+    remove("pendrive/dig_esparso.img");
+    remove((std::string("pendrive/") + NOME_DIGESTS).c_str());
+    opcoes.execucao = modos[m];
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    std::ifstream tabela(std::string("pendrive/") + NOME_DIGESTS);
+    std::string conteudo((std::istreambuf_iterator<char>(tabela)),
+                         std::istreambuf_iterator<char>());
+    REQUIRE(conteudo == esperado);
+  }
+
+  // Arquivos ignorados mantêm a linha da execução anterior
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  TabelaDigests digests;
+  REQUIRE(digests.carregar("pendrive"));
+  DigestArquivo digest;
+  REQUIRE(digests.buscar("dig_pequeno.txt", &digest));
+  REQUIRE(digest.crc32c == crc32c(0, pequeno.data(), pequeno.size()));
+
+  const char* arquivos[] = { "dig_pequeno.txt", "dig_blocos.bin",
+                             "dig_esparso.img" };
+  for (int i = 0; i < 3; i++) {
+    remove(arquivos[i]);
+    remove((std::string("pendrive/") + arquivos[i]).c_str());
+  }
+  remove((std::string("pendrive/") + NOME_DIGESTS).c_str());
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+std::string lerConteudo(const std::string& caminho) {
+  std::ifstream entrada(caminho.c_str(), std::ios::binary);
+  std::stringstream buffer;
+  buffer << entrada.rdbuf();
+  return buffer.str();
+}
+
+TEST_CASE("Conteudo identico com mtime novo so atualiza os tempos do destino", "[backup-identico]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "identico.txt";
+  std::ofstream("identico.txt") << "mesmo conteudo";
+  struct timespec tempos[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+  utimensat(AT_FDCWD, "identico.txt", tempos, 0);
+
+  OpcoesBackup opcoes;
+  opcoes.pular_identicos = true;
+  for (int com_digests = 0; com_digests < 2; com_digests++) {
+    opcoes.calcular_digests = com_digests == 1;
+    remove("pendrive/identico.txt");
+    std::ofstream("identico.txt") << "mesmo conteudo";
+    tempos[0].tv_sec = tempos[1].tv_sec = 1000000000;
+    utimensat(AT_FDCWD, "identico.txt", tempos, 0);
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+    MetadadosArquivo antes = obterMetadados("pendrive/identico.txt",
+                                            CAMPO_INODE);
+
+    // Só o mtime mudou: o destino não é reescrito
+    tempos[0].tv_sec = tempos[1].tv_sec = 1000000100;
+    utimensat(AT_FDCWD, "identico.txt", tempos, 0);
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("[IDENTICO] identico.txt") !=
+            std::string::npos);
+    REQUIRE(conteudo_log.find("Copiados: 0 | Ignorados: 1") !=
+            std::string::npos);
+    MetadadosArquivo depois = obterMetadados("pendrive/identico.txt",
+                                             CAMPO_INODE | CAMPO_MTIME);
+    REQUIRE(depois.inode == antes.inode);
+    REQUIRE(depois.mtime_seg == 1000000100);
+
+    // Mesmo tamanho, conteúdo diferente: copia
+    std::ofstream("identico.txt") << "outro conteudo";
+    tempos[0].tv_sec = tempos[1].tv_sec = 1000000200;
+    utimensat(AT_FDCWD, "identico.txt", tempos, 0);
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+    std::ifstream copiado("pendrive/identico.txt");
+    std::stringstream buffer;
+    buffer << copiado.rdbuf();
+    REQUIRE(buffer.str() == "outro conteudo");
+  }
+
+  // Colisão de CRC32C na tabela de digests: o conteúdo decide, e copia
+  const std::string novo = "OUTRO CONTEUDO";
+  {
+    TabelaDigests digests;
+    DigestArquivo digest;
+    REQUIRE(digests.carregar("pendrive"));
+    REQUIRE(digests.buscar("identico.txt", &digest));
+    digest.crc32c = crc32c(0, novo.data(), novo.size());
+    digests.atualizar("identico.txt", digest);
+    REQUIRE(digests.gravar());
+  }
+  std::ofstream("identico.txt") << novo;
+  tempos[0].tv_sec = tempos[1].tv_sec = 1000000300;
+  utimensat(AT_FDCWD, "identico.txt", tempos, 0);
+  remove("Backup.log");
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(lerConteudo("pendrive/identico.txt") == novo);
+
+  remove((std::string("pendrive/") + NOME_DIGESTS).c_str());
+  remove("Backup.parm");
+  remove("identico.txt");
+  remove("pendrive/identico.txt");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Soma rolante desliza em O(1) e XXH64 confere com a referencia", "[delta]") {
+  REQUIRE(xxh64("", 0) == 0xEF46DB3751D8E999ULL);
+  REQUIRE(xxh64("abc", 3) == 0x44BC2CF5AD770999ULL);
+  std::string dados;
+  for (int i = 0; i < 5000; i++) {
+    dados += static_cast<char>((i * 2654435761u) >> 13);
+  }
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(
+      dados.data());
+  SomaRolante rolante, direta;
+  rolante.iniciar(p, 1000);
+  size_t diferentes = 0;
+  for (size_t i = 1; i + 1000 <= dados.size(); i++) {
+    rolante.rolar(p[i - 1], p[i + 999]);
+    direta.iniciar(p + i, 1000);
+    if (rolante.valor() != direta.valor()) diferentes++;
+  }
+  REQUIRE(diferentes == 0);
+}
+
+TEST_CASE("Arquivo grande alterado e atualizado so nos blocos que mudaram", "[backup-delta]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "delta.bin";
+  std::string dados;
+  for (int i = 0; i < (1 << 20); i++) {
+    dados += static_cast<char>((i * 2654435761u) >> 13);
+  }
+  std::ofstream("delta.bin", std::ios::binary) << dados;
+  struct timespec tempos[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+  utimensat(AT_FDCWD, "delta.bin", tempos, 0);
+
+  OpcoesBackup opcoes;
+  opcoes.copia.limite_delta = 512 << 10;
+  opcoes.copia.bloco_delta = 64 << 10;
+  opcoes.calcular_digests = true;
+  opcoes.durabilidade = DURABILIDADE_NENHUMA;  // sem clone, no lugar
+  remove("pendrive/delta.bin");
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+  // Um bloco alterado e uma cauda nova: o resto vem do próprio destino
+  dados[5 * 65536 + 100] ^= 1;
+  dados += std::string(1000, 'x');
+  std::ofstream("delta.bin", std::ios::binary) << dados;
+  tempos[0].tv_sec = tempos[1].tv_sec = 1000000100;
+  utimensat(AT_FDCWD, "delta.bin", tempos, 0);
+  remove("Backup.log");
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[OK] COPIADO: delta.bin (delta)") !=
+          std::string::npos);
+  REQUIRE(conteudo_log.find("| Delta: 983040 bytes poupados, 66536 escritos") !=
+          std::string::npos);
+  std::ifstream copiado("pendrive/delta.bin", std::ios::binary);
+  std::stringstream buffer;
+  buffer << copiado.rdbuf();
+  REQUIRE(buffer.str() == dados);
+  MetadadosArquivo meta = obterMetadados("pendrive/delta.bin", CAMPO_MTIME);
+  REQUIRE(meta.mtime_seg == 1000000100);
+  TabelaDigests digests;
+  DigestArquivo digest;
+  REQUIRE(digests.carregar("pendrive"));
+  REQUIRE(digests.buscar("delta.bin", &digest));
+  REQUIRE(digest.crc32c == crc32c(0, dados.data(), dados.size()));
+
+  // Bytes inseridos no início deslocam todos os blocos: o resultado
+  // continua igual à origem
+  dados.insert(0, "deslocado");
+  std::ofstream("delta.bin", std::ios::binary) << dados;
+  tempos[0].tv_sec = tempos[1].tv_sec = 1000000200;
+  utimensat(AT_FDCWD, "delta.bin", tempos, 0);
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream deslocado("pendrive/delta.bin", std::ios::binary);
+  std::stringstream buffer_deslocado;
+  buffer_deslocado << deslocado.rdbuf();
+  REQUIRE(buffer_deslocado.str() == dados);
+
+  // Bytes removidos do início: no lugar, os blocos vêm de mais adiante no
+  // próprio destino; reescritos, não contam como poupados
+  dados.erase(0, 9);
+  std::ofstream("delta.bin", std::ios::binary) << dados;
+  tempos[0].tv_sec = tempos[1].tv_sec = 1000000300;
+  utimensat(AT_FDCWD, "delta.bin", tempos, 0);
+  remove("Backup.log");
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(lerConteudo("pendrive/delta.bin") == dados);
+  REQUIRE(lerConteudo("Backup.log").find("| Delta: 0 bytes poupados") !=
+          std::string::npos);
+
+  // Delta no lugar interrompido: destino pela metade, com o mtime da queda
+  // e a marca ao lado; o backup seguinte copia de novo
+  std::ofstream("pendrive/.delta.bin.parcial");
+  int fd = open("pendrive/delta.bin", O_WRONLY);
+  REQUIRE(pwrite(fd, "xx", 2, 0) == 2);
+  close(fd);
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(lerConteudo("pendrive/delta.bin") == dados);
+  REQUIRE(!std::ifstream("pendrive/.delta.bin.parcial").good());
+
+  // Sem rename, o resultado fica só no temporário: o destino continua com
+  // a versão anterior até o lote concluir. Sem clone a cópia é comum, e
+  // nada conta como poupado.
+  const std::string anterior = dados;
+  dados[3 * 65536] ^= 1;
+  std::ofstream("delta.bin", std::ios::binary) << dados;
+  OpcoesCopia copia = opcoes.copia;
+  copia.renomear = false;
+  ResultadoDelta resultado;
+  MetodoCopia metodo = copiarDelta("delta.bin", "pendrive/delta.bin", copia,
+                                   &resultado);
+  REQUIRE(metodo != COPIA_FALHOU);
+  REQUIRE(!resultado.no_lugar);
+  if (metodo == COPIA_DELTA) {
+    REQUIRE(resultado.reaproveitados >= 14 * 65536);
+  } else {
+    REQUIRE(resultado.reaproveitados == 0);
+  }
+  REQUIRE(lerConteudo("pendrive/delta.bin") == anterior);
+  REQUIRE(lerConteudo("pendrive/.delta.bin.parcial") == dados);
+  remove("pendrive/.delta.bin.parcial");
+
+  remove((std::string("pendrive/") + NOME_DIGESTS).c_str());
+  remove("Backup.parm");
+  remove("delta.bin");
+  remove("pendrive/delta.bin");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+// Dados pseudoaleatórios sem período curto (fragmentação definida pelo
+// conteúdo)
+std::string dadosAleatorios(size_t tamanho, uint64_t semente) {
+  std::string dados(tamanho, '\0');
+  for (size_t i = 0; i < tamanho; i++) {
+    semente = semente * 6364136223846793005ULL + 1442695040888963407ULL;
+    dados[i] = static_cast<char>(semente >> 56);
+  }
+  return dados;
+}
+
+int removerEntrada(const char* caminho, const struct stat*, int,
+                   struct FTW*) {
+  return remove(caminho);
+}
+
+void removerArvore(const std::string& caminho) {
+  nftw(caminho.c_str(), removerEntrada, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+TEST_CASE("Fragmentacao por conteudo respeita os limites e resiste a insercoes", "[fragmentos]") {
+  OpcoesFragmentos opcoes;
+  std::string dados = dadosAleatorios(1 << 20, 1);
+
+  std::vector<std::string> ids;
+  size_t originais = 0;
+  size_t fora_dos_limites = 0;
+  for (int deslocado = 0; deslocado < 2; deslocado++) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(
+        dados.data());
+    size_t pos = 0;
+    while (pos < dados.size()) {
+      size_t n = cortarFragmento(p + pos, dados.size() - pos, true, opcoes);
+      // Sem o fim dos dados, o corte só é adiado se não houver fronteira
+      size_t parcial = cortarFragmento(p + pos, dados.size() - pos, false,
+                                       opcoes);
+      if (n == 0 || n > opcoes.maximo ||
+          (pos + n < dados.size() && n < opcoes.minimo) ||
+          (parcial != n && parcial != 0)) {
+        fora_dos_limites++;
+        break;
+      }
+      ids.push_back(identificarFragmento(p + pos, n).hex());
+      pos += n;
+    }
+    if (deslocado == 0) {
+      originais = ids.size();
+      dados.insert(0, "deslocado");
+    }
+  }
+  REQUIRE(fora_dos_limites == 0);
+
+  // Tamanho médio perto do pedido e, depois da inserção, só os primeiros
+  // fragmentos mudam
+  REQUIRE(originais > (1 << 20) / (4 * opcoes.medio));
+  REQUIRE(originais < (1 << 20) / (opcoes.medio / 4));
+  size_t repetidos = 0;
+  for (size_t i = originais; i < ids.size(); i++) {
+    for (size_t j = 0; j < originais; j++) {
+      if (ids[i] == ids[j]) {
+        repetidos++;
+        break;
+      }
+    }
+  }
+  REQUIRE(repetidos + 2 >= originais);
+}
+
+TEST_CASE("Backup em fragmentos deduplica arquivos parecidos e restaura", "[backup-fragmentos]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "frag_a.img\nfrag_b.img";
+  std::string a = dadosAleatorios(1 << 20, 7);
+  std::string b = a;
+  b[300000] ^= 1;
+  b.insert(700000, "inserido");
+
+  OpcoesBackup opcoes;
+  opcoes.formato = DESTINO_FRAGMENTOS;
+  opcoes.threads = 2;
+  ModoExecucao modos[] = { EXECUCAO_SERIAL, EXECUCAO_PARALELA };
+  for (size_t m = 0; m < 2; m++) {
+    opcoes.execucao = modos[m];
+    std::ofstream("frag_a.img", std::ios::binary) << a;
+    std::ofstream("frag_b.img", std::ios::binary) << b;
+    struct timespec tempos[2] = { { 1000000000, 5 }, { 1000000000, 5 } };
+    utimensat(AT_FDCWD, "frag_a.img", tempos, 0);
+    utimensat(AT_FDCWD, "frag_b.img", tempos, 0);
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("[OK] COPIADO: frag_b.img (fragmentos)") !=
+            std::string::npos);
+    size_t pos = conteudo_log.find("| Fragmentos: ");
+    REQUIRE(pos != std::string::npos);
+    unsigned long novos = 0, total = 0;  // NOLINT
+    double dedup = 0;
+    REQUIRE(sscanf(conteudo_log.c_str() + pos,
+                   "| Fragmentos: %lu novos de %lu | Dedup: %lfx",
+                   &novos, &total, &dedup) == 3);
+    // O segundo arquivo só acrescenta os fragmentos das duas alterações
+    REQUIRE(novos < total / 2 + 6);
+    REQUIRE(dedup > 1.8);
+
+    // A receita fica no lugar do arquivo, com o mtime da origem
+    MetadadosArquivo receita = obterMetadados("pendrive/frag_b.img",
+                                              CAMPO_MTIME | CAMPO_TAMANHO);
+    REQUIRE(receita.mtime_seg == 1000000000);
+    REQUIRE(receita.mtime_nseg == 5);
+    REQUIRE(receita.tamanho < b.size() / 100);
+
+    // Nada mudou: as entradas são ignoradas
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    remove("frag_a.img");
+    remove("frag_b.img");
+    REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+    std::ifstream restaurado("frag_b.img", std::ios::binary);
+    std::stringstream buffer;
+    buffer << restaurado.rdbuf();
+    REQUIRE(buffer.str() == b);
+    MetadadosArquivo meta = obterMetadados("frag_b.img", CAMPO_MTIME);
+    REQUIRE(meta.mtime_nseg == 5);
+
+    removerArvore(std::string("pendrive/") + NOME_FRAGMENTOS);
+    remove("pendrive/frag_a.img");
+    remove("pendrive/frag_b.img");
+  }
+
+  remove("frag_a.img");
+  remove("frag_b.img");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Indice de fragmentos persiste em tabelas, funde e responde pelo filtro", "[indice]") {
+  mkdir("pendrive", 0777);
+  const std::string diretorio = "pendrive/indice";
+  std::vector<IdFragmento> ids;
+  for (int i = 0; i < 2000; i++) {
+    const std::string dados = "fragmento " + std::to_string(i);
+    ids.push_back(identificarFragmento(dados.data(), dados.size()));
+  }
+
+  {
+    // Uma tabela a cada 100 identificadores, no máximo 3 em disco
+    IndiceFragmentos indice(100, 3);
+    REQUIRE(indice.abrir(diretorio, false));
+    size_t novos = 0;
+    for (size_t i = 0; i < 1000; i++) {
+      if (!indice.contem(ids[i]) && indice.inserir(ids[i])) novos++;
+    }
+    REQUIRE(novos == 1000);
+    REQUIRE(indice.tabelas() <= 3);
+    REQUIRE(indice.quantidade() == 1000);
+    size_t certos = 0;
+    for (size_t i = 0; i < 2000; i++) {
+      if (indice.contem(ids[i]) == (i < 1000)) certos++;
+    }
+    REQUIRE(certos == 2000);
+  }
+
+  // Restos de execuções interrompidas e tabelas corrompidas são apagados
+  std::ofstream(diretorio + "/indice-000900") << "lixo";
+  std::ofstream(diretorio + "/.indice-000901.parcial") << "lixo";
+  {
+    IndiceFragmentos indice(100, 3);
+    REQUIRE(indice.abrir(diretorio, true));
+    REQUIRE(indice.quantidade() == 1000);
+    REQUIRE(indice.bytesEmMemoria() < 1500);  // só os filtros, ~10 bits/id
+    size_t certos = 0;
+    for (size_t i = 0; i < 2000; i++) {
+      if (indice.contem(ids[i]) == (i < 1000)) certos++;
+    }
+    REQUIRE(certos == 2000);
+    for (size_t i = 1000; i < 1050; i++) indice.inserir(ids[i]);
+    REQUIRE_FALSE(indice.inserir(ids[1049]));  // ainda em memória
+    REQUIRE(indice.concluir());
+  }
+  REQUIRE(access((diretorio + "/indice-000900").c_str(), F_OK) != 0);
+  REQUIRE(access((diretorio + "/.indice-000901.parcial").c_str(), F_OK) !=
+          0);
+  {
+    IndiceFragmentos indice;
+    REQUIRE(indice.abrir(diretorio, false));
+    REQUIRE(indice.contem(ids[1049]));
+    REQUIRE_FALSE(indice.contem(ids[1050]));
+  }
+  removerArvore(diretorio);
+
+  // Repositório sem índice (versão anterior): os fragmentos existentes são
+  // listados uma vez e não contam como novos
+  std::ofstream("Backup.parm") << "indice_a.img";
+  std::ofstream("indice_a.img", std::ios::binary) << dadosAleatorios(200000, 3);
+  OpcoesBackup opcoes;
+  opcoes.formato = DESTINO_FRAGMENTOS;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  const std::string repositorio = std::string("pendrive/") + NOME_FRAGMENTOS;
+  removerArvore(repositorio + "/indice");
+  remove("pendrive/indice_a.img");
+  remove("Backup.log");
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("| Fragmentos: 0 novos") != std::string::npos);
+
+  removerArvore(repositorio);
+  remove("pendrive/indice_a.img");
+  remove("indice_a.img");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Backup em pacotes junta arquivos pequenos e restaura pelo indice", "[backup-pacotes]") {
+  mkdir("pendrive", 0777);
+  mkdir("pct", 0777);
+  const int n = 50;
+  std::string grande = dadosAleatorios(300 << 10, 3);
+  std::ofstream("Backup.parm") << "pct";
+  const std::string pacote1 = std::string("pendrive/") + NOME_PACOTES +
+                              "/pacote-000001.pk";
+  const std::string pacote2 = std::string("pendrive/") + NOME_PACOTES +
+                              "/pacote-000002.pk";
+
+  OpcoesBackup opcoes;
+  opcoes.formato = DESTINO_PACOTES;
+  opcoes.pacotes.limite_arquivo = 64 << 10;
+  opcoes.threads = 3;
+  ModoExecucao modos[] = { EXECUCAO_SERIAL, EXECUCAO_PARALELA };
+  for (size_t m = 0; m < 2; m++) {
+    opcoes.execucao = modos[m];
+    for (int i = 0; i < n; i++) {
+      std::ofstream("pct/arq" + std::to_string(i) + ".cfg")
+          << "config " << i;
+    }
+    std::ofstream("pct/grande.bin", std::ios::binary) << grande;
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    // Um pacote para os pequenos; o grande é uma cópia comum
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("[OK] COPIADO: pct/arq7.cfg (pacote)") !=
+            std::string::npos);
+    REQUIRE(conteudo_log.find("Copiados: 51 | Ignorados: 0") !=
+            std::string::npos);
+    REQUIRE(std::ifstream(pacote1).good());
+    REQUIRE(!std::ifstream("pendrive/pct/arq7.cfg").good());
+    REQUIRE(std::ifstream("pendrive/pct/grande.bin").good());
+
+    // Nada mudou: tudo é decidido pelo índice
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+    std::ifstream log2("Backup.log");
+    std::string conteudo_log2((std::istreambuf_iterator<char>(log2)),
+                              std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log2.find("Copiados: 0 | Ignorados: 51") !=
+            std::string::npos);
+    REQUIRE(!std::ifstream(pacote2).good());
+
+    // Versão nova de um arquivo vai para outro pacote e vale na restauração
+    std::ofstream("pct/arq7.cfg") << "versao nova";
+    struct timespec tempos[2] = { { 2000000000, 0 }, { 2000000000, 0 } };
+    utimensat(AT_FDCWD, "pct/arq7.cfg", tempos, 0);
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+    REQUIRE(std::ifstream(pacote2).good());
+
+    for (int i = 0; i < n; i++) {
+      remove(("pct/arq" + std::to_string(i) + ".cfg").c_str());
+    }
+    remove("pct/grande.bin");
+    REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+    std::ifstream arq7("pct/arq7.cfg");
+    std::stringstream buffer7;
+    buffer7 << arq7.rdbuf();
+    REQUIRE(buffer7.str() == "versao nova");
+    REQUIRE(getFileModTime("pct/arq7.cfg") == 2000000000);
+    std::ifstream arq9("pct/arq9.cfg");
+    std::stringstream buffer9;
+    buffer9 << arq9.rdbuf();
+    REQUIRE(buffer9.str() == "config 9");
+    std::ifstream restaurado("pct/grande.bin", std::ios::binary);
+    std::stringstream buffer_grande;
+    buffer_grande << restaurado.rdbuf();
+    REQUIRE(buffer_grande.str() == grande);
+
+    // Pacote sem rodapé (execução interrompida) não conta: o arquivo
+    // volta a ser copiado
+    REQUIRE(truncate(pacote2.c_str(), 20) == 0);
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+    std::ifstream log3("Backup.log");
+    std::string conteudo_log3((std::istreambuf_iterator<char>(log3)),
+                              std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log3.find("Copiados: 1 | Ignorados: 50") !=
+            std::string::npos);
+
+    removerArvore(std::string("pendrive/") + NOME_PACOTES);
+    removerArvore("pendrive/pct");
+  }
+
+  removerArvore("pct");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("LZ4 comprime e descomprime nos dois niveis", "[compressao]") {
+  std::string texto;
+  for (int i = 0; texto.size() < (1 << 20); i++) {
+    texto += "linha " + std::to_string(i % 997) + " do relatorio de backup\n";
+  }
+  std::string aleatorio = dadosAleatorios(1 << 20, 3);
+  std::string curtos[] = { "", "a", "abcdefghijkl", std::string(40, 'x') };
+
+  for (int denso = 0; denso < 2; denso++) {
+    std::vector<char> saida(limiteLz4(texto.size()));
+    size_t n = comprimirLz4(texto.data(), texto.size(), &saida[0],
+                            saida.size(), denso == 1);
+    REQUIRE(n > 0);
+    REQUIRE(n < texto.size() / 4);
+    std::string volta(texto.size(), '\0');
+    REQUIRE(descomprimirLz4(&saida[0], n, &volta[0], volta.size()));
+    REQUIRE(volta == texto);
+    // Tamanho original errado ou dados truncados são recusados
+    REQUIRE_FALSE(descomprimirLz4(&saida[0], n, &volta[0], volta.size() - 1));
+    REQUIRE_FALSE(descomprimirLz4(&saida[0], n / 2, &volta[0], volta.size()));
+
+    n = comprimirLz4(aleatorio.data(), aleatorio.size(), &saida[0],
+                     saida.size(), denso == 1);
+    REQUIRE(n <= limiteLz4(aleatorio.size()));
+    volta.assign(aleatorio.size(), '\0');
+    REQUIRE(descomprimirLz4(&saida[0], n, &volta[0], volta.size()));
+    REQUIRE(volta == aleatorio);
+
+    for (size_t i = 0; i < 4; i++) {
+      n = comprimirLz4(curtos[i].data(), curtos[i].size(), &saida[0],
+                       saida.size(), denso == 1);
+      volta.assign(curtos[i].size(), '\0');
+      REQUIRE(n > 0);
+      REQUIRE(descomprimirLz4(&saida[0], n, &volta[0], volta.size()));
+      REQUIRE(volta == curtos[i]);
+    }
+  }
+
+  REQUIRE(entropiaBytes(reinterpret_cast<const unsigned char*>(
+              texto.data()), texto.size()) < 5);
+  REQUIRE(entropiaBytes(reinterpret_cast<const unsigned char*>(
+              aleatorio.data()), aleatorio.size()) > 7.9);
+}
+
+TEST_CASE("Backup comprime o que a amostragem aprova e restaura", "[backup-compressao]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "comp_texto.txt\ncomp_aleatorio.bin";
+  std::string texto;
+  for (int i = 0; texto.size() < (3 << 20); i++) {
+    texto += "registro " + std::to_string(i) + ";status=ok;origem=hd\n";
+  }
+  std::string aleatorio = dadosAleatorios(1 << 20, 9);
+
+  OpcoesBackup opcoes;
+  opcoes.compressao.bloco = 256 << 10;
+  CodecCompressao codecs[] = { CODEC_LZ4, CODEC_LZ4HC };
+  for (size_t c = 0; c < 2; c++) {
+    opcoes.compressao.codec = codecs[c];
+    std::ofstream("comp_texto.txt", std::ios::binary) << texto;
+    std::ofstream("comp_aleatorio.bin", std::ios::binary) << aleatorio;
+    struct timespec tempos[2] = { { 1000000000, 7 }, { 1000000000, 7 } };
+    utimensat(AT_FDCWD, "comp_texto.txt", tempos, 0);
+    utimensat(AT_FDCWD, "comp_aleatorio.bin", tempos, 0);
+    remove("Backup.log");
+    REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+    std::ifstream log("Backup.log");
+    std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                             std::istreambuf_iterator<char>());
+    REQUIRE(conteudo_log.find("[OK] COPIADO: comp_texto.txt (comprimida)") !=
+            std::string::npos);
+    const std::string codec = std::string("| ") + nomeCodec(codecs[c]) + ": ";
+    size_t pos = conteudo_log.find(codec);
+    REQUIRE(pos != std::string::npos);
+    double razao = 0, vazao = 0;
+    REQUIRE(sscanf(conteudo_log.c_str() + pos + codec.size(),
+                   "%lfx a %lf MB/s", &razao, &vazao) == 2);
+    REQUIRE(razao > 3);
+    REQUIRE(vazao > 0);
+    // Os dados aleatórios não passam pela amostragem
+    REQUIRE(conteudo_log.find("| Sem compressão: 1") != std::string::npos);
+
+    MetadadosArquivo comprimido = obterMetadados(
+        "pendrive/comp_texto.txt", CAMPO_MTIME | CAMPO_TAMANHO);
+    REQUIRE(comprimido.mtime_nseg == 7);
+    REQUIRE(comprimido.tamanho < texto.size() / 3);
+    REQUIRE(obterMetadados("pendrive/comp_aleatorio.bin",
+                           CAMPO_TAMANHO).tamanho == aleatorio.size());
+
+    remove("comp_texto.txt");
+    remove("comp_aleatorio.bin");
+    // O cabeçalho identifica o arquivo comprimido mesmo sem codec pedido
+    REQUIRE(realizaRestauracao("pendrive", c == 0 ? opcoes : OpcoesBackup())
+            == OPERACAO_SUCESSO);
+    std::ifstream restaurado("comp_texto.txt", std::ios::binary);
+    std::stringstream buffer;
+    buffer << restaurado.rdbuf();
+    REQUIRE(buffer.str() == texto);
+    MetadadosArquivo meta = obterMetadados("comp_texto.txt", CAMPO_MTIME);
+    REQUIRE(meta.mtime_seg == 1000000000);
+    REQUIRE(meta.mtime_nseg == 7);
+    std::ifstream restaurado_aleatorio("comp_aleatorio.bin",
+                                       std::ios::binary);
+    std::stringstream buffer_aleatorio;
+    buffer_aleatorio << restaurado_aleatorio.rdbuf();
+    REQUIRE(buffer_aleatorio.str() == aleatorio);
+
+    remove("pendrive/comp_texto.txt");
+    remove("pendrive/comp_aleatorio.bin");
+  }
+
+  remove("comp_texto.txt");
+  remove("comp_aleatorio.bin");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+TEST_CASE("Arquivo grande e comprimido e restaurado em blocos paralelos", "[backup-compressao-paralela]") {
+  mkdir("pendrive", 0777);
+  std::ofstream("Backup.parm") << "comp_grande.txt";
+  // Texto com trechos aleatórios espalhados pelos blocos
+  std::string dados;
+  for (int i = 0; dados.size() < (2 << 20); i++) {
+    dados += i % 40 == 0 ? dadosAleatorios(1000, i)
+                        : "entrada " + std::to_string(i) + " sem mudancas\n";
+  }
+  std::ofstream("comp_grande.txt", std::ios::binary) << dados;
+
+  OpcoesBackup opcoes;
+  opcoes.compressao.codec = CODEC_LZ4;
+  opcoes.compressao.bloco = 64 << 10;
+  opcoes.compressao.limite_paralelo = 1 << 20;
+  opcoes.calcular_digests = true;
+  opcoes.threads = 4;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+
+  // O CRC dos blocos paralelos, concatenado, é o do arquivo todo
+  TabelaDigests digests;
+  REQUIRE(digests.carregar("pendrive"));
+  DigestArquivo digest;
+  REQUIRE(digests.buscar("comp_grande.txt", &digest));
+  REQUIRE(digest.crc32c == crc32c(0, dados.data(), dados.size()));
+
+  // Trecho que atravessa blocos, sem descomprimir o arquivo inteiro
+  std::vector<char> trecho(200000);
+  const uint64_t offset = (5 << 16) - 1000;
+  REQUIRE(lerTrechoComprimido("pendrive/comp_grande.txt", offset,
+                              &trecho[0], trecho.size()) ==
+          static_cast<ssize_t>(trecho.size()));
+  REQUIRE(std::string(trecho.begin(), trecho.end()) ==
+          dados.substr(offset, trecho.size()));
+  REQUIRE(lerTrechoComprimido("pendrive/comp_grande.txt", dados.size() - 10,
+                              &trecho[0], trecho.size()) == 10);
+
+  remove("comp_grande.txt");
+  REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+  std::ifstream restaurado("comp_grande.txt", std::ios::binary);
+  std::stringstream buffer;
+  buffer << restaurado.rdbuf();
+  REQUIRE(buffer.str() == dados);
+
+  // Índice truncado: a restauração recusa o arquivo
+  MetadadosArquivo comprimido = obterMetadados("pendrive/comp_grande.txt",
+                                               CAMPO_TAMANHO);
+  REQUIRE(truncate("pendrive/comp_grande.txt", comprimido.tamanho - 4) == 0);
+  REQUIRE(copiarDescomprimindo("pendrive/comp_grande.txt", "comp_copia.txt",
+                               true) == COPIA_FALHOU);
+
+  remove("comp_grande.txt");
+  remove("pendrive/comp_grande.txt");
+  remove((std::string("pendrive/") + NOME_DIGESTS).c_str());
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+int arquivos_contados = 0;
+
+int contarEntrada(const char*, const struct stat*, int tipo, struct FTW*) {
+  if (tipo == FTW_F) arquivos_contados++;
+  return 0;
+}
+
+int contarArquivos(const std::string& caminho) {
+  arquivos_contados = 0;
+  nftw(caminho.c_str(), contarEntrada, 16, FTW_PHYS);
+  return arquivos_contados;
+}
+
+void escreverComMtime(const std::string& caminho, const std::string& dados,
+                      time_t mtime) {
+  std::ofstream(caminho.c_str(), std::ios::binary) << dados;
+  struct timespec tempos[2] = { { mtime, 0 }, { mtime, 0 } };
+  utimensat(AT_FDCWD, caminho.c_str(), tempos, 0);
+}
+
+TEST_CASE("Snapshots guardam versoes, compartilham nos e comparam so o que mudou", "[backup-snapshots]") {
+  mkdir("pendrive", 0777);
+  mkdir("snap", 0777);
+  mkdir("snap/alterado", 0777);
+  mkdir("snap/removido", 0777);
+  mkdir("snap/intacto", 0777);
+  std::ofstream("Backup.parm") << "snap";
+  escreverComMtime("snap/alterado/x.txt", "versao 1", 1000000000);
+  escreverComMtime("snap/removido/y.txt", "vai sumir", 1000000000);
+  escreverComMtime("snap/intacto/z.bin", dadosAleatorios(100000, 5),
+                   1000000000);
+
+  OpcoesBackup opcoes;
+  opcoes.formato = DESTINO_SNAPSHOTS;
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(lerConteudo("Backup.log").find("| Snapshot: 1") !=
+          std::string::npos);
+  // Nada no caminho espelhado: só objetos e o snapshot
+  REQUIRE(obterMetadados("pendrive/snap", CAMPO_MTIME).erro ==
+          METADADOS_INEXISTENTE);
+
+  escreverComMtime("snap/alterado/x.txt", "versao 2", 1000000100);
+  remove("snap/removido/y.txt");
+  escreverComMtime("snap/novo.txt", "novo", 1000000100);
+  remove("Backup.log");
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(lerConteudo("Backup.log").find("| Snapshot: 2") !=
+          std::string::npos);
+
+  // Sem mudanças: o snapshot 3 reaproveita todos os nós do 2
+  const std::string objetos = std::string("pendrive/") + NOME_FRAGMENTOS;
+  int antes = contarArquivos(objetos);
+  REQUIRE(realizaBackup("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(contarArquivos(objetos) == antes);
+
+  RepositorioFragmentos repositorio((OpcoesFragmentos()));
+  REQUIRE(repositorio.abrir("pendrive", true));
+  Snapshots snapshots(&repositorio);
+  REQUIRE(snapshots.abrir("pendrive"));
+  REQUIRE(snapshots.aberto() == 3);
+  std::vector<uint32_t> numeros = snapshots.numeros();
+  REQUIRE(numeros.size() == 3);
+
+  std::vector<DiferencaSnapshot> diferencas;
+  REQUIRE(snapshots.diferenca(1, 2, &diferencas));
+  REQUIRE(diferencas.size() == 3);
+  REQUIRE(diferencas[0].nome == "snap/alterado/x.txt");
+  REQUIRE(diferencas[0].mudanca == SNAPSHOT_ALTERADO);
+  REQUIRE(diferencas[1].nome == "snap/novo.txt");
+  REQUIRE(diferencas[1].mudanca == SNAPSHOT_ADICIONADO);
+  REQUIRE(diferencas[2].nome == "snap/removido/y.txt");
+  REQUIRE(diferencas[2].mudanca == SNAPSHOT_REMOVIDO);
+  REQUIRE(snapshots.diferenca(2, 3, &diferencas));
+  REQUIRE(diferencas.empty());
+  REQUIRE_FALSE(snapshots.diferenca(1, 9, &diferencas));
+
+  // O snapshot 1 volta por cima dos arquivos mais novos
+  opcoes.snapshot = 1;
+  REQUIRE(realizaRestauracao("pendrive", opcoes) == OPERACAO_SUCESSO);
+  REQUIRE(lerConteudo("snap/alterado/x.txt") == "versao 1");
+  REQUIRE(lerConteudo("snap/removido/y.txt") == "vai sumir");
+  REQUIRE(lerConteudo("snap/intacto/z.bin") == dadosAleatorios(100000, 5));
+  REQUIRE(obterMetadados("snap/alterado/x.txt", CAMPO_MTIME).mtime_seg ==
+          1000000000);
+
+  opcoes.snapshot = 9;
+  REQUIRE(realizaRestauracao("pendrive", opcoes) ==
+          ERRO_ARQUIVO_ORIGEM_NAO_EXISTE);
+
+  removerArvore("snap");
+  removerArvore(objetos);
+  removerArvore(std::string("pendrive/") + NOME_SNAPSHOTS);
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
+
+// Contador de alocações: substitui o operator new do programa de testes e
+// só conta enquanto 'contar_alocacoes' estiver ligado
+std::atomic<bool> contar_alocacoes(false);
+std::atomic<size_t> alocacoes(0);
+
+void* operator new(size_t tamanho) {
+  if (contar_alocacoes.load(std::memory_order_relaxed)) alocacoes++;
+  void* p = malloc(tamanho ? tamanho : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t tamanho) { return operator new(tamanho); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+// Alocações de um backup de 'quantidade' arquivos com o prefixo dado (os
+// que já existem ficam intactos e, na segunda vez, são ignorados)
+size_t alocacoesDoBackup(const std::string& prefixo, int quantidade,
+                         const OpcoesBackup& opcoes) {
+  std::ofstream param("Backup.parm");
+  for (int i = 0; i < quantidade; i++) {
+    char nome[64];
+    snprintf(nome, sizeof(nome), "alocacoes/%s_%03d.txt", prefixo.c_str(), i);
+    if (!std::ifstream(nome).good()) std::ofstream(nome) << "conteudo " << i;
+    param << nome << "\n";
+  }
+  param.close();
+  alocacoes = 0;
+  contar_alocacoes = true;
+  int status = realizaBackup("pendrive", opcoes);
+  contar_alocacoes = false;
+  REQUIRE(status == OPERACAO_SUCESSO);
+  return alocacoes;
+}
+
+TEST_CASE("Laco serial nao aloca por entrada copiada ou ignorada", "[alocacoes]") {
+  mkdir("pendrive", 0777);
+  mkdir("alocacoes", 0777);
+  OpcoesBackup opcoes;
+  opcoes.durabilidade = DURABILIDADE_LOTE;
+  opcoes.arquivos_por_lote = 16;  // a arena do lote é reaproveitada
+
+  // Primeira execução: buffers da thread e reservas que ficam
+  alocacoesDoBackup("aquecimento", 5, opcoes);
+
+  // O custo fixo de uma execução é o mesmo com 50 ou 150 entradas
+  size_t copiar_50 = alocacoesDoBackup("poucos", 50, opcoes);
+  size_t copiar_150 = alocacoesDoBackup("muitos", 150, opcoes);
+  REQUIRE(copiar_150 == copiar_50);
+
+  size_t ignorar_50 = alocacoesDoBackup("poucos", 50, opcoes);
+  size_t ignorar_150 = alocacoesDoBackup("muitos", 150, opcoes);
+  REQUIRE(ignorar_150 == ignorar_50);
+
+  std::ifstream log("Backup.log");
+  std::string conteudo_log((std::istreambuf_iterator<char>(log)),
+                           std::istreambuf_iterator<char>());
+  REQUIRE(conteudo_log.find("[OK] COPIADO: alocacoes/muitos_149.txt") !=
+          std::string::npos);
+  REQUIRE(conteudo_log.find("[IGNORADO] alocacoes/muitos_149.txt") !=
+          std::string::npos);
+
+  removerArvore("alocacoes");
+  removerArvore("pendrive/alocacoes");
+  remove("Backup.parm");
+  remove("Backup.log");
+  rmdir("pendrive");
+}
@@ -0,0 +1,203 @@
+// Copyright 2025 Alex Batista Resende
+#include "varredura.hpp"  // NOLINT
+
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t TAMANHO_BUFFER_DENTS = 64 * 1024;
+
+// Layout do registro devolvido por getdents64
+struct RegistroDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;  // NOLINT
+  unsigned char d_type;
+  char d_name[1];
+};
+
+bool ehPontoOuPontoPonto(const char* nome) {
+  return nome[0] == '.' &&
+         (nome[1] == '\0' || (nome[1] == '.' && nome[2] == '\0'));
+}
+
+}  // namespace
+
+VarreduraParalela::Diretorio::~Diretorio() {
+  if (fd >= 0) close(fd);
+}
+
+/***************************************************************************
+ * Construção e destruição
+ ***************************************************************************/
+VarreduraParalela::VarreduraParalela(const std::string& raiz,
+                                     const std::string& prefixo,
+                                     unsigned threads, size_t capacidade)
+    : saida_(capacidade), pendentes_(1), parar_(false) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  for (unsigned i = 0; i < threads; i++) {
+    trabalhadores_.push_back(
+        std::unique_ptr<Trabalhador>(new Trabalhador()));
+  }
+
+  TarefaDiretorio tarefa;
+  tarefa.nome = raiz;
+  tarefa.caminho = prefixo;
+  trabalhadores_[0]->pilha.push_back(tarefa);
+
+  for (unsigned i = 0; i < threads; i++) {
+    threads_.push_back(std::thread(&VarreduraParalela::trabalhar, this, i));
+  }
+}
+
+VarreduraParalela::~VarreduraParalela() {
+  parar_ = true;
+  saida_.fechar();
+  {
+    std::lock_guard<std::mutex> trava(mutex_ocioso_);
+    tem_trabalho_.notify_all();
+  }
+  for (size_t i = 0; i < threads_.size(); i++) threads_[i].join();
+}
+
+bool VarreduraParalela::proximo(std::string* caminho, int* erro) {
+  Entrada entrada;
+  if (!saida_.retirar(&entrada)) return false;
+  caminho->swap(entrada.caminho);
+  *erro = entrada.erro;
+  return true;
+}
+
+// false quando o consumidor desistiu da varredura
+bool VarreduraParalela::entregar(std::string caminho, int erro) {
+  Entrada entrada;
+  entrada.caminho = std::move(caminho);
+  entrada.erro = erro;
+  if (saida_.inserir(std::move(entrada))) return true;
+  parar_ = true;
+  return false;
+}
+
+/***************************************************************************
+ * Pilhas por thread: o dono trabalha no topo (profundidade primeiro, pouca
+ * memória); ladrões levam a base, onde estão as subárvores maiores.
+ ***************************************************************************/
+void VarreduraParalela::empilhar(size_t id, TarefaDiretorio tarefa) {
+  pendentes_++;
+  {
+    std::lock_guard<std::mutex> trava(trabalhadores_[id]->mutex);
+    trabalhadores_[id]->pilha.push_back(std::move(tarefa));
+  }
+  std::lock_guard<std::mutex> trava(mutex_ocioso_);
+  tem_trabalho_.notify_one();
+}
+
+bool VarreduraParalela::obterTarefa(size_t id, TarefaDiretorio* tarefa) {
+  {
+    Trabalhador& meu = *trabalhadores_[id];
+    std::lock_guard<std::mutex> trava(meu.mutex);
+    if (!meu.pilha.empty()) {
+      *tarefa = std::move(meu.pilha.back());
+      meu.pilha.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < trabalhadores_.size(); i++) {
+    Trabalhador& vitima = *trabalhadores_[(id + i) % trabalhadores_.size()];
+    std::lock_guard<std::mutex> trava(vitima.mutex);
+    if (!vitima.pilha.empty()) {
+      *tarefa = std::move(vitima.pilha.front());
+      vitima.pilha.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void VarreduraParalela::concluirTarefa() {
+  if (--pendentes_ == 0) {
+    saida_.fechar();
+    std::lock_guard<std::mutex> trava(mutex_ocioso_);
+    tem_trabalho_.notify_all();
+  }
+}
+
+void VarreduraParalela::trabalhar(size_t id) {
+  while (!parar_) {
+    TarefaDiretorio tarefa;
+    if (obterTarefa(id, &tarefa)) {
+      visitar(id, tarefa);
+      concluirTarefa();
+      continue;
+    }
+    if (pendentes_ == 0) return;
+    std::unique_lock<std::mutex> trava(mutex_ocioso_);
+    tem_trabalho_.wait_for(trava, std::chrono::milliseconds(1));
+  }
+}
+
+/***************************************************************************
+ * Lê um diretório: arquivos vão para a saída, subdiretórios para a pilha;
+ * um diretório que não abre vai para a saída com o errno
+ ***************************************************************************/
+void VarreduraParalela::visitar(size_t id, const TarefaDiretorio& tarefa) {
+  int base = tarefa.pai ? tarefa.pai->fd : AT_FDCWD;
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  if (tarefa.pai) flags |= O_NOFOLLOW;  // não segue links para diretórios
+  int fd = openat(base, tarefa.nome.c_str(), flags);
+  if (fd < 0) {
+    int erro = errno;
+    entregar(tarefa.caminho, erro);  // o consumidor registra a falha
+    return;
+  }
+  std::shared_ptr<Diretorio> dir(new Diretorio(fd));
+
+  std::vector<char> buffer(TAMANHO_BUFFER_DENTS);
+  for (;;) {
+    long lidos = syscall(SYS_getdents64, fd, &buffer[0],  // NOLINT
+                         buffer.size());
+    if (lidos < 0 && errno == EINTR) continue;
+    if (lidos <= 0) break;
+
+    for (long pos = 0; pos < lidos;) {  // NOLINT
+      const RegistroDirent64* d =
+          reinterpret_cast<const RegistroDirent64*>(&buffer[pos]);
+      pos += d->d_reclen;
+      if (ehPontoOuPontoPonto(d->d_name)) continue;
+
+      unsigned char tipo = d->d_type;
+      if (tipo == DT_UNKNOWN || tipo == DT_LNK) {
+        // Links valem pelo alvo, exceto links para diretórios
+        struct stat st;
+        int seguir = (tipo == DT_LNK) ? 0 : AT_SYMLINK_NOFOLLOW;
+        if (fstatat(fd, d->d_name, &st, seguir) != 0) continue;
+        if (S_ISREG(st.st_mode)) tipo = DT_REG;
+        else if (S_ISDIR(st.st_mode) && tipo == DT_UNKNOWN) tipo = DT_DIR;
+        else continue;
+      }
+
+      std::string caminho = tarefa.caminho + "/" + d->d_name;
+      if (tipo == DT_DIR) {
+        TarefaDiretorio filho;
+        filho.pai = dir;
+        filho.nome = d->d_name;
+        filho.caminho = std::move(caminho);
+        empilhar(id, std::move(filho));
+      } else if (tipo == DT_REG) {
+        if (!entregar(std::move(caminho), 0)) return;
+      }
+    }
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright 2025 Alex Batista Resende
+#ifndef VARREDURA_HPP_
+#define VARREDURA_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fila.hpp"  // NOLINT
+
+/***************************************************************************
+ * Classe: VarreduraParalela
+ * Percorre recursivamente um diretório com várias threads e entrega cada
+ * arquivo assim que é encontrado, sem montar a lista completa antes.
+ * Os diretórios são abertos com openat() relativo ao fd do diretório pai
+ * e lidos com getdents64; cada thread tem sua própria pilha de diretórios
+ * pendentes e rouba trabalho das outras quando a sua esvazia.
+ ***************************************************************************/
+class VarreduraParalela {
+ public:
+  // Percorre 'raiz'; os caminhos entregues começam com 'prefixo' no lugar
+  // de 'raiz'. 'capacidade' limita quantos caminhos ficam esperando.
+  VarreduraParalela(const std::string& raiz, const std::string& prefixo,
+                    unsigned threads, size_t capacidade);
+  ~VarreduraParalela();  // interrompe a varredura se ainda estiver ativa
+
+  // Bloqueia até o próximo arquivo; false quando a varredura terminou.
+  // Um diretório que não pôde ser aberto chega como um caminho com o
+  // errno em 'erro' (0 nos arquivos), e a varredura segue pelos outros.
+  bool proximo(std::string* caminho, int* erro);
+
+ private:
+  VarreduraParalela(const VarreduraParalela&);
+  VarreduraParalela& operator=(const VarreduraParalela&);
+
+  // fd de diretório compartilhado pelos subdiretórios ainda não abertos
+  struct Diretorio {
+    explicit Diretorio(int fd_) : fd(fd_) {}
+    ~Diretorio();
+    int fd;
+  };
+
+  struct TarefaDiretorio {
+    std::shared_ptr<Diretorio> pai;  // nulo para a raiz
+    std::string nome;                // relativo ao pai
+    std::string caminho;             // caminho entregue ao consumidor
+  };
+
+  struct Entrada {
+    std::string caminho;
+    int erro;  // errno do diretório que não abriu; 0 para arquivos
+  };
+
+  struct Trabalhador {
+    std::mutex mutex;
+    std::deque<TarefaDiretorio> pilha;
+  };
+
+  void trabalhar(size_t id);
+  bool obterTarefa(size_t id, TarefaDiretorio* tarefa);
+  void empilhar(size_t id, TarefaDiretorio tarefa);
+  void visitar(size_t id, const TarefaDiretorio& tarefa);
+  bool entregar(std::string caminho, int erro);
+  void concluirTarefa();
+
+  FilaLimitada<Entrada> saida_;
+  std::vector<std::unique_ptr<Trabalhador> > trabalhadores_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pendentes_;
+  std::atomic<bool> parar_;
+  std::mutex mutex_ocioso_;
+  std::condition_variable tem_trabalho_;
+};
+
+#endif  // VARREDURA_HPP_